@@ -0,0 +1,703 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Microbenchmark of the sfmbase DSP blocks.
+//
+// Each benchmark runs a DSP class on synthetic signals
+// and writes a JSON line with the throughput in samples/s,
+// the processing time in ns/sample, and the number of
+// heap allocations per block.
+// With -a, the VOLK kernel calls are also counted
+// to show the rate of the calls dispatched to the aligned kernels.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <functional>
+#include <getopt.h>
+#include <new>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <volk/volk.h>
+
+#include "AfSimpleAgc.h"
+#include "AmDecode.h"
+#include "AudioResampler.h"
+#include "DspKernels.h"
+#include "Filter.h"
+#include "FilterParameters.h"
+#include "FineTuner.h"
+#include "FmDecode.h"
+#include "FourthConverterDecimatorIQ.h"
+#include "FourthConverterIQ.h"
+#include "IfResampler.h"
+#include "IfSimpleAgc.h"
+#include "MultipathFilter.h"
+#include "NbfmDecode.h"
+#include "PhaseDiscriminator.h"
+#include "PilotPhaseLock.h"
+#include "SoftFM.h"
+#include "git.h"
+
+// Heap allocation counter, incremented by the replaced operator new
+// and volk_malloc().
+static std::atomic<std::uint64_t> alloc_count(0);
+
+void *operator new(std::size_t size) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+// The sample vectors are allocated by volk_malloc() instead of operator new,
+// so volk_malloc() and volk_free() are also replaced;
+// the definitions in the executable take precedence over
+// those of the VOLK shared library.
+extern "C" void *volk_malloc(std::size_t size, std::size_t alignment) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  void *p = nullptr;
+  if (posix_memalign(&p, alignment, size == 0 ? alignment : size) != 0) {
+    return nullptr;
+  }
+  return p;
+}
+
+extern "C" void volk_free(void *p) { std::free(p); }
+
+// Aligned VOLK kernel hit rate.
+//
+// Each VOLK kernel is a function pointer to the dispatcher,
+// which calls the aligned implementation only if all the pointer
+// arguments, including the results, are aligned to volk_get_alignment().
+// VolkProbe replaces the pointer with a wrapper which counts the calls
+// and the calls with all the pointer arguments aligned,
+// then calls the original dispatcher.
+
+struct VolkProbeCount {
+  const char *name;
+  std::uint64_t calls;
+  std::uint64_t aligned;
+};
+
+// Counts of the installed probes, only updated while measuring.
+static std::vector<VolkProbeCount> volk_probe_counts;
+static bool volk_probe_active = false;
+
+template <typename T> static bool volk_arg_aligned(T arg) {
+  if constexpr (std::is_pointer_v<T>) {
+    return volk_is_aligned(arg);
+  } else {
+    return true;
+  }
+}
+
+template <auto &Kernel, typename Func = std::remove_reference_t<
+                            decltype(Kernel)>>
+class VolkProbe;
+
+template <auto &Kernel, typename... Args>
+class VolkProbe<Kernel, void (*)(Args...)> {
+public:
+  static void install(const char *name) {
+    m_index = volk_probe_counts.size();
+    volk_probe_counts.push_back({name, 0, 0});
+    m_original = Kernel;
+    Kernel = call;
+  }
+
+private:
+  static void call(Args... args) {
+    if (volk_probe_active) {
+      VolkProbeCount &count = volk_probe_counts[m_index];
+      count.calls++;
+      if ((volk_arg_aligned(args) && ...)) {
+        count.aligned++;
+      }
+    }
+    m_original(args...);
+  }
+
+  static inline void (*m_original)(Args...) = nullptr;
+  static inline std::size_t m_index = 0;
+};
+
+#define VOLK_PROBE(kernel) VolkProbe<kernel>::install(#kernel)
+
+// Install the probes to the VOLK kernels used by the DSP classes.
+static void install_volk_probes() {
+  VOLK_PROBE(volk_32f_accumulator_s32f);
+  VOLK_PROBE(volk_32f_convert_64f);
+  VOLK_PROBE(volk_32f_s32f_32f_fm_detect_32f);
+  VOLK_PROBE(volk_32f_x2_dot_prod_32f);
+  VOLK_PROBE(volk_32fc_deinterleave_64f_x2);
+  VOLK_PROBE(volk_32fc_magnitude_32f);
+  VOLK_PROBE(volk_32fc_magnitude_squared_32f);
+  VOLK_PROBE(volk_32fc_s32f_atan2_32f);
+#if VOLK_VERSION < 030100
+  VOLK_PROBE(volk_32fc_s32fc_x2_rotator_32fc);
+#else
+  VOLK_PROBE(volk_32fc_s32fc_x2_rotator2_32fc);
+#endif
+  VOLK_PROBE(volk_32fc_x2_dot_prod_32fc);
+#if VOLK_VERSION < 030100
+  VOLK_PROBE(volk_32fc_x2_s32fc_multiply_conjugate_add_32fc);
+#else
+  VOLK_PROBE(volk_32fc_x2_s32fc_multiply_conjugate_add2_32fc);
+#endif
+  VOLK_PROBE(volk_64f_convert_32f);
+  VOLK_PROBE(volk_64f_x2_multiply_64f);
+}
+
+#undef VOLK_PROBE
+
+// Return the total number of the calls and the aligned calls.
+static void volk_probe_total(std::uint64_t &calls, std::uint64_t &aligned) {
+  calls = 0;
+  aligned = 0;
+  for (const auto &count : volk_probe_counts) {
+    calls += count.calls;
+    aligned += count.aligned;
+  }
+}
+
+// Format the aligned rate, or null if there are no calls.
+static std::string format_rate(std::uint64_t aligned, std::uint64_t calls) {
+  return calls == 0 ? std::string("null")
+                    : fmt::format("{:.4f}", double(aligned) / calls);
+}
+
+// Number of distinct input blocks cycled through.
+static constexpr unsigned int input_blocks = 4;
+
+// Benchmark settings.
+static double min_time = 0.5;
+static unsigned int min_blocks = 20;
+static std::string name_filter;
+
+// Generate FM stereo IQ signal at the given rate with the carrier offset.
+// Left: 1kHz, right: 400Hz, with 19kHz pilot, 75kHz deviation.
+static IQSampleVector make_fm_iq(double rate, double offset, std::size_t n,
+                                 unsigned int seed) {
+  std::mt19937 gen(seed);
+  std::normal_distribution<float> noise(0.0f, 0.01f);
+  IQSampleVector out(n);
+  double phase = 0;
+  double t0 = seed * 0.0137;
+  for (std::size_t i = 0; i < n; i++) {
+    double t = t0 + i / rate;
+    double left = std::sin(2 * M_PI * 1000 * t);
+    double right = std::sin(2 * M_PI * 400 * t);
+    double mpx = 0.45 * (left + right) / 2 +
+                 0.1 * std::sin(2 * M_PI * 19000 * t) +
+                 0.45 * (left - right) / 2 * std::sin(2 * M_PI * 38000 * t);
+    phase += 2 * M_PI * (offset + FmDecoder::freq_dev * mpx) / rate;
+    phase = std::remainder(phase, 2 * M_PI);
+    out[i] = IQSample(std::cos(phase) + noise(gen),
+                      std::sin(phase) + noise(gen));
+  }
+  return out;
+}
+
+// Generate AM IQ signal at 48kHz with 1kHz tone and noise.
+static IQSampleVector make_am_iq(std::size_t n, unsigned int seed) {
+  std::mt19937 gen(seed);
+  std::normal_distribution<float> noise(0.0f, 0.01f);
+  IQSampleVector out(n);
+  double t0 = seed * 0.0137;
+  for (std::size_t i = 0; i < n; i++) {
+    double t = t0 + i / 48000.0;
+    double a = 0.5 * (1.0 + 0.8 * std::sin(2 * M_PI * 1000 * t));
+    double c = 2 * M_PI * 300 * t;
+    out[i] =
+        IQSample(a * std::cos(c) + noise(gen), a * std::sin(c) + noise(gen));
+  }
+  return out;
+}
+
+// Generate FM stereo MPX signal at 384kHz.
+static SampleVector make_mpx(std::size_t n, unsigned int seed) {
+  SampleVector out(n);
+  double t0 = seed * 0.0137;
+  for (std::size_t i = 0; i < n; i++) {
+    double t = t0 + i / FmDecoder::sample_rate_if;
+    double left = std::sin(2 * M_PI * 1000 * t);
+    double right = std::sin(2 * M_PI * 400 * t);
+    out[i] = 0.45 * (left + right) / 2 + 0.1 * std::sin(2 * M_PI * 19000 * t) +
+             0.45 * (left - right) / 2 * std::sin(2 * M_PI * 38000 * t);
+  }
+  return out;
+}
+
+// Generate audio signal.
+static SampleVector make_audio(double rate, std::size_t n, unsigned int seed) {
+  SampleVector out(n);
+  double t0 = seed * 0.0137;
+  for (std::size_t i = 0; i < n; i++) {
+    out[i] = 0.5 * std::sin(2 * M_PI * 1000 * (t0 + i / rate));
+  }
+  return out;
+}
+
+// Make a set of input blocks with a generator.
+template <typename T>
+static std::vector<T> make_blocks(std::function<T(unsigned int)> generator) {
+  std::vector<T> blocks;
+  for (unsigned int i = 0; i < input_blocks; i++) {
+    blocks.push_back(generator(i + 1));
+  }
+  return blocks;
+}
+
+// Run a benchmark and write the result as a JSON line.
+// process_block is called with the input block index.
+static void run(const std::string &name, std::size_t block_samples,
+                std::function<void(unsigned int)> process_block) {
+  if (!name_filter.empty() && name.find(name_filter) == std::string::npos) {
+    return;
+  }
+
+  // Warm up to fill the filter histories and the internal buffers.
+  for (unsigned int i = 0; i < input_blocks * 2; i++) {
+    process_block(i % input_blocks);
+  }
+
+  using clock = std::chrono::steady_clock;
+  std::uint64_t volk_calls_start, volk_aligned_start;
+  volk_probe_total(volk_calls_start, volk_aligned_start);
+  volk_probe_active = !volk_probe_counts.empty();
+  std::uint64_t allocs_start = alloc_count.load();
+  clock::time_point start = clock::now();
+  double elapsed = 0;
+  unsigned int blocks = 0;
+  while (blocks < min_blocks || elapsed < min_time) {
+    process_block(blocks % input_blocks);
+    blocks++;
+    elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  }
+  std::uint64_t allocs = alloc_count.load() - allocs_start;
+  volk_probe_active = false;
+
+  double samples = double(block_samples) * blocks;
+  std::string volk_fields;
+  if (!volk_probe_counts.empty()) {
+    std::uint64_t volk_calls, volk_aligned;
+    volk_probe_total(volk_calls, volk_aligned);
+    volk_calls -= volk_calls_start;
+    volk_aligned -= volk_aligned_start;
+    volk_fields = fmt::format(",\"volk_calls_per_block\":{:.3f},"
+                              "\"volk_aligned_rate\":{}",
+                              double(volk_calls) / blocks,
+                              format_rate(volk_aligned, volk_calls));
+  }
+  fmt::println("{{\"bench\":\"{}\",\"block_samples\":{},\"blocks\":{},"
+               "\"samples_per_sec\":{:.6g},\"ns_per_sample\":{:.4f},"
+               "\"allocs_per_block\":{:.3f}{}}}",
+               name, block_samples, blocks, samples / elapsed,
+               1.0e9 * elapsed / samples, double(allocs) / blocks,
+               volk_fields);
+  fflush(stdout);
+}
+
+static void usage() {
+  fmt::print(
+      stderr,
+      "Usage: sfmbase_bench [options]\n"
+      "  -f name     Run only the benchmarks whose name contains the string\n"
+      "  -t seconds  Minimum measurement time per benchmark (default 0.5)\n"
+      "  -b blocks   Minimum number of blocks per benchmark (default 20)\n"
+      "  -k variant  Use the DSP kernel variant (e.g. sse2, avx2)\n"
+      "  -a          Count the VOLK kernel calls dispatched to the aligned\n"
+      "              kernels (adds the overhead of counting to the timing)\n"
+      "  -l          List benchmark names only\n");
+}
+
+// Benchmark list.
+
+static bool list_only = false;
+
+static void bench(const std::string &name, std::size_t block_samples,
+                  std::function<void(unsigned int)> process_block) {
+  if (list_only) {
+    fmt::println("{}", name);
+    return;
+  }
+  run(name, block_samples, process_block);
+}
+
+static void bench_iq_filters() {
+  const std::size_t n_if = 8192;
+  const std::size_t n_pcm = 1024;
+  auto if_blocks = make_blocks<IQSampleVector>([=](unsigned int seed) {
+    return make_fm_iq(FmDecoder::sample_rate_if, 0, n_if, seed);
+  });
+  auto pcm_blocks = make_blocks<IQSampleVector>(
+      [=](unsigned int seed) { return make_am_iq(n_pcm, seed); });
+
+  struct FilterSet {
+    const char *name;
+    const IQSampleCoeff &coeff;
+    bool if_rate;
+  };
+  const FilterSet sets[] = {
+      {"delay_3taps_only_iq", FilterParameters::delay_3taps_only_iq, true},
+      {"jj1bdx_fm_384kHz_narrow", FilterParameters::jj1bdx_fm_384kHz_narrow,
+       true},
+      {"jj1bdx_fm_384kHz_medium", FilterParameters::jj1bdx_fm_384kHz_medium,
+       true},
+      {"jj1bdx_am_48khz_narrow", FilterParameters::jj1bdx_am_48khz_narrow,
+       false},
+      {"jj1bdx_am_48khz_medium", FilterParameters::jj1bdx_am_48khz_medium,
+       false},
+      {"jj1bdx_am_48khz_default", FilterParameters::jj1bdx_am_48khz_default,
+       false},
+      {"jj1bdx_am_48khz_wide", FilterParameters::jj1bdx_am_48khz_wide, false},
+      {"jj1bdx_nbfm_48khz_narrow", FilterParameters::jj1bdx_nbfm_48khz_narrow,
+       false},
+      {"jj1bdx_nbfm_48khz_medium", FilterParameters::jj1bdx_nbfm_48khz_medium,
+       false},
+      {"jj1bdx_nbfm_48khz_default",
+       FilterParameters::jj1bdx_nbfm_48khz_default, false},
+      {"jj1bdx_nbfm_48khz_wide", FilterParameters::jj1bdx_nbfm_48khz_wide,
+       false},
+      {"jj1bdx_cw_48khz_500hz", FilterParameters::jj1bdx_cw_48khz_500hz,
+       false},
+      {"jj1bdx_ssb_48khz_1500hz", FilterParameters::jj1bdx_ssb_48khz_1500hz,
+       false},
+  };
+  for (const auto &set : sets) {
+    LowPassFilterFirIQ filter(set.coeff, 1);
+    IQSampleVector out;
+    auto &blocks = set.if_rate ? if_blocks : pcm_blocks;
+    bench(fmt::format("LowPassFilterFirIQ/{}", set.name),
+          set.if_rate ? n_if : n_pcm,
+          [&](unsigned int i) { filter.process(blocks[i], out); });
+  }
+
+  const struct {
+    const char *name;
+    const SampleCoeff &coeff;
+  } audio_sets[] = {
+      {"jj1bdx_48khz_fmaudio", FilterParameters::jj1bdx_48khz_fmaudio},
+      {"jj1bdx_48khz_nbfmaudio", FilterParameters::jj1bdx_48khz_nbfmaudio},
+  };
+  auto audio_blocks = make_blocks<SampleVector>(
+      [=](unsigned int seed) { return make_audio(48000, n_pcm, seed); });
+  for (const auto &set : audio_sets) {
+    LowPassFilterFirAudio filter(set.coeff);
+    SampleVector out;
+    bench(fmt::format("LowPassFilterFirAudio/{}", set.name), n_pcm,
+          [&](unsigned int i) { filter.process(audio_blocks[i], out); });
+  }
+}
+
+static void bench_if_stages() {
+  // Typical input rates: RTL-SDR default and Airspy R2 default.
+  const double if_rates[] = {1152000, 10000000};
+  for (double if_rate : if_rates) {
+    const std::size_t n = static_cast<std::size_t>(if_rate / 50);
+    auto blocks = make_blocks<IQSampleVector>([=](unsigned int seed) {
+      return make_fm_iq(if_rate, if_rate / 4, n, seed);
+    });
+    IQSampleVector out;
+
+    FourthConverterIQ fourth(false);
+    bench(fmt::format("FourthConverterIQ/{:.0f}", if_rate), n,
+          [&](unsigned int i) { fourth.process(blocks[i], out); });
+
+    // The rotation keeps the input blocks usable for the next rounds.
+    FourthConverterIQ fourth_inplace(false);
+    bench(fmt::format("FourthConverterIQ/inplace/{:.0f}", if_rate), n,
+          [&](unsigned int i) { fourth_inplace.process_inplace(blocks[i]); });
+
+    IfResampler resampler(if_rate, FmDecoder::sample_rate_if);
+    bench(fmt::format("IfResampler/{:.0f}-384000", if_rate), n,
+          [&](unsigned int i) { resampler.process(blocks[i], out); });
+
+    // Fs/4 downconverter and IF resampler in series,
+    // with the interleaved block between the stages
+    // (8 bytes per sample written and read, then deinterleaved
+    // to 16 bytes per sample by the resampler),
+    // and with the split-complex block
+    // (16 bytes per sample written by the Fs/4 downconverter).
+    FourthConverterIQ fourth_interleaved(false);
+    IfResampler resampler_interleaved(if_rate, FmDecoder::sample_rate_if);
+    IQSampleVector shifted;
+    bench(fmt::format("IfFrontEnd/interleaved/{:.0f}-384000", if_rate), n,
+          [&](unsigned int i) {
+            fourth_interleaved.process(blocks[i], shifted);
+            resampler_interleaved.process(shifted, out);
+          });
+
+    FourthConverterIQ fourth_split(false);
+    IfResampler resampler_split(if_rate, FmDecoder::sample_rate_if);
+    IQSampleSplitVector split;
+    bench(fmt::format("IfFrontEnd/split/{:.0f}-384000", if_rate), n,
+          [&](unsigned int i) {
+            fourth_split.process(blocks[i], split);
+            resampler_split.process(split, out);
+          });
+
+    // Fs/4 downconverter fused with the half-band decimator,
+    // and the IF resampler at the half rate.
+    FourthConverterDecimatorIQ decimator;
+    bench(fmt::format("FourthConverterDecimatorIQ/{:.0f}", if_rate), n,
+          [&](unsigned int i) { decimator.process(blocks[i], out); });
+
+    FourthConverterDecimatorIQ decimator_halfband;
+    IfResampler resampler_halfband(if_rate / 2, FmDecoder::sample_rate_if);
+    bench(fmt::format("IfFrontEnd/halfband/{:.0f}-384000", if_rate), n,
+          [&](unsigned int i) {
+            decimator_halfband.process(blocks[i], split);
+            resampler_halfband.process(split, out);
+          });
+  }
+}
+
+static void bench_fm_stages() {
+  const std::size_t n = 8192;
+  auto iq_blocks = make_blocks<IQSampleVector>([=](unsigned int seed) {
+    return make_fm_iq(FmDecoder::sample_rate_if, 0, n, seed);
+  });
+  auto mpx_blocks = make_blocks<SampleVector>(
+      [=](unsigned int seed) { return make_mpx(n, seed); });
+
+  {
+    PhaseDiscriminator disc(FmDecoder::freq_dev / FmDecoder::sample_rate_if);
+    IQSampleDecodedVector out;
+    bench("PhaseDiscriminator", n,
+          [&](unsigned int i) { disc.process(iq_blocks[i], out); });
+  }
+  {
+    PilotPhaseLock pll(FmDecoder::pilot_freq / FmDecoder::sample_rate_if);
+    SampleVector out;
+    bench("PilotPhaseLock", n,
+          [&](unsigned int i) { pll.process(mpx_blocks[i], out, false); });
+  }
+  {
+    PilotPhaseLock pll(FmDecoder::pilot_freq / FmDecoder::sample_rate_if);
+    pll.set_rds_mixing(true);
+    SampleVector out;
+    bench("PilotPhaseLock/rds", n,
+          [&](unsigned int i) { pll.process(mpx_blocks[i], out, false); });
+  }
+  {
+    AudioResampler resampler(FmDecoder::sample_rate_if,
+                             FmDecoder::sample_rate_pcm);
+    SampleVector out;
+    bench("AudioResampler/384000-48000", n,
+          [&](unsigned int i) { resampler.process(mpx_blocks[i], out); });
+  }
+  {
+    IfSimpleAgc agc(1.0, 100000.0, 0.0001);
+    IQSampleVector out;
+    bench("IfSimpleAgc", n,
+          [&](unsigned int i) { agc.process(iq_blocks[i], out); });
+  }
+  for (unsigned int stages : {1, 32, 128, 256, 1024}) {
+    MultipathFilter filter(stages);
+    IQSampleVector out;
+    bench(fmt::format("MultipathFilter/{}", stages), n, [&](unsigned int i) {
+      if (!filter.process(iq_blocks[i], out)) {
+        filter.initialize_coefficients();
+      }
+    });
+  }
+}
+
+static void bench_pcm_stages() {
+  const std::size_t n = 1024;
+  auto iq_blocks = make_blocks<IQSampleVector>(
+      [=](unsigned int seed) { return make_am_iq(n, seed); });
+  auto audio_blocks = make_blocks<SampleVector>(
+      [=](unsigned int seed) { return make_audio(48000, n, seed); });
+  {
+    AfSimpleAgc agc(1.0, 1.5, 0.6, 0.001);
+    SampleVector out;
+    bench("AfSimpleAgc", n,
+          [&](unsigned int i) { agc.process(audio_blocks[i], out); });
+  }
+  {
+    FineTuner tuner(48000, 1500);
+    IQSampleVector out;
+    bench("FineTuner", n,
+          [&](unsigned int i) { tuner.process(iq_blocks[i], out); });
+  }
+}
+
+static void bench_decoders() {
+  const std::size_t n_if = 8192;
+  const std::size_t n_pcm = 1024;
+  auto fm_blocks = make_blocks<IQSampleVector>([=](unsigned int seed) {
+    return make_fm_iq(FmDecoder::sample_rate_if, 0, n_if, seed);
+  });
+  auto am_blocks = make_blocks<IQSampleVector>(
+      [=](unsigned int seed) { return make_am_iq(n_pcm, seed); });
+
+  IQSampleCoeff fm_default = FilterParameters::delay_3taps_only_iq;
+  IQSampleCoeff fm_medium = FilterParameters::jj1bdx_fm_384kHz_medium;
+  const struct {
+    const char *name;
+    IQSampleCoeff &coeff;
+    bool stereo;
+    unsigned int multipath_stages;
+  } fm_sets[] = {
+      {"FmDecoder/stereo", fm_default, true, 0},
+      {"FmDecoder/mono", fm_default, false, 0},
+      {"FmDecoder/stereo_medium", fm_medium, true, 0},
+      {"FmDecoder/stereo_multipath32", fm_default, true, 32},
+  };
+  for (const auto &set : fm_sets) {
+    FmDecoder fm(true, set.coeff, set.stereo, FmDecoder::deemphasis_time_eu,
+                 false, set.multipath_stages);
+    SampleVector audio;
+    bench(set.name, n_if,
+          [&](unsigned int i) { fm.process(fm_blocks[i], audio); });
+  }
+
+  {
+    IQSampleCoeff coeff = FilterParameters::jj1bdx_nbfm_48khz_default;
+    NbfmDecoder nbfm(coeff, NbfmDecoder::freq_dev_normal);
+    SampleVector audio;
+    bench("NbfmDecoder", n_pcm,
+          [&](unsigned int i) { nbfm.process(am_blocks[i], audio); });
+  }
+
+  IQSampleCoeff am_coeff = FilterParameters::jj1bdx_am_48khz_default;
+  const struct {
+    const char *name;
+    ModType mode;
+  } am_sets[] = {
+      {"AmDecoder/am", ModType::AM},   {"AmDecoder/usb", ModType::USB},
+      {"AmDecoder/lsb", ModType::LSB}, {"AmDecoder/cw", ModType::CW},
+      {"AmDecoder/wspr", ModType::WSPR},
+  };
+  for (const auto &set : am_sets) {
+    AmDecoder am(am_coeff, set.mode);
+    SampleVector audio;
+    bench(set.name, n_pcm,
+          [&](unsigned int i) { am.process(am_blocks[i], audio); });
+  }
+}
+
+// Main program.
+
+int main(int argc, char **argv) {
+  bool volk_probe = false;
+  int c;
+  while ((c = getopt(argc, argv, "f:t:b:k:al")) >= 0) {
+    switch (c) {
+    case 'f':
+      name_filter.assign(optarg);
+      break;
+    case 't':
+      min_time = std::atof(optarg);
+      if (!(min_time >= 0)) {
+        usage();
+        return 1;
+      }
+      break;
+    case 'b': {
+      int blocks = std::atoi(optarg);
+      if (blocks < 1) {
+        usage();
+        return 1;
+      }
+      min_blocks = blocks;
+      break;
+    }
+    case 'k':
+      if (!DspKernels::select_variant(optarg)) {
+        fmt::println(stderr, "ERROR: DSP kernel variant '{}' not available",
+                     optarg);
+        usage();
+        return 1;
+      }
+      break;
+    case 'a':
+      volk_probe = true;
+      break;
+    case 'l':
+      list_only = true;
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (!list_only) {
+    // Write the environment as the first line
+    // to compare the results across commits.
+    fmt::println("{{\"bench\":\"_meta\",\"commit\":\"{:.{}}\","
+                 "\"uncommitted_changes\":{},\"volk\":\"{}.{}.{}\","
+                 "\"volk_machine\":\"{}\",\"dsp_kernels\":\"{}\"}}",
+                 git::CommitSHA1().data(),
+                 static_cast<int>(git::CommitSHA1().length()),
+                 git::AnyUncommittedChanges(), VOLK_VERSION_MAJOR,
+                 VOLK_VERSION_MINOR, VOLK_VERSION_MAINT, volk_get_machine(),
+                 DspKernels::variant_name());
+  }
+
+  if (volk_probe && !list_only) {
+    install_volk_probes();
+  }
+
+  bench_if_stages();
+  bench_iq_filters();
+  bench_fm_stages();
+  bench_pcm_stages();
+  bench_decoders();
+
+  if (!volk_probe_counts.empty()) {
+    // Write the aligned rate of each kernel over all the benchmarks.
+    std::uint64_t calls, aligned;
+    volk_probe_total(calls, aligned);
+    for (const auto &count : volk_probe_counts) {
+      fmt::println("{{\"bench\":\"_volk_aligned\",\"kernel\":\"{}\","
+                   "\"calls\":{},\"aligned\":{},\"aligned_rate\":{}}}",
+                   count.name, count.calls, count.aligned,
+                   format_rate(count.aligned, count.calls));
+    }
+    fmt::println("{{\"bench\":\"_volk_aligned\",\"kernel\":\"total\","
+                 "\"calls\":{},\"aligned\":{},\"aligned_rate\":{}}}",
+                 calls, aligned, format_rate(aligned, calls));
+  }
+
+  return 0;
+}
+
+// end
@@ -0,0 +1,1337 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Fidelity regression check of the decoding chain.
+//
+// Each scenario feeds synthetic (or stored) IQ samples through
+// the DecodeChain of airspy-fmradion (Fs/4 downconverter, IF resampler,
+// AFC, squelch, IF filter selection, and decoder) with the output gain,
+// measures SINAD, THD, and stereo separation
+// of the decoded test tones, and optionally compares the raw float output
+// with the golden output recorded by a known-good build.
+// The file inputs are read through FileSource as airspy-fmradion does,
+// and a synthetic scenario is also decoded from a temporary file
+// to cover FileSource.
+// The result of each scenario is written as a JSON line,
+// with the decoding throughput.
+// The decoding chain is also checked not to allocate memory
+// after the warm-up, by counting the calls of the global operator new
+// and volk_malloc() in the decoding thread.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <functional>
+#include <getopt.h>
+#include <memory>
+#include <new>
+#include <optional>
+#include <sndfile.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "AmDecode.h"
+#include "AudioOutput.h"
+#include "BatchDecoder.h"
+#include "DataBuffer.h"
+#include "DecodeChain.h"
+#include "FileSource.h"
+#include "FmDecode.h"
+#include "NbfmDecode.h"
+#include "RdsDecoder.h"
+#include "SampleFileWriter.h"
+#include "SignalGenerator.h"
+#include "SoftFM.h"
+#include "Utility.h"
+#include "git.h"
+
+// Input block length, same as the File Source driver.
+static constexpr std::size_t block_length = 2048;
+// Output audio sample rate.
+static constexpr double pcm_rate = 48000;
+// Decoded audio discarded before the analysis, for the PLL, AGCs,
+// and the multipath filter to settle.
+static constexpr double warmup_seconds = 1.5;
+// Analysis length; an integer number of seconds keeps the test tones
+// of integer frequencies orthogonal to each other.
+static constexpr double analysis_seconds = 1.0;
+// Number of harmonics included in THD.
+static constexpr unsigned int thd_harmonics = 5;
+// Maximum timing difference of the test tones in audio samples
+// to regard the audio as aligned with the reference.
+static constexpr double max_timing_error = 0.1;
+// Audio compared with the continuous decoding before and after
+// each segment boundary of the batch decoding in seconds.
+static constexpr double boundary_seconds = 0.1;
+// Maximum difference in ppm of the AFC correction from the expected one.
+static constexpr double max_afc_error_ppm = 1.0;
+// Tuner frequency for the ppm offset measured by AFC.
+static constexpr double tuner_freq = 80.0e6;
+
+// Number of calls of the global operator new and volk_malloc()
+// per thread, so that the source thread of FileSource is not counted.
+static thread_local std::uint64_t allocation_count = 0;
+
+// Settings.
+static std::string name_filter;
+static std::string golden_read_dir;
+static std::string golden_write_dir;
+static double min_golden_snr_db = 60.0;
+static bool list_only = false;
+
+// A decoding scenario.
+struct Scenario {
+  std::string name;
+  ModType modtype;
+  double if_rate;
+  bool fourth_downconverter;
+  bool stereo;
+  unsigned int multipath_stages;
+  // Signal generator setup; empty for stored input.
+  std::function<void(SignalGenerator &)> setup;
+  // Change of the signal, called before generating each block
+  // with the time in seconds; empty if the signal is constant.
+  std::function<void(SignalGenerator &, double)> schedule;
+  // Stored IQ input file name.
+  std::string filename;
+  // Expected test tone frequency per output channel in Hz.
+  // Empty for stored input, where only the golden comparison is made.
+  std::vector<double> tones;
+  // Pass criteria.
+  double min_sinad_db;
+  double max_thd_pct;
+  double min_separation_db;
+  // Options of the main loop; disabled by default.
+  double afc_max_ppm = 0;
+  double squelch_level = 0;
+  bool squelch_skip = false;
+  bool filtertype_auto = false;
+  // Write the synthetic input to a temporary file to read by FileSource.
+  bool via_file = false;
+  // Expect the blocks skipped by the squelch, and compare the audio length
+  // and the tone timing with decoding without the squelch.
+  bool expect_skip = false;
+  // Expected AFC correction in ppm at the end, NAN not to check.
+  double expected_afc_ppm = NAN;
+  // Expected filter type selected by filtertype_auto at the end,
+  // and the expected number of the filter changes to reach it.
+  std::optional<FilterType> expected_filtertype;
+  unsigned int expected_filter_changes = 0;
+  // Length of the synthetic input in seconds, 0 for the analysis only.
+  double input_seconds = 0;
+  // Number of jobs to decode the input file also by BatchDecoder
+  // with 1 and this number of jobs, 0 not to use BatchDecoder.
+  // The audio is compared with the continuous decoding
+  // at the segment boundaries.
+  unsigned int batch_jobs = 0;
+  // Write the MPX output and decode RDS as -X and -R,
+  // handing over the buffers in the decoding thread as main() does.
+  bool mpx_rds_output = false;
+};
+
+// Result of decoding a scenario.
+struct DecodeResult {
+  std::size_t input_samples = 0;
+  // Number of allocations by the decoding chain after the warm-up.
+  std::uint64_t allocations = 0;
+  // Decoding time in seconds excluding the input generation.
+  double elapsed = 0;
+  // Number of the blocks skipped by the squelch.
+  std::size_t skipped_blocks = 0;
+  // AFC correction in ppm at the end.
+  double afc_ppm = 0;
+  // Filter type selected by filtertype_auto at the end,
+  // and the number of the filter changes.
+  FilterType filtertype = FilterType::Default;
+  unsigned int filter_changes = 0;
+  // Number of the MPX frames written and the RDS groups decoded.
+  std::uint64_t mpx_frames = 0;
+  std::uint64_t rds_groups = 0;
+};
+
+// Tone measurement result of a channel.
+struct ToneMetrics {
+  double sinad_db;
+  double thd_pct;
+  // Ratio of the wanted tone to the tone of the other channel.
+  double separation_db;
+};
+
+// Return the temporary file path for the scenario.
+static std::string temp_path(const Scenario &scenario, const char *suffix) {
+  std::string name(scenario.name);
+  std::replace(name.begin(), name.end(), '/', '_');
+  return (std::filesystem::temp_directory_path() /
+          fmt::format("sfmbase_fidelity_{}_{}{}", getpid(), name, suffix))
+      .string();
+}
+
+// Source of the input IQ blocks.
+// The stored input and the synthetic input via file are read
+// by FileSource as fast as the decoder can process.
+class InputBlocks {
+public:
+  explicit InputBlocks(const Scenario &scenario)
+      : m_generator(scenario.if_rate), m_schedule(scenario.schedule),
+        m_remaining(0), m_generated(0), m_stop(false) {
+    std::string filename(scenario.filename);
+    if (scenario.setup) {
+      scenario.setup(m_generator);
+      m_remaining = static_cast<std::size_t>(std::ceil(
+          std::max(scenario.input_seconds,
+                   warmup_seconds + analysis_seconds + 0.5) *
+          scenario.if_rate));
+      if (!scenario.via_file) {
+        return;
+      }
+      m_tempfile = temp_path(scenario, ".wav");
+      if (!write_file(scenario.if_rate)) {
+        return;
+      }
+      filename = m_tempfile;
+    }
+    m_filename = filename;
+    m_source = std::make_unique<FileSource>(0);
+    if (!m_source->configure(
+            fmt::format("filename={},realtime=0", filename)) ||
+        !(*m_source)) {
+      m_error = fmt::format("FileSource: {}", m_source->error());
+      m_source.reset();
+      return;
+    }
+    if (!m_source->start(&m_buffer, &m_stop)) {
+      m_error = fmt::format("FileSource: {}", m_source->error());
+      m_source.reset();
+    }
+  }
+
+  ~InputBlocks() {
+    close();
+    if (!m_tempfile.empty()) {
+      std::filesystem::remove(m_tempfile);
+    }
+  }
+
+  // Stop and close FileSource, keeping the temporary file,
+  // since only one FileSource can exist at a time.
+  void close() {
+    if (m_source) {
+      m_stop.store(true);
+      m_source->stop();
+      m_source.reset();
+    }
+  }
+
+  // Read the next block, return false at the end of input.
+  bool next(IQSampleVector &samples) {
+    if (m_source) {
+      if (m_buffer.pull_end_reached()) {
+        return false;
+      }
+      // Give the previous block back to FileSource as main() does.
+      m_buffer.recycle(std::move(samples));
+      samples = m_buffer.pull();
+      return !samples.empty();
+    }
+    if (m_remaining == 0) {
+      return false;
+    }
+    generate(samples);
+    return true;
+  }
+
+  // Return the input file name, or an empty string for the direct input.
+  const std::string &filename() const { return m_filename; }
+
+  const std::string &error() const { return m_error; }
+
+private:
+  // Write the whole synthetic input to the temporary file
+  // as 2-channel float WAV.
+  bool write_file(double if_rate) {
+    SF_INFO info = {};
+    info.samplerate = static_cast<int>(if_rate);
+    info.channels = 2;
+    info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    SNDFILE *sfp = sf_open(m_tempfile.c_str(), SFM_WRITE, &info);
+    if (sfp == nullptr) {
+      m_error = fmt::format("can not create '{}' ({})", m_tempfile,
+                            sf_strerror(nullptr));
+      m_tempfile.clear();
+      return false;
+    }
+    IQSampleVector samples;
+    std::vector<float> buf;
+    while (m_remaining > 0) {
+      generate(samples);
+      std::size_t n = samples.size();
+      buf.resize(2 * n);
+      for (std::size_t i = 0; i < n; i++) {
+        buf[2 * i] = samples[i].real();
+        buf[2 * i + 1] = samples[i].imag();
+      }
+      if (sf_writef_float(sfp, buf.data(), n) != sf_count_t(n)) {
+        m_error = fmt::format("can not write '{}' ({})", m_tempfile,
+                              sf_strerror(sfp));
+        sf_close(sfp);
+        return false;
+      }
+    }
+    sf_close(sfp);
+    return true;
+  }
+
+  // Generate the next synthetic block.
+  void generate(IQSampleVector &samples) {
+    if (m_schedule) {
+      m_schedule(m_generator, m_generated / m_generator.get_sample_rate());
+    }
+    std::size_t n = std::min(block_length, m_remaining);
+    m_generator.generate(samples, n);
+    m_remaining -= n;
+    m_generated += n;
+  }
+
+  SignalGenerator m_generator;
+  std::function<void(SignalGenerator &, double)> m_schedule;
+  std::size_t m_remaining;
+  std::size_t m_generated;
+  std::unique_ptr<Source> m_source;
+  DataBuffer<IQSample> m_buffer;
+  std::atomic_bool m_stop;
+  std::string m_tempfile;
+  std::string m_filename;
+  std::string m_error;
+};
+
+// Audio output to collect the audio written by BatchDecoder.
+class CollectOutput : public AudioOutput {
+public:
+  explicit CollectOutput(SampleVector &audio) : m_audio(audio) {}
+
+  virtual bool write(const SampleVector &samples) override {
+    m_audio.insert(m_audio.end(), samples.begin(), samples.end());
+    return true;
+  }
+
+  virtual void output_close() override { m_closed = true; }
+
+private:
+  SampleVector &m_audio;
+};
+
+// Replace the global operator new and the aligned one
+// to count the allocations.
+// The other forms of operator new call one of these two.
+void *operator new(std::size_t size) {
+  allocation_count++;
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  allocation_count++;
+  std::size_t align =
+      std::max(static_cast<std::size_t>(alignment), sizeof(void *));
+  void *p = nullptr;
+  if (posix_memalign(&p, align, size == 0 ? align : size) != 0) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+// The sample vectors are allocated by volk_malloc() instead of operator new,
+// so volk_malloc() and volk_free() are also replaced;
+// the definitions in the executable take precedence over
+// those of the VOLK shared library.
+extern "C" void *volk_malloc(std::size_t size, std::size_t alignment) {
+  allocation_count++;
+  void *p = nullptr;
+  if (posix_memalign(&p, alignment, size == 0 ? alignment : size) != 0) {
+    return nullptr;
+  }
+  return p;
+}
+
+extern "C" void volk_free(void *p) { std::free(p); }
+
+// Return the decoding chain parameters of the scenario
+// with the default settings of airspy-fmradion.
+static DecodeChain::Parameters chain_parameters(const Scenario &scenario) {
+  const double demodulator_rate =
+      scenario.modtype == ModType::FM ? FmDecoder::sample_rate_if
+      : scenario.modtype == ModType::NBFM
+          ? NbfmDecoder::internal_rate_pcm
+          : AmDecoder::internal_rate_pcm;
+  return {.modtype = scenario.modtype,
+          .stereo = scenario.stereo,
+          .pilot_shift = false,
+          .deemphasis = FmDecoder::deemphasis_time_eu,
+          .multipath_stages = scenario.multipath_stages,
+          .filtertype = FilterType::Default,
+          .filtertype_auto = scenario.filtertype_auto,
+          .fs_fourth_downconverter = scenario.fourth_downconverter,
+          .if_rate = scenario.if_rate,
+          .demodulator_rate = demodulator_rate,
+          .squelch_level = scenario.squelch_level,
+          .squelch_skip = scenario.squelch_skip,
+          .squelch_gate = false,
+          .afc_max_ppm = scenario.afc_max_ppm,
+          .tuner_freq = tuner_freq};
+}
+
+// Decode the scenario as airspy-fmradion does.
+static DecodeResult decode(const Scenario &scenario, InputBlocks &input,
+                           SampleVector &audio) {
+  DecodeChain chain(chain_parameters(scenario));
+
+  // MPX output to a temporary file, and RDS decoding to a temporary file
+  // in the threads of their own, as -X and -R of airspy-fmradion.
+  std::string mpx_filename;
+  std::unique_ptr<SampleFileWriter> mpx_writer;
+  FILE *rdsfile = nullptr;
+  std::unique_ptr<RdsDecoder> rds_decoder;
+  if (scenario.mpx_rds_output) {
+    mpx_filename = temp_path(scenario, "_mpx.wav");
+    mpx_writer = std::make_unique<SampleFileWriter>(
+        mpx_filename, static_cast<unsigned int>(FmDecoder::sample_rate_if),
+        1, SF_FORMAT_WAV | SF_FORMAT_FLOAT);
+    if (!(*mpx_writer)) {
+      fmt::println(stderr, "{}: MPX output: {}", scenario.name,
+                   mpx_writer->error());
+    }
+    rdsfile = std::tmpfile();
+    if (rdsfile != nullptr) {
+      chain.fm().set_rds_enabled(true);
+      rds_decoder = std::make_unique<RdsDecoder>(rdsfile, true);
+    }
+  }
+
+  IQSampleVector iqsamples;
+  SampleVector audiosamples;
+  DecodeResult result;
+  audio.clear();
+  const std::size_t warmup_samples =
+      static_cast<std::size_t>(warmup_seconds * scenario.if_rate);
+
+  using clock = std::chrono::steady_clock;
+  clock::duration elapsed(0);
+  while (input.next(iqsamples)) {
+    result.input_samples += iqsamples.size();
+    clock::time_point start = clock::now();
+    std::uint64_t allocation_start = allocation_count;
+
+    if (chain.convert(iqsamples)) {
+      bool decode_block = chain.gate();
+      if (!decode_block) {
+        result.skipped_blocks++;
+      }
+      chain.decode(decode_block, audiosamples);
+      if (chain.filter_selected()) {
+        result.filter_changes++;
+      }
+      if (decode_block && mpx_writer) {
+        IQSampleDecodedVector mpx_samples = mpx_writer->get_spare();
+        chain.fm().swap_mpx_samples(mpx_samples);
+        mpx_writer->push(std::move(mpx_samples));
+      }
+      if (decode_block && rds_decoder) {
+        IQSampleVector rds_samples = rds_decoder->get_spare();
+        chain.fm().swap_rds_samples(rds_samples);
+        rds_decoder->feed(std::move(rds_samples));
+      }
+      Utility::adjust_gain(audiosamples, chain.squelch_open()
+                                             ? DecodeChain::nominal_gain
+                                             : 0.0);
+    }
+
+    elapsed += clock::now() - start;
+    if (result.input_samples > warmup_samples) {
+      result.allocations += allocation_count - allocation_start;
+    }
+    audio.insert(audio.end(), audiosamples.begin(), audiosamples.end());
+    audiosamples.clear();
+  }
+  result.elapsed = std::chrono::duration<double>(elapsed).count();
+  result.afc_ppm = chain.get_afc_correction_ppm();
+  if (scenario.filtertype_auto) {
+    result.filtertype = chain.get_selected_filtertype();
+  }
+  if (mpx_writer) {
+    mpx_writer->close();
+    result.mpx_frames = mpx_writer->get_written_frames();
+    std::filesystem::remove(mpx_filename);
+  }
+  if (rds_decoder) {
+    rds_decoder->close();
+    result.rds_groups = rds_decoder->get_group_count();
+    std::fclose(rdsfile);
+  }
+  return result;
+}
+
+// Solve the linear equations a * x = b by Gaussian elimination.
+static std::vector<double> solve(std::vector<std::vector<double>> a,
+                                 std::vector<double> b) {
+  const std::size_t n = b.size();
+  for (std::size_t k = 0; k < n; k++) {
+    std::size_t pivot = k;
+    for (std::size_t i = k + 1; i < n; i++) {
+      if (std::fabs(a[i][k]) > std::fabs(a[pivot][k])) {
+        pivot = i;
+      }
+    }
+    std::swap(a[k], a[pivot]);
+    std::swap(b[k], b[pivot]);
+    for (std::size_t i = k + 1; i < n; i++) {
+      double f = a[i][k] / a[k][k];
+      for (std::size_t j = k; j < n; j++) {
+        a[i][j] -= f * a[k][j];
+      }
+      b[i] -= f * b[k];
+    }
+  }
+  std::vector<double> x(n);
+  for (std::size_t k = n; k-- > 0;) {
+    double sum = b[k];
+    for (std::size_t j = k + 1; j < n; j++) {
+      sum -= a[k][j] * x[j];
+    }
+    x[k] = sum / a[k][k];
+  }
+  return x;
+}
+
+// Measure a channel of the interleaved audio.
+// The wanted tone with its harmonics, the tone of the other channel,
+// and the DC offset are fitted by least squares,
+// and the rest is regarded as noise.
+static ToneMetrics analyze(const SampleVector &audio, unsigned int channels,
+                           unsigned int channel, double wanted, double other) {
+  const std::size_t begin =
+      static_cast<std::size_t>(warmup_seconds * pcm_rate);
+  const std::size_t length =
+      static_cast<std::size_t>(analysis_seconds * pcm_rate);
+
+  // Frequencies of the basis functions; the fundamental comes first.
+  std::vector<double> freqs;
+  for (unsigned int h = 1; h <= thd_harmonics; h++) {
+    if (h * wanted < 0.45 * pcm_rate) {
+      freqs.push_back(h * wanted);
+    }
+  }
+  const std::size_t harmonics = freqs.size();
+  if (other > 0 && other != wanted) {
+    freqs.push_back(other);
+  }
+  // Basis: cos and sin per frequency, and DC at the end.
+  const std::size_t n = 2 * freqs.size() + 1;
+
+  std::vector<std::vector<double>> ata(n, std::vector<double>(n, 0.0));
+  std::vector<double> atb(n, 0.0);
+  std::vector<double> basis(n);
+  double total_power = 0;
+  for (std::size_t i = 0; i < length; i++) {
+    double t = i / pcm_rate;
+    for (std::size_t k = 0; k < freqs.size(); k++) {
+      basis[2 * k] = std::cos(2 * M_PI * freqs[k] * t);
+      basis[2 * k + 1] = std::sin(2 * M_PI * freqs[k] * t);
+    }
+    basis[n - 1] = 1.0;
+    double y = audio[(begin + i) * channels + channel];
+    for (std::size_t r = 0; r < n; r++) {
+      for (std::size_t c = 0; c < n; c++) {
+        ata[r][c] += basis[r] * basis[c];
+      }
+      atb[r] += basis[r] * y;
+    }
+    total_power += y * y;
+  }
+  total_power /= length;
+
+  std::vector<double> x = solve(ata, atb);
+  auto power = [&](std::size_t k) {
+    return 0.5 * (x[2 * k] * x[2 * k] + x[2 * k + 1] * x[2 * k + 1]);
+  };
+  double fundamental = power(0);
+  double harmonic_power = 0;
+  for (std::size_t k = 1; k < harmonics; k++) {
+    harmonic_power += power(k);
+  }
+  double other_power = freqs.size() > harmonics ? power(harmonics) : 0.0;
+  double dc_power = x[n - 1] * x[n - 1];
+  double rest = std::max(total_power - dc_power - fundamental, 1e-30);
+
+  ToneMetrics metrics;
+  metrics.sinad_db = 10 * std::log10(fundamental / rest + 1e-30);
+  metrics.thd_pct = 100 * std::sqrt(harmonic_power / fundamental);
+  metrics.separation_db =
+      other_power > 0
+          ? 10 * std::log10(fundamental / std::max(other_power, 1e-30))
+          : INFINITY;
+  return metrics;
+}
+
+// Return the phase in radians of the tone of a channel
+// of the interleaved audio, from the sample frame begin for length frames.
+// The phase is referred to the time of the first frame of the audio.
+static double tone_phase(const SampleVector &audio, unsigned int channels,
+                         unsigned int channel, double freq, std::size_t begin,
+                         std::size_t length) {
+  double re = 0;
+  double im = 0;
+  for (std::size_t i = begin; i < begin + length; i++) {
+    double y = audio[i * channels + channel];
+    double phase = 2 * M_PI * freq * i / pcm_rate;
+    re += y * std::cos(phase);
+    im -= y * std::sin(phase);
+  }
+  return std::atan2(im, re);
+}
+
+// Return the largest timing difference in audio samples of the test tones
+// between the audio and the reference audio,
+// from the sample frame begin for length frames.
+static double timing_error(const Scenario &scenario, const SampleVector &audio,
+                           const SampleVector &reference, std::size_t begin,
+                           std::size_t length) {
+  const unsigned int channels = scenario.stereo ? 2 : 1;
+  double error = 0;
+  for (unsigned int ch = 0; ch < scenario.tones.size(); ch++) {
+    double freq = scenario.tones[ch];
+    double diff = std::remainder(
+        tone_phase(audio, channels, ch, freq, begin, length) -
+            tone_phase(reference, channels, ch, freq, begin, length),
+        2 * M_PI);
+    error = std::max(error, std::fabs(diff) * pcm_rate / (2 * M_PI * freq));
+  }
+  return error;
+}
+
+// Decode the input file by BatchDecoder with the jobs,
+// and compare the audio with the continuous decoding.
+// The audio must be of the same length, and the test tones must be
+// of the same timing before and after each segment boundary.
+// Return true if passed.
+static bool check_batch(const Scenario &scenario, const std::string &filename,
+                        unsigned int jobs, const SampleVector &continuous,
+                        SampleVector &audio) {
+  std::unique_ptr<Source> source = std::make_unique<FileSource>(0);
+  if (!source->configure(fmt::format("filename={},realtime=0", filename)) ||
+      !(*source)) {
+    fmt::println(stderr, "{}: FileSource: {}", scenario.name,
+                 source->error());
+    return false;
+  }
+  BatchDecoder batch(static_cast<FileSource &>(*source),
+                     {.chain = chain_parameters(scenario),
+                      .jobs = jobs,
+                      .quiet = true});
+  CollectOutput output(audio);
+  std::atomic_bool stop_flag(false);
+  audio.clear();
+  if (!batch.run(output, stop_flag)) {
+    fmt::println(stderr, "{}: batch decoding with {} jobs: {}", scenario.name,
+                 jobs, batch.error());
+    return false;
+  }
+  output.output_close();
+
+  if (audio.size() != continuous.size()) {
+    fmt::println(stderr, "{}: {} audio samples with {} jobs, {} continuous",
+                 scenario.name, audio.size(), jobs, continuous.size());
+    return false;
+  }
+  bool pass = true;
+  const unsigned int channels = scenario.stereo ? 2 : 1;
+  const std::size_t length =
+      static_cast<std::size_t>(boundary_seconds * pcm_rate);
+  for (std::uint64_t k = 1; k < batch.get_segments(); k++) {
+    std::size_t boundary = static_cast<std::size_t>(
+        std::round(k * batch.get_segment_seconds() * pcm_rate));
+    if ((boundary + length) * channels > audio.size()) {
+      break;
+    }
+    double error =
+        std::max(timing_error(scenario, audio, continuous,
+                              boundary - length, length),
+                 timing_error(scenario, audio, continuous, boundary, length));
+    if (!(error <= max_timing_error)) {
+      fmt::println(stderr,
+                   "{}: timing error {:.3f} samples at segment {} "
+                   "with {} jobs",
+                   scenario.name, error, k, jobs);
+      pass = false;
+    }
+  }
+  return pass;
+}
+
+// Return the golden file path of the scenario.
+static std::string golden_path(const std::string &dir,
+                               const std::string &name) {
+  std::string file(name);
+  std::replace(file.begin(), file.end(), '/', '_');
+  return fmt::format("{}/{}.f32", dir, file);
+}
+
+// Write the audio as raw FLOAT_LE samples, the same format as -F.
+static bool write_golden(const std::string &path, const SampleVector &audio) {
+  FILE *fp = fopen(path.c_str(), "wb");
+  if (fp == nullptr) {
+    return false;
+  }
+  std::vector<float> buf(audio.begin(), audio.end());
+  bool ok = fwrite(buf.data(), sizeof(float), buf.size(), fp) == buf.size();
+  return (fclose(fp) == 0) && ok;
+}
+
+// Compare the audio with the golden file, and return the SNR in dB
+// regarding the difference as noise, or NaN if the golden file is missing
+// or the length is different.
+static double compare_golden(const std::string &path,
+                             const SampleVector &audio) {
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (fp == nullptr) {
+    return NAN;
+  }
+  std::vector<float> golden(audio.size() + 1);
+  std::size_t n = fread(golden.data(), sizeof(float), golden.size(), fp);
+  fclose(fp);
+  if (n != audio.size()) {
+    return NAN;
+  }
+  double signal = 0;
+  double error = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    // Compare in the stored precision.
+    double diff = double(static_cast<float>(audio[i])) - golden[i];
+    signal += double(golden[i]) * golden[i];
+    error += diff * diff;
+  }
+  if (error == 0) {
+    return INFINITY;
+  }
+  return 10 * std::log10(signal / error);
+}
+
+// Return the name of the filter type as shown by airspy-fmradion.
+static const char *filtertype_name(FilterType type) {
+  return (type == FilterType::Narrow)   ? "narrow"
+         : (type == FilterType::Medium) ? "medium"
+                                        : "none";
+}
+
+// Format a JSON number, or null if not finite.
+static std::string json_number(double value) {
+  return std::isfinite(value) ? fmt::format("{:.2f}", value) : "null";
+}
+
+// Run a scenario, write the result as a JSON line, and return true if passed.
+static bool run(const Scenario &scenario) {
+  InputBlocks input(scenario);
+  if (!input.error().empty()) {
+    fmt::println(stderr, "{}: {}", scenario.name, input.error());
+    return false;
+  }
+
+  SampleVector audio;
+  DecodeResult result = decode(scenario, input, audio);
+
+  bool pass = true;
+  if (result.allocations > 0) {
+    fmt::println(stderr, "{}: {} allocations after the warm-up",
+                 scenario.name, result.allocations);
+    pass = false;
+  }
+  const unsigned int channels = scenario.stereo ? 2 : 1;
+  std::string sinad_list;
+  std::string thd_list;
+  double separation = INFINITY;
+  const std::size_t required = static_cast<std::size_t>(
+      (warmup_seconds + analysis_seconds) * pcm_rate * channels);
+  if (!scenario.tones.empty() && audio.size() < required) {
+    fmt::println(stderr, "{}: too few audio samples ({})", scenario.name,
+                 audio.size());
+    pass = false;
+  } else {
+    for (unsigned int ch = 0; ch < scenario.tones.size(); ch++) {
+      double other = scenario.tones.size() > 1
+                         ? scenario.tones[scenario.tones.size() - 1 - ch]
+                         : 0;
+      ToneMetrics m = analyze(audio, channels, ch, scenario.tones[ch], other);
+      sinad_list += fmt::format("{}{}", ch == 0 ? "" : ",",
+                                json_number(m.sinad_db));
+      thd_list +=
+          fmt::format("{}{}", ch == 0 ? "" : ",", json_number(m.thd_pct));
+      separation = std::min(separation, m.separation_db);
+      if (!(m.sinad_db >= scenario.min_sinad_db) ||
+          !(m.thd_pct <= scenario.max_thd_pct)) {
+        pass = false;
+      }
+    }
+    if (scenario.tones.size() > 1 &&
+        !(separation >= scenario.min_separation_db)) {
+      pass = false;
+    }
+  }
+
+  // AFC must correct the carrier offset in the right direction.
+  if (!std::isnan(scenario.expected_afc_ppm) &&
+      !(std::fabs(result.afc_ppm - scenario.expected_afc_ppm) <=
+        max_afc_error_ppm)) {
+    fmt::println(stderr, "{}: AFC correction {:.2f}ppm, expected {:.2f}ppm",
+                 scenario.name, result.afc_ppm, scenario.expected_afc_ppm);
+    pass = false;
+  }
+
+  // The adaptive filter selection must end with the expected filter type,
+  // without changing the filter more than needed.
+  if (scenario.expected_filtertype &&
+      (result.filtertype != *scenario.expected_filtertype ||
+       result.filter_changes != scenario.expected_filter_changes)) {
+    fmt::println(stderr, "{}: IF filter {} after {} changes, expected {}",
+                 scenario.name, filtertype_name(result.filtertype),
+                 result.filter_changes,
+                 filtertype_name(*scenario.expected_filtertype));
+    pass = false;
+  }
+
+  // The MPX and RDS outputs must be written while decoding.
+  if (scenario.mpx_rds_output &&
+      (result.mpx_frames == 0 || result.rds_groups == 0)) {
+    fmt::println(stderr, "{}: {} MPX frames written, {} RDS groups decoded",
+                 scenario.name, result.mpx_frames, result.rds_groups);
+    pass = false;
+  }
+
+  // The skipped blocks must give the same audio length and timing
+  // as decoding all blocks without the squelch.
+  if (scenario.expect_skip) {
+    if (result.skipped_blocks == 0) {
+      fmt::println(stderr, "{}: no blocks skipped", scenario.name);
+      pass = false;
+    }
+    Scenario reference(scenario);
+    reference.squelch_level = 0;
+    reference.squelch_skip = false;
+    InputBlocks reference_input(reference);
+    SampleVector reference_audio;
+    decode(reference, reference_input, reference_audio);
+    if (reference_audio.size() != audio.size()) {
+      fmt::println(stderr, "{}: {} audio samples, {} without squelch",
+                   scenario.name, audio.size(), reference_audio.size());
+      pass = false;
+    } else if (audio.size() >= required) {
+      double error = timing_error(
+          scenario, audio, reference_audio,
+          static_cast<std::size_t>(warmup_seconds * pcm_rate),
+          static_cast<std::size_t>(analysis_seconds * pcm_rate));
+      if (!(error <= max_timing_error)) {
+        fmt::println(stderr, "{}: timing error {:.3f} samples", scenario.name,
+                     error);
+        pass = false;
+      }
+    }
+  }
+
+  // The batch decoding must give the same audio as the continuous decoding
+  // regardless of the number of jobs.
+  if (scenario.batch_jobs > 0) {
+    const std::string filename(input.filename());
+    input.close();
+    SampleVector single_audio;
+    SampleVector parallel_audio;
+    if (!check_batch(scenario, filename, 1, audio, single_audio) ||
+        !check_batch(scenario, filename, scenario.batch_jobs, audio,
+                     parallel_audio)) {
+      pass = false;
+    } else if (parallel_audio != single_audio) {
+      fmt::println(stderr, "{}: different audio with 1 and {} jobs",
+                   scenario.name, scenario.batch_jobs);
+      pass = false;
+    }
+  }
+
+  double golden_snr = NAN;
+  if (!golden_write_dir.empty()) {
+    std::string path = golden_path(golden_write_dir, scenario.name);
+    if (!write_golden(path, audio)) {
+      fmt::println(stderr, "{}: can not write '{}'", scenario.name, path);
+      pass = false;
+    }
+  }
+  if (!golden_read_dir.empty()) {
+    std::string path = golden_path(golden_read_dir, scenario.name);
+    golden_snr = compare_golden(path, audio);
+    if (std::isnan(golden_snr)) {
+      fmt::println(stderr, "{}: '{}' is missing or of different length",
+                   scenario.name, path);
+    }
+    if (!(golden_snr >= min_golden_snr_db)) {
+      pass = false;
+    }
+  }
+
+  const std::size_t input_samples = result.input_samples;
+  const double elapsed = result.elapsed;
+  double duration = input_samples / scenario.if_rate;
+  fmt::println(
+      "{{\"fidelity\":\"{}\",\"if_rate\":{:.0f},\"input_samples\":{},"
+      "\"audio_samples\":{},\"skipped_blocks\":{},\"afc_ppm\":{},"
+      "\"filtertype\":{},\"filter_changes\":{},\"mpx_frames\":{},"
+      "\"rds_groups\":{},\"sinad_db\":[{}],"
+      "\"thd_pct\":[{}],\"separation_db\":{},\"golden_snr_db\":{},"
+      "\"allocations\":{},\"ns_per_sample\":{:.4f},"
+      "\"realtime_factor\":{:.2f},\"pass\":{}}}",
+      scenario.name, scenario.if_rate, input_samples, audio.size(),
+      result.skipped_blocks,
+      json_number(scenario.afc_max_ppm > 0 ? result.afc_ppm : NAN),
+      scenario.filtertype_auto
+          ? fmt::format("\"{}\"", filtertype_name(result.filtertype))
+          : "null",
+      result.filter_changes, result.mpx_frames, result.rds_groups, sinad_list,
+      thd_list,
+      json_number(scenario.tones.size() > 1 ? separation : NAN),
+      golden_snr == INFINITY ? "\"identical\"" : json_number(golden_snr),
+      result.allocations,
+      input_samples > 0 ? 1.0e9 * elapsed / input_samples : 0.0,
+      elapsed > 0 ? duration / elapsed : 0.0, pass);
+  fflush(stdout);
+  return pass;
+}
+
+// Synthetic scenarios.
+// The signal levels are those of a strong station, so the thresholds
+// are set to catch regressions rather than to rate the receiver.
+static std::vector<Scenario> synthetic_scenarios() {
+  std::vector<Scenario> scenarios;
+
+  // FM stereo at the RTL-SDR default rate, shifted by Fs/4.
+  // Left: 1kHz, right: 400Hz, 90% modulation with 10% pilot.
+  auto fm_stereo = [](double if_rate, bool fourth, double echo_gain) {
+    return [=](SignalGenerator &gen) {
+      gen.add_fm_stereo(fourth ? if_rate / 4 : 0, 1000, 400, 0.9, 1.0);
+      gen.set_noise(0.001);
+      if (echo_gain > 0) {
+        // About 5 microseconds echo, as from a nearby building.
+        gen.set_multipath(6 / if_rate, echo_gain, 0.5);
+      }
+    };
+  };
+  scenarios.push_back({.name = "fm_stereo",
+                       .modtype = ModType::FM,
+                       .if_rate = 1152000,
+                       .fourth_downconverter = true,
+                       .stereo = true,
+                       .multipath_stages = 0,
+                       .setup = fm_stereo(1152000, true, 0),
+                       .tones = {1000, 400},
+                       .min_sinad_db = 30,
+                       .max_thd_pct = 1.0,
+                       .min_separation_db = 30});
+  // The same signal as fm_stereo read by FileSource from a float file,
+  // which must give the identical output.
+  scenarios.push_back({.name = "fm_stereo_file",
+                       .modtype = ModType::FM,
+                       .if_rate = 1152000,
+                       .fourth_downconverter = true,
+                       .stereo = true,
+                       .multipath_stages = 0,
+                       .setup = fm_stereo(1152000, true, 0),
+                       .tones = {1000, 400},
+                       .min_sinad_db = 30,
+                       .max_thd_pct = 1.0,
+                       .min_separation_db = 30,
+                       .via_file = true});
+  scenarios.push_back({.name = "fm_mono_lowif",
+                       .modtype = ModType::FM,
+                       .if_rate = 384000,
+                       .fourth_downconverter = false,
+                       .stereo = false,
+                       .multipath_stages = 0,
+                       .setup =
+                           [](SignalGenerator &gen) {
+                             gen.add_fm_stereo(0, 1000, 1000, 0.9, 1.0);
+                             gen.set_noise(0.001);
+                           },
+                       .tones = {1000},
+                       .min_sinad_db = 40,
+                       .max_thd_pct = 1.0,
+                       .min_separation_db = 0});
+  scenarios.push_back({.name = "fm_multipath",
+                       .modtype = ModType::FM,
+                       .if_rate = 1152000,
+                       .fourth_downconverter = true,
+                       .stereo = true,
+                       .multipath_stages = 32,
+                       .setup = fm_stereo(1152000, true, 0.3),
+                       .tones = {1000, 400},
+                       .min_sinad_db = 20,
+                       .max_thd_pct = 5.0,
+                       .min_separation_db = 20});
+  // Options of the main loop.
+  // The carrier offset of +10ppm is corrected by AFC to -10ppm.
+  scenarios.push_back({.name = "fm_afc",
+                       .modtype = ModType::FM,
+                       .if_rate = 1152000,
+                       .fourth_downconverter = true,
+                       .stereo = true,
+                       .multipath_stages = 0,
+                       .setup =
+                           [](SignalGenerator &gen) {
+                             gen.add_fm_stereo(1152000 / 4 + 800, 1000, 400,
+                                               0.9, 1.0);
+                             gen.set_noise(0.001);
+                           },
+                       .tones = {1000, 400},
+                       .min_sinad_db = 30,
+                       .max_thd_pct = 1.0,
+                       .min_separation_db = 30,
+                       .afc_max_ppm = 20,
+                       .expected_afc_ppm = -10});
+  // The carrier drops out for 0.4 seconds, where the squelch closes
+  // and the blocks are skipped.
+  scenarios.push_back({.name = "fm_squelch_skip",
+                       .modtype = ModType::FM,
+                       .if_rate = 1152000,
+                       .fourth_downconverter = true,
+                       .stereo = true,
+                       .multipath_stages = 0,
+                       .setup = fm_stereo(1152000, true, 0),
+                       .schedule =
+                           [](SignalGenerator &gen, double time) {
+                             gen.set_amplitude(
+                                 0, (time >= 0.3 && time < 0.7) ? 0.0 : 1.0);
+                           },
+                       .tones = {1000, 400},
+                       .min_sinad_db = 30,
+                       .max_thd_pct = 1.0,
+                       .min_separation_db = 30,
+                       .squelch_level = 0.1,
+                       .squelch_skip = true,
+                       .expect_skip = true});
+  // The adjacent channel at +200kHz of -10dB selects the narrow filter.
+  scenarios.push_back({.name = "fm_auto_filter",
+                       .modtype = ModType::FM,
+                       .if_rate = 1152000,
+                       .fourth_downconverter = true,
+                       .stereo = true,
+                       .multipath_stages = 0,
+                       .setup =
+                           [](SignalGenerator &gen) {
+                             gen.add_fm_stereo(1152000 / 4, 1000, 400, 0.9,
+                                               1.0);
+                             gen.add_fm_stereo(1152000 / 4 + 200000, 700,
+                                               700, 0.9, 0.3);
+                             gen.set_noise(0.001);
+                           },
+                       .tones = {1000, 400},
+                       .min_sinad_db = 20,
+                       .max_thd_pct = 5.0,
+                       .min_separation_db = 20,
+                       .filtertype_auto = true,
+                       .expected_filtertype = FilterType::Narrow,
+                       .expected_filter_changes = 1});
+  // The clean signal selects no filter for 0.3 seconds, then the adjacent
+  // channel of -4dB selects the narrow filter. The adjacent channel of
+  // -10dB, often below the narrow level, keeps the narrow filter
+  // by the hysteresis for 0.3 seconds, and no filter is selected again
+  // after the adjacent channel disappears.
+  scenarios.push_back({.name = "fm_auto_filter_release",
+                       .modtype = ModType::FM,
+                       .if_rate = 1152000,
+                       .fourth_downconverter = true,
+                       .stereo = true,
+                       .multipath_stages = 0,
+                       .setup =
+                           [](SignalGenerator &gen) {
+                             gen.add_fm_stereo(1152000 / 4, 1000, 400, 0.9,
+                                               1.0);
+                             gen.add_fm_stereo(1152000 / 4 + 200000, 700,
+                                               700, 0.9, 0);
+                             gen.set_noise(0.001);
+                           },
+                       .schedule =
+                           [](SignalGenerator &gen, double time) {
+                             gen.set_amplitude(1, time < 0.3   ? 0.0
+                                                  : time < 0.6 ? 0.6
+                                                  : time < 0.9 ? 0.3
+                                                               : 0.0);
+                           },
+                       .tones = {1000, 400},
+                       .min_sinad_db = 20,
+                       .max_thd_pct = 5.0,
+                       .min_separation_db = 20,
+                       .filtertype_auto = true,
+                       .expected_filtertype = FilterType::Default,
+                       .expected_filter_changes = 2});
+  // The MPX output and RDS decoding hand over the buffers
+  // without allocation.
+  scenarios.push_back({.name = "fm_mpx_rds",
+                       .modtype = ModType::FM,
+                       .if_rate = 1152000,
+                       .fourth_downconverter = true,
+                       .stereo = true,
+                       .multipath_stages = 0,
+                       .setup =
+                           [](SignalGenerator &gen) {
+                             gen.add_fm_stereo(1152000 / 4, 1000, 400, 0.9,
+                                               1.0, 0.04);
+                             gen.set_noise(0.001);
+                           },
+                       .tones = {1000, 400},
+                       .min_sinad_db = 30,
+                       .max_thd_pct = 1.0,
+                       .min_separation_db = 30,
+                       .mpx_rds_output = true});
+  // The file longer than two segments is decoded by -j in parallel.
+  scenarios.push_back({.name = "fm_batch",
+                       .modtype = ModType::FM,
+                       .if_rate = 384000,
+                       .fourth_downconverter = false,
+                       .stereo = true,
+                       .multipath_stages = 0,
+                       .setup = fm_stereo(384000, false, 0),
+                       .tones = {1000, 400},
+                       .min_sinad_db = 30,
+                       .max_thd_pct = 1.0,
+                       .min_separation_db = 30,
+                       .via_file = true,
+                       .input_seconds =
+                           2 * BatchDecoder::segment_seconds + 3.0,
+                       .batch_jobs = 4});
+  scenarios.push_back({.name = "nbfm",
+                       .modtype = ModType::NBFM,
+                       .if_rate = 192000,
+                       .fourth_downconverter = true,
+                       .stereo = false,
+                       .multipath_stages = 0,
+                       .setup =
+                           [](SignalGenerator &gen) {
+                             gen.add_nbfm(192000 / 4, 1000, 3000, 1.0);
+                             gen.set_noise(0.001);
+                           },
+                       .tones = {1000},
+                       .min_sinad_db = 30,
+                       .max_thd_pct = 2.0,
+                       .min_separation_db = 0});
+
+  // AM family at a low-IF rate as Airspy HF+.
+  auto am_family = [&](const char *name, ModType modtype,
+                       std::function<void(SignalGenerator &)> setup,
+                       double tone) {
+    scenarios.push_back({.name = name,
+                         .modtype = modtype,
+                         .if_rate = 384000,
+                         .fourth_downconverter = false,
+                         .stereo = false,
+                         .multipath_stages = 0,
+                         .setup = setup,
+                         .tones = {tone},
+                         .min_sinad_db = 25,
+                         .max_thd_pct = 3.0,
+                         .min_separation_db = 0});
+  };
+  am_family(
+      "am", ModType::AM,
+      [](SignalGenerator &gen) {
+        gen.add_am(0, 1000, 0.5, 0.1);
+        gen.set_noise(0.0001);
+      },
+      1000);
+  am_family(
+      "usb", ModType::USB,
+      [](SignalGenerator &gen) {
+        gen.add_ssb(0, 1000, true, 0.05);
+        gen.set_noise(0.0001);
+      },
+      1000);
+  am_family(
+      "lsb", ModType::LSB,
+      [](SignalGenerator &gen) {
+        gen.add_ssb(0, 1000, false, 0.05);
+        gen.set_noise(0.0001);
+      },
+      1000);
+  // CW carrier at +100Hz is heard at 600Hz by the 500Hz pitch shift.
+  am_family(
+      "cw", ModType::CW,
+      [](SignalGenerator &gen) {
+        gen.add_cw(100, 0.05);
+        gen.set_noise(0.0001);
+      },
+      600);
+
+  return scenarios;
+}
+
+// Parse modulation type of stored input.
+static bool parse_modtype(const std::string &str, ModType &modtype) {
+  const struct {
+    const char *name;
+    ModType modtype;
+  } types[] = {
+      {"fm", ModType::FM},   {"nbfm", ModType::NBFM}, {"am", ModType::AM},
+      {"dsb", ModType::DSB}, {"usb", ModType::USB},   {"lsb", ModType::LSB},
+      {"cw", ModType::CW},   {"wspr", ModType::WSPR},
+  };
+  for (const auto &type : types) {
+    if (str == type.name) {
+      modtype = type.modtype;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void usage() {
+  fmt::print(
+      stderr,
+      "Usage: sfmbase_fidelity [options]\n"
+      "  -f name     Run only the scenarios whose name contains the string\n"
+      "  -g dir      Compare the outputs with the golden files in dir\n"
+      "  -G dir      Write the outputs as the golden files into dir\n"
+      "  -s dB       Minimum SNR against the golden output (default 60)\n"
+      "  -i filename Add a stored IQ file (2-channel, low IF) as a scenario\n"
+      "  -m mode     Modulation type of the following -i (default fm)\n"
+      "  -l          List scenario names only\n");
+}
+
+// Main program.
+
+int main(int argc, char **argv) {
+  std::vector<Scenario> scenarios = synthetic_scenarios();
+  ModType stored_modtype = ModType::FM;
+
+  int c;
+  while ((c = getopt(argc, argv, "f:g:G:s:i:m:l")) >= 0) {
+    switch (c) {
+    case 'f':
+      name_filter.assign(optarg);
+      break;
+    case 'g':
+      golden_read_dir.assign(optarg);
+      break;
+    case 'G':
+      golden_write_dir.assign(optarg);
+      break;
+    case 's':
+      min_golden_snr_db = std::atof(optarg);
+      break;
+    case 'i': {
+      SF_INFO info = {};
+      SNDFILE *sfp = sf_open(optarg, SFM_READ, &info);
+      if (sfp == nullptr) {
+        fmt::println(stderr, "can not open '{}' ({})", optarg,
+                     sf_strerror(nullptr));
+        return 1;
+      }
+      sf_close(sfp);
+      std::string name(optarg);
+      name = name.substr(name.find_last_of('/') + 1);
+      scenarios.push_back({.name = fmt::format("stored/{}", name),
+                           .modtype = stored_modtype,
+                           .if_rate = double(info.samplerate),
+                           .fourth_downconverter = false,
+                           .stereo = stored_modtype == ModType::FM,
+                           .multipath_stages = 0,
+                           .setup = nullptr,
+                           .filename = optarg,
+                           .tones = {},
+                           .min_sinad_db = 0,
+                           .max_thd_pct = 0,
+                           .min_separation_db = 0});
+      break;
+    }
+    case 'm':
+      if (!parse_modtype(optarg, stored_modtype)) {
+        usage();
+        return 1;
+      }
+      break;
+    case 'l':
+      list_only = true;
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (!golden_write_dir.empty()) {
+    std::error_code ec;
+    std::filesystem::create_directories(golden_write_dir, ec);
+    if (ec) {
+      fmt::println(stderr, "can not create '{}' ({})", golden_write_dir,
+                   ec.message());
+      return 1;
+    }
+  }
+
+  if (!list_only) {
+    fmt::println("{{\"fidelity\":\"_meta\",\"commit\":\"{:.{}}\","
+                 "\"uncommitted_changes\":{}}}",
+                 git::CommitSHA1().data(),
+                 static_cast<int>(git::CommitSHA1().length()),
+                 git::AnyUncommittedChanges());
+  }
+
+  unsigned int failed = 0;
+  for (const auto &scenario : scenarios) {
+    if (!name_filter.empty() &&
+        scenario.name.find(name_filter) == std::string::npos) {
+      continue;
+    }
+    if (list_only) {
+      fmt::println("{}", scenario.name);
+      continue;
+    }
+    if (!run(scenario)) {
+      failed++;
+    }
+  }
+
+  if (failed > 0) {
+    fmt::println(stderr, "{} scenario(s) failed", failed);
+    return 1;
+  }
+  return 0;
+}
+
+// end
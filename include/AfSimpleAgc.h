@@ -47,12 +47,19 @@ public:
   void reset_gain();
 
   // Process audio samples.
-  void process(const SampleVector &samples_in, SampleVector &samples_out);
+  void process(std::span<const Sample> samples_in, SampleVector &samples_out);
+
+  // Process audio samples in-place.
+  void process_inplace(std::span<Sample> samples);
 
   // Return AF AGC current gain.
   double get_current_gain() const { return m_current_gain; }
 
 private:
+  // Process n samples; input and output may be the same buffer.
+  inline void process_samples(const Sample *input, Sample *output,
+                              unsigned int n);
+
   double m_initial_gain;
   double m_current_gain;
   double m_max_gain;
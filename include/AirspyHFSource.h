@@ -33,6 +33,10 @@
 
 class AirspyHFSource : public Source {
 public:
+  // Blocks discarded after retuning: the USB transfers of libairspyhf
+  // filled before the tuner is set.
+  static constexpr unsigned int retune_pipeline_blocks = 16;
+
   /** Open Airspy device. */
   AirspyHFSource(int dev_index);
 
@@ -47,6 +51,9 @@ public:
   /** Return device current center frequency in Hz. */
   virtual std::uint32_t get_frequency() override;
 
+  /** Retune the device without restarting the stream. */
+  virtual bool set_frequency(std::uint32_t frequency) override;
+
   /** Return if device is using Low-IF. */
   virtual bool is_low_if() override;
 
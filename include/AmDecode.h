@@ -27,6 +27,7 @@
 #include "IfResampler.h"
 #include "IfSimpleAgc.h"
 #include "SoftFM.h"
+#include "StageProfiler.h"
 
 /** Complete decoder for FM broadcast signal. */
 class AmDecoder {
@@ -45,12 +46,29 @@ public:
    * amfilter_coeff    :: IQSample Filter Coefficients.
    * mode              :: ModType for decoding mode.
    */
-  AmDecoder(IQSampleCoeff &amfilter_coeff, const ModType mode);
+  AmDecoder(const IQSampleCoeff &amfilter_coeff, const ModType mode);
 
   // Process IQ samples and return audio samples.
-  // samples_in is taken by value so that std::move(samples_in) inside
-  // the body actually moves.
-  void process(IQSampleVector samples_in, SampleVector &audio);
+  // The audio buffer is owned by the caller and reused for each block,
+  // so no allocation is made after the first blocks.
+  void process(std::span<const IQSample> samples_in, SampleVector &audio);
+
+  // Skip decoding a block of if_length IQ samples while the squelch is
+  // closed, and return the silent audio samples of the same duration.
+  // The decoder state is kept for a warm restart by the next process().
+  void skip(std::size_t if_length, SampleVector &audio);
+
+  // Reset the state adapted to the previous channel after retuning:
+  // the IF and AF AGC gains and the tuning offset.
+  void reset();
+
+  // Change the AM/DSB IF filter, keeping the filter history.
+  // The output is crossfaded from the previous filter
+  // for crossfade_length IF samples (0 to switch at once).
+  void set_filter(const IQSampleCoeff &amfilter_coeff,
+                  unsigned int crossfade_length) {
+    m_amfilter.set_coefficients(amfilter_coeff, crossfade_length);
+  }
 
   // Return RMS baseband signal level (where nominal level is 0.707).
   double get_baseband_level() const { return m_baseband_level; }
@@ -64,21 +82,22 @@ public:
   // Return RMS IF level.
   float get_if_rms() const { return m_if_rms; }
 
+  // Set the stage profiler, or nullptr to disable profiling.
+  void set_profiler(StageProfiler *profiler) { m_profiler = profiler; }
+
 private:
   // Demodulate AM signal.
-  inline void demodulate_am(const IQSampleVector &samples_in,
+  inline void demodulate_am(std::span<const IQSample> samples_in,
                             IQSampleDecodedVector &samples_out);
-  // Demodulate DSB signal.
-  inline void demodulate_dsb(const IQSampleVector &samples_in,
-                             IQSampleDecodedVector &samples_out);
 
   // Data members.
-  const IQSampleCoeff &m_amfilter_coeff;
   const ModType m_mode;
   float m_baseband_mean;
   float m_baseband_level;
   float m_if_rms;
+  StageProfiler *m_profiler;
 
+  volk::vector<float> m_buf_magnitude_sq;
   IQSampleVector m_buf_filtered;
   IQSampleVector m_buf_filtered1a;
   IQSampleVector m_buf_filtered1b;
@@ -87,7 +106,6 @@ private:
   IQSampleDecodedVector m_buf_decoded;
   SampleVector m_buf_baseband_demod;
   SampleVector m_buf_baseband_preagc;
-  SampleVector m_buf_baseband;
   SampleVector m_buf_mono;
 
   LowPassFilterFirIQ m_amfilter;
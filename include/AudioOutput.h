@@ -20,6 +20,7 @@
 #ifndef INCLUDE_AUDIOOUTPUT_H
 #define INCLUDE_AUDIOOUTPUT_H
 
+#include <cstdint>
 #include <string>
 
 #include "SoftFM.h"
@@ -138,4 +139,71 @@ private:
   volk::vector<float> m_floatbuf;
 };
 
+// Streaming output to TCP or Unix domain socket clients.
+//
+// Each client receives a fixed-size stream header first,
+// then continuous little-endian interleaved audio samples.
+// Sending is non-blocking: every client has a bounded pending buffer,
+// and a client which can not keep up is disconnected
+// so that the decoder is never stalled by the network.
+class NetworkOutput : public AudioOutput {
+public:
+  // Stream header magic number and version.
+  static constexpr char header_magic[4] = {'A', 'F', 'M', 'R'};
+  static constexpr std::uint16_t header_version = 1;
+  static constexpr std::size_t header_size = 16;
+  // Sample format codes in the header (same as WAVE format tags).
+  static constexpr std::uint16_t format_int16 = 1;
+  static constexpr std::uint16_t format_float32 = 3;
+  // Maximum number of simultaneous clients.
+  static constexpr unsigned int max_clients = 16;
+  // TCP host to listen on if not given, only reachable from this host.
+  static constexpr const char *default_tcp_host = "127.0.0.1";
+  // Per-client pending buffer limit in seconds of audio.
+  static constexpr double max_pending_seconds = 1.0;
+
+  //
+  // Construct network audio output.
+  //
+  // address      :: "tcp:[host:]port" or "unix:path"
+  // samplerate   :: audio sample rate in Hz
+  // stereo       :: true if the output stream contains stereo data
+  // float32      :: true for FLOAT_LE samples, false for S16_LE samples
+  NetworkOutput(const std::string &address, unsigned int samplerate,
+                bool stereo, bool float32);
+
+  virtual ~NetworkOutput() override;
+  virtual bool write(const SampleVector &samples) override;
+  virtual void output_close() override;
+
+private:
+  struct Client {
+    int fd;
+    std::string name;
+    std::vector<std::uint8_t> pending;
+    std::size_t offset;
+  };
+
+  // Open listening socket, return false on error.
+  bool open_tcp(const std::string &hostport);
+  bool open_unix(const std::string &path);
+  // Accept all pending connections without blocking.
+  void accept_clients();
+  // Send as much pending data as possible without blocking.
+  // Return false if the client has to be dropped.
+  bool flush_client(Client &client);
+  // Close client socket and print the reason.
+  void drop_client(Client &client, const std::string &reason);
+
+  const unsigned int m_nchannels;
+  const unsigned int m_samplerate;
+  const bool m_float32;
+  const std::size_t m_max_pending;
+  int m_listen_fd = -1;
+  std::string m_unix_path;
+  std::uint8_t m_header[header_size];
+  std::vector<Client> m_clients;
+  std::vector<std::uint8_t> m_bytebuf;
+};
+
 #endif
@@ -35,7 +35,7 @@ public:
   AudioResampler(const double input_rate, const double output_rate);
   // Process monaural audio samples,
   // converting input_rate to output_rate.
-  void process(const SampleVector &samples_in, SampleVector &samples_out);
+  void process(std::span<const Sample> samples_in, SampleVector &samples_out);
 
 private:
   std::unique_ptr<r8b::CDSPResampler> m_cdspr;
@@ -0,0 +1,143 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_BATCHDECODER_H
+#define INCLUDE_BATCHDECODER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioOutput.h"
+#include "DecodeChain.h"
+#include "FileSource.h"
+#include "SoftFM.h"
+
+// Parallel offline decoder of a FileSource input.
+//
+// The input file is split into segments, each of which is decoded
+// by an independent DecodeChain in a worker thread.
+// Each segment starts earlier by the warm-up period to settle the PLL,
+// the AGCs, the multipath filter, and the resamplers; the audio of the
+// warm-up period is discarded.
+// Segment boundaries are aligned so that each boundary falls on
+// an integer audio sample index and on the same Fs/4 and fine tuner phase,
+// thus the segments are concatenated without gaps or overlaps.
+// A remainder shorter than the warm-up period at the end of the file
+// is merged into the last segment, which is decoded to the end of the file,
+// instead of being decoded as a segment which yields less audio than
+// the warm-up audio to discard.
+class BatchDecoder {
+public:
+  // Output audio sample rate.
+  static constexpr unsigned int pcm_rate = 48000;
+  // Nominal segment length in seconds.
+  static constexpr double segment_seconds = 10.0;
+  // Warm-up margin for AGC and multipath filter convergence in seconds.
+  static constexpr double warmup_margin_seconds = 1.0;
+  // Boundary alignment in audio samples (fine tuner period of 100Hz,
+  // which all the fixed pitch shifts are multiples of).
+  static constexpr std::uint64_t align_pcm_samples = 480;
+  // Maximum number of decoded segments waiting to be written per job.
+  static constexpr unsigned int max_pending_per_job = 2;
+
+  // Decoding parameters, same as the real-time decoding.
+  struct Parameters {
+    DecodeChain::Parameters chain;
+    unsigned int jobs;
+    bool quiet;
+  };
+
+  //
+  // Construct batch decoder.
+  //
+  // source :: configured FileSource, used for opening the file per thread
+  // params :: decoding parameters
+  //
+  BatchDecoder(FileSource &source, const Parameters &params);
+
+  // Decode the whole file and write the audio in order.
+  // Return false if an error occurred or stopped by stop_flag.
+  bool run(AudioOutput &output, std::atomic_bool &stop_flag);
+
+  // Return the number of segments.
+  std::uint64_t get_segments() const { return m_segments; }
+
+  // Return the segment length in seconds.
+  double get_segment_seconds() const {
+    return double(m_segment_pcm) / pcm_rate;
+  }
+
+  // Return the warm-up length in seconds.
+  double get_warmup_seconds() const {
+    return double(m_warmup_pcm) / pcm_rate;
+  }
+
+  /** Return the last error, or return an empty string if there is no error. */
+  std::string error() {
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    std::string ret(m_error);
+    m_error.clear();
+    return ret;
+  }
+
+  /** Return true if the decoder is OK, return false if there is an error. */
+  operator bool() const { return !m_failed.load(); }
+
+private:
+  // Decode a segment and return the audio samples to keep.
+  bool decode_segment(std::uint64_t index, SampleVector &audio);
+  // Worker thread body.
+  void worker();
+  // Set error message and stop decoding.
+  void set_error(const std::string &msg);
+
+  FileSource &m_source;
+  Parameters m_params;
+  const double m_ifrate;
+  const std::uint64_t m_frames;
+  const unsigned int m_block_length;
+  const unsigned int m_channels;
+
+  // Alignment unit in input samples and in audio samples.
+  std::uint64_t m_align_in;
+  std::uint64_t m_align_pcm;
+  // Segment and warm-up lengths in input samples and in audio samples.
+  std::uint64_t m_segment_in;
+  std::uint64_t m_segment_pcm;
+  std::uint64_t m_warmup_in;
+  std::uint64_t m_warmup_pcm;
+  std::uint64_t m_segments;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::uint64_t m_next_segment;
+  std::uint64_t m_next_write;
+  std::map<std::uint64_t, SampleVector> m_results;
+  std::atomic_bool m_stop;
+  std::atomic_bool m_failed;
+  std::string m_error;
+  std::vector<std::thread> m_threads;
+};
+
+#endif
@@ -0,0 +1,156 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_CONTROLSERVER_H
+#define INCLUDE_CONTROLSERVER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SoftFM.h"
+
+// Runtime control server on a Unix domain socket.
+//
+// Each client sends the commands as text lines, and receives a line
+// starting with "ok" or "error" for each command:
+//   set volume <dB>          output volume relative to the nominal level
+//   set squelch <dB>|off     IF squelch level as -l
+//   set deemphasis <us>      FM de-emphasis time constant (0 to disable)
+//   set multipath <stages>   FM multipath filter stages (0 to disable)
+//   set freq <Hz>            retune the source
+//   set filter <type>        IF filter type as -f
+//   get stats                live statistics as key=value pairs
+// The set commands are checked by the server thread, including whether
+// the command applies to the modulation type and the source, so that
+// "ok" is replied only for the commands applied by the main loop.
+// The commands are passed to the main loop through a lock-free
+// single-producer single-consumer queue, which is polled and applied
+// between blocks. The client sockets are non-blocking, and a client
+// which does not read the replies is closed instead of blocking
+// the server thread.
+// The statistics are published by the main loop after each block
+// as atomic values, so that the main loop never waits for the server.
+class ControlServer {
+public:
+  // Maximum number of queued commands.
+  static constexpr std::size_t queue_length = 64;
+  // Maximum number of simultaneous clients.
+  static constexpr unsigned int max_clients = 8;
+  // Maximum length of a command line.
+  static constexpr std::size_t max_line_length = 256;
+  // Interval to check the stop request in milliseconds.
+  static constexpr int poll_interval = 100;
+
+  // Parameters changed by the set commands.
+  enum class Parameter {
+    Volume,
+    Squelch,
+    Deemphasis,
+    Multipath,
+    Frequency,
+    Filter
+  };
+
+  // Command passed to the main loop.
+  // The squelch level is negative for turning off the squelch.
+  // The filter type is passed as filtertype instead of value.
+  struct Command {
+    Parameter parameter;
+    double value;
+    FilterType filtertype;
+  };
+
+  // Live statistics published by the main loop.
+  struct Stats {
+    std::atomic<std::uint64_t> block{0};
+    std::atomic<double> frequency{0};
+    std::atomic<double> if_level_db{0};
+    std::atomic<double> audio_level_db{0};
+    std::atomic<double> ppm{0};
+    std::atomic<double> pilot_level{0};
+    std::atomic<bool> stereo{false};
+    std::atomic<bool> squelch_open{false};
+    std::atomic<double> volume_db{0};
+    std::atomic<double> squelch_db{-1};
+  };
+
+  ControlServer();
+  ~ControlServer();
+
+  // Listen on the Unix domain socket path, and start the server thread.
+  // modtype    :: Modulation type, to reject the commands for FM only.
+  // can_retune :: True if the source can be retuned by set freq.
+  // Return false if failed.
+  bool start(const std::string &path, ModType modtype, bool can_retune);
+
+  // Stop the server thread, and remove the socket.
+  void stop();
+
+  // Return the error message of the last failure.
+  std::string error() const { return m_error; }
+
+  // Remove a command from the queue, called by the main loop.
+  // Return false if the queue is empty.
+  bool pop(Command &command);
+
+  // Return the statistics to be published by the main loop.
+  Stats &stats() { return m_stats; }
+
+private:
+  struct Client {
+    int fd;
+    std::string line;
+  };
+
+  // Server thread body.
+  void run();
+
+  // Read the commands from the client and reply.
+  // Return false if the client is to be closed.
+  bool serve_client(Client &client);
+
+  // Execute the command line and return the reply.
+  std::string execute(const std::string &line);
+
+  // Add a command to the queue, called by the server thread.
+  // Return false if the queue is full.
+  bool push(const Command &command);
+
+  int m_listen_fd;
+  std::string m_path;
+  ModType m_modtype;
+  bool m_can_retune;
+  std::vector<Client> m_clients;
+  std::atomic_bool m_stop;
+  std::unique_ptr<std::thread> m_thread;
+  std::string m_error;
+  Stats m_stats;
+
+  // Single-producer single-consumer ring buffer.
+  std::array<Command, queue_length> m_queue;
+  alignas(64) std::atomic<std::size_t> m_head;
+  alignas(64) std::atomic<std::size_t> m_tail;
+};
+
+#endif
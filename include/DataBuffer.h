@@ -20,23 +20,44 @@
 #ifndef INCLUDE_DATABUFFER_H
 #define INCLUDE_DATABUFFER_H
 
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
-#include <queue>
+#include <vector>
+
+#include <volk/volk_alloc.hh>
 
 // Buffer to move sample data between threads.
+// Pulled blocks can be recycled to the push side as spare buffers,
+// so that the blocks are not reallocated for each push.
+// The blocks are allocated with the VOLK alignment.
+// The queue is a ring buffer which keeps its capacity,
+// so that pushing a block does not allocate memory in the steady state.
+// Each block is tagged with the segment number of the stream,
+// which is incremented when the source is retuned,
+// so that the pull side can tell where the new segment begins.
 
 template <class Element> class DataBuffer {
 public:
+  using Vector = volk::vector<Element>;
+
+  // Maximum number of spare blocks kept for recycling.
+  static constexpr std::size_t max_spare_blocks = 8;
+  // Initial number of blocks of the queue, doubled when full.
+  static constexpr std::size_t initial_queue_blocks = 16;
+
   // Constructor.
-  DataBuffer() : m_end_marked(false) {}
+  DataBuffer() : m_end_marked(false), m_segment(0) {
+    m_spare.reserve(max_spare_blocks);
+  }
 
-  // Add samples to the queue.
-  inline void push(std::vector<Element> &&samples) {
+  // Add samples to the queue, tagged with the current segment number.
+  inline void push(Vector &&samples) {
     if (!samples.empty()) {
       {
         std::scoped_lock<std::mutex> lock(m_mutex);
-        m_queue.push(std::move(samples));
+        m_queue.push(Block{std::move(samples), m_segment});
         // unlock m_mutex here by getting out of scope
       }
       m_cond.notify_all();
@@ -53,7 +74,23 @@ public:
     m_cond.notify_all();
   }
 
-  // Return size of std::queue structure (for debugging).
+  // Start a new segment of the stream, e.g., after retuning the source.
+  // The queued blocks of the previous segments are stale,
+  // and are discarded as spare blocks.
+  // Return the number of the new segment.
+  inline std::uint64_t start_segment() {
+    {
+      std::scoped_lock<std::mutex> lock(m_mutex);
+      while (!m_queue.empty()) {
+        recycle(std::move(m_queue.front().samples));
+        m_queue.pop();
+      }
+      return ++m_segment;
+      // unlock m_mutex here by getting out of scope
+    }
+  }
+
+  // Return the number of the queued blocks (for debugging).
   inline std::size_t queue_size() {
     {
       std::scoped_lock<std::mutex> lock(m_mutex);
@@ -66,20 +103,72 @@ public:
   // return the samples. If the end marker has been reached, return
   // an empty vector. If the queue is empty, wait until more data is pushed
   // or until the end marker is pushed.
-  inline std::vector<Element> pull() {
-    std::vector<Element> ret;
+  inline Vector pull() {
+    std::uint64_t segment;
+    return pull(segment);
+  }
+
+  // Same as pull(), and set the segment number of the block.
+  inline Vector pull(std::uint64_t &segment) {
+    Vector ret;
     {
       std::unique_lock<std::mutex> lock(m_mutex);
       m_cond.wait(lock, [&] { return !(m_queue.empty() && (!m_end_marked)); });
+      segment = m_segment;
       if (!m_queue.empty()) {
-        std::swap(ret, m_queue.front());
+        std::swap(ret, m_queue.front().samples);
+        segment = m_queue.front().segment;
         m_queue.pop();
+        m_cond_pulled.notify_all();
       }
       return (ret);
       // unlock m_mutex here by getting out of scope
     }
   }
 
+  // Wait until the queue size becomes smaller than the given limit,
+  // or until the timeout expires.
+  // Return true if the queue size is smaller than the limit.
+  // This is for the push side to apply backpressure.
+  inline bool wait_queue_size_below(std::size_t limit,
+                                    std::chrono::milliseconds timeout) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      return m_cond_pulled.wait_for(
+          lock, timeout, [&] { return m_queue.size() < limit; });
+      // unlock m_mutex here by getting out of scope
+    }
+  }
+
+  // Return a block recycled by the pull side with its capacity kept,
+  // or a new empty vector if no spare block is available.
+  inline Vector get_spare() {
+    Vector ret;
+    {
+      std::scoped_lock<std::mutex> lock(m_spare_mutex);
+      if (!m_spare.empty()) {
+        std::swap(ret, m_spare.back());
+        m_spare.pop_back();
+      }
+      return (ret);
+      // unlock m_spare_mutex here by getting out of scope
+    }
+  }
+
+  // Give a pulled block back to the push side for reuse.
+  // The block is discarded if it has no capacity
+  // or if enough spare blocks are kept.
+  inline void recycle(Vector &&samples) {
+    if (samples.capacity() > 0) {
+      std::scoped_lock<std::mutex> lock(m_spare_mutex);
+      if (m_spare.size() < max_spare_blocks) {
+        samples.clear();
+        m_spare.push_back(std::move(samples));
+      }
+      // unlock m_spare_mutex here by getting out of scope
+    }
+  }
+
   // Return true if the end has been reached at the Pull side.
   inline bool pull_end_reached() {
     {
@@ -90,10 +179,57 @@ public:
   }
 
 private:
+  struct Block {
+    Vector samples;
+    std::uint64_t segment = 0;
+  };
+
+  // FIFO queue of the blocks in a ring buffer.
+  // Unlike std::queue, which allocates a new chunk of std::deque
+  // periodically, the memory is allocated only when the queue grows.
+  class BlockQueue {
+  public:
+    BlockQueue() : m_blocks(initial_queue_blocks), m_head(0), m_size(0) {}
+
+    bool empty() const { return m_size == 0; }
+    std::size_t size() const { return m_size; }
+    Block &front() { return m_blocks[m_head]; }
+
+    void push(Block &&block) {
+      if (m_size == m_blocks.size()) {
+        // Double the ring buffer, moving the blocks in order.
+        std::vector<Block> blocks(2 * m_blocks.size());
+        for (std::size_t i = 0; i < m_size; i++) {
+          blocks[i] = std::move(m_blocks[(m_head + i) % m_blocks.size()]);
+        }
+        m_blocks.swap(blocks);
+        m_head = 0;
+      }
+      m_blocks[(m_head + m_size) % m_blocks.size()] = std::move(block);
+      m_size++;
+    }
+
+    void pop() {
+      // Release the samples left in the block.
+      m_blocks[m_head].samples = Vector();
+      m_head = (m_head + 1) % m_blocks.size();
+      m_size--;
+    }
+
+  private:
+    std::vector<Block> m_blocks;
+    std::size_t m_head;
+    std::size_t m_size;
+  };
+
   bool m_end_marked;
-  std::queue<std::vector<Element>> m_queue;
+  std::uint64_t m_segment;
+  BlockQueue m_queue;
   std::mutex m_mutex;
   std::condition_variable m_cond;
+  std::condition_variable m_cond_pulled;
+  std::mutex m_spare_mutex;
+  std::vector<Vector> m_spare;
 };
 
 #endif
@@ -0,0 +1,199 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#ifndef INCLUDE_DECODECHAIN_H
+#define INCLUDE_DECODECHAIN_H
+
+#include <memory>
+
+#include "AmDecode.h"
+#include "FmDecode.h"
+#include "FourthConverterDecimatorIQ.h"
+#include "FourthConverterIQ.h"
+#include "IfAfc.h"
+#include "IfFilterSelector.h"
+#include "IfResampler.h"
+#include "MovingAverage.h"
+#include "NbfmDecode.h"
+#include "SoftFM.h"
+#include "StageProfiler.h"
+
+// Decoding chain from the source IQ samples to the audio samples,
+// shared by the real-time decoding, BatchDecoder, and the fidelity check.
+//
+// The chain consists of the Fs/4 downconverter (fused with the half-band
+// decimator when usable), the IF resampler, the AFC, the pre-demodulation
+// squelch, the adaptive IF filter selection, and the decoder of
+// the modulation type. Each block is processed in three steps:
+// convert() to the IF samples, gate() to measure the IF level and decide
+// whether to decode, and decode() to the audio samples, so that the caller
+// can record the IF samples and override the decision between the steps.
+// The output gain is applied by the caller, muted while !squelch_open().
+class DecodeChain {
+public:
+  // Number of blocks the squelch is held open
+  // after the IF level drops below the squelch level.
+  static constexpr unsigned int squelch_hold_blocks = 10;
+  // Number of blocks averaged for the ppm offset and each AFC update.
+  static constexpr unsigned int ppm_average_stages = 100;
+  // Crossfade time in seconds when the IF filter is changed.
+  static constexpr double filter_crossfade_time = 0.005;
+  // Nominal output gain (-6dB) while the squelch is open.
+  static constexpr double nominal_gain = 0.5;
+
+  // Decoding parameters.
+  struct Parameters {
+    ModType modtype;
+    bool stereo;
+    bool pilot_shift;
+    double deemphasis;
+    unsigned int multipath_stages;
+    FilterType filtertype;
+    // Select the FM IF filter by the adjacent channel energy.
+    bool filtertype_auto;
+    bool fs_fourth_downconverter;
+    // Input sample rate and the IF sample rate of the decoder.
+    double if_rate;
+    double demodulator_rate;
+    // Linear IF squelch level, 0 to keep the squelch open.
+    double squelch_level;
+    // Skip decoding while the squelch is closed.
+    bool squelch_skip;
+    // Measure the IF level before the decoder also without squelch_skip.
+    bool squelch_gate;
+    // AFC range in ppm for FM and NBFM, 0 to disable AFC.
+    double afc_max_ppm;
+    double tuner_freq;
+  };
+
+  // Construct decoding chain.
+  DecodeChain(const Parameters &params);
+
+  // Set the stage profiler, or nullptr to disable profiling.
+  void set_profiler(StageProfiler *profiler);
+
+  // Convert the source IQ samples to the IF samples, and correct
+  // the carrier offset by AFC. iqsamples is used as a work buffer.
+  // Return false if no IF samples are ready yet.
+  bool convert(IQSampleVector &iqsamples);
+
+  // Return the IF samples converted by the last convert().
+  const IQSampleVector &get_if_samples() const { return m_if_samples; }
+
+  // Measure the IF level of the IF samples for the pre-demodulation squelch.
+  // Return false if the decoder can be skipped while the squelch is closed.
+  bool gate();
+
+  // Decode the IF samples into audio, or skip decoding
+  // if decode_block is false; the audio is generated in either case.
+  void decode(bool decode_block, SampleVector &audio);
+
+  // Reset the decoder state adapted to the previous channel,
+  // and restart the offset measurement and the AFC after retuning.
+  void retuned(double tuner_freq);
+
+  // Set the linear IF squelch level, 0 to keep the squelch open.
+  void set_squelch_level(double level) { m_squelch_level = level; }
+
+  // Set the IF filter type of the decoder with crossfading,
+  // which also stops the adaptive selection.
+  void set_filtertype(FilterType filtertype);
+
+  // Return true if the squelch is open at the last block.
+  bool squelch_open() const { return m_if_rms >= m_squelch_level; }
+
+  // Return the IF level of the last block.
+  double get_if_rms() const { return m_if_rms; }
+
+  // Return the average IF level.
+  double get_if_level() const { return m_if_level; }
+
+  // Return the averaged tuning offset in ppm for FM and NBFM.
+  double get_ppm() const { return m_ppm_average.average(); }
+
+  // Return true if the AFC correction is updated at the last block.
+  bool afc_updated() const { return m_afc_updated; }
+
+  // Return the current AFC correction in ppm.
+  double get_afc_correction_ppm() const {
+    return m_afc ? m_afc->get_correction_ppm() : 0.0;
+  }
+
+  // Return true if the filter type is changed by the adaptive selection
+  // at the last block.
+  bool filter_selected() const { return m_filter_selected; }
+
+  // Return the filter type of the adaptive selection,
+  // and the adjacent channel energy relative to the channel in dB.
+  FilterType get_selected_filtertype() const {
+    return m_filter_selector->get_filtertype();
+  }
+  double get_adjacent_level() const {
+    return m_filter_selector->get_adjacent_level();
+  }
+
+  // Return the decoder of the modulation type.
+  FmDecoder &fm() { return *m_fm; }
+  NbfmDecoder &nbfm() { return *m_nbfm; }
+  AmDecoder &am() { return *m_am; }
+
+private:
+  // Set the IF filter coefficients of the filter type.
+  void select_filter(FilterType filtertype);
+
+  const ModType m_modtype;
+  const bool m_fs_fourth_downconverter;
+  const bool m_fs_fourth_decimator;
+  const bool m_downsampling;
+  // Fs/4 downconverted into the split-complex block for the IF resampler.
+  const bool m_split_if;
+  const bool m_squelch_skip;
+  const bool m_squelch_gate;
+  double m_squelch_level;
+  double m_tuner_freq;
+
+  StageProfiler *m_profiler;
+  FourthConverterIQ m_fourth_downconverter;
+  FourthConverterDecimatorIQ m_fourth_decimator;
+  std::unique_ptr<IfResampler> m_if_resampler;
+  std::unique_ptr<IfAfc> m_afc;
+  std::unique_ptr<IfFilterSelector> m_filter_selector;
+
+  // IF filter coefficients of the selected filter type.
+  bool m_fmfilter_enable;
+  IQSampleCoeff m_fmfilter_coeff;
+  IQSampleCoeff m_amfilter_coeff;
+  IQSampleCoeff m_nbfmfilter_coeff;
+
+  std::unique_ptr<FmDecoder> m_fm;
+  std::unique_ptr<NbfmDecoder> m_nbfm;
+  std::unique_ptr<AmDecoder> m_am;
+
+  MovingAverage<float> m_ppm_average;
+  unsigned int m_squelch_hold;
+  double m_if_rms;
+  double m_if_level;
+  bool m_afc_updated;
+  bool m_filter_selected;
+
+  IQSampleSplitVector m_if_split_samples;
+  IQSampleVector m_if_samples;
+  volk::vector<float> m_if_magnitude_sq;
+};
+
+#endif
@@ -0,0 +1,65 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_DSPKERNELS_H
+#define INCLUDE_DSPKERNELS_H
+
+#include <string>
+#include <vector>
+
+#include "SoftFM.h"
+
+// namespace DspKernels.
+//
+// Hot loops of the DSP classes which are not covered by VOLK.
+// Each kernel is compiled for several instruction sets
+// (x86: baseline, AVX2 with FMA, and AVX-512; other architectures:
+// baseline only, which includes NEON on AArch64),
+// and the best variant supported by the CPU is chosen at the first call.
+// All variants give bit-identical results,
+// since the floating-point operations are done in the same order.
+
+namespace DspKernels {
+
+// Symmetric FIR filter of IQ samples with real coefficients.
+// Compute count output samples, where output[i] is computed from
+// input[i * step] to input[i * step + order].
+void fir_symmetric_iq(const IQSample *input, const IQSample::value_type *coeff,
+                      unsigned int order, IQSample *output, unsigned int count,
+                      unsigned int step);
+
+// Symmetric FIR filter of real samples without down-sampling.
+// Compute count output samples, where output[i] is computed from
+// input[i] to input[i + order].
+void fir_symmetric_real(const Sample *input, const Sample *coeff,
+                        unsigned int order, Sample *output,
+                        unsigned int count);
+
+// Return the name of the selected variant.
+const char *variant_name();
+
+// Return the names of the variants supported by the CPU.
+std::vector<std::string> available_variants();
+
+// Select the variant by name, for benchmarking.
+// Return false if the variant is not supported by the CPU.
+bool select_variant(const std::string &name);
+
+} // namespace DspKernels
+
+#endif
@@ -21,6 +21,7 @@
 #define INCLUDE_FILESOURCE_H
 
 #include <atomic>
+#include <chrono>
 #include <string>
 #include <thread>
 #include <vector>
@@ -38,6 +39,9 @@ public:
   /** max expected micro seconds per block */
   static constexpr int max_expected_us = 10000;
 
+  /** max queued blocks when reading faster than real time */
+  static constexpr std::size_t max_queued_blocks = 32;
+
   /** Constructor */
   FileSource(int dev_index);
 
@@ -69,6 +73,20 @@ public:
   /** Return a list of supported devices. */
   static void get_device_names(std::vector<std::string> &devices);
 
+  /**
+   * Open the source file again for independent reading,
+   * e.g., by the batch decoder threads.
+   * Return the SNDFILE handle, or nullptr if failed.
+   * The caller must close the handle by sf_close().
+   */
+  SNDFILE *open_duplicate() const;
+
+  /** Return the number of sample frames in the file. */
+  sf_count_t get_frames() const { return m_sfinfo.frames; }
+
+  /** Return the number of samples per block. */
+  int get_block_length() const { return m_block_length; }
+
 private:
   enum class FormatType {
     Unknown = 0,
@@ -90,6 +108,8 @@ private:
    * frequency    :: desired center frequency in Hz.
    * zero_offset  :: true if sample contain zero offset.
    * block_length :: preferred number of samples per block.
+   * realtime     :: true to throttle reading to the sample rate,
+   *                 false to read as fast as the decoder can process.
    *
    * Return true.
    */
@@ -98,7 +118,8 @@ private:
                  std::uint32_t sample_rate = default_sample_rate,
                  std::uint32_t frequency = default_frequency,
                  bool zero_offset = false,
-                 int block_length = default_block_length);
+                 int block_length = default_block_length,
+                 bool realtime = true);
 
   /**
    * Fetch a bunch of samples from the file.
@@ -123,9 +144,16 @@ private:
   std::uint32_t m_frequency;
   bool m_zero_offset;
   int m_block_length;
+  bool m_realtime;
+  bool m_raw;
+
+  std::atomic<std::uint64_t> m_samples_read;
+  std::chrono::steady_clock::time_point m_start_time;
 
   SNDFILE *m_sfp;
   SF_INFO m_sfinfo;
+  // Read buffer, reused for each block.
+  std::vector<float> m_read_buf;
 
   double m_sample_rate_per_us = 0.0;
 
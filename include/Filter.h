@@ -34,14 +34,55 @@ public:
   LowPassFilterFirIQ(const IQSampleCoeff &coeff, const unsigned int downsample);
 
   // Process samples.
-  void process(const IQSampleVector &samples_in, IQSampleVector &samples_out);
+  void process(std::span<const IQSample> samples_in,
+               IQSampleVector &samples_out);
+
+  // Output the input samples delayed by the center tap of the coefficients
+  // without filtering, and update the history, to keep the history and
+  // the delay while the filter is bypassed. No downsampling.
+  void bypass(std::span<const IQSample> samples_in,
+              IQSampleVector &samples_out);
+
+  // Change the filter coefficients between blocks.
+  // The history of the input samples is kept, padded with zero
+  // if the new order is longer.
+  //
+  // coeff            :: FIR filter coefficients.
+  // crossfade_length :: Number of output samples to crossfade
+  //                     from the old coefficients (0 to switch at once)
+  //
+  void set_coefficients(const IQSampleCoeff &coeff,
+                        const unsigned int crossfade_length = 0);
+
+  // Return true while crossfading.
+  bool crossfading() const { return m_fade_pos < m_fade_length; }
 
 private:
-  const IQSampleCoeff m_coeff;
+  // Compute the output samples with the coefficients and the history,
+  // and update the history.
+  void filter(const IQSampleCoeff &coeff, IQSampleVector &state,
+              std::span<const IQSample> samples_in,
+              IQSampleVector &samples_out) const;
+
+  // Update index of start position in next sample block.
+  void advance(const unsigned int n);
+
+  // Update the history with the input samples.
+  static void update_state(IQSampleVector &state,
+                           std::span<const IQSample> samples_in);
+
+  IQSampleCoeff m_coeff;
   IQSampleVector m_state;
   unsigned int m_order;
   unsigned int m_downsample;
   unsigned int m_pos;
+
+  // Old coefficients and their history while crossfading.
+  IQSampleCoeff m_fade_coeff;
+  IQSampleVector m_fade_state;
+  IQSampleVector m_fade_out;
+  unsigned int m_fade_length;
+  unsigned int m_fade_pos;
 };
 
 // Low-pass filter for mono audio signal.
@@ -55,7 +96,7 @@ public:
   LowPassFilterFirAudio(const SampleCoeff &coeff);
 
   // Process samples.
-  void process(const SampleVector &samples_in, SampleVector &samples_out);
+  void process(std::span<const Sample> samples_in, SampleVector &samples_out);
 
 private:
   SampleCoeff m_coeff;
@@ -79,6 +120,9 @@ public:
   // Process a value
   double process(double input);
 
+  // Change the filter coefficients, keeping the filter state.
+  void set_coefficients(const double b0, const double b1, const double a1);
+
 private:
   double m_b0, m_b1, m_a1;
   double m_x0, m_x1;
@@ -94,18 +138,21 @@ public:
   //
   LowPassFilterRC(const double timeconst);
 
+  // Change the time constant, keeping the filter state.
+  void set_timeconst(const double timeconst);
+
   // Process samples.
-  void process(const SampleVector &samples_in, SampleVector &samples_out);
+  void process(std::span<const Sample> samples_in, SampleVector &samples_out);
 
   // Process samples in-place.
-  void process_inplace(SampleVector &samples);
+  void process_inplace(std::span<Sample> samples);
 
   // Process interleaved samples.
-  void process_interleaved(const SampleVector &samples_in,
+  void process_interleaved(std::span<const Sample> samples_in,
                            SampleVector &samples_out);
 
   // Process interleaved samples in-place.
-  void process_interleaved_inplace(SampleVector &samples);
+  void process_interleaved_inplace(std::span<Sample> samples);
 
 private:
   double m_timeconst;
@@ -151,10 +198,10 @@ public:
   HighPassFilterIir(const double cutoff);
 
   // Process samples.
-  void process(const SampleVector &samples_in, SampleVector &samples_out);
+  void process(std::span<const Sample> samples_in, SampleVector &samples_out);
 
   // Process samples in-place.
-  void process_inplace(SampleVector &samples);
+  void process_inplace(std::span<Sample> samples);
 
 private:
   BiquadIirFilter m_iirfilter;
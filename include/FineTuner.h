@@ -20,34 +20,51 @@
 #ifndef INCLUDE_FINETUNER_H
 #define INCLUDE_FINETUNER_H
 
+#include <volk/volk.h>
+
 #include "SoftFM.h"
 
-// Fine tuner which shifts the frequency of an IQ signal by a fixed offset.
+// Fine tuner which shifts the frequency of an IQ signal by an offset.
+//
+// The shift is done by a numerically controlled oscillator
+// of a complex phasor, multiplied by the phase increment per sample
+// and renormalized periodically by the VOLK rotator kernel.
+// The offset can be any frequency, and can be changed
+// while keeping the phase continuous.
 class FineTuner {
 public:
   //
   // Construct fine tuner.
-  // table_size :: Size of internal sin/cos tables, determines the resolution
-  //               of the frequency shift.
-  // freq_shift :: Frequency shift. Signal frequency will be shifted by
-  //               (sample_rate * freq_shift / table_size).
-  FineTuner(unsigned const int table_size, const int freq_shift);
-  FineTuner(unsigned const int table_size) : FineTuner(table_size, 0) {}
-
-  // Initialize freq_shift table.
-  // The phase continuity with ongoing (i.e., phase != 0) table is guaranteed.
-  // freq_shift :: Frequency shift. Signal frequency will be shifted by
-  //               (sample_rate * freq_shift / table_size).
-  void set_freq_shift(const int freq_shift);
+  // sample_rate :: Sample rate in Hz.
+  // freq_shift  :: Frequency shift in Hz.
+  FineTuner(const double sample_rate, const double freq_shift);
+  FineTuner(const double sample_rate) : FineTuner(sample_rate, 0) {}
+
+  // Set the frequency shift.
+  // The phase continuity with the ongoing samples is guaranteed.
+  // freq_shift :: Frequency shift in Hz.
+  void set_freq_shift(const double freq_shift);
+
+  // Return the frequency shift in Hz.
+  double get_freq_shift() const { return m_freq_shift; }
 
   // Process samples.
-  void process(const IQSampleVector &samples_in, IQSampleVector &samples_out);
+  void process(std::span<const IQSample> samples_in,
+               IQSampleVector &samples_out);
+
+  // Process samples in-place.
+  void process_inplace(std::span<IQSample> samples);
 
 private:
-  unsigned int m_index;
-  unsigned const int m_table_size;
-  IQSampleVector m_table;
-  SampleVector m_phase_table;
+  // Rotate n samples; input and output may be the same buffer.
+  inline void process_samples(const IQSample *input, IQSample *output,
+                              unsigned int n);
+
+  const double m_sample_rate;
+  double m_freq_shift;
+  // Aligned for the aligned VOLK kernel.
+  alignas(volk_result_alignment) lv_32fc_t m_phase_inc;
+  alignas(volk_result_alignment) lv_32fc_t m_phase;
 };
 
 #endif
@@ -20,6 +20,8 @@
 #ifndef INCLUDE_FMDECODE_H
 #define INCLUDE_FMDECODE_H
 
+#include <optional>
+
 #include "AudioResampler.h"
 #include "Filter.h"
 #include "FilterParameters.h"
@@ -28,6 +30,7 @@
 #include "PhaseDiscriminator.h"
 #include "PilotPhaseLock.h"
 #include "SoftFM.h"
+#include "StageProfiler.h"
 
 // Complete decoder for FM broadcast signal.
 
@@ -38,6 +41,10 @@ public:
   static constexpr double sample_rate_if = 384000;
   // Output sampling rate.
   static constexpr double sample_rate_pcm = 48000;
+  // Decimation ratio of the audio resamplers.
+  static constexpr unsigned int audio_decimation =
+      static_cast<unsigned int>(sample_rate_if / sample_rate_pcm);
+  static_assert(audio_decimation * sample_rate_pcm == sample_rate_if);
   // Full scale carrier frequency deviation (75 kHz for broadcast FM)
   static constexpr double freq_dev = 75000;
   // Half bandwidth of audio signal in Hz (15 kHz for broadcast FM)
@@ -45,12 +52,14 @@ public:
   static constexpr double pilot_freq = 19000;
   static constexpr double deemphasis_time_eu = 50; // Europe and Japan
   static constexpr double deemphasis_time_na = 75; // USA/Canada
+  // Number of blocks to wait before enabling the multipath filter.
+  static constexpr unsigned int multipath_wait_blocks = 100;
 
   //
   // Construct FM decoder.
   //
   // fmfilter_enable   :: True to enable IQSample filter frontend.
-  // fmfilter_coeff    :: IQSample filter coefficients.
+  // fmfilter_coeff    :: IQSample filter coefficients (if enabled).
   // stereo            :: True to enable stereo decoding.
   // deemphasis        :: Time constant of de-emphasis filter in microseconds
   //                      (50 us for broadcast FM, 0 to disable de-emphasis).
@@ -60,8 +69,9 @@ public:
   // multipath_stages  :: Set >0 to enable multipath filter
   //                   :: (LMS adaptive filter stage number)
   //
-  FmDecoder(bool fmfilter_enable, IQSampleCoeff &fmfilter_coeff, bool stereo,
-            double deemphasis, bool pilot_shift, unsigned int multipath_stages);
+  FmDecoder(bool fmfilter_enable, const IQSampleCoeff &fmfilter_coeff,
+            bool stereo, double deemphasis, bool pilot_shift,
+            unsigned int multipath_stages);
   //
   // Process IQ samples and return audio samples.
   //
@@ -69,9 +79,21 @@ public:
   // channels are interleaved in the output vector (even if no stereo
   // signal is detected). If the decoder is set in mono mode, the output
   // vector only contains samples for one channel.
-  // samples_in is taken by value so that std::move(samples_in) inside
-  // the body actually moves.
-  void process(IQSampleVector samples_in, SampleVector &audio);
+  // The audio buffer is owned by the caller and reused for each block,
+  // so no allocation is made after the first blocks.
+  void process(std::span<const IQSample> samples_in, SampleVector &audio);
+
+  // Skip decoding a block of if_length IQ samples while the squelch is
+  // closed, and return the silent audio samples of the same duration.
+  // The decoder state is kept for a warm restart by the next process(),
+  // except for the pilot PLL which has to lock again.
+  // The audio resamplers are fed with zeros for the IF samples
+  // less than an audio sample, so that the audio timing is kept.
+  void skip(std::size_t if_length, SampleVector &audio);
+
+  // Reset the state adapted to the previous channel after retuning:
+  // the multipath filter, the IF AGC gain, and the tuning offset.
+  void reset();
 
   // Return true if a stereo signal is detected.
   bool stereo_detected() const { return m_stereo_detected; }
@@ -89,19 +111,58 @@ public:
   float get_if_rms() const { return m_if_rms; }
 
   // Return PPS events from the most recently processed block.
-  std::vector<PilotPhaseLock::PpsEvent> get_pps_events() const {
+  const std::vector<PilotPhaseLock::PpsEvent> &get_pps_events() const {
     return m_pilotpll.get_pps_events();
   }
 
+  // Exchange the post-discriminator MPX samples of the most recently
+  // processed block with the given buffer without copying.
+  // The MPX samples are at sample_rate_if, normalized to freq_dev.
+  // The given buffer is reused by the decoder for the next block.
+  void swap_mpx_samples(IQSampleDecodedVector &buf) {
+    std::swap(buf, m_buf_decoded);
+  }
+
+  // Enable generating the 57kHz-mixed RDS baseband signal.
+  // The pilot PLL is run even in mono mode when enabled.
+  void set_rds_enabled(bool enable) {
+    m_rds_enabled = enable;
+    m_pilotpll.set_rds_mixing(enable);
+  }
+
+  // Exchange the RDS baseband samples of the most recently processed block
+  // with the given buffer without copying.
+  // The RDS baseband samples are at sample_rate_if.
+  void swap_rds_samples(IQSampleVector &buf) {
+    m_pilotpll.swap_rds_baseband(buf);
+  }
+
+  // Set the stage profiler, or nullptr to disable profiling.
+  void set_profiler(StageProfiler *profiler) { m_profiler = profiler; }
+
   // Erase the first PPS event.
   void erase_first_pps_event() { m_pilotpll.erase_first_pps_event(); }
 
+  // Change the time constant of the de-emphasis filters in microseconds
+  // (0 to disable de-emphasis), keeping the filter state.
+  void set_deemphasis(double deemphasis);
+
+  // Change the number of the multipath filter stages (0 to disable).
+  // The filter is trained again from the initial coefficients.
+  void set_multipath_stages(unsigned int multipath_stages);
+
+  // Change the IF filter, keeping the filter history.
+  // The output is crossfaded from the previous filter
+  // for crossfade_length IF samples (0 to switch at once).
+  void set_filter(bool fmfilter_enable, const IQSampleCoeff &fmfilter_coeff,
+                  unsigned int crossfade_length);
+
   // Get error value of the multipath filter.
-  double get_multipath_error() { return m_multipathfilter.get_error(); }
+  double get_multipath_error() { return m_multipathfilter->get_error(); }
 
   // Get multipath filter coefficients.
   const MfCoeffVector &get_multipath_coefficients() {
-    return m_multipathfilter.get_coefficients();
+    return m_multipathfilter->get_coefficients();
   }
 
 private:
@@ -124,18 +185,20 @@ private:
                                  SampleVector &audio);
 
   // Data members.
-  const bool m_fmfilter_enable;
-  const IQSampleCoeff &m_fmfilter_coeff;
+  bool m_fmfilter_enable;
   const bool m_pilot_shift;
-  const bool m_enable_multipath_filter;
+  bool m_enable_multipath_filter;
   unsigned int m_wait_multipath_blocks;
-  const unsigned int m_multipath_stages;
+  unsigned int m_multipath_stages;
   const bool m_stereo_enabled;
   bool m_stereo_detected;
+  bool m_rds_enabled;
   float m_baseband_mean;
   float m_baseband_level;
   float m_if_rms;
+  StageProfiler *m_profiler;
 
+  volk::vector<float> m_buf_magnitude_sq;
   IQSampleVector m_samples_in_iffiltered;
   IQSampleVector m_samples_in_after_agc;
   IQSampleVector m_samples_in_multipathfiltered;
@@ -160,7 +223,8 @@ private:
   LowPassFilterRC m_deemph_mono;
   LowPassFilterRC m_deemph_stereo;
   IfSimpleAgc m_ifagc;
-  MultipathFilter m_multipathfilter;
+  // Reconstructed when the number of stages is changed.
+  std::optional<MultipathFilter> m_multipathfilter;
 };
 
 #endif
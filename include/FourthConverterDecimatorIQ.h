@@ -0,0 +1,100 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_FOURTHCONVERTERDECIMATORIQ_H
+#define INCLUDE_FOURTHCONVERTERDECIMATORIQ_H
+
+#include "SoftFM.h"
+
+// Fs/4 downconverter fused with a complex half-band decimator by 2,
+// for the zero-IF receivers.
+//
+// The output is the same as FourthConverterIQ(false) followed by
+// a half-band low-pass filter and taking every other sample,
+// computed in one pass:
+//
+// * every other tap of the half-band filter except the center one
+//   is zero, and only the outputs kept after decimation are computed,
+//   so the input samples are split into the odd and even positions,
+//   the former for the non-zero taps and the latter for the center tap;
+// * the Fs/4 rotation of the input samples is folded into the signs
+//   of the coefficients, so each pair of the symmetric taps takes
+//   one real multiplication of the difference of the two input samples,
+//   and the rotation of the output sample is a swap of the real and
+//   imaginary parts with sign changes.
+//
+// The group delay of the filter is compensated, so that the output
+// sample m is aligned to the input sample 2m.
+// The passband is up to Fs/6 of the input sample rate,
+// and the stopband from Fs/3 is attenuated by 100dB or more.
+class FourthConverterDecimatorIQ {
+public:
+  // Number of non-zero tap pairs excluding the center tap.
+  static constexpr unsigned int half_length = 11;
+  // Number of taps of the half-band filter.
+  static constexpr unsigned int taps = 4 * half_length - 1;
+  // Kaiser window parameter.
+  static constexpr double kaiser_beta = 11.0;
+  // Minimum ratio of the input sample rate to the demodulator rate,
+  // so that the IF band of the demodulator is within the passband.
+  static constexpr double min_rate_ratio = 3.0;
+
+  // Construct the downconverting decimator.
+  FourthConverterDecimatorIQ();
+
+  // Return true if the decimator can be used before the IF resampler
+  // from the input sample rate to the demodulator rate.
+  static bool usable(double input_rate, double demodulator_rate) {
+    return input_rate >= min_rate_ratio * demodulator_rate;
+  }
+
+  // Process samples.
+  void process(std::span<const IQSample> samples_in,
+               IQSampleVector &samples_out);
+
+  // Process samples into the split-complex block for the IF resampler.
+  void process(std::span<const IQSample> samples_in,
+               IQSampleSplitVector &samples_out);
+
+  // Return the non-zero coefficients of the pairs with the Fs/4
+  // rotation folded in, in the order of the input sample delay.
+  const std::vector<float> &coeff() const { return m_coeff; }
+
+private:
+  // Compute the output samples and call store(i, re, im) for each.
+  template <typename Store>
+  unsigned int process_samples(std::span<const IQSample> samples_in,
+                               Store store);
+
+  // Return the number of the output samples for n input samples.
+  unsigned int output_size(unsigned int n) const;
+
+  std::vector<float> m_coeff;
+  // Input samples at the odd positions, from half_length samples
+  // before the next output sample, and at the even positions,
+  // from the next output sample, as split-complex blocks.
+  volk::vector<float> m_odd_re, m_odd_im;
+  volk::vector<float> m_even_re, m_even_im;
+  // Parity of the position of the next input sample.
+  unsigned int m_parity;
+  // Sign of the next output sample.
+  float m_sign;
+};
+
+#endif
@@ -22,71 +22,165 @@
 #include "SoftFM.h"
 
 // Converting Fs/4 tuner.
+// See Richard G. Lyons' explanation at
+// https://www.embedded.com/print/4007186
+//
+// The samples are multiplied by +1, -j, -1, +j (downconverting)
+// or +1, +j, -1, -j (upconverting), repeating every 4 samples.
+// Each multiplication is a swap of the real and imaginary parts
+// with sign changes, so the samples are processed in groups of 4
+// with the multiplication of each position in the group fixed
+// for the phase at the start of the block, without branches
+// in the loop. The phase is carried over between blocks.
 class FourthConverterIQ {
 public:
   // Construct Fs/4 downconverting tuner.
   // up : true if upconverting
   //    : false if downconverting
-  FourthConverterIQ(bool up)
-      : m_index(0), m_tblidx0(up ? 3 : 1), m_tblidx1(up ? 0 : 2),
-        m_tblidx2(up ? 1 : 3), m_tblidx3(up ? 2 : 0) {
+  FourthConverterIQ(bool up) : m_up(up), m_index(0) {
     // do nothing
   }
+
   // Process samples.
-  // See Richard G. Lyons' explanation at
-  // https://www.embedded.com/print/4007186
-  inline void process(const IQSampleVector &samples_in,
+  inline void process(std::span<const IQSample> samples_in,
                       IQSampleVector &samples_out) {
-    unsigned int tblidx = m_index;
     unsigned int n = samples_in.size();
+    samples_out.resize(n);
+    IQSample *output = samples_out.data();
+    process_samples(samples_in.data(), n,
+                    [output](unsigned int i, float re, float im) {
+                      output[i] = IQSample(re, im);
+                    });
+  }
+
+  // Process samples in-place.
+  inline void process_inplace(std::span<IQSample> samples) {
+    IQSample *output = samples.data();
+    process_samples(samples.data(), samples.size(),
+                    [output](unsigned int i, float re, float im) {
+                      output[i] = IQSample(re, im);
+                    });
+  }
 
+  // Process samples into the split-complex block for the IF resampler.
+  inline void process(std::span<const IQSample> samples_in,
+                      IQSampleSplitVector &samples_out) {
+    unsigned int n = samples_in.size();
     samples_out.resize(n);
+    double *out_re = samples_out.re.data();
+    double *out_im = samples_out.im.data();
+    process_samples(samples_in.data(), n,
+                    [out_re, out_im](unsigned int i, float re, float im) {
+                      out_re[i] = re;
+                      out_im[i] = im;
+                    });
+  }
+
+  // Process n samples and call store(i, re, im) for each converted
+  // sample in order, so that the conversion can be fused with the
+  // following stage.
+  template <typename Store>
+  inline void process_samples(const IQSample *input, unsigned int n,
+                              Store store) {
+    unsigned int groups = n / 4;
+    switch (m_up ? m_index + 4 : m_index) {
+    case 0:
+      convert_groups<0, false>(input, groups, store);
+      break;
+    case 1:
+      convert_groups<1, false>(input, groups, store);
+      break;
+    case 2:
+      convert_groups<2, false>(input, groups, store);
+      break;
+    case 3:
+      convert_groups<3, false>(input, groups, store);
+      break;
+    case 4:
+      convert_groups<0, true>(input, groups, store);
+      break;
+    case 5:
+      convert_groups<1, true>(input, groups, store);
+      break;
+    case 6:
+      convert_groups<2, true>(input, groups, store);
+      break;
+    case 7:
+      convert_groups<3, true>(input, groups, store);
+      break;
+    default:
+      // unreachable, error here;
+      assert(m_index < 4);
+      break;
+    }
 
-    for (unsigned int i = 0; i < n; i++) {
-      IQSample y;
-      const IQSample &s = samples_in[i];
-      const IQSample::value_type re = s.real();
-      const IQSample::value_type im = s.imag();
-      switch (tblidx) {
-      // downconvert: +1, +j, -1, -j
-      // upconvert: +1, -j, -1, +j
+    // The phase after whole groups is the same as the initial one.
+    // Convert the remaining samples one by one.
+    for (unsigned int i = groups * 4; i < n; i++) {
+      switch (m_index) {
       case 0:
-        // multiply +1
-        y = s;
-        tblidx = m_tblidx0;
+        convert<0>(input[i], i, store);
         break;
       case 1:
-        // multiply +j
-        y = IQSample(im, -re);
-        tblidx = m_tblidx1;
+        convert<1>(input[i], i, store);
         break;
       case 2:
-        // multiply -1
-        y = IQSample(-re, -im);
-        tblidx = m_tblidx2;
+        convert<2>(input[i], i, store);
         break;
       case 3:
-        // multiply -j
-        y = IQSample(-im, re);
-        tblidx = m_tblidx3;
-        break;
-      default:
-        // unreachable, error here;
-        assert(tblidx < 4);
+        convert<3>(input[i], i, store);
         break;
       }
-      samples_out[i] = y;
+      m_index = next_index(m_index, m_up);
     }
-
-    m_index = tblidx;
   }
 
 private:
+  // Return the phase index of the next sample.
+  static constexpr unsigned int next_index(unsigned int index, bool up) {
+    return (index + (up ? 3 : 1)) % 4;
+  }
+
+  // Convert a sample at the phase index K, multiplying by (-j)^K.
+  template <unsigned int K, typename Store>
+  static inline void convert(const IQSample &s, unsigned int i,
+                             Store &store) {
+    const IQSample::value_type re = s.real();
+    const IQSample::value_type im = s.imag();
+    if constexpr (K == 0) {
+      // multiply +1
+      store(i, re, im);
+    } else if constexpr (K == 1) {
+      // multiply -j
+      store(i, im, -re);
+    } else if constexpr (K == 2) {
+      // multiply -1
+      store(i, -re, -im);
+    } else {
+      // multiply +j
+      store(i, -im, re);
+    }
+  }
+
+  // Convert groups of 4 samples starting at the phase index Start.
+  template <unsigned int Start, bool Up, typename Store>
+  static inline void convert_groups(const IQSample *input,
+                                    unsigned int groups, Store &store) {
+    constexpr unsigned int k0 = Start;
+    constexpr unsigned int k1 = next_index(k0, Up);
+    constexpr unsigned int k2 = next_index(k1, Up);
+    constexpr unsigned int k3 = next_index(k2, Up);
+    for (unsigned int g = 0; g < groups; g++) {
+      const unsigned int i = g * 4;
+      convert<k0>(input[i], i, store);
+      convert<k1>(input[i + 1], i + 1, store);
+      convert<k2>(input[i + 2], i + 2, store);
+      convert<k3>(input[i + 3], i + 3, store);
+    }
+  }
+
+  const bool m_up;
   unsigned int m_index;
-  const unsigned int m_tblidx0;
-  const unsigned int m_tblidx1;
-  const unsigned int m_tblidx2;
-  const unsigned int m_tblidx3;
 };
 
 #endif
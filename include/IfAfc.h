@@ -0,0 +1,75 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_IFAFC_H
+#define INCLUDE_IFAFC_H
+
+#include "FineTuner.h"
+#include "SoftFM.h"
+
+// Automatic frequency control of the IF for FM and NBFM.
+//
+// The carrier offset measured by the decoder and averaged over
+// update_blocks blocks is fed back to the NCO which shifts the IF samples
+// before the decoder. The correction is updated once per averaging
+// period, so that the average only covers the samples after the last
+// update. Each update is bounded by max_step_ppm, and the total
+// correction by the given range. Offsets within dead_band_ppm are left
+// uncorrected, so that the noise of the measurement does not move
+// the NCO.
+class IfAfc {
+public:
+  // Maximum correction change at each update in ppm.
+  static constexpr double max_step_ppm = 2.0;
+  // Offsets smaller than this are not corrected.
+  static constexpr double dead_band_ppm = 0.1;
+
+  // Construct AFC.
+  // sample_rate   :: IF sample rate in Hz.
+  // tuner_freq    :: Tuner frequency in Hz.
+  // max_ppm       :: Maximum total correction in ppm.
+  // update_blocks :: Number of blocks averaged for each update.
+  IfAfc(double sample_rate, double tuner_freq, double max_ppm,
+        unsigned int update_blocks);
+
+  // Feed the averaged correction to make in ppm for each block.
+  // Return true if the correction is updated.
+  bool update(double ppm);
+
+  // Clear the correction for the new tuner frequency after retuning.
+  void reset(double tuner_freq);
+
+  // Return the current correction in ppm.
+  double get_correction_ppm() const { return m_correction_ppm; }
+
+  // Shift the IF samples in-place by the current correction.
+  void process_inplace(std::span<IQSample> samples) {
+    m_tuner.process_inplace(samples);
+  }
+
+private:
+  double m_tuner_freq;
+  const double m_max_ppm;
+  const unsigned int m_update_blocks;
+  unsigned int m_blocks;
+  double m_correction_ppm;
+  FineTuner m_tuner;
+};
+
+#endif
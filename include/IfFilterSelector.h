@@ -0,0 +1,96 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_IFFILTERSELECTOR_H
+#define INCLUDE_IFFILTERSELECTOR_H
+
+#include <vector>
+
+#include "SoftFM.h"
+
+// Adaptive selection of the FM IF filter by the adjacent channel energy.
+//
+// The power spectrum of the IF samples before the IF filter is measured
+// with a short FFT once every measure_blocks blocks, averaged over
+// up to max_frames frames of the block. The energy outside the passband
+// of the medium filter, where the sidebands of the desired channel are
+// negligible, is compared with the energy of the desired channel.
+// The medium or the narrow filter is selected at once when the level
+// exceeds its enable level, and the filter is widened again after
+// the level stays below the enable level minus hysteresis for
+// release_count measurements. No filter is used for the clean signals.
+class IfFilterSelector {
+public:
+  // FFT length (1.5kHz resolution at 384kHz).
+  static constexpr unsigned int fft_length = 256;
+  // Maximum number of FFT frames averaged at each measurement.
+  static constexpr unsigned int max_frames = 8;
+  // Number of blocks between the measurements.
+  static constexpr unsigned int measure_blocks = 8;
+  // Bandwidth of the desired channel in Hz (one side).
+  static constexpr double channel_bandwidth = 100000;
+  // Passband edge of the medium filter in Hz (one side).
+  static constexpr double medium_edge = 156000;
+  // Adjacent channel energy relative to the channel in dB
+  // to enable the medium and the narrow filters.
+  static constexpr double medium_level = -35.0;
+  static constexpr double narrow_level = -20.0;
+  // Hysteresis of the levels in dB to disable the filters.
+  static constexpr double hysteresis = 6.0;
+  // Number of measurements below the levels to widen the filter.
+  static constexpr unsigned int release_count = 4;
+
+  // Construct selector.
+  // sample_rate :: IF sample rate in Hz.
+  IfFilterSelector(double sample_rate);
+
+  // Measure the IF samples once every measure_blocks blocks.
+  // Return true if the selected filter type is changed.
+  bool process(std::span<const IQSample> samples);
+
+  // Return the selected filter type:
+  // Default (no filter), Medium, or Narrow.
+  FilterType get_filtertype() const { return m_filtertype; }
+
+  // Return the adjacent channel energy relative to the channel in dB
+  // at the last measurement.
+  double get_adjacent_level() const { return m_adjacent_level; }
+
+private:
+  // Add the power spectrum of the frame to m_power.
+  void add_power_spectrum(std::span<const IQSample> frame);
+
+  // In-place radix-2 FFT of m_fft.
+  void fft();
+
+  unsigned int m_blocks;
+  unsigned int m_release;
+  FilterType m_filtertype;
+  double m_adjacent_level;
+  // Last FFT bins of the channel and the medium filter passband.
+  unsigned int m_channel_bin;
+  unsigned int m_medium_bin;
+  std::vector<float> m_window;
+  std::vector<IQSample> m_twiddle;
+  std::vector<unsigned int> m_bitrev;
+  IQSampleVector m_fft;
+  std::vector<float> m_power;
+};
+
+#endif
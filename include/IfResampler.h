@@ -35,11 +35,17 @@ public:
   IfResampler(const double input_rate, const double output_rate);
   // Process IQ samples.
   // converting input_rate to output_rate.
-  void process(const IQSampleVector &samples_in, IQSampleVector &samples_out);
+  void process(std::span<const IQSample> samples_in,
+               IQSampleVector &samples_out);
+  // Process split-complex IQ samples without deinterleaving.
+  // samples_in may be used as a work buffer by the resampler.
+  void process(IQSampleSplitVector &samples_in, IQSampleVector &samples_out);
 
 private:
   std::unique_ptr<r8b::CDSPResampler24> m_cdspr_re;
   std::unique_ptr<r8b::CDSPResampler24> m_cdspr_im;
+  // Deinterleaved input, reused for each block.
+  IQSampleSplitVector m_samples_in_split;
 };
 
 #endif
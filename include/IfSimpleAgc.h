@@ -47,12 +47,27 @@ public:
   void reset_gain();
 
   // Process IQ samples.
-  void process(const IQSampleVector &samples_in, IQSampleVector &samples_out);
+  void process(std::span<const IQSample> samples_in,
+               IQSampleVector &samples_out);
+
+  // Process IQ samples in-place.
+  void process_inplace(std::span<IQSample> samples);
+
+  // Process IQ samples and output the real part only,
+  // for demodulating DSB signals.
+  void process_real(std::span<const IQSample> samples_in,
+                    IQSampleDecodedVector &samples_out);
 
   // Return IF AGC current gain.
   float get_current_gain() const { return m_current_gain; }
 
 private:
+  // Process n samples; input and output may be the same buffer.
+  // If T is not IQSample, only the real part is output.
+  template <typename T>
+  inline void process_samples(const IQSample *input, T *output,
+                              unsigned int n);
+
   float m_initial_gain;
   float m_current_gain;
   float m_max_gain;
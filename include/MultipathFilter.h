@@ -56,7 +56,8 @@ public:
   // (or the input length is zero);
   // Return false if the processing fails
   // (i.e., internal values contains infinite values (NaN, inf, etc)).
-  bool process(const IQSampleVector &samples_in, IQSampleVector &samples_out);
+  bool process(std::span<const IQSample> samples_in,
+               IQSampleVector &samples_out);
 
   // Obtain the latest error value.
   const double get_error() const { return m_error; }
@@ -84,6 +85,8 @@ private:
   float m_mu;
   MfCoeffVector m_coeff;
   MfCoeffVector m_state;
+  // Work buffer of update_coeff().
+  volk::vector<float> m_state_mag_sq;
   double m_error;
 };
 
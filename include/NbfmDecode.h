@@ -24,6 +24,7 @@
 #include "IfSimpleAgc.h"
 #include "PhaseDiscriminator.h"
 #include "SoftFM.h"
+#include "StageProfiler.h"
 
 // Complete decoder for Narrow Band FM broadcast signal.
 
@@ -45,35 +46,61 @@ public:
    * nbfmfilter_coeff  :: IQSample Filter Coefficients.
    * freq_dev          :: full scale deviation in Hz.
    */
-  NbfmDecoder(IQSampleCoeff &nbfmfilter_coeff, const double freq_dev);
+  NbfmDecoder(const IQSampleCoeff &nbfmfilter_coeff, const double freq_dev);
 
   /**
    * Process IQ samples and return audio samples.
+   * The audio buffer is owned by the caller and reused for each block.
    */
-  void process(const IQSampleVector &samples_in, SampleVector &audio);
+  void process(std::span<const IQSample> samples_in, SampleVector &audio);
+
+  /**
+   * Skip decoding a block of if_length IQ samples while the squelch is
+   * closed, and return the silent audio samples of the same duration.
+   * The decoder state is kept for a warm restart by the next process().
+   */
+  void skip(std::size_t if_length, SampleVector &audio);
+
+  /**
+   * Reset the state adapted to the previous channel after retuning:
+   * the IF AGC gain and the tuning offset.
+   */
+  void reset();
 
   /** Return actual frequency offset in Hz with respect to receiver LO. */
   float get_tuning_offset() const { return m_baseband_mean * m_freq_dev; }
 
+  /**
+   * Change the IF filter, keeping the filter history.
+   * The output is crossfaded from the previous filter
+   * for crossfade_length IF samples (0 to switch at once).
+   */
+  void set_filter(const IQSampleCoeff &nbfmfilter_coeff,
+                  unsigned int crossfade_length) {
+    m_nbfmfilter.set_coefficients(nbfmfilter_coeff, crossfade_length);
+  }
+
   /** Return RMS baseband signal level (where nominal level is 0.707). */
   float get_baseband_level() const { return m_baseband_level; }
 
   // Return RMS IF level.
   float get_if_rms() const { return m_if_rms; }
 
+  // Set the stage profiler, or nullptr to disable profiling.
+  void set_profiler(StageProfiler *profiler) { m_profiler = profiler; }
+
 private:
   // Data members.
-  const IQSampleCoeff &m_nbfmfilter_coeff;
   const double m_freq_dev;
   float m_baseband_mean;
   float m_baseband_level;
   float m_if_rms;
+  StageProfiler *m_profiler;
 
+  volk::vector<float> m_buf_magnitude_sq;
   IQSampleVector m_buf_filtered;
-  IQSampleVector m_samples_in_after_agc;
   IQSampleDecodedVector m_buf_decoded;
   SampleVector m_buf_baseband;
-  SampleVector m_buf_baseband_filtered;
 
   LowPassFilterFirIQ m_nbfmfilter;
   PhaseDiscriminator m_phasedisc;
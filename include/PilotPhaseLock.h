@@ -35,6 +35,9 @@ public:
   static constexpr double bandwidth = 30 / sample_rate_if;
   // Minimum pilot amplitude (lowered to prevent accidental unlocking)
   static constexpr double minsignal = 0.001;
+  // PPS events reserved to avoid allocation in process()
+  // (one event per second, so a block has one event at most).
+  static constexpr std::size_t reserved_pps_events = 4;
 
   // Timestamp event produced once every 19000 pilot periods.
   struct PpsEvent {
@@ -56,7 +59,7 @@ public:
   // pilot_shift :: true to shift pilot phase by
   //             :: using cos(2*x) instead of sin (2*x)
   //             :: (for multipath distortion detection)
-  void process(const SampleVector &samples_in, SampleVector &samples_out,
+  void process(std::span<const Sample> samples_in, SampleVector &samples_out,
                bool pilot_shift);
 
   // Return true if the phase-locked loop is locked.
@@ -69,7 +72,9 @@ public:
   double get_freq_err() const { return m_freq_err; }
 
   // Return PPS events from the most recently processed block.
-  std::vector<PpsEvent> get_pps_events() const { return m_pps_events; }
+  const std::vector<PpsEvent> &get_pps_events() const {
+    return m_pps_events;
+  }
 
   // Erase the first PPS event.
   void erase_first_pps_event() {
@@ -78,6 +83,21 @@ public:
     }
   }
 
+  // Account for the given number of samples skipped without processing
+  // while the decoder is squelched. The pilot phase is not tracked
+  // during the skip, so the lock and the PPS count restart.
+  void skip(std::size_t samples);
+
+  // Enable mixing the input with the 57kHz RDS subcarrier
+  // derived from the locked pilot phase.
+  void set_rds_mixing(bool enable) { m_rds_mixing = enable; }
+
+  // Exchange the 57kHz-mixed complex samples of the most recently
+  // processed block with the given buffer without copying.
+  void swap_rds_baseband(IQSampleVector &buf) {
+    std::swap(buf, m_rds_baseband);
+  }
+
 private:
   Sample m_minfreq, m_maxfreq;
   Sample m_freq, m_phase;
@@ -92,6 +112,8 @@ private:
   BiquadIirFilter m_biquad_phasor_q1, m_biquad_phasor_q2;
   FirstOrderIirFilter m_first_phase_err;
   Sample m_freq_err;
+  bool m_rds_mixing;
+  IQSampleVector m_rds_baseband;
 };
 
 #endif
@@ -0,0 +1,190 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_RDSDECODER_H
+#define INCLUDE_RDSDECODER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DataBuffer.h"
+#include "SoftFM.h"
+
+// RDS/RBDS decoder.
+//
+// The input is the MPX signal already mixed down with the 57kHz subcarrier
+// derived from the pilot PLL (see PilotPhaseLock::set_rds_mixing()).
+// Processing stages:
+//   decimation to 24kHz, Costas loop for the residual carrier phase,
+//   chip matched filter and Gardner symbol timing recovery,
+//   biphase and differential decoding,
+//   block synchronization and burst error correction,
+//   and group decoding of PI, PS (0A/0B), RT (2A/2B), and CT (4A).
+// Decoded data are written as timestamped JSON lines.
+class RdsDecoder {
+public:
+  // Input sampling rate (FM IF rate).
+  static constexpr double sample_rate_if = 384000;
+  // Decimation ratio of the first and the second stage.
+  static constexpr unsigned int decimation_first = 8;
+  static constexpr unsigned int decimation_second = 2;
+  // Internal sampling rate.
+  static constexpr double sample_rate_internal =
+      sample_rate_if / (decimation_first * decimation_second);
+  // Biphase chip rate (twice the bit rate of 1187.5bps).
+  static constexpr double chip_rate = 2375;
+  // Cutoff frequency of the second stage LPF.
+  static constexpr double lpf_cutoff = 2600;
+  // Number of taps of the second stage LPF.
+  static constexpr unsigned int lpf_taps = 101;
+  // Maximum number of blocks waiting to be decoded.
+  static constexpr std::size_t max_queue_blocks = 64;
+
+  //
+  // Construct RDS decoder.
+  //
+  // output   :: FILE pointer to write JSON lines
+  // threaded :: true to decode in a dedicated thread
+  //
+  RdsDecoder(FILE *output, bool threaded);
+
+  // Destructor.
+  ~RdsDecoder();
+
+  // Feed a block of 57kHz-mixed samples.
+  // In threaded mode the block is moved to the decoder thread.
+  void feed(IQSampleVector &&samples);
+
+  // Return an empty buffer recycled from the decoder,
+  // or a new empty buffer if no spare buffer is available.
+  IQSampleVector get_spare();
+
+  // Stop the decoder thread after decoding all queued blocks.
+  void close();
+
+  // Return the number of valid groups decoded.
+  std::uint64_t get_group_count() const { return m_group_count.load(); }
+
+  // Return true if block synchronization is established.
+  bool synchronized() const { return m_synced.load(); }
+
+private:
+  // Block offset index (C' is treated as C).
+  enum BlockIndex { BlockA = 0, BlockB = 1, BlockC = 2, BlockD = 3 };
+
+  // Decode a block of samples.
+  void process(std::span<const IQSample> samples);
+  // Process a baseband sample at the internal rate.
+  void process_internal(IQSample z);
+  // Process a matched filter output sample for symbol timing.
+  void process_symbol(float y);
+  // Process a chip (half bit).
+  void process_chip(float chip);
+  // Process a data bit after differential decoding.
+  void process_bit(unsigned int bit);
+  // Process a 26-bit block at the expected block index.
+  void process_block(std::uint32_t word);
+  // Decode a complete group.
+  void process_group();
+  // Write a JSON line with the given members.
+  void emit(const std::string &group, const std::string &members);
+  // Decoder thread body.
+  void run();
+
+  // Compute 10-bit syndrome of a 26-bit block.
+  static std::uint32_t syndrome(std::uint32_t word);
+  // Return JSON string literal from RDS characters.
+  static std::string json_string(const char *chars, std::size_t n);
+
+  FILE *m_output;
+
+  // Decimation filters.
+  IQSampleCoeff m_coeff_first;
+  IQSampleCoeff m_coeff_second;
+  IQSampleVector m_hist_first;
+  IQSampleVector m_hist_second;
+  IQSampleVector m_buf_first;
+
+  // Costas loop.
+  double m_carrier_phase;
+  double m_carrier_freq;
+  float m_carrier_power;
+
+  // Chip matched filter (moving sum over a chip).
+  std::vector<float> m_mf_state;
+  unsigned int m_mf_pos;
+  float m_mf_sum;
+
+  // Gardner symbol timing recovery.
+  double m_symbol_phase;
+  float m_prev_y;
+  float m_prev_strobe;
+  float m_mid_strobe;
+  float m_symbol_level;
+
+  // Biphase decoding.
+  float m_prev_chip;
+  unsigned int m_chip_count;
+  std::array<float, 2> m_pairing_score;
+  unsigned int m_prev_bit;
+
+  // Block synchronization.
+  std::uint32_t m_shift_reg;
+  std::uint64_t m_bit_count;
+  bool m_synced_flag;
+  std::uint64_t m_candidate_bit;
+  int m_candidate_index;
+  unsigned int m_block_bits;
+  unsigned int m_block_index;
+  unsigned int m_block_errors;
+  unsigned int m_block_total;
+  std::array<std::uint16_t, 4> m_group_data;
+  std::array<bool, 4> m_group_valid;
+  std::vector<std::uint32_t> m_burst_table;
+
+  // Decoded data.
+  int m_pi;
+  int m_pi_candidate;
+  std::array<char, 8> m_ps;
+  unsigned int m_ps_segments;
+  std::string m_ps_emitted;
+  std::array<char, 64> m_rt;
+  unsigned int m_rt_segments;
+  int m_rt_ab;
+  std::string m_rt_emitted;
+
+  std::atomic<std::uint64_t> m_group_count;
+  std::atomic_bool m_synced;
+
+  // Threading.
+  const bool m_threaded;
+  bool m_closed;
+  DataBuffer<IQSample> m_queue;
+  std::mutex m_spare_mutex;
+  std::vector<IQSampleVector> m_spare;
+  std::unique_ptr<std::thread> m_thread;
+};
+
+#endif
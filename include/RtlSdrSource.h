@@ -29,6 +29,9 @@
 class RtlSdrSource : public Source {
 public:
   static constexpr int default_block_length = 16384;
+  // Blocks discarded after retuning: the block being read by
+  // rtlsdr_read_sync() and the samples buffered by the device.
+  static constexpr unsigned int retune_pipeline_blocks = 2;
 
   /** Open RTL-SDR device. */
   RtlSdrSource(int dev_index);
@@ -44,6 +47,9 @@ public:
   /** Return device current center frequency in Hz. */
   virtual std::uint32_t get_frequency() override;
 
+  /** Retune the device without restarting the stream. */
+  virtual bool set_frequency(std::uint32_t frequency) override;
+
   /** Return if device is using Low-IF. */
   virtual bool is_low_if() override;
 
@@ -95,6 +101,8 @@ private:
 
   struct rtlsdr_dev *m_dev;
   int m_block_length;
+  // Read buffer, reused for each block.
+  std::vector<uint8_t> m_read_buf;
   std::vector<int> m_gains;
   std::string m_gainsStr;
   bool m_confAgc = false;
@@ -0,0 +1,121 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_SAMPLEFILEWRITER_H
+#define INCLUDE_SAMPLEFILEWRITER_H
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sndfile.h>
+
+#include "DataBuffer.h"
+#include "SoftFM.h"
+
+// Asynchronous writer of interleaved float sample frames via libsndfile.
+//
+// Blocks are queued by the DSP thread and written by a dedicated thread,
+// so that slow storage never stalls the decoder.
+// When the queue grows beyond max_queue_blocks, new blocks are dropped
+// and counted instead of blocking the caller.
+// Written blocks are recycled as spare buffers to avoid reallocation.
+class SampleFileWriter {
+public:
+  // Maximum number of blocks waiting to be written.
+  static constexpr std::size_t max_queue_blocks = 256;
+  // Maximum number of spare buffers kept for recycling.
+  static constexpr std::size_t max_spare_blocks = 8;
+
+  //
+  // Construct the writer and start the writer thread.
+  //
+  // filename     :: file name (including path) or "-" to write to stdout
+  // samplerate   :: sample rate in Hz
+  // channels     :: number of interleaved channels per frame
+  // format       :: output format of SF_INFO.format
+  //
+  SampleFileWriter(const std::string &filename, unsigned int samplerate,
+                   unsigned int channels, int format);
+
+  // Destructor.
+  ~SampleFileWriter();
+
+  // Queue interleaved float samples to be written.
+  // The buffer is moved to the writer thread without copying.
+  void push(IQSampleDecodedVector &&samples);
+
+  // Queue IQ samples as two-channel frames (I: left, Q: right).
+  void push(const IQSampleVector &samples);
+
+  // Return an empty buffer recycled from the writer thread,
+  // or a new empty buffer if no spare buffer is available.
+  IQSampleDecodedVector get_spare();
+
+  // Flush the queue, stop the writer thread, and close the file.
+  void close();
+
+  // Return the number of dropped blocks.
+  std::uint64_t get_dropped_blocks() const { return m_dropped_blocks.load(); }
+
+  // Return the number of written frames.
+  std::uint64_t get_written_frames() const { return m_written_frames.load(); }
+
+  /** Return the last error, or return an empty string if there is no error. */
+  std::string error() {
+    std::scoped_lock<std::mutex> lock(m_error_mutex);
+    std::string ret(m_error);
+    m_error.clear();
+    return ret;
+  }
+
+  /** Return true if the writer is OK, return false if there is an error. */
+  operator bool() const { return !m_zombie.load(); }
+
+private:
+  // Writer thread body.
+  void run();
+
+  // Set error message and mark as zombie.
+  void set_error(const std::string &msg);
+
+  const unsigned int m_channels;
+  int m_fd = -1;
+  SNDFILE *m_sndfile = nullptr;
+  SF_INFO m_sfinfo{};
+  std::atomic_bool m_zombie;
+  std::atomic_bool m_closed;
+  std::atomic<std::uint64_t> m_dropped_blocks;
+  std::atomic<std::uint64_t> m_written_frames;
+  std::mutex m_error_mutex;
+  std::string m_error;
+  DataBuffer<float> m_queue;
+  std::mutex m_spare_mutex;
+  std::vector<IQSampleDecodedVector> m_spare;
+  std::unique_ptr<std::thread> m_thread;
+
+  SampleFileWriter(const SampleFileWriter &);            // no copy constructor
+  SampleFileWriter &operator=(const SampleFileWriter &); // no assignment
+};
+
+#endif
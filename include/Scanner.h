@@ -0,0 +1,131 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_SCANNER_H
+#define INCLUDE_SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Frequency scanner.
+//
+// The scanner steps across a list of frequencies, and stops on the
+// channels where the IF level is above the squelch level.
+// The configuration string is a comma-separated list of:
+//   freqs=<list>   frequencies of the channels in Hz,
+//                  colon-separated, with k/M/G suffixes allowed
+//   dwell=<sec>    time to listen for activity on each channel
+//   hold=<sec>     time to stay after the activity ends
+// The time is counted by the IF samples after the source is retuned,
+// from the first block of the new segment of the source buffer,
+// so that the stale blocks of the previous channel are not counted.
+// The source starts the new segment after discarding the blocks
+// in the device pipeline, which hold the samples read before retuning.
+class Scanner {
+public:
+  // Default time to listen for activity in seconds.
+  static constexpr double default_dwell_time = 0.1;
+  // Default time to stay after the activity ends in seconds.
+  static constexpr double default_hold_time = 2.0;
+  // Time skipped at the beginning of the new segment for the tuner PLL
+  // and the filters to settle in seconds.
+  static constexpr double settle_time = 0.01;
+
+  // Scanner state of the current channel.
+  enum class State { Retuning, Settling, Listening, Active };
+
+  // Action for the block fed to the scanner.
+  enum class Action { Skip, Decode, Retune };
+
+  Scanner();
+
+  // Parse the configuration string. Return false if failed.
+  bool configure(const std::string &configuration);
+
+  // Return the error message of the last failure.
+  std::string error() const { return m_error; }
+
+  // Set the IF sample rate at which the time is counted.
+  void set_sample_rate(double sample_rate) { m_sample_rate = sample_rate; }
+
+  // Return the list of the frequencies in Hz.
+  const std::vector<std::uint32_t> &get_frequencies() const {
+    return m_frequencies;
+  }
+
+  // Return the frequency of the current channel in Hz.
+  std::uint32_t get_frequency() const { return m_frequencies[m_index]; }
+
+  // Move to the next channel, and return its frequency in Hz.
+  std::uint32_t next();
+
+  // Notify that the source has been retuned to the current channel
+  // at the given time in seconds.
+  void retuned(double time);
+
+  // Feed a block of if_length IF samples of the given source segment,
+  // with active set if the IF level is above the squelch level.
+  // Return whether to decode or skip the block,
+  // or to retune to the next channel.
+  Action feed(std::uint64_t segment, std::size_t if_length, bool active);
+
+  // Return the state of the current channel.
+  State get_state() const { return m_state; }
+
+  // Record the time when the first audio of the channel is written,
+  // and return the latency from the retune in seconds.
+  double audio_started(double time);
+
+  // Return true if the audio of the current channel is not started yet.
+  bool audio_pending() const { return m_audio_pending; }
+
+  // Return the number of the measured latencies.
+  unsigned int get_latency_count() const { return m_latency_count; }
+
+  // Return the average and the maximum of the latencies in seconds.
+  double get_latency_average() const {
+    return m_latency_count > 0 ? m_latency_sum / m_latency_count : 0.0;
+  }
+  double get_latency_max() const { return m_latency_max; }
+
+private:
+  // Parse the frequency list. Return false if failed.
+  static bool parse_frequencies(const std::string &s,
+                                std::vector<std::uint32_t> &frequencies);
+
+  std::vector<std::uint32_t> m_frequencies;
+  std::size_t m_index;
+  double m_dwell_time;
+  double m_hold_time;
+  double m_sample_rate;
+  State m_state;
+  std::uint64_t m_segment;
+  // IF samples counted in the current state.
+  std::uint64_t m_samples;
+  bool m_audio_pending;
+  double m_retune_time;
+  unsigned int m_latency_count;
+  double m_latency_sum;
+  double m_latency_max;
+  std::string m_error;
+};
+
+#endif
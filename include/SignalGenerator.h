@@ -0,0 +1,178 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_SIGNALGENERATOR_H
+#define INCLUDE_SIGNALGENERATOR_H
+
+#include <complex>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SoftFM.h"
+
+// Deterministic synthetic IQ signal generator.
+//
+// The output is a sum of carriers modulated by audio tones,
+// optionally with an echo (multipath) and Gaussian noise.
+// The FM stereo multiplex optionally carries RDS 0A groups
+// of the program identification (PI) and the program service name (PS).
+// All oscillators keep their phases across the calls of generate(),
+// so the signal is continuous over the block boundaries,
+// and the same seed always gives the same samples.
+class SignalGenerator {
+public:
+  // Nominal FM broadcast parameters.
+  static constexpr double fm_freq_dev = 75000;
+  static constexpr double fm_pilot_freq = 19000;
+  static constexpr double fm_pilot_level = 0.1;
+  // RDS bit rate.
+  static constexpr double rds_bit_rate = 1187.5;
+  // Number of samples generated per carrier at a time.
+  static constexpr std::size_t chunk_length = 1024;
+  // Default RDS program identification.
+  static constexpr std::uint16_t default_rds_pi = 0x1234;
+
+  //
+  // Construct signal generator.
+  //
+  // sample_rate :: output IQ sample rate in Hz
+  // seed        :: seed of the noise generator
+  //
+  SignalGenerator(double sample_rate, unsigned int seed = 1);
+
+  // Add FM broadcast stereo multiplex with the 19kHz pilot.
+  // offset       :: carrier frequency offset in Hz
+  // left_freq    :: left channel tone frequency in Hz
+  // right_freq   :: right channel tone frequency in Hz
+  // audio_level  :: peak deviation of the audio tones (1.0 = 75kHz)
+  // amplitude    :: carrier amplitude
+  // rds_level    :: peak deviation of the 57kHz RDS subcarrier,
+  //                 0 to disable RDS
+  void add_fm_stereo(double offset, double left_freq, double right_freq,
+                     double audio_level, double amplitude,
+                     double rds_level = 0.0);
+
+  // Set the RDS program identification and program service name
+  // (up to 8 characters) sent by all FM stereo carriers with RDS.
+  void set_rds_station(std::uint16_t pi, const std::string &ps);
+
+  // Add narrow band FM carrier modulated by a tone.
+  void add_nbfm(double offset, double tone_freq, double deviation,
+                double amplitude);
+
+  // Add AM carrier modulated by a tone with the modulation depth.
+  void add_am(double offset, double tone_freq, double depth,
+              double amplitude);
+
+  // Add single-tone SSB signal of the suppressed carrier frequency offset.
+  // The upper sideband is used if upper is true.
+  void add_ssb(double offset, double tone_freq, bool upper, double amplitude);
+
+  // Add unmodulated (CW key-down) carrier.
+  void add_cw(double offset, double amplitude);
+
+  // Change the amplitude of the carrier added index-th (from 0),
+  // e.g., to make a dropout of the signal while generating.
+  void set_amplitude(std::size_t index, double amplitude) {
+    m_carriers.at(index).amplitude = amplitude;
+  }
+
+  // Set RMS level of the complex Gaussian noise, 0 to disable.
+  void set_noise(double level) { m_noise_level = level; }
+
+  // Add an echo of the whole signal with the delay in seconds,
+  // and the complex gain of the given magnitude and phase in radians.
+  void set_multipath(double delay, double gain, double phase = 0.0);
+
+  // Generate n samples.
+  void generate(IQSampleVector &samples_out, std::size_t n);
+
+  // Return the sample rate in Hz.
+  double get_sample_rate() const { return m_sample_rate; }
+
+private:
+  // Recursive complex oscillator.
+  class Oscillator {
+  public:
+    Oscillator(double freq, double sample_rate);
+    // Return the current phasor and advance by a sample.
+    std::complex<double> next() {
+      std::complex<double> current = m_phasor;
+      m_phasor *= m_step;
+      return current;
+    }
+    // Keep the magnitude to one against the rounding errors.
+    void normalize() { m_phasor /= std::abs(m_phasor); }
+
+  private:
+    std::complex<double> m_phasor;
+    std::complex<double> m_step;
+  };
+
+  enum class Modulation { FmStereo, Nbfm, Am, Carrier };
+
+  struct Carrier {
+    Modulation modulation;
+    double amplitude;
+    // Carrier offset oscillator (AM and unmodulated carriers).
+    Oscillator carrier;
+    // Modulating tones; the pilot is used for FM stereo only.
+    Oscillator tone1;
+    Oscillator tone2;
+    Oscillator pilot;
+    // Modulation parameter: audio level, deviation, or depth.
+    double index;
+    // Carrier phase and offset per sample in cycles for FM.
+    double phase;
+    double phase_step;
+    // RDS subcarrier level, current bit index, bit phase in cycles,
+    // differentially encoded bit value (+1 or -1).
+    double rds_level;
+    std::size_t rds_index;
+    double rds_phase;
+    double rds_symbol;
+  };
+
+  // Return the unit phasor of the phase in cycles, from [0, 1).
+  static std::complex<double> unit_phasor(double cycles);
+
+  // Return the next RDS biphase waveform sample of the carrier.
+  double next_rds(Carrier &c);
+
+  // Return the 26-bit RDS block of the information word and the offset word.
+  static std::uint32_t rds_block(std::uint16_t info, std::uint16_t offset);
+
+  const double m_sample_rate;
+  std::vector<Carrier> m_carriers;
+  // RDS bit sequence repeated by the FM stereo carriers.
+  std::vector<std::uint8_t> m_rds_bits;
+  double m_noise_level;
+  std::mt19937 m_noise_gen;
+  std::normal_distribution<double> m_noise_dist;
+  std::size_t m_echo_delay;
+  std::complex<double> m_echo_gain;
+  // Last m_echo_delay samples of the direct signal.
+  std::vector<std::complex<double>> m_echo_history;
+  std::size_t m_echo_index;
+  // Sum of the carriers in the current block.
+  std::vector<std::complex<double>> m_sum;
+};
+
+#endif
@@ -26,26 +26,53 @@
 #include <complex>
 #include <cstdint>
 #include <memory>
+#include <span>
 #include <vector>
 
 #include <volk/volk_alloc.hh>
 
+// Sample containers are allocated with the VOLK alignment,
+// so that the aligned VOLK kernels are chosen for whole blocks.
+// Coefficient vectors are not passed to VOLK and remain std::vector.
+
 using IQSample = std::complex<float>;
-using IQSampleVector = std::vector<IQSample>;
+using IQSampleVector = volk::vector<IQSample>;
 
 using IQSampleDecoded = float;
-using IQSampleDecodedVector = std::vector<float>;
+using IQSampleDecodedVector = volk::vector<float>;
 
 using Sample = double;
-using SampleVector = std::vector<Sample>;
+using SampleVector = volk::vector<Sample>;
 
 using IQSampleCoeff = std::vector<IQSample::value_type>;
 using SampleCoeff = std::vector<SampleVector::value_type>;
 
-using DoubleVector = std::vector<double>;
+using DoubleVector = volk::vector<double>;
+
+// Split-complex (structure of arrays) IQ block,
+// with the real and imaginary parts in separate vectors.
+// Used between the Fs/4 converter and the IF resampler,
+// which processes the real and imaginary parts independently,
+// to avoid the deinterleaving pass over the interleaved IQ block.
+struct IQSampleSplitVector {
+  DoubleVector re;
+  DoubleVector im;
+
+  std::size_t size() const { return re.size(); }
+  bool empty() const { return re.empty(); }
+  void resize(std::size_t n) {
+    re.resize(n);
+    im.resize(n);
+  }
+};
+
+// Alignment of the scalar results of the VOLK kernels.
+// VOLK chooses the aligned kernel only when all the pointer arguments,
+// including the result, are aligned to volk_get_alignment().
+constexpr std::size_t volk_result_alignment = 64;
 
 enum class FilterType { Default, Medium, Narrow, Wide };
-enum class DevType { Airspy, AirspyHF, RTLSDR, FileSource };
+enum class DevType { Airspy, AirspyHF, RTLSDR, FileSource, Synthetic };
 enum class ModType { FM, NBFM, AM, DSB, USB, LSB, CW, WSPR };
 enum class OutputMode {
   RAW_INT16,
@@ -53,6 +80,8 @@ enum class OutputMode {
   WAV_INT16,
   WAV_FLOAT32,
   PORTAUDIO,
+  NET_INT16,
+  NET_FLOAT32,
 #if defined(LIBSNDFILE_MP3_ENABLED)
   MP3_FMAUDIO
 #endif // LIBSNDFILE_MP3_ENABLED
@@ -25,10 +25,13 @@
 
 #include "DataBuffer.h"
 #include "SoftFM.h"
+#include "ThreadPolicy.h"
 
 class Source {
 public:
-  Source() : m_confFreq(0), m_buf(nullptr), m_stop_flag(nullptr) {}
+  Source()
+      : m_confFreq(0), m_buf(nullptr), m_stop_flag(nullptr),
+        m_segment_pending(false), m_discard_blocks(0) {}
   virtual ~Source() {}
 
   /**
@@ -48,6 +51,19 @@ public:
   /** Return current configured center frequency in Hz. */
   std::uint32_t get_configured_frequency() const { return m_confFreq; }
 
+  /**
+   * Retune the device to the frequency of radio station in Hz
+   * without restarting the stream, as the freq configuration option.
+   * The queued blocks are discarded, and the blocks read after retuning
+   * are pushed as a new segment of the buffer by the source thread.
+   * Return false if failed or not supported by the device.
+   */
+  virtual bool set_frequency(std::uint32_t frequency) {
+    (void)frequency;
+    m_error = "Retuning is not supported by the device";
+    return false;
+  }
+
   /** Print current parameters specific to device type */
   virtual void print_specific_parms() = 0;
 
@@ -56,6 +72,12 @@ public:
   virtual bool start(DataBuffer<IQSample> *buf,
                      std::atomic_bool *stop_flag) = 0;
 
+  /** Set CPU affinity and real-time priority of the source thread,
+   * applied by the thread itself when started. */
+  void set_thread_setting(const ThreadSetting &setting) {
+    m_thread_setting = setting;
+  }
+
   /** stop device after sampling loop */
   virtual bool stop() = 0;
 
@@ -73,11 +95,38 @@ public:
   }
 
 protected:
+  // Request a new segment of the buffer after retuning.
+  // The segment is started by the source thread at the next block
+  // read from the device, not when the tuner call returns,
+  // since the device pipeline still holds the samples of the previous
+  // frequency.
+  void request_segment() { m_segment_pending.store(true); }
+
+  // Check the block read from the device, called by the source thread.
+  // After retuning, start a new segment, and discard the block and
+  // the following blocks up to the depth of the device pipeline.
+  // Return false if the block is to be discarded.
+  bool check_segment(unsigned int pipeline_blocks) {
+    if (m_segment_pending.exchange(false)) {
+      m_buf->start_segment();
+      m_discard_blocks = pipeline_blocks;
+    }
+    if (m_discard_blocks > 0) {
+      m_discard_blocks--;
+      return false;
+    }
+    return true;
+  }
+
   std::string m_devname;
   std::string m_error;
   uint32_t m_confFreq;
   DataBuffer<IQSample> *m_buf;
   std::atomic_bool *m_stop_flag;
+  ThreadSetting m_thread_setting;
+  std::atomic_bool m_segment_pending;
+  // Used by the source thread only.
+  unsigned int m_discard_blocks;
 };
 
 #endif /* INCLUDE_SOURCE_H_ */
@@ -0,0 +1,161 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_STAGEPROFILER_H
+#define INCLUDE_STAGEPROFILER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Per-stage timing profiler of the DSP chain.
+//
+// Each stage has a histogram of block processing time
+// with power-of-two nanosecond buckets.
+// All counters are relaxed atomics, so that a snapshot can be taken
+// from another thread (e.g., on SIGUSR1) without locking the DSP thread.
+// When profiling is disabled the profiler pointer is null,
+// and the cost of each Scope is a single branch.
+class StageProfiler {
+public:
+  // Profiled stages.
+  enum class Stage {
+    FourthConverter = 0,
+    IfResampler,
+    IfAfc,
+    FineTuner,
+    IfFilter,
+    IfAgc,
+    Multipath,
+    Discriminator,
+    PilotPll,
+    AudioResampler,
+    AudioFilter,
+    AfAgc,
+    OutputWrite,
+    NumStages
+  };
+
+  static constexpr unsigned int num_stages =
+      static_cast<unsigned int>(Stage::NumStages);
+  // Bucket k counts durations in [2^k, 2^(k+1)) nanoseconds.
+  static constexpr unsigned int num_buckets = 40;
+
+  // Scoped timer; record the elapsed time of the enclosing block.
+  // Do nothing if the profiler pointer is null.
+  class Scope {
+  public:
+    Scope(StageProfiler *profiler, Stage stage, std::size_t samples)
+        : m_profiler(profiler), m_stage(stage), m_samples(samples),
+          m_start(profiler ? now_ns() : 0) {}
+    ~Scope() {
+      if (m_profiler) {
+        m_profiler->record(m_stage, now_ns() - m_start, m_samples);
+      }
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    StageProfiler *const m_profiler;
+    const Stage m_stage;
+    const std::size_t m_samples;
+    const std::uint64_t m_start;
+  };
+
+  // Construct profiler with all counters cleared.
+  StageProfiler();
+
+  // Record a duration of a stage processing the given number of samples.
+  void record(Stage stage, std::uint64_t ns, std::size_t samples);
+
+  // Copy the counters into snapshot, to be read by another thread.
+  void copy_to(StageProfiler &snapshot) const;
+
+  // Return the current snapshot as a JSON object string.
+  std::string to_json() const;
+
+  // Print a human-readable summary table.
+  void print_summary(FILE *fp) const;
+
+  // Return the name of a stage.
+  static const char *stage_name(Stage stage);
+
+  // Return the monotonic clock time in nanoseconds.
+  static std::uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+private:
+  struct StageStats {
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> total_ns;
+    std::atomic<std::uint64_t> max_ns;
+    std::atomic<std::uint64_t> samples;
+    std::array<std::atomic<std::uint64_t>, num_buckets> buckets;
+  };
+
+  // Estimate the given quantile in nanoseconds from the histogram.
+  static std::uint64_t quantile_ns(const StageStats &stats, double q);
+
+  std::array<StageStats, num_stages> m_stats;
+};
+
+// Writer of the stage profile in a separate thread,
+// so that the DSP thread does not wait for the file output.
+// The DSP thread copies the counters by request() between blocks,
+// and the copy is written by the writer thread.
+class StageProfileWriter {
+public:
+  // Start the writer thread for the file.
+  StageProfileWriter(const std::string &filename);
+
+  // Stop the writer thread after writing the pending copy.
+  ~StageProfileWriter();
+
+  // Copy the counters of the profiler to be written.
+  // Ignored while the previous copy is being written.
+  void request(const StageProfiler &profiler);
+
+  // Write the profile as JSON to the file,
+  // and print the summary to stderr.
+  static void write(const StageProfiler &profiler,
+                    const std::string &filename);
+
+private:
+  // Writer thread body.
+  void run();
+
+  const std::string m_filename;
+  StageProfiler m_snapshot;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  bool m_pending;
+  bool m_stop;
+  std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,123 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_SYNTHETICSOURCE_H
+#define INCLUDE_SYNTHETICSOURCE_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SignalGenerator.h"
+#include "Source.h"
+
+// Synthetic signal source for testing without hardware.
+//
+// The IQ samples are generated by SignalGenerator in a dedicated thread,
+// either paced to the sample rate or as fast as the decoder can process.
+// The stations of the scene stay at the configured frequency
+// when the source is retuned, so that the band can be scanned.
+class SyntheticSource : public Source {
+public:
+  static constexpr std::uint32_t default_sample_rate = 1152000;
+  static constexpr std::uint32_t max_sample_rate = 10000000;
+  static constexpr std::uint32_t default_frequency = 82500000;
+  // Minimum block length; longer blocks of about 5 milliseconds
+  // are used for higher sample rates.
+  static constexpr int min_block_length = 2048;
+  // Carrier amplitude of the main station.
+  static constexpr double carrier_amplitude = 0.5;
+  // Maximum number of neighbor stations on each side in the band scenes.
+  static constexpr int max_band_neighbors = 4;
+  // Max queued blocks when generating faster than real time.
+  static constexpr std::size_t max_queued_blocks = 32;
+
+  // Signal scenes.
+  enum class Scene { FM, AM, USB, LSB, CW, FmBand, AmBand };
+
+  /** Constructor */
+  SyntheticSource(int dev_index);
+
+  /** Destructor */
+  virtual ~SyntheticSource() override;
+
+  /** Configure the generator and prepare for streaming. */
+  virtual bool configure(std::string configuration) override;
+
+  /** Return current sample frequency in Hz. */
+  virtual std::uint32_t get_sample_rate() override { return m_sample_rate; }
+
+  /** Return device current center frequency in Hz. */
+  virtual std::uint32_t get_frequency() override { return m_frequency; }
+
+  /** Retune the device without restarting the stream. */
+  virtual bool set_frequency(std::uint32_t frequency) override;
+
+  /** Return if device is using Low-IF. */
+  virtual bool is_low_if() override { return !m_zero_offset; }
+
+  /** Print current parameters specific to device type */
+  virtual void print_specific_parms() override;
+
+  virtual bool start(DataBuffer<IQSample> *samples,
+                     std::atomic_bool *stop_flag) override;
+  virtual bool stop() override;
+
+  /** Return true if the generator is OK, return false if there is an error. */
+  virtual operator bool() const override { return m_error.empty(); }
+
+  /** Return a list of supported devices. */
+  static void get_device_names(std::vector<std::string> &devices);
+
+  /** Return the number of samples per block. */
+  int get_block_length() const { return m_block_length; }
+
+private:
+  // Set up the carriers of the scene.
+  void setup_scene();
+
+  // Generator thread body.
+  void run();
+
+  std::uint32_t m_sample_rate;
+  // Set by the caller and applied by the generator thread.
+  std::atomic<std::uint32_t> m_frequency;
+  std::uint32_t m_scene_frequency;
+  Scene m_scene;
+  std::string m_scene_name;
+  double m_offset;
+  bool m_rds;
+  double m_snr_db;
+  double m_echo_delay_us;
+  double m_echo_gain;
+  bool m_zero_offset;
+  bool m_realtime;
+  double m_seconds;
+  unsigned int m_seed;
+  int m_block_length;
+
+  std::unique_ptr<SignalGenerator> m_generator;
+  std::atomic<std::uint64_t> m_samples_generated;
+  std::chrono::steady_clock::time_point m_start_time;
+  std::unique_ptr<std::thread> m_thread;
+};
+
+#endif /* INCLUDE_SYNTHETICSOURCE_H */
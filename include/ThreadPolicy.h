@@ -0,0 +1,92 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#ifndef INCLUDE_THREADPOLICY_H
+#define INCLUDE_THREADPOLICY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// CPU affinity and real-time priority of a thread.
+struct ThreadSetting {
+  // CPUs to run the thread on; empty for no change.
+  std::vector<int> cpus;
+  // SCHED_FIFO priority; 0 for no change.
+  int priority = 0;
+
+  // Return true if nothing is to be changed.
+  bool empty() const { return cpus.empty() && priority == 0; }
+
+  // Apply the setting to the calling thread,
+  // and report the result or the failure to stderr.
+  // Threads created later by the thread inherit the setting.
+  // Return false if any of the settings failed.
+  bool apply(const std::string &thread_name) const;
+};
+
+// Scheduling and memory locking policy of the decoder.
+//
+// The configuration string is a comma-separated list of:
+//   source_cpus=<list>     CPUs of the source thread
+//   source_priority=<n>    SCHED_FIFO priority of the source thread (1-99)
+//   dsp_cpus=<list>        CPUs of the main DSP loop
+//   dsp_priority=<n>       SCHED_FIFO priority of the main DSP loop (1-99)
+//   mlock                  lock and pre-fault the memory
+// where <list> is a colon-separated list of CPU numbers or ranges,
+// such as 2, 2:3, or 0-1:4.
+class ThreadPolicy {
+public:
+  // Size of the heap pre-faulted and kept by mlock.
+  static constexpr std::size_t heap_prefault_size = 32 << 20;
+  // Size of the stack pre-faulted by mlock.
+  static constexpr std::size_t stack_prefault_size = 512 << 10;
+
+  ThreadPolicy() : m_mlock(false) {}
+
+  // Parse the configuration string. Return false if failed.
+  bool configure(const std::string &configuration);
+
+  // Lock the current and future memory pages into RAM,
+  // and pre-fault the heap and the stack of the calling thread,
+  // so that no page fault happens in the sample loops.
+  // Do nothing if mlock is not configured.
+  // Report the result or the failure to stderr, and
+  // return false if failed.
+  bool lock_memory();
+
+  // Return the setting of the source thread.
+  const ThreadSetting &source() const { return m_source; }
+
+  // Return the setting of the main DSP loop.
+  const ThreadSetting &dsp() const { return m_dsp; }
+
+  // Return the error message of the last failure.
+  std::string error() const { return m_error; }
+
+private:
+  // Parse the CPU list. Return false if failed.
+  static bool parse_cpus(const std::string &s, std::vector<int> &cpus);
+
+  ThreadSetting m_source;
+  ThreadSetting m_dsp;
+  bool m_mlock;
+  std::string m_error;
+};
+
+#endif
@@ -115,15 +115,17 @@ inline bool parse_int(const char *s, int &v, bool allow_unit = false) {
 }
 
 // Compute RMS over the specified IQSample vector.
-inline float rms_level_sample(const IQSampleVector &samples) {
+// magnitude_sq is a work buffer owned by the caller,
+// reused to avoid allocation per call.
+inline float rms_level_sample(std::span<const IQSample> samples,
+                              volk::vector<float> &magnitude_sq) {
   unsigned int n = samples.size();
   if (n == 0) {
     return 0.0f;
   }
-  volk::vector<float> magnitude_sq;
   magnitude_sq.resize(n);
 
-  IQSample::value_type level = 0;
+  alignas(volk_result_alignment) IQSample::value_type level = 0;
 
   volk_32fc_magnitude_squared_32f(magnitude_sq.data(), samples.data(), n);
   volk_32f_accumulator_s32f(&level, magnitude_sq.data(), n);
@@ -132,10 +134,10 @@ inline float rms_level_sample(const IQSampleVector &samples) {
 }
 
 // Compute mean value and RMS over the specified Sample vector.
-inline void samples_mean_rms(const IQSampleDecodedVector &samples, float &mean,
-                             float &rms) {
-  float vsum = 0;
-  float vsumsq = 0;
+inline void samples_mean_rms(std::span<const IQSampleDecoded> samples,
+                             float &mean, float &rms) {
+  alignas(volk_result_alignment) float vsum = 0;
+  alignas(volk_result_alignment) float vsumsq = 0;
   unsigned int n = samples.size();
 
   if (n == 0) {
@@ -304,7 +306,7 @@ inline float fast_atan2f(float y, float x) {
 }
 
 // Simple linear gain adjustment.
-inline void adjust_gain(SampleVector &samples, double gain) {
+inline void adjust_gain(std::span<Sample> samples, double gain) {
   for (unsigned int i = 0, n = samples.size(); i < n; i++) {
     double amplitude = samples[i] * gain;
     samples[i] = amplitude;
@@ -0,0 +1,119 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INCLUDE_VOLKSELFTEST_H
+#define INCLUDE_VOLKSELFTEST_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <volk/volk.h>
+
+#include "SoftFM.h"
+
+// Self-test of the VOLK kernels used by the decoders.
+//
+// All implementations of each kernel are timed at the block lengths
+// of the decoders, and the fastest aligned and unaligned ones
+// are written as a volk_config file in the cache directory,
+// merged with the current VOLK configuration of the other kernels.
+// The cached file is used by setting VOLK_CONFIGPATH at startup,
+// before any VOLK kernel is called.
+class VolkSelfTest {
+public:
+  // Block length of the IF and audio kernels.
+  static constexpr unsigned int block_length = 8192;
+  // Block length of the multipath filter kernels (32 stages).
+  static constexpr unsigned int multipath_length = 32 * 4 + 1;
+  // Minimum time of a timing round in seconds.
+  static constexpr double min_round_time = 0.01;
+  // Number of timing rounds; the fastest one is taken.
+  static constexpr unsigned int rounds = 3;
+
+  // Construct self-test with the test signal buffers.
+  VolkSelfTest();
+
+  // Time all implementations of the kernels and print the results.
+  void run();
+
+  // Write the selected implementations to the cache file,
+  // and check that VOLK resolves the written file with use_cache().
+  // Return false if failed.
+  bool write_cache();
+
+  // Return the error message of the last failure.
+  std::string error() const { return m_error; }
+
+  // Set VOLK_CONFIGPATH to the cache directory,
+  // if the cache exists for the current VOLK version and machine,
+  // and VOLK_CONFIGPATH is not set by the user.
+  // Must be called before any VOLK kernel is called.
+  // Return true if the cache is used.
+  static bool use_cache();
+
+  // Print the VOLK configuration file and the implementations
+  // selected for the kernels of the decoders.
+  static void print_selection();
+
+  // Return the cache directory name, or empty string if unknown.
+  static std::string cache_dir();
+
+  // Return the directory set to VOLK_CONFIGPATH by use_cache(),
+  // or empty string if unknown.
+  static std::string cache_config_dir();
+
+  // Return the cache file name, as VOLK resolves it in
+  // cache_config_dir(), or empty string if unknown.
+  static std::string cache_file();
+
+private:
+  struct Kernel {
+    const char *name;
+    unsigned int length;
+    // Return the names and alignments of the implementations.
+    std::function<volk_func_desc_t()> describe;
+    // Call the implementation with the buffers at the offset.
+    std::function<void(const char *, unsigned int)> call;
+  };
+
+  struct Result {
+    std::string name;
+    std::string impl_a;
+    std::string impl_u;
+  };
+
+  // Return seconds per call of the implementation.
+  double time_impl(const Kernel &kernel, const char *impl,
+                   unsigned int offset);
+
+  // Return the first line of the cache file
+  // identifying the VOLK version and machine.
+  static std::string cache_header();
+
+  std::vector<Kernel> m_kernels;
+  std::vector<Result> m_results;
+  std::string m_error;
+
+  volk::vector<lv_32fc_t> m_cin1, m_cin2, m_cout;
+  volk::vector<float> m_fin1, m_fin2, m_fout;
+  volk::vector<double> m_din1, m_din2, m_dout1, m_dout2;
+  float m_fm_detect_save;
+  lv_32fc_t m_rotator_phase;
+};
+
+#endif
@@ -36,17 +36,28 @@
 #include "AirspySource.h"
 #include "AmDecode.h"
 #include "AudioOutput.h"
+#include "BatchDecoder.h"
+#include "ConfigParser.h"
+#include "ControlServer.h"
 #include "DataBuffer.h"
+#include "DecodeChain.h"
+#include "DspKernels.h"
 #include "FileSource.h"
-#include "FilterParameters.h"
 #include "FineTuner.h"
 #include "FmDecode.h"
-#include "FourthConverterIQ.h"
+#include "FourthConverterDecimatorIQ.h"
 #include "MovingAverage.h"
 #include "NbfmDecode.h"
+#include "RdsDecoder.h"
 #include "RtlSdrSource.h"
+#include "SampleFileWriter.h"
+#include "Scanner.h"
 #include "SoftFM.h"
+#include "StageProfiler.h"
+#include "SyntheticSource.h"
+#include "ThreadPolicy.h"
 #include "Utility.h"
+#include "VolkSelfTest.h"
 #include "git.h"
 
 // define this for enabling coefficient monitor functions
@@ -58,6 +69,10 @@
 // in process_signals()
 static std::atomic_bool stop_flag(false);
 
+// Flag to request writing the stage profile
+// in process_signals()
+static std::atomic_bool profile_dump_flag(false);
+
 static void usage() {
   std::string usage_string =
       "Usage: airspy-fmradion [options]\n"
@@ -75,6 +90,7 @@ static void usage() {
       "                   - airspy: Airspy R2\n"
       "                   - airspyhf: Airspy HF+\n"
       "                   - filesource: File Source\n"
+      "                   - synthetic: Synthetic signal generator\n"
       "  -q             Quiet mode\n"
       "  -c config      Comma separated key=value configuration pairs or just "
       "key for switches\n"
@@ -96,11 +112,32 @@ static void usage() {
       "                 of VBR -V 1 (experimental)\n"
       "                 use filename '-' to write to stdout\n"
 #endif // LIBSNDFILE_MP3_ENABLED
+      "  -N address     Stream audio data as S16_LE samples to socket clients\n"
+      "                 address: tcp:[host:]port or unix:path\n"
+      "                 (host: 127.0.0.1 if omitted, 0.0.0.0 for all)\n"
+      "  -O address     Stream audio data as FLOAT_LE samples to socket "
+      "clients\n"
+      "                 address: tcp:[host:]port or unix:path\n"
+      "                 (host: 127.0.0.1 if omitted, 0.0.0.0 for all)\n"
       "  -P device_num  Play audio via PortAudio device index number\n"
       "                 use string '-' to specify the default PortAudio "
       "device\n"
       "  -T filename    Write pulse-per-second timestamps\n"
       "                 use filename '-' to write to stdout\n"
+      "  -x filename    Write FM MPX (composite) signal at 384kHz\n"
+      "                 to RF64/WAV FLOAT_LE file\n"
+      "                 use filename '-' to write raw FLOAT_LE to stdout\n"
+      "  -D filename    Decode RDS/RBDS and write JSON lines\n"
+      "                 use filename '-' to write to stdout\n"
+      "  -I config      Record IQ samples, comma separated key=value pairs:\n"
+      "                   filename=<string> RF64/WAV or FLAC file name\n"
+      "                   tap=<string>      raw: device samples as received\n"
+      "                                     if: resampled IF (default)\n"
+      "                   format=<string>   S16_LE (default), FLOAT, or FLAC\n"
+      "  -p filename    Profile DSP stage timing and write JSON to the file\n"
+      "                 at exit and on SIGUSR1\n"
+      "  -j jobs        Decode a FileSource file in parallel with given jobs\n"
+      "                 (file audio outputs only, faster than real time)\n"
       "  -X             Shift pilot phase (for Quadrature Multipath Monitor)\n"
       "                 (-X is ignored under mono mode (-M))\n"
       "  -U             Set deemphasis to 75 microseconds (default: 50)\n"
@@ -110,6 +147,8 @@ static void usage() {
       "                   - default: none after conversion\n"
       "                   - medium:  +-156kHz\n"
       "                   - narrow:  +-121kHz\n"
+      "                   - auto: none, medium, or narrow selected by\n"
+      "                     the adjacent channel energy\n"
       "                 For AM:\n"
       "                   - wide: +-9kHz\n"
       "                   - default: +-6kHz\n"
@@ -121,6 +160,23 @@ static void usage() {
       "                   - medium:  +-8kHz\n"
       "                   - narrow:  +-6.25kHz\n"
       "  -l dB          Set IF squelch level to minus given value of dB\n"
+      "  --squelch-skip\n"
+      "                 Skip decoding while the IF squelch is closed,\n"
+      "                 measuring the IF level before demodulation\n"
+      "                 (requires -l, not used with -j)\n"
+      "  --scan config  Scan the channels, stopping on the channels where\n"
+      "                 the IF level is above the squelch level,\n"
+      "                 as comma-separated key=value pairs:\n"
+      "                   freqs=<list> colon-separated frequencies in Hz\n"
+      "                   dwell=<sec> time to listen to each channel\n"
+      "                     (default 0.1)\n"
+      "                   hold=<sec> time to stay after the activity ends\n"
+      "                     (default 2)\n"
+      "                 (requires -l, not used with -j)\n"
+      "  --control path Accept the control commands on the Unix domain\n"
+      "                 socket to change the volume, squelch, de-emphasis,\n"
+      "                 multipath filter and frequency, and to get the\n"
+      "                 statistics while running (not used with -j)\n"
       "  -E stages      Enable multipath filter for FM\n"
       "                 (For stable reception only:\n"
       "                  turn off if reception becomes unstable)\n"
@@ -128,6 +184,20 @@ static void usage() {
       "  -r ppm         Set IF offset in ppm (range: +-1000000ppm)\n"
       "                 (This option affects output pitch and timing:\n"
       "                  use for the output timing compensation only!)\n"
+      "  -A ppm         Enable AFC for FM and NBFM, correcting the carrier\n"
+      "                 offset up to given ppm (range: 0.1 to 1000ppm)\n"
+      "                 (not used with -j)\n"
+      "  -S config      Set CPU affinity, real-time priority and memory\n"
+      "                 locking as comma-separated key=value pairs:\n"
+      "                   source_cpus=<list> CPUs of the source thread\n"
+      "                   source_priority=<int> SCHED_FIFO priority (1-99)\n"
+      "                   dsp_cpus=<list> CPUs of the DSP loop\n"
+      "                   dsp_priority=<int> SCHED_FIFO priority (1-99)\n"
+      "                   mlock: lock and pre-fault memory\n"
+      "                 <list> is colon-separated CPUs or ranges, e.g. 0-1:4\n"
+      "  --volk-selftest\n"
+      "                 Time the VOLK kernels used by the decoders,\n"
+      "                 cache the fastest implementations, and exit\n"
       "\n"
       "Configuration options for RTL-SDR devices\n"
       "  freq=<int>     Frequency of radio station in Hz (default 100000000)\n"
@@ -175,6 +245,7 @@ static void usage() {
       "  freq=<int>        Frequency of radio station in Hz\n"
       "  srate=<int>       IF sample rate in Hz.\n"
       "  filename=<string> Source file name.\n"
+      "                    Supported containers: WAV, RF64, W64, FLAC\n"
       "                    Supported encodings: FLOAT, S24_LE, S16_LE\n"
       "  zero_offset       Set if the source file is in zero offset,\n"
       "                    which requires Fs/4 IF shifting.\n"
@@ -182,6 +253,28 @@ static void usage() {
       "  raw               Set if the file is raw binary.\n"
       "  format=<string>   Set the file format for the raw binary file.\n"
       "                    (formats: U8_LE, S8_LE, S16_LE, S24_LE, FLOAT)\n"
+      "  realtime=<int>    1: read at the sample rate (default)\n"
+      "                    0: read as fast as possible (batch decoding)\n"
+      "\n"
+      "Configuration options for Synthetic signal generator:\n"
+      "  srate=<float>     IF sample rate in Hz, up to 10000000\n"
+      "                    (default 1152000)\n"
+      "  freq=<float>      Nominal frequency of radio station in Hz\n"
+      "  scene=<string>    Signal scene (default fm):\n"
+      "                    fm: FM stereo (L: 1kHz, R: 400Hz)\n"
+      "                    am, usb, lsb: 1kHz tone, cw: 600Hz pitch\n"
+      "                    fmband, amband: multiple stations\n"
+      "  offset=<float>    Frequency offset of the station in Hz\n"
+      "  rds               Add RDS to the FM stations\n"
+      "  snr=<float>       Carrier to noise ratio in dB (default no noise)\n"
+      "  echo_delay=<float> Multipath echo delay in microseconds\n"
+      "  echo_gain=<float> Multipath echo gain from 0 to 1\n"
+      "  zero_offset       Place the station at Fs/4 as zero-IF devices\n"
+      "  realtime=<int>    1: generate at the sample rate (default)\n"
+      "                    0: generate as fast as possible\n"
+      "  seconds=<float>   Stop after the given seconds (default endless)\n"
+      "  seed=<int>        Seed of the noise generator (default 1)\n"
+      "  blklen=<int>      Set block length in samples\n"
       "\n";
 
   fmt::print(stderr, "{}", usage_string);
@@ -209,6 +302,9 @@ static bool get_device(std::vector<std::string> &devnames, DevType devtype,
   case DevType::FileSource:
     FileSource::get_device_names(devnames);
     break;
+  case DevType::Synthetic:
+    SyntheticSource::get_device_names(devnames);
+    break;
   }
 
   if (devidx < 0 || (unsigned int)devidx >= devnames.size()) {
@@ -241,6 +337,9 @@ static bool get_device(std::vector<std::string> &devnames, DevType devtype,
   case DevType::FileSource:
     up_srcsdr = std::make_unique<FileSource>(devidx);
     break;
+  case DevType::Synthetic:
+    up_srcsdr = std::make_unique<SyntheticSource>(devidx);
+    break;
   }
 
   return true;
@@ -267,6 +366,9 @@ static void *process_signals(void *arg) {
       stop_flag.store(true);
       psignal(signum, "\nStopping by getting signal");
       break;
+    case SIGUSR1:
+      profile_dump_flag.store(true);
+      break;
     default:
       psignal(signum, "\nERROR: unexpected signal");
       exit(1);
@@ -287,13 +389,26 @@ int main(int argc, char **argv) {
   bool quietmode = false;
   std::string ppsfilename;
   FILE *ppsfile = nullptr;
+  std::string mpxfilename;
+  std::string rdsfilename;
+  FILE *rdsfile = nullptr;
+  std::string iqrec_config_str;
+  std::string profilefilename;
+  int batch_jobs = 0;
+  bool volk_selftest = false;
+  std::string sched_config_str;
   bool enable_squelch = false;
+  bool squelch_skip = false;
+  std::string scan_config_str;
+  std::string control_path;
   double squelch_level_db = 150.0;
   bool pilot_shift = false;
   bool deemphasis_na = false;
   int multipathfilter_stages = 0;
   bool ifrate_offset_enable = false;
   double ifrate_offset_ppm = 0;
+  bool afc_enable = false;
+  double afc_max_ppm = 0;
   std::string config_str;
   std::string devtype_str;
   DevType devtype;
@@ -301,6 +416,7 @@ int main(int argc, char **argv) {
   ModType modtype = ModType::FM;
   std::string filtertype_str("default");
   FilterType filtertype = FilterType::Default;
+  bool filtertype_auto = false;
   std::vector<std::string> devnames;
   // Source device ownership will be transferred to thread therefore the
   // unique_ptr with move is convenient.
@@ -310,12 +426,13 @@ int main(int argc, char **argv) {
   int err;
   pthread_t sigmask_thread_id;
 
-  // Perform signal mask on SIGINT, SIGQUIT, and SIGTERM.
+  // Perform signal mask on SIGINT, SIGQUIT, SIGTERM, and SIGUSR1.
   // See APUE 3rd Figure 12.16.
   sigemptyset(&signalmask);
   sigaddset(&signalmask, SIGINT);
   sigaddset(&signalmask, SIGQUIT);
   sigaddset(&signalmask, SIGTERM);
+  sigaddset(&signalmask, SIGUSR1);
   if ((err = pthread_sigmask(SIG_BLOCK, &signalmask, &old_signalmask)) != 0) {
     fmt::println(stderr, "ERROR: can not mask signals ({})", strerror(err));
     exit(1);
@@ -345,12 +462,21 @@ int main(int argc, char **argv) {
   } else {
     fmt::println(stderr, "Git commit unknown");
   }
+  // Use the VOLK self-test result before any VOLK kernel is called.
+  VolkSelfTest::use_cache();
   fmt::println(stderr, "VOLK Version = {}.{}.{}", VOLK_VERSION_MAJOR,
                VOLK_VERSION_MINOR, VOLK_VERSION_MAINT);
+  fmt::println(stderr, "DSP kernels: {}", DspKernels::variant_name());
 #if defined(LIBSNDFILE_MP3_ENABLED)
   fmt::println(stderr, "libsndfile MP3 support enabled");
 #endif // LIBSNDFILE_MP3_ENABLED
 
+  // Values of the long options without the short option letters.
+  constexpr int opt_volk_selftest = 256;
+  constexpr int opt_squelch_skip = 257;
+  constexpr int opt_scan = 258;
+  constexpr int opt_control = 259;
+
   const struct option longopts[] = {
       {"modtype", required_argument, nullptr, 'm'},
       {"devtype", required_argument, nullptr, 't'},
@@ -362,25 +488,39 @@ int main(int argc, char **argv) {
       {"float", required_argument, nullptr, 'F'},
       {"wav", required_argument, nullptr, 'W'},
       {"wavfloat", required_argument, nullptr, 'G'},
+      {"netraw", required_argument, nullptr, 'N'},
+      {"netfloat", required_argument, nullptr, 'O'},
       {"play", required_argument, nullptr, 'P'},
       {"pps", required_argument, nullptr, 'T'},
+      {"mpx", required_argument, nullptr, 'x'},
+      {"rds", required_argument, nullptr, 'D'},
+      {"iqrecord", required_argument, nullptr, 'I'},
+      {"profile", required_argument, nullptr, 'p'},
+      {"jobs", required_argument, nullptr, 'j'},
       {"pilotshift", no_argument, nullptr, 'X'},
       {"usa", no_argument, nullptr, 'U'},
       {"filtertype", required_argument, nullptr, 'f'},
       {"squelch", required_argument, nullptr, 'l'},
+      {"squelch-skip", no_argument, nullptr, opt_squelch_skip},
+      {"scan", required_argument, nullptr, opt_scan},
+      {"control", required_argument, nullptr, opt_control},
       {"multipathfilter", required_argument, nullptr, 'E'},
       {"ifrateppm", required_argument, nullptr, 'r'},
+      {"afc", required_argument, nullptr, 'A'},
+      {"sched", required_argument, nullptr, 'S'},
 #if defined(LIBSNDFILE_MP3_ENABLED)
       {"mp3fmaudio", required_argument, nullptr, 'C'},
 #endif // LIBSNDFILE_MP3_ENABLED
+      {"volk-selftest", no_argument, nullptr, opt_volk_selftest},
       {nullptr, no_argument, nullptr, 0}};
 
   int c, longindex;
 
 #if defined(LIBSNDFILE_MP3_ENABLED)
-  const char *optstring = "m:t:c:d:MR:F:W:G:f:l:P:T:qXUE:r:C:";
+  const char *optstring =
+      "m:t:c:d:MR:F:W:G:N:O:f:l:P:T:x:D:I:p:j:qXUE:r:A:S:C:";
 #else  // !LIBSNDFILE_MP3_ENABLED
-  const char *optstring = "m:t:c:d:MR:F:W:G:f:l:P:T:qXUE:r:";
+  const char *optstring = "m:t:c:d:MR:F:W:G:N:O:f:l:P:T:x:D:I:p:j:qXUE:r:A:S:";
 #endif // LIBSNDFILE_MP3_ENABLED
 
   while ((c = getopt_long(argc, argv, optstring, longopts, &longindex)) >= 0) {
@@ -418,6 +558,14 @@ int main(int argc, char **argv) {
       outmode = OutputMode::WAV_FLOAT32;
       filename = optarg;
       break;
+    case 'N':
+      outmode = OutputMode::NET_INT16;
+      filename = optarg;
+      break;
+    case 'O':
+      outmode = OutputMode::NET_FLOAT32;
+      filename = optarg;
+      break;
     case 'f':
       filtertype_str.assign(optarg);
       break;
@@ -440,6 +588,24 @@ int main(int argc, char **argv) {
     case 'T':
       ppsfilename = optarg;
       break;
+    case 'x':
+      mpxfilename = optarg;
+      break;
+    case 'D':
+      rdsfilename = optarg;
+      break;
+    case 'I':
+      iqrec_config_str.assign(optarg);
+      break;
+    case 'p':
+      profilefilename.assign(optarg);
+      break;
+    case 'j':
+      if (!Utility::parse_int(optarg, batch_jobs) || batch_jobs < 1 ||
+          batch_jobs > 256) {
+        badarg("-j");
+      }
+      break;
     case 'q':
       quietmode = true;
       break;
@@ -462,12 +628,34 @@ int main(int argc, char **argv) {
         badarg("-r");
       }
       break;
+    case 'A':
+      afc_enable = true;
+      if (!Utility::parse_dbl(optarg, afc_max_ppm) || afc_max_ppm < 0.1 ||
+          afc_max_ppm > 1000.0) {
+        badarg("-A");
+      }
+      break;
+    case 'S':
+      sched_config_str.assign(optarg);
+      break;
 #if defined(LIBSNDFILE_MP3_ENABLED)
     case 'C':
       outmode = OutputMode::MP3_FMAUDIO;
       filename = optarg;
       break;
 #endif // LIBSNDFILE_MP3_ENABLED
+    case opt_volk_selftest:
+      volk_selftest = true;
+      break;
+    case opt_squelch_skip:
+      squelch_skip = true;
+      break;
+    case opt_scan:
+      scan_config_str.assign(optarg);
+      break;
+    case opt_control:
+      control_path.assign(optarg);
+      break;
     default:
       usage();
       fmt::println(stderr, "ERROR: Invalid command line options");
@@ -481,6 +669,43 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
+  if (volk_selftest) {
+    VolkSelfTest selftest;
+    selftest.run();
+    if (!selftest.write_cache()) {
+      fmt::println(stderr, "ERROR: VOLK self-test: {}", selftest.error());
+      exit(1);
+    }
+    exit(0);
+  }
+  VolkSelfTest::print_selection();
+
+  // Lock the memory before allocating the buffers.
+  ThreadPolicy thread_policy;
+  if (!thread_policy.configure(sched_config_str)) {
+    fmt::println(stderr, "ERROR: -S: {}", thread_policy.error());
+    exit(1);
+  }
+  thread_policy.lock_memory();
+
+  if (squelch_skip && !enable_squelch) {
+    fmt::println(stderr, "ERROR: --squelch-skip requires -l");
+    exit(1);
+  }
+
+  std::unique_ptr<Scanner> scanner;
+  if (!scan_config_str.empty()) {
+    if (!enable_squelch) {
+      fmt::println(stderr, "ERROR: --scan requires -l");
+      exit(1);
+    }
+    scanner = std::make_unique<Scanner>();
+    if (!scanner->configure(scan_config_str)) {
+      fmt::println(stderr, "ERROR: --scan: {}", scanner->error());
+      exit(1);
+    }
+  }
+
   double squelch_level;
   if (enable_squelch) {
     squelch_level = pow(10.0, -(squelch_level_db / 20.0));
@@ -496,11 +721,14 @@ int main(int argc, char **argv) {
     devtype = DevType::AirspyHF;
   } else if (strcasecmp(devtype_str.c_str(), "filesource") == 0) {
     devtype = DevType::FileSource;
+  } else if (strcasecmp(devtype_str.c_str(), "synthetic") == 0) {
+    devtype = DevType::Synthetic;
   } else {
     fmt::println(
         stderr,
         "ERROR: wrong device type (-t option) must be one of the following:");
-    fmt::println(stderr, "        rtlsdr, airspy, airspyhf, filesource");
+    fmt::println(stderr,
+                 "        rtlsdr, airspy, airspyhf, filesource, synthetic");
     exit(1);
   }
 
@@ -540,11 +768,89 @@ int main(int argc, char **argv) {
     filtertype = FilterType::Narrow;
   } else if (strcasecmp(filtertype_str.c_str(), "wide") == 0) {
     filtertype = FilterType::Wide;
+  } else if (strcasecmp(filtertype_str.c_str(), "auto") == 0) {
+    // Start without the filter.
+    filtertype = FilterType::Default;
+    filtertype_auto = true;
   } else {
     fmt::println(stderr, "Filter type string unsuppored");
     exit(1);
   }
 
+  // Check the batch decoding restrictions.
+  if (batch_jobs > 0) {
+    if (devtype != DevType::FileSource) {
+      fmt::println(stderr, "ERROR: -j is available for filesource only");
+      exit(1);
+    }
+    if (outmode == OutputMode::PORTAUDIO) {
+      fmt::println(stderr, "ERROR: -j can not be used with -P");
+      exit(1);
+    }
+    if (ifrate_offset_enable) {
+      fmt::println(stderr, "ERROR: -j can not be used with -r");
+      exit(1);
+    }
+    if (filtertype_auto) {
+      fmt::println(stderr, "ERROR: -j can not be used with -f auto");
+      exit(1);
+    }
+    if (afc_enable) {
+      fmt::println(stderr, "ERROR: -j can not be used with -A");
+      exit(1);
+    }
+    if (squelch_skip || scanner || !control_path.empty()) {
+      fmt::println(stderr, "ERROR: -j can not be used with --squelch-skip, "
+                           "--scan, or --control");
+      exit(1);
+    }
+    if (!ppsfilename.empty() || !mpxfilename.empty() ||
+        !rdsfilename.empty() || !iqrec_config_str.empty() ||
+        !profilefilename.empty()) {
+      fmt::println(stderr,
+                   "ERROR: -j can not be used with -T, -x, -D, -I, or -p");
+      exit(1);
+    }
+  }
+
+  // Parse IQ recorder configuration.
+  std::string iqrec_filename;
+  bool iqrec_tap_raw = false;
+  int iqrec_format = SF_FORMAT_RF64 | SF_FORMAT_PCM_16 | SF_ENDIAN_LITTLE;
+  if (!iqrec_config_str.empty()) {
+    ConfigParser cp;
+    ConfigParser::map_type m;
+    cp.parse_config_string(iqrec_config_str, m);
+    for (const auto &pair : m) {
+      if (pair.first == "filename") {
+        iqrec_filename = pair.second;
+      } else if (pair.first == "tap") {
+        if (pair.second == "raw") {
+          iqrec_tap_raw = true;
+        } else if (pair.second == "if") {
+          iqrec_tap_raw = false;
+        } else {
+          badarg("-I tap");
+        }
+      } else if (pair.first == "format") {
+        if (pair.second == "S16_LE") {
+          iqrec_format = SF_FORMAT_RF64 | SF_FORMAT_PCM_16 | SF_ENDIAN_LITTLE;
+        } else if (pair.second == "FLOAT") {
+          iqrec_format = SF_FORMAT_RF64 | SF_FORMAT_FLOAT | SF_ENDIAN_LITTLE;
+        } else if (pair.second == "FLAC") {
+          iqrec_format = SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+        } else {
+          badarg("-I format");
+        }
+      } else {
+        badarg("-I");
+      }
+    }
+    if (iqrec_filename.empty() || iqrec_filename == "-") {
+      badarg("-I filename");
+    }
+  }
+
   // Open PPS file.
   if (!ppsfilename.empty()) {
     if (ppsfilename == "-") {
@@ -585,6 +891,52 @@ int main(int argc, char **argv) {
     fflush(ppsfile);
   }
 
+  // Open MPX output file.
+  std::unique_ptr<SampleFileWriter> mpx_writer;
+  if (!mpxfilename.empty()) {
+    if (modtype != ModType::FM) {
+      fmt::println(stderr, "MPX output is available for FM only, ignored");
+    } else {
+      bool mpx_stdout = (mpxfilename == "-");
+      mpx_writer = std::make_unique<SampleFileWriter>(
+          mpxfilename, static_cast<unsigned int>(FmDecoder::sample_rate_if),
+          1,
+          mpx_stdout ? (SF_FORMAT_RAW | SF_FORMAT_FLOAT | SF_ENDIAN_LITTLE)
+                     : (SF_FORMAT_RF64 | SF_FORMAT_FLOAT | SF_ENDIAN_LITTLE));
+      if (!(*mpx_writer)) {
+        fmt::println(stderr, "ERROR: MPX output: {}", mpx_writer->error());
+        exit(1);
+      }
+      fmt::println(stderr, "writing {} float32 MPX samples to '{}'",
+                   mpx_stdout ? "raw" : "RF64/WAV", mpxfilename);
+    }
+  }
+
+  // Open RDS output file.
+  if (!rdsfilename.empty()) {
+    if (modtype != ModType::FM) {
+      fmt::println(stderr, "RDS decoding is available for FM only, ignored");
+    } else if (rdsfilename == "-") {
+      fmt::println(stderr, "writing RDS data to stdout");
+      rdsfile = stdout;
+    } else {
+      fmt::println(stderr, "writing RDS data to '{}'", rdsfilename);
+      int rds_fd =
+          open(rdsfilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+      if (rds_fd < 0) {
+        fmt::println(stderr, "ERROR: can not open '{}' ({})", rdsfilename,
+                     strerror(errno));
+        exit(1);
+      }
+      rdsfile = fdopen(rds_fd, "w");
+      if (rdsfile == nullptr) {
+        fmt::println(stderr, "ERROR: can not open '{}' ({})", rdsfilename,
+                     strerror(errno));
+        exit(1);
+      }
+    }
+  }
+
   // Prepare output writer.
   std::unique_ptr<AudioOutput> audio_output;
 
@@ -632,6 +984,22 @@ int main(int argc, char **argv) {
     }
     fmt::println(stderr, "name '{}'", audio_output->get_device_name());
     break;
+  case OutputMode::NET_INT16:
+    audio_output =
+        std::make_unique<NetworkOutput>(filename, pcmrate, stereo, false);
+    fmt::println(stderr,
+                 "streaming 16-bit integer little-endian audio samples to "
+                 "clients of '{}'",
+                 filename);
+    break;
+  case OutputMode::NET_FLOAT32:
+    audio_output =
+        std::make_unique<NetworkOutput>(filename, pcmrate, stereo, true);
+    fmt::println(stderr,
+                 "streaming 32-bit float little-endian audio samples to "
+                 "clients of '{}'",
+                 filename);
+    break;
 #if defined(LIBSNDFILE_MP3_ENABLED)
   case OutputMode::MP3_FMAUDIO:
     audio_output = std::make_unique<SndfileOutput>(
@@ -676,7 +1044,6 @@ int main(int argc, char **argv) {
 
   bool enable_fs_fourth_downconverter = !(up_srcsdr->is_low_if());
 
-  bool enable_downsampling = true;
   double if_decimation_ratio = 1.0;
   double fm_target_rate = FmDecoder::sample_rate_if;
   double am_target_rate = AmDecoder::internal_rate_pcm;
@@ -697,6 +1064,10 @@ int main(int argc, char **argv) {
   case DevType::FileSource:
     if_blocksize = 2048;
     break;
+  case DevType::Synthetic:
+    if_blocksize = static_cast<unsigned int>(
+        static_cast<SyntheticSource &>(*up_srcsdr).get_block_length());
+    break;
   }
 
   // Status refresh rate.
@@ -733,6 +1104,9 @@ int main(int argc, char **argv) {
   if (enable_squelch) {
     fmt::println(stderr, "IF Squelch level: {:.9g} [dB]",
                  20 * log10(squelch_level));
+    if (squelch_skip) {
+      fmt::println(stderr, "IF Squelch skips decoding when closed");
+    }
   }
 
   double demodulator_rate = ifrate / if_decimation_ratio;
@@ -745,19 +1119,59 @@ int main(int argc, char **argv) {
                  ifrate_offset_ppm);
   }
 
+  // Halve the sample rate with the Fs/4 downconverter
+  // before the IF resampler if the rate is high enough.
+  const bool enable_fs_fourth_decimator =
+      enable_fs_fourth_downconverter &&
+      FourthConverterDecimatorIQ::usable(ifrate, demodulator_rate);
+
   // Display filter configuration.
   fmt::print(stderr, "IF sample rate: {:.9g} [Hz], ", ifrate);
   fmt::println(stderr, "IF decimation: / {:.9g}", if_decimation_ratio);
+  if (enable_fs_fourth_decimator) {
+    fmt::println(stderr, "Fs/4 downconverter with half-band decimation: / 2");
+  }
   fmt::print(stderr, "Demodulator rate: {:.8g} [Hz], ", demodulator_rate);
   fmt::println(stderr, "audio decimation: / {:.9g}", audio_decimation_ratio);
 
   up_srcsdr->print_specific_parms();
 
+  // Open IQ recorder.
+  std::unique_ptr<SampleFileWriter> iq_writer;
+  if (!iqrec_filename.empty()) {
+    unsigned int iqrec_rate = static_cast<unsigned int>(
+        iqrec_tap_raw ? up_srcsdr->get_sample_rate() : demodulator_rate);
+    // FLAC only supports the sample rate up to 655350Hz.
+    if (((iqrec_format & SF_FORMAT_TYPEMASK) == SF_FORMAT_FLAC) &&
+        (iqrec_rate > 655350)) {
+      fmt::println(stderr,
+                   "ERROR: IQ recorder: FLAC does not support {} [Hz], "
+                   "use tap=if or format=S16_LE",
+                   iqrec_rate);
+      exit(1);
+    }
+    iq_writer = std::make_unique<SampleFileWriter>(iqrec_filename, iqrec_rate,
+                                                   2, iqrec_format);
+    if (!(*iq_writer)) {
+      fmt::println(stderr, "ERROR: IQ recorder: {}", iq_writer->error());
+      exit(1);
+    }
+    fmt::println(stderr, "recording {} IQ samples at {} [Hz] to '{}'",
+                 iqrec_tap_raw ? "raw" : "IF", iqrec_rate, iqrec_filename);
+    if (iqrec_tap_raw && enable_fs_fourth_downconverter) {
+      fmt::println(stderr, "(use zero_offset of FileSource to play back)");
+    }
+  }
+
   // Create source data queue.
   DataBuffer<IQSample> source_buffer;
 
   // Start reading from device in separate thread.
-  up_srcsdr->start(&source_buffer, &stop_flag);
+  // The batch decoder reads the file by itself.
+  if (batch_jobs == 0) {
+    up_srcsdr->set_thread_setting(thread_policy.source());
+    up_srcsdr->start(&source_buffer, &stop_flag);
+  }
 
   // Reported by GitHub @bstalk: (!up_srcadr) doesn't work for gcc of Debian.
   if (!(*up_srcsdr)) {
@@ -769,65 +1183,25 @@ int main(int argc, char **argv) {
   double deemphasis = deemphasis_na ? FmDecoder::deemphasis_time_na
                                     : FmDecoder::deemphasis_time_eu;
 
-  // Prepare Fs/4 downconverter.
-  FourthConverterIQ fourth_downconverter(false);
-
-  IfResampler if_resampler(ifrate,          // input_rate
-                           demodulator_rate // output_rate
-  );
-  enable_downsampling = (ifrate != demodulator_rate);
-
-  IQSampleCoeff amfilter_coeff;
-  bool fmfilter_enable;
-  IQSampleCoeff fmfilter_coeff;
-  IQSampleCoeff nbfmfilter_coeff;
-
-  switch (filtertype) {
-  case FilterType::Default:
-    amfilter_coeff = FilterParameters::jj1bdx_am_48khz_default;
-    fmfilter_enable = false;
-    fmfilter_coeff = FilterParameters::delay_3taps_only_iq;
-    nbfmfilter_coeff = FilterParameters::jj1bdx_nbfm_48khz_default;
-    break;
-  case FilterType::Medium:
-    amfilter_coeff = FilterParameters::jj1bdx_am_48khz_medium;
-    fmfilter_enable = true;
-    fmfilter_coeff = FilterParameters::jj1bdx_fm_384kHz_medium;
-    nbfmfilter_coeff = FilterParameters::jj1bdx_nbfm_48khz_medium;
-    break;
-  case FilterType::Narrow:
-    amfilter_coeff = FilterParameters::jj1bdx_am_48khz_narrow;
-    fmfilter_enable = true;
-    fmfilter_coeff = FilterParameters::jj1bdx_fm_384kHz_narrow;
-    nbfmfilter_coeff = FilterParameters::jj1bdx_nbfm_48khz_narrow;
-    break;
-  case FilterType::Wide:
-    amfilter_coeff = FilterParameters::jj1bdx_am_48khz_wide;
-    fmfilter_enable = false;
-    fmfilter_coeff = FilterParameters::delay_3taps_only_iq;
-    nbfmfilter_coeff = FilterParameters::jj1bdx_nbfm_48khz_wide;
-    break;
-  }
-
-  // Prepare AM decoder.
-  AmDecoder am(amfilter_coeff, // amfilter_coeff
-               modtype         // mode
-  );
-
-  // Prepare FM decoder.
-  FmDecoder fm(fmfilter_enable, // fmfilter_enable
-               fmfilter_coeff,  // fmfilter_coeff
-               stereo,          // stereo
-               deemphasis,      // deemphasis,
-               pilot_shift,     // pilot_shift
-               static_cast<unsigned int>(multipathfilter_stages)
-               // multipath_stages
-  );
-
-  // Prepare narrow band FM decoder.
-  NbfmDecoder nbfm(nbfmfilter_coeff,            // nbfmfilter_coeff
-                   NbfmDecoder::freq_dev_normal // freq_dev
-  );
+  // Parameters of the decoding chain.
+  // The IF level is measured before the decoder with the scanner,
+  // and used for both skipping and muting.
+  DecodeChain::Parameters chain_params = {
+      .modtype = modtype,
+      .stereo = stereo,
+      .pilot_shift = pilot_shift,
+      .deemphasis = deemphasis,
+      .multipath_stages = static_cast<unsigned int>(multipathfilter_stages),
+      .filtertype = filtertype,
+      .filtertype_auto = filtertype_auto,
+      .fs_fourth_downconverter = enable_fs_fourth_downconverter,
+      .if_rate = ifrate,
+      .demodulator_rate = demodulator_rate,
+      .squelch_level = squelch_level,
+      .squelch_skip = squelch_skip,
+      .squelch_gate = scanner != nullptr,
+      .afc_max_ppm = afc_enable ? afc_max_ppm : 0.0,
+      .tuner_freq = tuner_freq};
 
   // Initialize moving average object for FM ppm monitoring.
   switch (modtype) {
@@ -858,9 +1232,98 @@ int main(int argc, char **argv) {
   }
   fmt::println(stderr, "Filter type: {}", filtertype_str);
 
-  // Initialize moving average object for FM ppm monitoring.
-  const unsigned int ppm_average_stages = 100;
-  MovingAverage<float> ppm_average(ppm_average_stages, 0.0f);
+  // Decode the file in parallel and exit.
+  if (batch_jobs > 0) {
+    BatchDecoder::Parameters batch_params = {
+        .chain = chain_params,
+        .jobs = static_cast<unsigned int>(batch_jobs),
+        .quiet = quietmode};
+    BatchDecoder batch(static_cast<FileSource &>(*up_srcsdr), batch_params);
+    fmt::println(stderr,
+                 "batch decoding: {} jobs, {} segments, warm-up {:.2f} [s]",
+                 batch_jobs, batch.get_segments(), batch.get_warmup_seconds());
+    bool batch_ok = batch.run(*audio_output, stop_flag);
+    if (!batch) {
+      fmt::println(stderr, "ERROR: batch decoding: {}", batch.error());
+    }
+    audio_output->output_close();
+    fmt::println(stderr, "airspy-fmradion terminated");
+    exit(batch_ok ? 0 : 1);
+  }
+
+  // Prepare the decoding chain.
+  DecodeChain chain(chain_params);
+  if (afc_enable) {
+    if (modtype == ModType::FM || modtype == ModType::NBFM) {
+      fmt::println(stderr, "AFC enabled, range: +-{:.9g} [ppm]", afc_max_ppm);
+    } else {
+      fmt::println(stderr, "AFC is ignored except for FM and NBFM");
+    }
+  }
+  if (filtertype_auto && modtype != ModType::FM) {
+    fmt::println(stderr, "Filter type auto is ignored except for FM");
+  }
+
+  // Prepare RDS decoder running in a separate thread.
+  std::unique_ptr<RdsDecoder> rds_decoder;
+  if (rdsfile != nullptr) {
+    chain.fm().set_rds_enabled(true);
+    rds_decoder = std::make_unique<RdsDecoder>(rdsfile, true);
+  }
+
+  // Prepare DSP stage profiler if requested.
+  // The profiler pointer stays null otherwise.
+  std::unique_ptr<StageProfiler> profiler;
+  std::unique_ptr<StageProfileWriter> profile_writer;
+  if (!profilefilename.empty()) {
+    profiler = std::make_unique<StageProfiler>();
+    profile_writer = std::make_unique<StageProfileWriter>(profilefilename);
+    chain.set_profiler(profiler.get());
+    fmt::println(stderr, "writing DSP stage profile to '{}'",
+                 profilefilename);
+  }
+
+  // Retune the source while streaming,
+  // and restart the measurement and the correction of the offset.
+  auto retune = [&](std::uint32_t frequency) {
+    if (!up_srcsdr->set_frequency(frequency)) {
+      return false;
+    }
+    tuner_freq = up_srcsdr->get_frequency();
+    chain.retuned(tuner_freq);
+    return true;
+  };
+
+  // Tune to the first channel to scan.
+  if (scanner) {
+    scanner->set_sample_rate(demodulator_rate);
+    if (!retune(scanner->get_frequency())) {
+      fmt::println(stderr, "ERROR: --scan: {}", up_srcsdr->error());
+      exit(1);
+    }
+    scanner->retuned(Utility::get_time());
+    fmt::println(stderr, "Scanning {} channels",
+                 scanner->get_frequencies().size());
+  }
+
+  // Start the control server.
+  std::unique_ptr<ControlServer> control;
+  if (!control_path.empty()) {
+    control = std::make_unique<ControlServer>();
+    // The frequency is set by the scanner with --scan,
+    // and FileSource can not be retuned.
+    bool can_retune = !scanner && devtype != DevType::FileSource;
+    if (!control->start(control_path, modtype, can_retune)) {
+      fmt::println(stderr, "ERROR: --control: {}", control->error());
+      exit(1);
+    }
+    fmt::println(stderr, "Control server listening on '{}'", control_path);
+  }
+
+  // Output gain, changed by the control server.
+  // The nominal audio volume is -6dB.
+  double volume_db = 0;
+  double output_gain = DecodeChain::nominal_gain;
 
   // Initialize moving average object for FM stereo pilot level monitoring.
   const unsigned int pilot_level_average_stages = 10;
@@ -869,15 +1332,64 @@ int main(int argc, char **argv) {
   float audio_level = 0;
   double block_time = Utility::get_time();
 
-  float if_level = 0;
+  // Segment of the source buffer, incremented by retuning.
+  std::uint64_t source_segment = 0;
 
   PilotState pilot_status = PilotState::NotDetected;
 
+  // Sample buffers of the main processing loop.
+  // These are kept out of the loop and reused for each block,
+  // so that no allocation is made after the first blocks.
+  IQSampleVector iqsamples;
+  SampleVector audiosamples;
+  IQSampleDecodedVector audiosamples_float;
+
+  // Applied after starting the other threads,
+  // which would otherwise inherit the setting.
+  thread_policy.dsp().apply("DSP");
+
   ///////////////////////////////////////
   // NOTE: main processing loop from here
   ///////////////////////////////////////
   for (uint64_t block = 0; !stop_flag.load(); block++) {
 
+    // Apply the commands of the control server between blocks.
+    ControlServer::Command command;
+    while (control && control->pop(command)) {
+      switch (command.parameter) {
+      case ControlServer::Parameter::Volume:
+        volume_db = command.value;
+        output_gain =
+            DecodeChain::nominal_gain * pow(10.0, volume_db / 20.0);
+        break;
+      case ControlServer::Parameter::Squelch:
+        enable_squelch = (command.value >= 0);
+        squelch_level_db = enable_squelch ? command.value : 150.0;
+        squelch_level =
+            enable_squelch ? pow(10.0, -(squelch_level_db / 20.0)) : 0;
+        chain.set_squelch_level(squelch_level);
+        break;
+      // The commands for FM only and the frequency are checked
+      // by the control server.
+      case ControlServer::Parameter::Deemphasis:
+        chain.fm().set_deemphasis(command.value);
+        break;
+      case ControlServer::Parameter::Multipath:
+        multipathfilter_stages = static_cast<int>(command.value);
+        chain.fm().set_multipath_stages(multipathfilter_stages);
+        break;
+      case ControlServer::Parameter::Frequency:
+        if (!retune(static_cast<std::uint32_t>(command.value))) {
+          fmt::println(stderr, "\nERROR: control: {}", up_srcsdr->error());
+        }
+        break;
+      case ControlServer::Parameter::Filter:
+        // The filter type set by the command overrides -f auto.
+        chain.set_filtertype(command.filtertype);
+        break;
+      }
+    }
+
     // If the end has been reached at the source buffer,
     // exit the main processing loop.
     if (source_buffer.pull_end_reached()) {
@@ -885,15 +1397,10 @@ int main(int argc, char **argv) {
       break;
     }
 
-    // Pull next block from source buffer.
-    IQSampleVector iqsamples = source_buffer.pull();
-
-    IQSampleVector if_shifted_samples;
-    IQSampleVector if_downsampled_samples;
-    IQSampleVector if_samples;
-
-    // Initialize audio samples
-    SampleVector audiosamples(0);
+    // Give the previous block back to the source for reuse,
+    // and pull next block from source buffer.
+    source_buffer.recycle(std::move(iqsamples));
+    iqsamples = source_buffer.pull(source_segment);
 
     // If no IF data is sent,
     // go back and wait again
@@ -905,75 +1412,83 @@ int main(int argc, char **argv) {
     double prev_block_time = block_time;
     block_time = Utility::get_time();
 
-    // Fine tuning is not needed
-    // so long as the stability of the receiver device is
-    // within the range of +- 1ppm (~100Hz or less).
-
-    if (enable_fs_fourth_downconverter) {
-      // Fs/4 downconvering is required
-      // to avoid frequency zero offset
-      // because Airspy HF+ and RTL-SDR are Zero IF receivers
-      fourth_downconverter.process(iqsamples, if_shifted_samples);
-    } else {
-      if_shifted_samples = std::move(iqsamples);
-    }
-
-    // Downsample IF for the decoder.
-    if (enable_downsampling) {
-      if_resampler.process(if_shifted_samples, if_samples);
-    } else {
-      if_samples = std::move(if_shifted_samples);
+    // Record raw IQ samples.
+    if (iq_writer && iqrec_tap_raw) {
+      iq_writer->push(iqsamples);
     }
 
-    // Downsample IF for the decoder.
-    size_t if_samples_size = if_samples.size();
-    bool if_exists = if_samples_size > 0;
-    double if_rms = 0.0;
-
-    if (!if_exists) {
+    // Convert to the IF samples for the decoder.
+    if (!chain.convert(iqsamples)) {
       // go to the end of the for loop
       continue;
     }
 
-    // Valid data exists in if_samples
+    // Valid data exists in the IF samples
     // from here in the for loop
 
-    if (modtype == ModType::FM) {
-      // the minus factor is to show the ppm correction
-      // to make and not the one which has already been made
-      ppm_average.feed((fm.get_tuning_offset() / tuner_freq) * -1.0e6);
-    } else if (modtype == ModType::NBFM) {
-      ppm_average.feed((nbfm.get_tuning_offset() / tuner_freq) * -1.0e6);
+    // Record resampled IF samples.
+    if (iq_writer && !iqrec_tap_raw) {
+      iq_writer->push(chain.get_if_samples());
     }
 
-    // Add 1e-9 to log10() to prevent generating NaN
-    float if_level_db = 20 * log10(if_level + 1e-9);
+    // Measure IF level before demodulation for the squelch,
+    // so that the decoder can be skipped while the squelch is closed.
+    bool decode_block = chain.gate();
+
+    // Skip decoding while the scanner is not on an active channel,
+    // and retune to the next channel when the scanner moves on.
+    if (scanner) {
+      switch (scanner->feed(source_segment, chain.get_if_samples().size(),
+                            chain.squelch_open())) {
+      case Scanner::Action::Skip:
+        decode_block = false;
+        break;
+      case Scanner::Action::Decode:
+        break;
+      case Scanner::Action::Retune:
+        decode_block = false;
+        if (!retune(scanner->next())) {
+          fmt::println(stderr, "\nERROR: --scan: {}", up_srcsdr->error());
+          stop_flag.store(true);
+          continue;
+        }
+        scanner->retuned(Utility::get_time());
+        break;
+      }
+    }
 
-    // Decode signal from if_samples.
-    switch (modtype) {
-    case ModType::FM:
-      // Decode FM signal.
-      fm.process(if_samples, audiosamples);
-      if_rms = fm.get_if_rms();
-      break;
-    case ModType::NBFM:
-      // Decode narrow band FM signal.
-      nbfm.process(if_samples, audiosamples);
-      if_rms = nbfm.get_if_rms();
-      break;
-    case ModType::AM:
-    case ModType::DSB:
-    case ModType::USB:
-    case ModType::LSB:
-    case ModType::CW:
-    case ModType::WSPR:
-      // Decode AM/DSB/USB/LSB/CW signals.
-      am.process(if_samples, audiosamples);
-      if_rms = am.get_if_rms();
-      break;
+    // Add 1e-9 to log10() to prevent generating NaN
+    float if_level_db = 20 * log10(chain.get_if_level() + 1e-9);
+
+    // Decode signal from the IF samples,
+    // or skip decoding while the squelch is closed.
+    chain.decode(decode_block, audiosamples);
+    if (chain.afc_updated()) {
+      fmt::println(stderr, "\nAFC correction: {:+.3f} [ppm]",
+                   chain.get_afc_correction_ppm());
+    }
+    if (chain.filter_selected()) {
+      FilterType type = chain.get_selected_filtertype();
+      fmt::println(stderr, "\nIF filter: {} (adjacent channel: {:.1f} [dB])",
+                   (type == FilterType::Narrow)   ? "narrow"
+                   : (type == FilterType::Medium) ? "medium"
+                                                  : "none",
+                   chain.get_adjacent_level());
+    }
+    if (decode_block && modtype == ModType::FM) {
+      // Hand over the MPX samples to the writer thread.
+      if (mpx_writer) {
+        IQSampleDecodedVector mpx_samples = mpx_writer->get_spare();
+        chain.fm().swap_mpx_samples(mpx_samples);
+        mpx_writer->push(std::move(mpx_samples));
+      }
+      // Hand over the 57kHz-mixed samples to the RDS decoder.
+      if (rds_decoder) {
+        IQSampleVector rds_samples = rds_decoder->get_spare();
+        chain.fm().swap_rds_samples(rds_samples);
+        rds_decoder->feed(std::move(rds_samples));
+      }
     }
-    // Measure (unsigned int)the average IF level.
-    if_level = 0.75 * if_level + 0.25 * if_rms;
 
     size_t audiosamples_size = audiosamples.size();
     bool audio_exists = audiosamples_size > 0;
@@ -988,18 +1503,56 @@ int main(int argc, char **argv) {
 
     // Measure audio level
     float audio_mean, audio_rms;
-    IQSampleDecodedVector audiosamples_float;
     audiosamples_float.resize(audiosamples_size);
     volk_64f_convert_32f(audiosamples_float.data(), audiosamples.data(),
                          audiosamples_size);
     Utility::samples_mean_rms(audiosamples_float, audio_mean, audio_rms);
     audio_level = 0.95 * audio_level + 0.05 * audio_rms;
 
-    // Set nominal audio volume (-6dB) when IF squelch is open,
+    // Set the output volume (nominal: -6dB) when IF squelch is open,
     // set to zero volume if the squelch is closed.
-    Utility::adjust_gain(audiosamples, if_rms >= squelch_level ? 0.5 : 0.0);
+    Utility::adjust_gain(audiosamples,
+                         chain.squelch_open() ? output_gain : 0.0);
     // Write samples to output.
-    audio_output->write(std::move(audiosamples));
+    {
+      StageProfiler::Scope scope(profiler.get(),
+                                 StageProfiler::Stage::OutputWrite,
+                                 audiosamples_size);
+      audio_output->write(audiosamples);
+    }
+
+    // Report the latency from retuning to the audio of the channel.
+    if (scanner && scanner->audio_pending() && decode_block &&
+        chain.squelch_open()) {
+      double latency = scanner->audio_started(Utility::get_time());
+      fmt::println(stderr,
+                   "\nScanner: {:.7g} [MHz] active, "
+                   "retune-to-audio latency {:.1f} [ms]",
+                   scanner->get_frequency() * 1.0e-6, latency * 1.0e3);
+    }
+
+    // Publish the statistics for the control server.
+    if (control) {
+      ControlServer::Stats &stats = control->stats();
+      stats.block.store(block);
+      stats.frequency.store(up_srcsdr->get_configured_frequency());
+      stats.if_level_db.store(if_level_db);
+      stats.audio_level_db.store(20 * log10(audio_level + 1e-9) + 3.01);
+      stats.ppm.store(chain.get_ppm());
+      stats.stereo.store(modtype == ModType::FM &&
+                         chain.fm().stereo_detected());
+      stats.pilot_level.store(
+          modtype == ModType::FM ? chain.fm().get_pilot_level() : 0.0);
+      stats.squelch_open.store(chain.squelch_open());
+      stats.volume_db.store(volume_db);
+      stats.squelch_db.store(enable_squelch ? squelch_level_db : -1.0);
+    }
+
+    // Write the stage profile in the writer thread
+    // if requested by SIGUSR1.
+    if (profiler && profile_dump_flag.exchange(false)) {
+      profile_writer->request(*profiler);
+    }
 
     // Show status messages for each block if not in quiet mode.
     if (!quietmode) {
@@ -1007,9 +1560,9 @@ int main(int argc, char **argv) {
         // Stereo detection display
         // Use a state machine here
         if (modtype == ModType::FM) {
-          float pilot_level = fm.get_pilot_level();
+          float pilot_level = chain.fm().get_pilot_level();
           pilot_level_average.feed(pilot_level);
-          bool stereo_status = fm.stereo_detected();
+          bool stereo_status = chain.fm().stereo_detected();
           switch (pilot_status) {
           case PilotState::NotDetected:
             if (stereo_status) {
@@ -1035,14 +1588,14 @@ int main(int argc, char **argv) {
           fmt::print(stderr,
                      "\rblk={:11}:ppm={:+7.3f}:IF={:+6.1f}dB:AF={:+6.1f}dB:"
                      "Pilot= {:8.6f}",
-                     block, ppm_average.average(), if_level_db, audio_level_db,
+                     block, chain.get_ppm(), if_level_db, audio_level_db,
                      pilot_level_average.average());
           fflush(stderr);
           break;
         case ModType::NBFM:
           fmt::print(stderr,
                      "\rblk={:11}:ppm={:+7.3f}:IF={:+6.1f}dB:AF={:+6.1f}dB",
-                     block, ppm_average.average(), if_level_db, audio_level_db);
+                     block, chain.get_ppm(), if_level_db, audio_level_db);
           fflush(stderr);
           break;
         case ModType::AM:
@@ -1054,7 +1607,7 @@ int main(int argc, char **argv) {
           // Show statistics without ppm offset.
           // Add 1e-9 to log10() to prevent generating NaN
           double if_agc_gain_db =
-              20 * log10(am.get_if_agc_current_gain() + 1e-9);
+              20 * log10(chain.am().get_if_agc_current_gain() + 1e-9);
           fmt::print(stderr,
                      "\rblk={:11}:IF={:+6.1f}dB:AGC={:+6.1f}dB:AF={:+6.1f}dB",
                      block, if_level_db, if_agc_gain_db, audio_level_db);
@@ -1066,8 +1619,9 @@ int main(int argc, char **argv) {
 #ifdef COEFF_MONITOR
       if ((modtype == ModType::FM) && (multipathfilter_stages > 0) &&
           (block % (stat_rate * 10)) == 0) {
-        double mf_error = fm.get_multipath_error();
-        const MfCoeffVector &mf_coeff = fm.get_multipath_coefficients();
+        double mf_error = chain.fm().get_multipath_error();
+        const MfCoeffVector &mf_coeff =
+            chain.fm().get_multipath_coefficients();
         fmt::print(stderr, "block,{},mf_error,{:.9f},mf_coeff,", block,
                    mf_error);
         for (unsigned int i = 0; i < mf_coeff.size(); i++) {
@@ -1084,15 +1638,15 @@ int main(int argc, char **argv) {
     if (ppsfile != nullptr) {
       switch (modtype) {
       case ModType::FM:
-        for (const PilotPhaseLock::PpsEvent &ev : fm.get_pps_events()) {
+        for (const PilotPhaseLock::PpsEvent &ev :
+             chain.fm().get_pps_events()) {
           double ts = prev_block_time;
           ts += ev.block_position * (block_time - prev_block_time);
           fmt::println(ppsfile, "{:>8} {:>14} {:18.6f} {:+9.3f}", ev.pps_index,
                        ev.sample_index, ts, if_level_db);
           fflush(ppsfile);
-          // Erase the marked event.
-          fm.erase_first_pps_event();
         }
+        // The events are cleared when the next block is processed.
         break;
       case ModType::NBFM:
       case ModType::AM:
@@ -1119,6 +1673,56 @@ int main(int argc, char **argv) {
 
   // Close audio output.
   audio_output->output_close();
+  // Write the final stage profile
+  // after the pending request is written.
+  if (profiler) {
+    profile_writer.reset();
+    StageProfileWriter::write(*profiler, profilefilename);
+  }
+  // Close IQ recorder.
+  if (iq_writer) {
+    iq_writer->close();
+    if (!(*iq_writer)) {
+      fmt::println(stderr, "ERROR: IQ recorder: {}", iq_writer->error());
+    }
+    if (iq_writer->get_dropped_blocks() > 0) {
+      fmt::println(stderr, "IQ recorder: {} blocks dropped",
+                   iq_writer->get_dropped_blocks());
+    }
+  }
+  // Stop RDS decoder.
+  if (rds_decoder) {
+    rds_decoder->close();
+    fmt::println(stderr, "RDS groups decoded: {}",
+                 rds_decoder->get_group_count());
+    if (rdsfile != stdout) {
+      fclose(rdsfile);
+    }
+  }
+  // Close MPX output.
+  if (mpx_writer) {
+    mpx_writer->close();
+    if (!(*mpx_writer)) {
+      fmt::println(stderr, "ERROR: MPX output: {}", mpx_writer->error());
+    }
+    if (mpx_writer->get_dropped_blocks() > 0) {
+      fmt::println(stderr, "MPX output: {} blocks dropped",
+                   mpx_writer->get_dropped_blocks());
+    }
+  }
+  // Report the latency statistics of the scanner.
+  if (scanner && scanner->get_latency_count() > 0) {
+    fmt::println(stderr,
+                 "Scanner: {} channels active, retune-to-audio latency "
+                 "average {:.1f} [ms], max {:.1f} [ms]",
+                 scanner->get_latency_count(),
+                 scanner->get_latency_average() * 1.0e3,
+                 scanner->get_latency_max() * 1.0e3);
+  }
+  // Stop control server.
+  if (control) {
+    control->stop();
+  }
   // Terminate receiver thread.
   up_srcsdr->stop();
 
@@ -33,15 +33,23 @@ void AfSimpleAgc::reset_gain() { m_current_gain = m_initial_gain; }
 
 // AF AGC based on the Tisserand-Berviller algorithm
 
-void AfSimpleAgc::process(const SampleVector &samples_in,
+void AfSimpleAgc::process(std::span<const Sample> samples_in,
                           SampleVector &samples_out) {
   unsigned int n = samples_in.size();
   samples_out.resize(n);
+  process_samples(samples_in.data(), samples_out.data(), n);
+}
+
+void AfSimpleAgc::process_inplace(std::span<Sample> samples) {
+  process_samples(samples.data(), samples.data(), samples.size());
+}
 
+inline void AfSimpleAgc::process_samples(const Sample *input, Sample *output,
+                                         unsigned int n) {
   for (unsigned int i = 0; i < n; i++) {
-    Sample x = samples_in[i];
+    Sample x = input[i];
     Sample x2 = x * m_current_gain;
-    samples_out[i] = x2 * m_reference;
+    output[i] = x2 * m_reference;
     double z = 1.0 + (m_distortion_rate * (1.0 - (x2 * x2)));
     m_current_gain *= z;
     // Check if m_current_gain is finite
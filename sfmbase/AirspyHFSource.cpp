@@ -337,6 +337,41 @@ bool AirspyHFSource::configure(std::string configurationStr) {
   return configure(sampleRateIndex, hfAttLevel, frequency);
 }
 
+bool AirspyHFSource::set_frequency(std::uint32_t frequency) {
+  if (((frequency > 31000000) && (frequency < 60000000)) ||
+      (frequency > 260000000)) {
+    m_error = "Invalid frequency";
+    return false;
+  }
+  if (!m_dev) {
+    return false;
+  }
+
+  // Shift down frequency by Fs/4 if NOT using low_if
+  std::uint32_t tuned = frequency;
+  if (!m_low_if) {
+    const std::uint32_t shift = m_sampleRate / 4;
+    if (frequency < shift) {
+      m_error = "Invalid (computed) tuner frequency after Fs/4 shift";
+      return false;
+    }
+    tuned = frequency - shift;
+  }
+
+  airspyhf_error rc = (airspyhf_error)airspyhf_set_freq(m_dev, tuned);
+
+  if (rc != AIRSPYHF_SUCCESS) {
+    m_error = fmt::format("Could not set center frequency to {} Hz", tuned);
+    return false;
+  }
+
+  m_frequency = tuned;
+  m_confFreq = frequency;
+  // Discard the samples of the previous frequency.
+  request_segment();
+  return true;
+}
+
 bool AirspyHFSource::start(DataBuffer<IQSample> *buf,
                            std::atomic_bool *stop_flag) {
   m_buf = buf;
@@ -347,7 +382,11 @@ bool AirspyHFSource::start(DataBuffer<IQSample> *buf,
     fmt::println(stderr, "AirspyHFSource::start: starting");
 #endif
     m_running = true;
-    m_thread = std::make_unique<std::thread>(run, m_dev, m_stop_flag);
+    // The threads of libairspyhf inherit the setting from this thread.
+    m_thread = std::make_unique<std::thread>([this] {
+      m_thread_setting.apply("source");
+      run(m_dev, m_stop_flag);
+    });
     return true;
   } else {
     fmt::println(stderr, "AirspyHFSource::start: error");
@@ -399,7 +438,11 @@ int AirspyHFSource::rx_callback(airspyhf_transfer_t *transfer) {
 }
 
 void AirspyHFSource::callback(const float *buf, std::size_t len) {
-  IQSampleVector iqsamples;
+  if (!check_segment(retune_pipeline_blocks)) {
+    return;
+  }
+
+  IQSampleVector iqsamples = m_buf->get_spare();
 
   iqsamples.resize(len / 2);
 
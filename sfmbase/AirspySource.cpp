@@ -410,6 +410,29 @@ bool AirspySource::configure(std::string configurationStr) {
                    vgaGain, lnaAGC, mixAGC);
 }
 
+bool AirspySource::set_frequency(std::uint32_t frequency) {
+  if ((frequency < 24000000) || (frequency > 1800000000)) {
+    m_error = "Invalid frequency";
+    return false;
+  }
+  if (!m_dev) {
+    return false;
+  }
+
+  airspy_error rc = (airspy_error)airspy_set_freq(m_dev, frequency);
+
+  if (rc != AIRSPY_SUCCESS) {
+    m_error = fmt::format("Could not set center frequency to {} Hz", frequency);
+    return false;
+  }
+
+  m_frequency = frequency;
+  m_confFreq = frequency;
+  // Discard the samples of the previous frequency.
+  request_segment();
+  return true;
+}
+
 bool AirspySource::start(DataBuffer<IQSample> *buf,
                          std::atomic_bool *stop_flag) {
   m_buf = buf;
@@ -420,7 +443,11 @@ bool AirspySource::start(DataBuffer<IQSample> *buf,
     fmt::println(stderr, "AirspySource::start: starting");
 #endif
     m_running = true;
-    m_thread = std::make_unique<std::thread>(run, m_dev, stop_flag);
+    // The threads of libairspy inherit the setting from this thread.
+    m_thread = std::make_unique<std::thread>([this, stop_flag] {
+      m_thread_setting.apply("source");
+      run(m_dev, stop_flag);
+    });
     return *this;
   } else {
     fmt::println(stderr, "AirspySource::start: error");
@@ -486,7 +513,11 @@ int AirspySource::rx_callback(airspy_transfer_t *transfer) {
 }
 
 void AirspySource::callback(const float *buf, std::size_t len) {
-  IQSampleVector iqsamples;
+  if (!check_segment(retune_pipeline_blocks)) {
+    return;
+  }
+
+  IQSampleVector iqsamples = m_buf->get_spare();
 
   iqsamples.resize(len / 2);
 
@@ -17,19 +17,21 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <optional>
+
 #include "AmDecode.h"
 #include "Utility.h"
 
 // class AmDecoder
 
-AmDecoder::AmDecoder(IQSampleCoeff &amfilter_coeff, const ModType mode)
+AmDecoder::AmDecoder(const IQSampleCoeff &amfilter_coeff, const ModType mode)
     // Initialize member fields
-    : m_amfilter_coeff(amfilter_coeff), m_mode(mode), m_baseband_mean(0),
-      m_baseband_level(0), m_if_rms(0.0)
+    : m_mode(mode), m_baseband_mean(0),
+      m_baseband_level(0), m_if_rms(0.0), m_profiler(nullptr)
 
       // Construct AM narrow filter
       ,
-      m_amfilter(m_amfilter_coeff, 1)
+      m_amfilter(amfilter_coeff, 1)
 
       // Construct CW narrow filter (in sample rate 12kHz)
       ,
@@ -78,27 +80,49 @@ AmDecoder::AmDecoder(IQSampleCoeff &amfilter_coeff, const ModType mode)
 
       // fine tuner for CW pitch shifting (shift up 500Hz)
       // sampling rate: 48kHz
-      // table size: 480 = 48000 / 100
       ,
-      m_cw_finetuner(internal_rate_pcm / 100, 500 / 100)
+      m_cw_finetuner(internal_rate_pcm, 500)
 
       // fine tuner for WSPR/SSB pitch shifting (shift up and down 1500Hz)
       // sampling rate: 48kHz
-      // table size: 480 = 48000 / 100
       ,
-      m_wspr_ssb_up_finetuner(internal_rate_pcm / 100, 1500 / 100),
-      m_wspr_ssb_down_finetuner(internal_rate_pcm / 100, -1500 / 100)
+      m_wspr_ssb_up_finetuner(internal_rate_pcm, 1500),
+      m_wspr_ssb_down_finetuner(internal_rate_pcm, -1500)
 
 {
   // Do nothing
 }
 
-void AmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
+void AmDecoder::process(std::span<const IQSample> samples_in,
+                        SampleVector &audio) {
+  // The output of the last stage is referred to instead of being moved,
+  // so that all buffers are kept allocated.
+  // The final frequency shift is done in-place.
+  std::span<const IQSample> samples_filtered;
+  // The filters and the fine tuners are profiled separately.
+  auto if_filter = [&](auto &filter, std::span<const IQSample> in,
+                       IQSampleVector &out) {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::IfFilter,
+                               in.size());
+    filter.process(in, out);
+  };
+  auto fine_tune = [&](auto &finetuner, std::span<const IQSample> in,
+                       IQSampleVector &out) {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::FineTuner,
+                               in.size());
+    finetuner.process(in, out);
+  };
+  auto fine_tune_inplace = [&](auto &finetuner, IQSampleVector &samples) {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::FineTuner,
+                               samples.size());
+    finetuner.process_inplace(samples);
+  };
   switch (m_mode) {
   case ModType::AM:
   case ModType::DSB:
     // Apply narrower filters
-    m_amfilter.process(samples_in, m_buf_filtered2);
+    if_filter(m_amfilter, samples_in, m_buf_filtered2);
+    samples_filtered = m_buf_filtered2;
     break;
   case ModType::USB:
   case ModType::LSB:
@@ -107,56 +131,73 @@ void AmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
     switch (m_mode) {
     case ModType::USB:
       // Shift down 1500Hz first to filter
-      m_wspr_ssb_down_finetuner.process(samples_in, m_buf_filtered1a);
+      fine_tune(m_wspr_ssb_down_finetuner, samples_in, m_buf_filtered1a);
       // Apply SSB filter
-      m_ssbfilter.process(m_buf_filtered1a, m_buf_filtered1b);
+      if_filter(m_ssbfilter, m_buf_filtered1a, m_buf_filtered1b);
       // Shift up 1500Hz to make center frequency to 1500Hz
-      m_wspr_ssb_up_finetuner.process(m_buf_filtered1b, m_buf_filtered2);
+      fine_tune_inplace(m_wspr_ssb_up_finetuner, m_buf_filtered1b);
+      samples_filtered = m_buf_filtered1b;
       break;
     case ModType::LSB:
       // Shift up 1500Hz first to filter
-      m_wspr_ssb_up_finetuner.process(samples_in, m_buf_filtered1a);
+      fine_tune(m_wspr_ssb_up_finetuner, samples_in, m_buf_filtered1a);
       // Apply SSB filter
-      m_ssbfilter.process(m_buf_filtered1a, m_buf_filtered1b);
+      if_filter(m_ssbfilter, m_buf_filtered1a, m_buf_filtered1b);
       // Shift down 1500Hz to make center frequency to 1500Hz
-      m_wspr_ssb_down_finetuner.process(m_buf_filtered1b, m_buf_filtered2);
+      fine_tune_inplace(m_wspr_ssb_down_finetuner, m_buf_filtered1b);
+      samples_filtered = m_buf_filtered1b;
       break;
     case ModType::CW:
       // Apply CW LPF here
-      m_cwfilter.process(samples_in, m_buf_filtered1a);
+      if_filter(m_cwfilter, samples_in, m_buf_filtered1a);
       // Shift up to an audio frequency (500Hz)
-      m_cw_finetuner.process(m_buf_filtered1a, m_buf_filtered2);
+      fine_tune_inplace(m_cw_finetuner, m_buf_filtered1a);
+      samples_filtered = m_buf_filtered1a;
       break;
     case ModType::WSPR:
       // Shift down 1500Hz first to filter
-      m_wspr_ssb_down_finetuner.process(samples_in, m_buf_filtered1a);
+      fine_tune(m_wspr_ssb_down_finetuner, samples_in, m_buf_filtered1a);
       // Apply CW LPF here
-      m_cwfilter.process(m_buf_filtered1a, m_buf_filtered1b);
+      if_filter(m_cwfilter, m_buf_filtered1a, m_buf_filtered1b);
       // Shift up 1500Hz to make center frequency to 1500Hz
-      m_wspr_ssb_up_finetuner.process(m_buf_filtered1b, m_buf_filtered2);
+      fine_tune_inplace(m_wspr_ssb_up_finetuner, m_buf_filtered1b);
+      samples_filtered = m_buf_filtered1b;
       break;
     default:
-      m_buf_filtered2 = std::move(samples_in);
+      samples_filtered = samples_in;
       break;
     }
     // If no upsampled signal comes out, terminate and wait for next block.
-    if (m_buf_filtered2.size() == 0) {
+    if (samples_filtered.size() == 0) {
       audio.resize(0);
       return;
     }
     break;
   default:
-    m_buf_filtered2 = std::move(samples_in);
+    samples_filtered = samples_in;
     break;
   }
 
   // Measure IF RMS level.
-  m_if_rms = Utility::rms_level_sample(m_buf_filtered2);
+  m_if_rms = Utility::rms_level_sample(samples_filtered, m_buf_magnitude_sq);
 
   // If AGC
-  m_ifagc.process(m_buf_filtered2, m_buf_filtered3);
+  // DSB signals are demodulated by taking the real part,
+  // which the IF AGC outputs directly without the IQ output.
+  {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::IfAgc,
+                               samples_filtered.size());
+    if (m_mode == ModType::AM) {
+      m_ifagc.process(samples_filtered, m_buf_filtered3);
+    } else {
+      m_ifagc.process_real(samples_filtered, m_buf_decoded);
+    }
+  }
 
   // Demodulate AM/DSB signal.
+  std::optional<StageProfiler::Scope> demod_scope;
+  demod_scope.emplace(m_profiler, StageProfiler::Stage::Discriminator,
+                      samples_filtered.size());
   switch (m_mode) {
   case ModType::FM:
     // Force error
@@ -174,9 +215,10 @@ void AmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
   case ModType::LSB:
   case ModType::CW:
   case ModType::WSPR:
-    demodulate_dsb(m_buf_filtered3, m_buf_decoded);
+    // Already demodulated by the IF AGC.
     break;
   }
+  demod_scope.reset();
 
   // If no decoded signal comes out, terminate and wait for next block,
   size_t decoded_size = m_buf_decoded.size();
@@ -191,7 +233,11 @@ void AmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
                        decoded_size);
 
   // DC blocking.
-  m_dcblock.process_inplace(m_buf_baseband_demod);
+  {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::AudioFilter,
+                               m_buf_baseband_demod.size());
+    m_dcblock.process_inplace(m_buf_baseband_demod);
+  }
 
   // If no baseband audio signal comes out, terminate and wait for next block,
   if (m_buf_baseband_demod.size() == 0) {
@@ -199,8 +245,12 @@ void AmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
     return;
   }
 
-  // Audio AGC
-  m_afagc.process(m_buf_baseband_demod, m_buf_baseband);
+  // Audio AGC, returning mono channel.
+  {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::AfAgc,
+                               m_buf_baseband_demod.size());
+    m_afagc.process(m_buf_baseband_demod, audio);
+  }
 
   // Measure baseband level after DC blocking.
   float baseband_mean, baseband_rms;
@@ -210,27 +260,29 @@ void AmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
 
   // Apply deemphasis for AM mode only.
   if (m_mode == ModType::AM) {
-    m_deemph.process_inplace(m_buf_baseband);
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::AudioFilter,
+                               audio.size());
+    m_deemph.process_inplace(audio);
   }
+}
 
-  // Return mono channel.
-  audio = std::move(m_buf_baseband);
+void AmDecoder::skip(std::size_t if_length, SampleVector &audio) {
+  // The audio sample rate is the same as the IF sample rate.
+  audio.assign(if_length, 0.0);
+}
+
+void AmDecoder::reset() {
+  m_ifagc.reset_gain();
+  m_afagc.reset_gain();
+  m_baseband_mean = 0;
 }
 
 // Demodulate AM signal.
-inline void AmDecoder::demodulate_am(const IQSampleVector &samples_in,
+inline void AmDecoder::demodulate_am(std::span<const IQSample> samples_in,
                                      IQSampleDecodedVector &samples_out) {
   unsigned int n = samples_in.size();
   samples_out.resize(n);
   volk_32fc_magnitude_32f(samples_out.data(), samples_in.data(), n);
 }
 
-// Demodulate DSB signal.
-inline void AmDecoder::demodulate_dsb(const IQSampleVector &samples_in,
-                                      IQSampleDecodedVector &samples_out) {
-  unsigned int n = samples_in.size();
-  samples_out.resize(n);
-  volk_32fc_deinterleave_real_32f(samples_out.data(), samples_in.data(), n);
-}
-
 // end
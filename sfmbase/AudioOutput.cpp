@@ -17,11 +17,18 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
 #include <fcntl.h>
 #include <fmt/format.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "AudioOutput.h"
@@ -309,4 +316,339 @@ void PortAudioOutput::add_paerror(const std::string &premsg) {
   m_zombie = true;
 }
 
+// Class NetworkOutput
+
+#if defined(MSG_NOSIGNAL)
+static constexpr int send_flags = MSG_NOSIGNAL;
+#else
+// macOS: SIGPIPE is suppressed by SO_NOSIGPIPE per socket
+static constexpr int send_flags = 0;
+#endif
+
+// Set O_NONBLOCK and suppress SIGPIPE on the socket.
+static bool set_socket_options(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    return false;
+  }
+#if defined(SO_NOSIGPIPE)
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+  return true;
+}
+
+// Store little-endian integers into the header.
+static void put_le16(std::uint8_t *p, std::uint16_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+static void put_le32(std::uint8_t *p, std::uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = (v >> (8 * i)) & 0xff;
+  }
+}
+
+// Construct network audio output.
+NetworkOutput::NetworkOutput(const std::string &address,
+                             unsigned int samplerate, bool stereo,
+                             bool float32)
+    : m_nchannels(stereo ? 2 : 1), m_samplerate(samplerate),
+      m_float32(float32),
+      m_max_pending(static_cast<std::size_t>(
+          max_pending_seconds * samplerate * (stereo ? 2 : 1) *
+          (float32 ? sizeof(float) : sizeof(std::int16_t)))) {
+
+  // Stream header:
+  // offset 0: magic "AFMR"
+  // offset 4: header version (uint16)
+  // offset 6: sample format (uint16, 1: S16_LE, 3: FLOAT_LE)
+  // offset 8: number of channels (uint16)
+  // offset 10: bits per sample (uint16)
+  // offset 12: sample rate in Hz (uint32)
+  std::memcpy(m_header, header_magic, sizeof(header_magic));
+  put_le16(m_header + 4, header_version);
+  put_le16(m_header + 6, m_float32 ? format_float32 : format_int16);
+  put_le16(m_header + 8, m_nchannels);
+  put_le16(m_header + 10, m_float32 ? 32 : 16);
+  put_le32(m_header + 12, m_samplerate);
+
+  bool ok;
+  if (address.compare(0, 4, "tcp:") == 0) {
+    ok = open_tcp(address.substr(4));
+  } else if (address.compare(0, 5, "unix:") == 0) {
+    ok = open_unix(address.substr(5));
+  } else {
+    m_error = fmt::format("invalid network address '{}' "
+                          "(use tcp:[host:]port or unix:path)",
+                          address);
+    ok = false;
+  }
+  if (!ok) {
+    if (m_listen_fd >= 0) {
+      ::close(m_listen_fd);
+      m_listen_fd = -1;
+    }
+    m_zombie = true;
+    return;
+  }
+
+  m_device_name = fmt::format("NetworkOutput {}", address);
+}
+
+// Open TCP listening socket.
+bool NetworkOutput::open_tcp(const std::string &hostport) {
+  std::string host;
+  std::string port;
+  std::size_t colon = hostport.rfind(':');
+  if (colon == std::string::npos) {
+    port = hostport;
+  } else {
+    host = hostport.substr(0, colon);
+    port = hostport.substr(colon + 1);
+  }
+  // Accept bracketed IPv6 addresses.
+  if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+  // Listen on the loopback interface unless the host is given,
+  // e.g., 0.0.0.0 or [::] for all interfaces.
+  if (host.empty()) {
+    host = default_tcp_host;
+  }
+
+  struct addrinfo hints {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  struct addrinfo *res = nullptr;
+  int gai = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+  if (gai != 0) {
+    m_error = fmt::format("can not resolve '{}' ({})", hostport,
+                          gai_strerror(gai));
+    return false;
+  }
+
+  for (struct addrinfo *ai = res; ai != nullptr; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+        listen(fd, max_clients) == 0 && set_socket_options(fd)) {
+      m_listen_fd = fd;
+      break;
+    }
+    m_error = fmt::format("can not listen on '{}' ({})", hostport,
+                          strerror(errno));
+    ::close(fd);
+  }
+  freeaddrinfo(res);
+
+  if (m_listen_fd < 0) {
+    if (m_error.empty()) {
+      m_error = fmt::format("can not open socket for '{}'", hostport);
+    }
+    return false;
+  }
+  m_error.clear();
+  return true;
+}
+
+// Open Unix domain listening socket.
+bool NetworkOutput::open_unix(const std::string &path) {
+  struct sockaddr_un addr {};
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    m_error = fmt::format("invalid Unix socket path '{}'", path);
+    return false;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  // Remove a stale socket left by a previous run,
+  // but never remove any other type of file.
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    ::unlink(path.c_str());
+  }
+
+  m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_listen_fd < 0) {
+    m_error = fmt::format("can not create Unix socket ({})", strerror(errno));
+    return false;
+  }
+  if (bind(m_listen_fd, reinterpret_cast<struct sockaddr *>(&addr),
+           sizeof(addr)) != 0) {
+    m_error =
+        fmt::format("can not bind to '{}' ({})", path, strerror(errno));
+    return false;
+  }
+  m_unix_path = path;
+  if (listen(m_listen_fd, max_clients) != 0 ||
+      !set_socket_options(m_listen_fd)) {
+    m_error =
+        fmt::format("can not listen on '{}' ({})", path, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+// Accept all pending connections without blocking.
+void NetworkOutput::accept_clients() {
+  for (;;) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    int fd = accept(m_listen_fd, reinterpret_cast<struct sockaddr *>(&addr),
+                    &addrlen);
+    if (fd < 0) {
+      // EAGAIN/EWOULDBLOCK: no more pending connections
+      return;
+    }
+
+    std::string name;
+    char host[NI_MAXHOST];
+    char serv[NI_MAXSERV];
+    if (addr.ss_family != AF_UNIX &&
+        getnameinfo(reinterpret_cast<struct sockaddr *>(&addr), addrlen, host,
+                    sizeof(host), serv, sizeof(serv),
+                    NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+      name = fmt::format("{}:{}", host, serv);
+    } else {
+      name = fmt::format("fd {}", fd);
+    }
+
+    if (m_clients.size() >= max_clients || !set_socket_options(fd)) {
+      fmt::println(stderr, "\nNetworkOutput: rejected client {}", name);
+      ::close(fd);
+      continue;
+    }
+    if (addr.ss_family != AF_UNIX) {
+      int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    Client client{fd, name, {}, 0};
+    client.pending.reserve(m_max_pending);
+    client.pending.assign(m_header, m_header + header_size);
+    m_clients.push_back(std::move(client));
+    fmt::println(stderr, "\nNetworkOutput: client {} connected", name);
+  }
+}
+
+// Send as much pending data as possible without blocking.
+bool NetworkOutput::flush_client(Client &client) {
+  while (client.offset < client.pending.size()) {
+    ssize_t sent =
+        send(client.fd, client.pending.data() + client.offset,
+             client.pending.size() - client.offset, send_flags);
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      } else if (errno == EINTR) {
+        continue;
+      }
+      drop_client(client, strerror(errno));
+      return false;
+    }
+    client.offset += static_cast<std::size_t>(sent);
+  }
+  // Compact the pending buffer.
+  if (client.offset == client.pending.size()) {
+    client.pending.clear();
+    client.offset = 0;
+  } else if (client.offset > 0) {
+    client.pending.erase(client.pending.begin(),
+                         client.pending.begin() + client.offset);
+    client.offset = 0;
+  }
+  return true;
+}
+
+// Close client socket and print the reason.
+void NetworkOutput::drop_client(Client &client, const std::string &reason) {
+  fmt::println(stderr, "\nNetworkOutput: client {} dropped ({})", client.name,
+               reason);
+  ::close(client.fd);
+  client.fd = -1;
+}
+
+// Output closing method.
+void NetworkOutput::output_close() {
+  for (Client &client : m_clients) {
+    if (client.fd >= 0) {
+      ::close(client.fd);
+    }
+  }
+  m_clients.clear();
+  if (m_listen_fd >= 0) {
+    ::close(m_listen_fd);
+    m_listen_fd = -1;
+  }
+  if (!m_unix_path.empty()) {
+    ::unlink(m_unix_path.c_str());
+    m_unix_path.clear();
+  }
+  // Set closed flag to prevent multiple closing
+  m_closed = true;
+}
+
+// Destructor.
+NetworkOutput::~NetworkOutput() {
+  // close output if not yet closed
+  if (!m_closed) {
+    NetworkOutput::output_close();
+  }
+}
+
+// Write audio data.
+bool NetworkOutput::write(const SampleVector &samples) {
+  if (m_zombie) {
+    return false;
+  }
+
+  accept_clients();
+  if (m_clients.empty()) {
+    return true;
+  }
+
+  // Convert samples to little-endian bytes once for all clients.
+  std::size_t sample_size = samples.size();
+  if (m_float32) {
+    m_bytebuf.resize(sample_size * sizeof(float));
+    for (std::size_t i = 0; i < sample_size; i++) {
+      float v = static_cast<float>(samples[i]);
+      std::uint32_t u;
+      std::memcpy(&u, &v, sizeof(u));
+      put_le32(&m_bytebuf[i * sizeof(float)], u);
+    }
+  } else {
+    m_bytebuf.resize(sample_size * sizeof(std::int16_t));
+    for (std::size_t i = 0; i < sample_size; i++) {
+      double v = std::clamp(samples[i], -1.0, 1.0) * 32767.0;
+      std::int16_t s = static_cast<std::int16_t>(std::lrint(v));
+      put_le16(&m_bytebuf[i * sizeof(std::int16_t)],
+               static_cast<std::uint16_t>(s));
+    }
+  }
+
+  for (Client &client : m_clients) {
+    std::size_t queued = client.pending.size() - client.offset;
+    if (queued + m_bytebuf.size() > m_max_pending) {
+      drop_client(client, "client too slow");
+      continue;
+    }
+    client.pending.insert(client.pending.end(), m_bytebuf.begin(),
+                          m_bytebuf.end());
+    flush_client(client);
+  }
+
+  // Remove dropped clients.
+  std::erase_if(m_clients, [](const Client &c) { return c.fd < 0; });
+
+  return true;
+}
+
 /* end */
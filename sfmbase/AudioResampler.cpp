@@ -34,7 +34,7 @@ AudioResampler::AudioResampler(const double input_rate,
   // do nothing
 }
 
-void AudioResampler::process(const SampleVector &samples_in,
+void AudioResampler::process(std::span<const Sample> samples_in,
                              SampleVector &samples_out) {
   size_t input_size = samples_in.size();
 
@@ -0,0 +1,281 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fmt/format.h>
+
+#include "BatchDecoder.h"
+#include "FmDecode.h"
+#include "PilotPhaseLock.h"
+#include "Utility.h"
+
+// Construct batch decoder.
+BatchDecoder::BatchDecoder(FileSource &source, const Parameters &params)
+    : m_source(source), m_params(params), m_ifrate(source.get_sample_rate()),
+      m_frames(static_cast<std::uint64_t>(source.get_frames())),
+      m_block_length(static_cast<unsigned int>(source.get_block_length())),
+      m_channels(params.chain.stereo ? 2 : 1), m_next_segment(0),
+      m_next_write(0), m_stop(false), m_failed(false) {
+
+  // Find the alignment unit of segment boundaries:
+  // a multiple of align_pcm_samples which maps to an integer number
+  // of input samples, also a multiple of 4 for the Fs/4 downconverter.
+  // 4 seconds always satisfies the conditions.
+  const std::uint64_t ifrate = static_cast<std::uint64_t>(m_ifrate);
+  m_align_pcm = align_pcm_samples;
+  while (m_align_pcm < 4 * pcm_rate) {
+    if ((m_align_pcm * ifrate) % pcm_rate == 0) {
+      std::uint64_t align_in = m_align_pcm * ifrate / pcm_rate;
+      if (!m_params.chain.fs_fourth_downconverter || (align_in % 4) == 0) {
+        break;
+      }
+    }
+    m_align_pcm += align_pcm_samples;
+  }
+  m_align_in = m_align_pcm * ifrate / pcm_rate;
+
+  // Warm-up period.
+  double warmup = warmup_margin_seconds;
+  if (m_params.chain.modtype == ModType::FM) {
+    // PLL lock delay.
+    warmup +=
+        15.0 / PilotPhaseLock::bandwidth / PilotPhaseLock::sample_rate_if;
+    // Waiting time of the multipath filter.
+    if (m_params.chain.multipath_stages > 0) {
+      warmup += double(FmDecoder::multipath_wait_blocks) * m_block_length /
+                m_ifrate;
+    }
+  }
+  std::uint64_t warmup_units = static_cast<std::uint64_t>(
+      std::ceil(warmup * pcm_rate / m_align_pcm));
+  m_warmup_pcm = warmup_units * m_align_pcm;
+  m_warmup_in = warmup_units * m_align_in;
+
+  // Segment length.
+  std::uint64_t segment_units = std::max<std::uint64_t>(
+      1, static_cast<std::uint64_t>(
+             std::round(segment_seconds * pcm_rate / m_align_pcm)));
+  m_segment_pcm = segment_units * m_align_pcm;
+  m_segment_in = segment_units * m_align_in;
+  m_segments = (m_frames + m_segment_in - 1) / m_segment_in;
+  // Merge the remainder shorter than the warm-up period
+  // into the previous segment, which is decoded to the end of the file.
+  if (m_segments > 1 &&
+      m_frames - (m_segments - 1) * m_segment_in < m_warmup_in) {
+    m_segments--;
+  }
+}
+
+// Decode the whole file and write the audio in order.
+bool BatchDecoder::run(AudioOutput &output, std::atomic_bool &stop_flag) {
+  std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+
+  unsigned int jobs = static_cast<unsigned int>(
+      std::min<std::uint64_t>(m_params.jobs, m_segments));
+  for (unsigned int i = 0; i < jobs; i++) {
+    m_threads.emplace_back(&BatchDecoder::worker, this);
+  }
+
+  std::uint64_t written = 0;
+  for (; written < m_segments; written++) {
+    SampleVector audio;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_stop && !m_results.contains(written)) {
+        m_cond.wait_for(lock, std::chrono::milliseconds(100));
+        if (stop_flag.load()) {
+          m_stop = true;
+        }
+      }
+      if (m_stop) {
+        break;
+      }
+      std::swap(audio, m_results[written]);
+      m_results.erase(written);
+      m_next_write = written + 1;
+    }
+    m_cond.notify_all();
+
+    if (!output.write(audio)) {
+      set_error(fmt::format("audio output: {}", output.error()));
+      break;
+    }
+    if (!m_params.quiet) {
+      fmt::print(stderr, "\rbatch: segment {}/{} written", written + 1,
+                 m_segments);
+      fflush(stderr);
+    }
+  }
+
+  // Stop and join the worker threads.
+  {
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cond.notify_all();
+  for (auto &thread : m_threads) {
+    thread.join();
+  }
+  m_threads.clear();
+
+  // Report the achieved speed.
+  double elapsed =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - begin)
+          .count();
+  double duration =
+      double(std::min(written * m_segment_in, m_frames)) / m_ifrate;
+  fmt::println(stderr,
+               "\nbatch: {:.3f} seconds of samples decoded in {:.3f} seconds "
+               "({:.2f} times real time, {} jobs)",
+               duration, elapsed, elapsed > 0 ? duration / elapsed : 0.0,
+               jobs);
+
+  return !m_failed.load() && written == m_segments;
+}
+
+// Worker thread body.
+void BatchDecoder::worker() {
+  const std::uint64_t max_pending =
+      std::uint64_t(max_pending_per_job) * m_params.jobs;
+  for (;;) {
+    std::uint64_t index;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      // Limit the number of decoded segments waiting to be written.
+      m_cond.wait(lock, [&] {
+        return m_stop || m_next_segment >= m_segments ||
+               m_next_segment < m_next_write + max_pending;
+      });
+      if (m_stop || m_next_segment >= m_segments) {
+        return;
+      }
+      index = m_next_segment++;
+    }
+
+    SampleVector audio;
+    if (!decode_segment(index, audio)) {
+      return;
+    }
+
+    {
+      std::scoped_lock<std::mutex> lock(m_mutex);
+      m_results[index] = std::move(audio);
+    }
+    m_cond.notify_all();
+  }
+}
+
+// Decode a segment and return the audio samples to keep.
+bool BatchDecoder::decode_segment(std::uint64_t index, SampleVector &audio) {
+  const bool last = (index + 1 == m_segments);
+  const std::uint64_t start_in = index * m_segment_in;
+  const std::uint64_t read_start =
+      start_in > m_warmup_in ? start_in - m_warmup_in : 0;
+  // Number of audio samples (not frames) to discard and to keep.
+  const std::uint64_t discard =
+      (start_in - read_start) / m_align_in * m_align_pcm * m_channels;
+  const std::uint64_t keep = m_segment_pcm * m_channels;
+
+  SNDFILE *sfp = m_source.open_duplicate();
+  if (sfp == nullptr) {
+    set_error(fmt::format("can not open '{}' ({})",
+                          m_source.get_device_name(), sf_strerror(nullptr)));
+    return false;
+  }
+  if (sf_seek(sfp, static_cast<sf_count_t>(read_start), SEEK_SET) < 0) {
+    set_error(fmt::format("can not seek '{}' ({})",
+                          m_source.get_device_name(), sf_strerror(sfp)));
+    sf_close(sfp);
+    return false;
+  }
+
+  // Prepare an independent decoding chain.
+  DecodeChain chain(m_params.chain);
+
+  std::vector<float> buf(2 * m_block_length);
+  IQSampleVector iqsamples;
+  SampleVector audiosamples;
+  std::uint64_t skipped = 0;
+  audio.clear();
+  if (!last) {
+    audio.reserve(keep);
+  }
+
+  while (last || audio.size() < keep) {
+    if (m_stop) {
+      break;
+    }
+    sf_count_t n_read = sf_readf_float(sfp, buf.data(), m_block_length);
+    if (n_read <= 0) {
+      break;
+    }
+    iqsamples.resize(n_read);
+    for (sf_count_t i = 0; i < n_read; i++) {
+      iqsamples[i] = IQSample(buf[2 * i], buf[2 * i + 1]);
+    }
+
+    if (!chain.convert(iqsamples)) {
+      continue;
+    }
+    chain.decode(chain.gate(), audiosamples);
+    if (audiosamples.empty()) {
+      continue;
+    }
+
+    // Same gain and squelch as the real-time decoding.
+    Utility::adjust_gain(audiosamples,
+                         chain.squelch_open() ? DecodeChain::nominal_gain
+                                              : 0.0);
+
+    // Discard the warm-up period, and keep the segment only.
+    std::size_t offset = 0;
+    if (skipped < discard) {
+      offset = static_cast<std::size_t>(
+          std::min<std::uint64_t>(discard - skipped, audiosamples.size()));
+      skipped += offset;
+    }
+    std::size_t count = audiosamples.size() - offset;
+    if (!last) {
+      count = static_cast<std::size_t>(
+          std::min<std::uint64_t>(count, keep - audio.size()));
+    }
+    audio.insert(audio.end(), audiosamples.begin() + offset,
+                 audiosamples.begin() + offset + count);
+  }
+
+  sf_close(sfp);
+  return true;
+}
+
+// Set error message and stop decoding.
+void BatchDecoder::set_error(const std::string &msg) {
+  {
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    if (m_error.empty()) {
+      m_error = msg;
+    }
+    m_failed.store(true);
+    m_stop = true;
+  }
+  m_cond.notify_all();
+}
+
+// end
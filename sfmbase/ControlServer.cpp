@@ -0,0 +1,283 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fmt/format.h>
+#include <poll.h>
+#include <strings.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ControlServer.h"
+#include "Utility.h"
+
+// class ControlServer
+
+// Constructor.
+ControlServer::ControlServer()
+    : m_listen_fd(-1), m_modtype(ModType::FM), m_can_retune(false),
+      m_stop(false), m_thread(nullptr), m_head(0), m_tail(0) {}
+
+// Destructor.
+ControlServer::~ControlServer() { stop(); }
+
+bool ControlServer::start(const std::string &path, ModType modtype,
+                          bool can_retune) {
+  m_modtype = modtype;
+  m_can_retune = can_retune;
+  struct sockaddr_un addr {};
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    m_error = fmt::format("invalid Unix socket path '{}'", path);
+    return false;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  // Remove a stale socket left by a previous run,
+  // but never remove any other type of file.
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    ::unlink(path.c_str());
+  }
+
+  m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_listen_fd < 0) {
+    m_error = fmt::format("can not create Unix socket ({})", strerror(errno));
+    return false;
+  }
+  if (bind(m_listen_fd, reinterpret_cast<struct sockaddr *>(&addr),
+           sizeof(addr)) != 0) {
+    m_error = fmt::format("can not bind to '{}' ({})", path, strerror(errno));
+    ::close(m_listen_fd);
+    m_listen_fd = -1;
+    return false;
+  }
+  m_path = path;
+  if (listen(m_listen_fd, max_clients) != 0) {
+    m_error =
+        fmt::format("can not listen on '{}' ({})", path, strerror(errno));
+    stop();
+    return false;
+  }
+
+  m_thread = std::make_unique<std::thread>([this] { run(); });
+  return true;
+}
+
+void ControlServer::stop() {
+  if (m_thread) {
+    m_stop.store(true);
+    m_thread->join();
+    m_thread.reset();
+  }
+  for (Client &client : m_clients) {
+    ::close(client.fd);
+  }
+  m_clients.clear();
+  if (m_listen_fd >= 0) {
+    ::close(m_listen_fd);
+    m_listen_fd = -1;
+  }
+  if (!m_path.empty()) {
+    ::unlink(m_path.c_str());
+    m_path.clear();
+  }
+}
+
+bool ControlServer::push(const Command &command) {
+  std::size_t tail = m_tail.load(std::memory_order_relaxed);
+  std::size_t next = (tail + 1) % queue_length;
+  if (next == m_head.load(std::memory_order_acquire)) {
+    return false;
+  }
+  m_queue[tail] = command;
+  m_tail.store(next, std::memory_order_release);
+  return true;
+}
+
+bool ControlServer::pop(Command &command) {
+  std::size_t head = m_head.load(std::memory_order_relaxed);
+  if (head == m_tail.load(std::memory_order_acquire)) {
+    return false;
+  }
+  command = m_queue[head];
+  m_head.store((head + 1) % queue_length, std::memory_order_release);
+  return true;
+}
+
+// Server thread body.
+void ControlServer::run() {
+  std::vector<struct pollfd> fds;
+  while (!m_stop.load()) {
+    fds.clear();
+    fds.push_back({m_listen_fd, POLLIN, 0});
+    for (const Client &client : m_clients) {
+      fds.push_back({client.fd, POLLIN, 0});
+    }
+    int n = ::poll(fds.data(), fds.size(), poll_interval);
+    if (n <= 0) {
+      continue;
+    }
+
+    // Serve the clients first, since accepting changes m_clients.
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < m_clients.size(); i++) {
+      Client &client = m_clients[i];
+      if ((fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) != 0 &&
+          !serve_client(client)) {
+        ::close(client.fd);
+        continue;
+      }
+      m_clients[kept++] = std::move(client);
+    }
+    m_clients.resize(kept);
+
+    if ((fds[0].revents & POLLIN) != 0) {
+      // Non-blocking, so that a client which stops reading
+      // can not block the server thread in send().
+      int fd = accept4(m_listen_fd, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd >= 0) {
+        if (m_clients.size() >= max_clients) {
+          ::close(fd);
+        } else {
+          m_clients.push_back({fd, {}});
+        }
+      }
+    }
+  }
+}
+
+// Read the commands from the client and reply.
+bool ControlServer::serve_client(Client &client) {
+  char buf[max_line_length];
+  ssize_t len = ::read(client.fd, buf, sizeof(buf));
+  if (len <= 0) {
+    return len < 0 && (errno == EAGAIN || errno == EINTR);
+  }
+  client.line.append(buf, len);
+
+  std::size_t newline;
+  while ((newline = client.line.find('\n')) != std::string::npos) {
+    std::string reply = execute(client.line.substr(0, newline)) + "\n";
+    client.line.erase(0, newline + 1);
+    // Close the client if the reply does not fit in the socket buffer.
+    if (::send(client.fd, reply.data(), reply.size(), MSG_NOSIGNAL) !=
+        static_cast<ssize_t>(reply.size())) {
+      return false;
+    }
+  }
+  // Close the client sending too long lines.
+  return client.line.size() < max_line_length;
+}
+
+// Execute the command line and return the reply.
+std::string ControlServer::execute(const std::string &line) {
+  std::istringstream input(line);
+  std::string verb, name, value, extra;
+  input >> verb >> name >> value >> extra;
+
+  if (verb == "get" && name == "stats" && value.empty()) {
+    double squelch_db = m_stats.squelch_db.load();
+    const char *squelch = (squelch_db < 0)              ? "off"
+                          : m_stats.squelch_open.load() ? "open"
+                                                        : "closed";
+    return fmt::format(
+        "ok block={} freq={:.0f} if_level={:.3f} audio_level={:.3f} "
+        "ppm={:+.3f} stereo={} pilot={:.4f} squelch={} squelch_level={:.1f} "
+        "volume={:.1f}",
+        m_stats.block.load(), m_stats.frequency.load(),
+        m_stats.if_level_db.load(), m_stats.audio_level_db.load(),
+        m_stats.ppm.load(), m_stats.stereo.load() ? 1 : 0,
+        m_stats.pilot_level.load(), squelch,
+        squelch_db < 0 ? 0.0 : -squelch_db, m_stats.volume_db.load());
+  }
+  if (verb != "set" || value.empty() || !extra.empty()) {
+    return "error: unknown command";
+  }
+
+  if (name == "filter") {
+    const struct {
+      const char *name;
+      FilterType filtertype;
+    } filtertypes[] = {
+        {"default", FilterType::Default},
+        {"medium", FilterType::Medium},
+        {"narrow", FilterType::Narrow},
+        {"wide", FilterType::Wide},
+    };
+    for (const auto &f : filtertypes) {
+      if (strcasecmp(value.c_str(), f.name) == 0) {
+        if (!push(Command{Parameter::Filter, 0, f.filtertype})) {
+          return "error: command queue full";
+        }
+        return "ok";
+      }
+    }
+    return "error: filter must be default, medium, narrow, or wide";
+  }
+
+  const struct {
+    const char *name;
+    Parameter parameter;
+    double min;
+    double max;
+  } parameters[] = {
+      {"volume", Parameter::Volume, -60, 20},
+      {"squelch", Parameter::Squelch, 0, 150},
+      {"deemphasis", Parameter::Deemphasis, 0, 1000},
+      {"multipath", Parameter::Multipath, 0, 1024},
+      {"freq", Parameter::Frequency, 0, 4.0e9},
+  };
+  for (const auto &p : parameters) {
+    if (name != p.name) {
+      continue;
+    }
+    if ((p.parameter == Parameter::Deemphasis ||
+         p.parameter == Parameter::Multipath) &&
+        m_modtype != ModType::FM) {
+      return fmt::format("error: {} is for FM only", name);
+    }
+    if (p.parameter == Parameter::Frequency && !m_can_retune) {
+      return "error: freq can not be set for the source or with --scan";
+    }
+    Command command{p.parameter, -1, FilterType::Default};
+    if (!(p.parameter == Parameter::Squelch && value == "off") &&
+        (!Utility::parse_dbl(value.c_str(), command.value) ||
+         command.value < p.min || command.value > p.max)) {
+      return fmt::format("error: {} must be from {:g} to {:g}", name, p.min,
+                         p.max);
+    }
+    if (p.parameter == Parameter::Multipath) {
+      command.value = std::round(command.value);
+    }
+    if (!push(command)) {
+      return "error: command queue full";
+    }
+    return "ok";
+  }
+  return fmt::format("error: unknown parameter {}", name);
+}
+
+// end
@@ -0,0 +1,279 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "DecodeChain.h"
+#include "FilterParameters.h"
+#include "Utility.h"
+
+// Construct decoding chain.
+DecodeChain::DecodeChain(const Parameters &params)
+    : m_modtype(params.modtype),
+      m_fs_fourth_downconverter(params.fs_fourth_downconverter),
+      m_fs_fourth_decimator(params.fs_fourth_downconverter &&
+                            FourthConverterDecimatorIQ::usable(
+                                params.if_rate, params.demodulator_rate)),
+      m_downsampling((m_fs_fourth_decimator ? params.if_rate / 2
+                                            : params.if_rate) !=
+                     params.demodulator_rate),
+      m_split_if(m_fs_fourth_downconverter && m_downsampling),
+      m_squelch_skip(params.squelch_skip),
+      m_squelch_gate(params.squelch_skip || params.squelch_gate),
+      m_squelch_level(params.squelch_level), m_tuner_freq(params.tuner_freq),
+      m_profiler(nullptr), m_fourth_downconverter(false),
+      m_ppm_average(ppm_average_stages, 0.0f), m_squelch_hold(0),
+      m_if_rms(0.0), m_if_level(0.0), m_afc_updated(false),
+      m_filter_selected(false) {
+
+  if (m_downsampling) {
+    m_if_resampler = std::make_unique<IfResampler>(
+        m_fs_fourth_decimator ? params.if_rate / 2 : params.if_rate,
+        params.demodulator_rate);
+  }
+  if (params.afc_max_ppm > 0 &&
+      (m_modtype == ModType::FM || m_modtype == ModType::NBFM)) {
+    m_afc = std::make_unique<IfAfc>(params.demodulator_rate, m_tuner_freq,
+                                    params.afc_max_ppm, ppm_average_stages);
+  }
+  if (params.filtertype_auto && m_modtype == ModType::FM) {
+    m_filter_selector =
+        std::make_unique<IfFilterSelector>(params.demodulator_rate);
+  }
+
+  select_filter(params.filtertype);
+  switch (m_modtype) {
+  case ModType::FM:
+    m_fm = std::make_unique<FmDecoder>(m_fmfilter_enable, m_fmfilter_coeff,
+                                       params.stereo, params.deemphasis,
+                                       params.pilot_shift,
+                                       params.multipath_stages);
+    break;
+  case ModType::NBFM:
+    m_nbfm = std::make_unique<NbfmDecoder>(m_nbfmfilter_coeff,
+                                           NbfmDecoder::freq_dev_normal);
+    break;
+  case ModType::AM:
+  case ModType::DSB:
+  case ModType::USB:
+  case ModType::LSB:
+  case ModType::CW:
+  case ModType::WSPR:
+    m_am = std::make_unique<AmDecoder>(m_amfilter_coeff, m_modtype);
+    break;
+  }
+}
+
+// Set the stage profiler, or nullptr to disable profiling.
+void DecodeChain::set_profiler(StageProfiler *profiler) {
+  m_profiler = profiler;
+  if (m_fm) {
+    m_fm->set_profiler(profiler);
+  }
+  if (m_nbfm) {
+    m_nbfm->set_profiler(profiler);
+  }
+  if (m_am) {
+    m_am->set_profiler(profiler);
+  }
+}
+
+// Convert the source IQ samples to the IF samples.
+bool DecodeChain::convert(IQSampleVector &iqsamples) {
+  if (m_fs_fourth_downconverter) {
+    // Fs/4 downconvering is required
+    // to avoid frequency zero offset
+    // because Airspy HF+ and RTL-SDR are Zero IF receivers
+    StageProfiler::Scope scope(m_profiler,
+                               StageProfiler::Stage::FourthConverter,
+                               iqsamples.size());
+    if (m_fs_fourth_decimator) {
+      m_fourth_decimator.process(iqsamples, m_if_split_samples);
+    } else if (m_split_if) {
+      m_fourth_downconverter.process(iqsamples, m_if_split_samples);
+    } else {
+      m_fourth_downconverter.process_inplace(iqsamples);
+    }
+  }
+
+  // Downsample IF for the decoder.
+  if (m_split_if) {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::IfResampler,
+                               m_if_split_samples.size());
+    m_if_resampler->process(m_if_split_samples, m_if_samples);
+  } else if (m_downsampling) {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::IfResampler,
+                               iqsamples.size());
+    m_if_resampler->process(iqsamples, m_if_samples);
+  } else {
+    std::swap(m_if_samples, iqsamples);
+  }
+
+  if (m_if_samples.empty()) {
+    return false;
+  }
+
+  // Correct the carrier offset of the IF.
+  if (m_afc) {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::IfAfc,
+                               m_if_samples.size());
+    m_afc->process_inplace(m_if_samples);
+  }
+  return true;
+}
+
+// Measure the IF level for the pre-demodulation squelch.
+bool DecodeChain::gate() {
+  m_if_rms = 0.0;
+  if (!m_squelch_gate) {
+    return true;
+  }
+  m_if_rms = Utility::rms_level_sample(m_if_samples, m_if_magnitude_sq);
+  if (!m_squelch_skip) {
+    return true;
+  }
+  if (m_if_rms >= m_squelch_level) {
+    m_squelch_hold = squelch_hold_blocks;
+  } else if (m_squelch_hold > 0) {
+    m_squelch_hold--;
+  }
+  return m_squelch_hold > 0;
+}
+
+// Decode the IF samples into audio.
+void DecodeChain::decode(bool decode_block, SampleVector &audio) {
+  const std::size_t if_length = m_if_samples.size();
+
+  // The tuning offset is not updated while the decoder is skipped.
+  if (decode_block && m_fm) {
+    // the minus factor is to show the ppm correction
+    // to make and not the one which has already been made
+    m_ppm_average.feed((m_fm->get_tuning_offset() / m_tuner_freq) * -1.0e6);
+  } else if (decode_block && m_nbfm) {
+    m_ppm_average.feed((m_nbfm->get_tuning_offset() / m_tuner_freq) *
+                       -1.0e6);
+  }
+  // Update AFC only while the signal is above the squelch level,
+  // since the offset of the noise is meaningless.
+  m_afc_updated = m_afc && m_if_level >= m_squelch_level &&
+                  m_afc->update(m_ppm_average.average());
+
+  m_filter_selected = false;
+  if (!decode_block) {
+    if (m_fm) {
+      m_fm->skip(if_length, audio);
+    } else if (m_nbfm) {
+      m_nbfm->skip(if_length, audio);
+    } else {
+      m_am->skip(if_length, audio);
+    }
+  } else {
+    double decoded_if_rms;
+    if (m_fm) {
+      // Select the IF filter by the adjacent channel energy.
+      if (m_filter_selector) {
+        StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::IfFilter,
+                                   if_length);
+        if (m_filter_selector->process(m_if_samples)) {
+          select_filter(m_filter_selector->get_filtertype());
+          m_fm->set_filter(m_fmfilter_enable, m_fmfilter_coeff,
+                           FmDecoder::sample_rate_if * filter_crossfade_time);
+          m_filter_selected = true;
+        }
+      }
+      m_fm->process(m_if_samples, audio);
+      decoded_if_rms = m_fm->get_if_rms();
+    } else if (m_nbfm) {
+      m_nbfm->process(m_if_samples, audio);
+      decoded_if_rms = m_nbfm->get_if_rms();
+    } else {
+      m_am->process(m_if_samples, audio);
+      decoded_if_rms = m_am->get_if_rms();
+    }
+    // The AM and NBFM decoders measure the level after the IF filter,
+    // which is not used with the pre-demodulation squelch, so that
+    // the skipped and the muted blocks are decided by the same level.
+    if (!m_squelch_gate) {
+      m_if_rms = decoded_if_rms;
+    }
+  }
+  // Measure the average IF level.
+  m_if_level = 0.75 * m_if_level + 0.25 * m_if_rms;
+}
+
+// Restart the decoder, the offset measurement and the AFC after retuning.
+void DecodeChain::retuned(double tuner_freq) {
+  m_tuner_freq = tuner_freq;
+  if (m_fm) {
+    m_fm->reset();
+  } else if (m_nbfm) {
+    m_nbfm->reset();
+  } else {
+    m_am->reset();
+  }
+  m_ppm_average.fill(0.0f);
+  if (m_afc) {
+    m_afc->reset(tuner_freq);
+  }
+}
+
+// Set the IF filter type of the decoder with crossfading.
+void DecodeChain::set_filtertype(FilterType filtertype) {
+  m_filter_selector.reset();
+  select_filter(filtertype);
+  if (m_fm) {
+    m_fm->set_filter(m_fmfilter_enable, m_fmfilter_coeff,
+                     FmDecoder::sample_rate_if * filter_crossfade_time);
+  } else if (m_nbfm) {
+    m_nbfm->set_filter(m_nbfmfilter_coeff,
+                       NbfmDecoder::internal_rate_pcm * filter_crossfade_time);
+  } else {
+    m_am->set_filter(m_amfilter_coeff,
+                     AmDecoder::internal_rate_pcm * filter_crossfade_time);
+  }
+}
+
+// Set the IF filter coefficients of the filter type.
+void DecodeChain::select_filter(FilterType filtertype) {
+  switch (filtertype) {
+  case FilterType::Default:
+    m_amfilter_coeff = FilterParameters::jj1bdx_am_48khz_default;
+    m_fmfilter_enable = false;
+    m_fmfilter_coeff = FilterParameters::delay_3taps_only_iq;
+    m_nbfmfilter_coeff = FilterParameters::jj1bdx_nbfm_48khz_default;
+    break;
+  case FilterType::Medium:
+    m_amfilter_coeff = FilterParameters::jj1bdx_am_48khz_medium;
+    m_fmfilter_enable = true;
+    m_fmfilter_coeff = FilterParameters::jj1bdx_fm_384kHz_medium;
+    m_nbfmfilter_coeff = FilterParameters::jj1bdx_nbfm_48khz_medium;
+    break;
+  case FilterType::Narrow:
+    m_amfilter_coeff = FilterParameters::jj1bdx_am_48khz_narrow;
+    m_fmfilter_enable = true;
+    m_fmfilter_coeff = FilterParameters::jj1bdx_fm_384kHz_narrow;
+    m_nbfmfilter_coeff = FilterParameters::jj1bdx_nbfm_48khz_narrow;
+    break;
+  case FilterType::Wide:
+    m_amfilter_coeff = FilterParameters::jj1bdx_am_48khz_wide;
+    m_fmfilter_enable = false;
+    m_fmfilter_coeff = FilterParameters::delay_3taps_only_iq;
+    m_nbfmfilter_coeff = FilterParameters::jj1bdx_nbfm_48khz_wide;
+    break;
+  }
+}
+
+// end
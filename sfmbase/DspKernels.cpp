@@ -0,0 +1,218 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <iterator>
+
+#include "DspKernels.h"
+
+// NOTE: this file must be compiled with -ffp-contract=off
+// (see CMakeLists.txt), otherwise the FMA variants may fuse
+// the multiplications and additions, and the results differ
+// from those of the baseline variant.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DSP_KERNELS_X86
+#endif
+
+namespace {
+
+// Number of output samples computed at a time.
+// The loop over a tile is vectorized while each output sample
+// is accumulated in the same order as the scalar loop.
+constexpr unsigned int tile_length = 16;
+
+// Kernel bodies, inlined into each variant.
+// W is the number of values per sample (2 for IQ samples).
+
+template <typename T, unsigned int W>
+[[gnu::always_inline]] inline void
+fir_symmetric_body(const T *input, const T *coeff, unsigned int order,
+                   T *output, unsigned int count, unsigned int step) {
+  const unsigned int half_order = (order - 1) / 2;
+  const bool center_tap = ((order % 2) == 0);
+  unsigned int i = 0;
+
+  if (step == 1) {
+    for (; i + tile_length <= count; i += tile_length) {
+      const T *x = input + i * W;
+      T acc[tile_length * W] = {};
+      for (unsigned int k = 0; k <= half_order; k++) {
+        const T c = coeff[k];
+        const T *x0 = x + (order - k) * W;
+        const T *x1 = x + k * W;
+        for (unsigned int j = 0; j < tile_length * W; j++) {
+          acc[j] += (x0[j] + x1[j]) * c;
+        }
+      }
+      if (center_tap) {
+        const T c = coeff[order / 2];
+        const T *xc = x + (order / 2) * W;
+        for (unsigned int j = 0; j < tile_length * W; j++) {
+          acc[j] += xc[j] * c;
+        }
+      }
+      for (unsigned int j = 0; j < tile_length * W; j++) {
+        output[i * W + j] = acc[j];
+      }
+    }
+  }
+
+  // Remaining samples, or down-sampling.
+  for (; i < count; i++) {
+    const T *x = input + i * step * W;
+    T acc[W] = {};
+    for (unsigned int k = 0; k <= half_order; k++) {
+      const T c = coeff[k];
+      for (unsigned int w = 0; w < W; w++) {
+        acc[w] += (x[(order - k) * W + w] + x[k * W + w]) * c;
+      }
+    }
+    if (center_tap) {
+      const T c = coeff[order / 2];
+      for (unsigned int w = 0; w < W; w++) {
+        acc[w] += x[(order / 2) * W + w] * c;
+      }
+    }
+    for (unsigned int w = 0; w < W; w++) {
+      output[i * W + w] = acc[w];
+    }
+  }
+}
+
+// Define the variant of the kernels compiled with the target attribute.
+#define DSP_KERNELS_VARIANT(suffix, attribute)                                \
+  attribute void fir_symmetric_iq_##suffix(                                   \
+      const IQSample *input, const IQSample::value_type *coeff,               \
+      unsigned int order, IQSample *output, unsigned int count,               \
+      unsigned int step) {                                                    \
+    fir_symmetric_body<float, 2>(reinterpret_cast<const float *>(input),      \
+                                 coeff, order,                                \
+                                 reinterpret_cast<float *>(output), count,    \
+                                 step);                                       \
+  }                                                                           \
+  attribute void fir_symmetric_real_##suffix(                                 \
+      const Sample *input, const Sample *coeff, unsigned int order,           \
+      Sample *output, unsigned int count) {                                   \
+    fir_symmetric_body<Sample, 1>(input, coeff, order, output, count, 1);     \
+  }
+
+DSP_KERNELS_VARIANT(baseline, )
+#ifdef DSP_KERNELS_X86
+DSP_KERNELS_VARIANT(avx2, __attribute__((target("avx2,fma"))))
+DSP_KERNELS_VARIANT(avx512,
+                    __attribute__((target("avx512f,avx512vl,avx2,fma"))))
+#endif
+
+#undef DSP_KERNELS_VARIANT
+
+bool baseline_supported() { return true; }
+
+#ifdef DSP_KERNELS_X86
+bool avx2_supported() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+bool avx512_supported() {
+  __builtin_cpu_init();
+  return avx2_supported() && __builtin_cpu_supports("avx512f") &&
+         __builtin_cpu_supports("avx512vl");
+}
+#endif
+
+struct Variant {
+  const char *name;
+  bool (*supported)();
+  decltype(&DspKernels::fir_symmetric_iq) fir_symmetric_iq;
+  decltype(&DspKernels::fir_symmetric_real) fir_symmetric_real;
+};
+
+// Variants in the order of preference.
+const Variant variants[] = {
+#ifdef DSP_KERNELS_X86
+    {"avx512", avx512_supported, fir_symmetric_iq_avx512,
+     fir_symmetric_real_avx512},
+    {"avx2", avx2_supported, fir_symmetric_iq_avx2, fir_symmetric_real_avx2},
+    {"sse2", baseline_supported, fir_symmetric_iq_baseline,
+     fir_symmetric_real_baseline},
+#elif defined(__ARM_NEON)
+    {"neon", baseline_supported, fir_symmetric_iq_baseline,
+     fir_symmetric_real_baseline},
+#else
+    {"generic", baseline_supported, fir_symmetric_iq_baseline,
+     fir_symmetric_real_baseline},
+#endif
+};
+
+// Return the selected variant, choosing the best one at the first call.
+std::atomic<const Variant *> &selected() {
+  static std::atomic<const Variant *> variant = [] {
+    for (const auto &v : variants) {
+      if (v.supported()) {
+        return &v;
+      }
+    }
+    return &variants[std::size(variants) - 1];
+  }();
+  return variant;
+}
+
+} // namespace
+
+namespace DspKernels {
+
+void fir_symmetric_iq(const IQSample *input, const IQSample::value_type *coeff,
+                      unsigned int order, IQSample *output, unsigned int count,
+                      unsigned int step) {
+  selected().load(std::memory_order_relaxed)
+      ->fir_symmetric_iq(input, coeff, order, output, count, step);
+}
+
+void fir_symmetric_real(const Sample *input, const Sample *coeff,
+                        unsigned int order, Sample *output,
+                        unsigned int count) {
+  selected().load(std::memory_order_relaxed)
+      ->fir_symmetric_real(input, coeff, order, output, count);
+}
+
+const char *variant_name() { return selected().load()->name; }
+
+std::vector<std::string> available_variants() {
+  std::vector<std::string> names;
+  for (const auto &v : variants) {
+    if (v.supported()) {
+      names.push_back(v.name);
+    }
+  }
+  return names;
+}
+
+bool select_variant(const std::string &name) {
+  for (const auto &v : variants) {
+    if (name == v.name && v.supported()) {
+      selected().store(&v);
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace DspKernels
+
+// end
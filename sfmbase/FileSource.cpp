@@ -35,7 +35,8 @@ std::atomic<FileSource *> FileSource::m_this{nullptr};
 FileSource::FileSource(int dev_index)
     : m_sample_rate(default_sample_rate), m_frequency(default_frequency),
       m_zero_offset(false), m_block_length(default_block_length),
-      m_sfp(nullptr), m_fmt_fn(nullptr), m_thread(nullptr) {
+      m_realtime(true), m_raw(false), m_samples_read(0), m_sfp(nullptr),
+      m_fmt_fn(nullptr), m_thread(nullptr) {
   (void)dev_index;
   m_sfinfo = {0, 0, 0, 0, 0, 0};
   m_this = this;
@@ -60,6 +61,7 @@ bool FileSource::configure(std::string configurationStr) {
   uint32_t frequency = default_frequency;
   bool zero_offset = false;
   int block_length = default_block_length;
+  bool realtime = true;
 
   bool srate_specified = false;
 
@@ -109,6 +111,19 @@ bool FileSource::configure(std::string configurationStr) {
     fmt::println(stderr, "FileSource::configure: blklen: {}", block_length);
   }
 
+  // realtime
+  if (m.find("realtime") != m.end()) {
+    int realtime_value = 1;
+    if (!Utility::parse_int(m["realtime"].c_str(), realtime_value) ||
+        (realtime_value != 0 && realtime_value != 1)) {
+      fmt::println(stderr, "FileSource::configure: invalid realtime");
+      return false;
+    }
+    realtime = (realtime_value == 1);
+    fmt::println(stderr, "FileSource::configure: realtime: {}",
+                 realtime_value);
+  }
+
   // zero_offset
   if (m.find("zero_offset") != m.end()) {
     fmt::println(stderr, "FileSource::configure: zero_offset");
@@ -157,17 +172,19 @@ bool FileSource::configure(std::string configurationStr) {
 
   // configure
   return configure(filename, raw, format_type, sample_rate, frequency,
-                   zero_offset, block_length);
+                   zero_offset, block_length, realtime);
 }
 
 bool FileSource::configure(std::string fname, bool raw, FormatType format_type,
                            std::uint32_t sample_rate, std::uint32_t frequency,
-                           bool zero_offset, int block_length) {
+                           bool zero_offset, int block_length, bool realtime) {
   m_devname = fname;
   m_sample_rate = sample_rate;
   m_frequency = frequency;
   m_zero_offset = zero_offset;
   m_block_length = block_length;
+  m_realtime = realtime;
+  m_raw = raw;
 
   // Fill sfinfo when raw is true;
   if (raw) {
@@ -276,7 +293,9 @@ std::uint32_t FileSource::get_frequency() { return m_frequency; }
 bool FileSource::is_low_if() { return !m_zero_offset; }
 
 void FileSource::print_specific_parms() {
-  // nop
+  if (!m_realtime) {
+    fmt::println(stderr, "FileSource: reading faster than real time");
+  }
 }
 
 // Return a list of supported device.
@@ -285,6 +304,18 @@ void FileSource::get_device_names(std::vector<std::string> &devices) {
   devices.push_back("FileSource");
 }
 
+// Open the source file again for independent reading.
+SNDFILE *FileSource::open_duplicate() const {
+  SF_INFO sfinfo = {0, 0, 0, 0, 0, 0};
+  // Raw files need the format information to open.
+  if (m_raw) {
+    sfinfo.samplerate = m_sfinfo.samplerate;
+    sfinfo.channels = m_sfinfo.channels;
+    sfinfo.format = m_sfinfo.format;
+  }
+  return sf_open(m_devname.c_str(), SFM_READ, &sfinfo);
+}
+
 int FileSource::to_sf_format(FormatType format_type) {
   int ret = 0;
 
@@ -318,7 +349,8 @@ bool FileSource::get_major_format(int major_format, std::string &str) {
     return ret;
   }
   if ((major_format != SF_FORMAT_WAV) && (major_format != SF_FORMAT_W64) &&
-      (major_format != SF_FORMAT_WAVEX) && (major_format != SF_FORMAT_RAW)) {
+      (major_format != SF_FORMAT_WAVEX) && (major_format != SF_FORMAT_RF64) &&
+      (major_format != SF_FORMAT_FLAC) && (major_format != SF_FORMAT_RAW)) {
     return ret;
   }
   int count;
@@ -369,7 +401,10 @@ bool FileSource::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag) {
 
   // Start thread.
   if (m_thread == 0) {
-    m_thread = std::make_unique<std::thread>(run);
+    m_thread = std::make_unique<std::thread>([this] {
+      m_thread_setting.apply("source");
+      run();
+    });
     return true;
   } else {
     m_error = "Source thread already started";
@@ -382,6 +417,16 @@ bool FileSource::stop() {
   if (m_thread) {
     m_thread->join();
     m_thread.reset();
+
+    // Report the achieved speed.
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - m_start_time)
+                         .count();
+    double duration = double(m_samples_read.load()) / m_sample_rate;
+    fmt::println(stderr,
+                 "FileSource: {:.3f} seconds of samples processed in {:.3f} "
+                 "seconds ({:.2f} times real time)",
+                 duration, elapsed, elapsed > 0 ? duration / elapsed : 0.0);
   }
 
   return true;
@@ -418,14 +463,27 @@ void FileSource::run() {
   // Use steady_clock so the cadence is immune to wall-clock (NTP) jumps.
   std::chrono::steady_clock::time_point begin =
       std::chrono::steady_clock::now();
+  self->m_start_time = begin;
   while (!self->m_stop_flag->load()) {
     // Read and convert samples.
     if (!get_samples(&iqsamples)) {
       break;
     }
+    self->m_samples_read += iqsamples.size();
 
     // Push samples.
     self->m_buf->push(std::move(iqsamples));
+    iqsamples = self->m_buf->get_spare();
+
+    if (!self->m_realtime) {
+      // No throttling, but wait for the decoder to catch up
+      // so that the queue memory is bounded.
+      while (!self->m_stop_flag->load() &&
+             !self->m_buf->wait_queue_size_below(
+                 max_queued_blocks, std::chrono::milliseconds(100))) {
+      }
+      continue;
+    }
 
     // Get clock and calculate elapsed.
     std::chrono::steady_clock::time_point end =
@@ -507,7 +565,8 @@ bool FileSource::get_sf_read_float(IQSampleVector *samples) {
   // setup vector for reading
   sf_count_t n_read;
   sf_count_t sz = static_cast<sf_count_t>(self->m_block_length) * 2;
-  std::vector<float> buf(sz);
+  std::vector<float> &buf = self->m_read_buf;
+  buf.resize(sz);
 
   // read float samples
   // Note: implicit conversion done in sf_read_float()
@@ -19,6 +19,7 @@
 
 #include <algorithm>
 
+#include "DspKernels.h"
 #include "Filter.h"
 
 // class LowPassFilterFirIQ
@@ -27,23 +28,17 @@
 LowPassFilterFirIQ::LowPassFilterFirIQ(const IQSampleCoeff &coeff,
                                        const unsigned int downsample)
     : m_coeff(coeff), m_order(coeff.empty() ? 0 : coeff.size() - 1),
-      m_downsample(downsample), m_pos(0) {
+      m_downsample(downsample), m_pos(0), m_fade_length(0), m_fade_pos(0) {
   assert(!coeff.empty());
   assert(downsample >= 1);
   m_state.resize(m_order);
 }
 
 // Process samples.
-void LowPassFilterFirIQ::process(const IQSampleVector &samples_in,
+void LowPassFilterFirIQ::process(std::span<const IQSample> samples_in,
                                  IQSampleVector &samples_out) {
-  unsigned int order = m_state.size();
   unsigned int n = samples_in.size();
 
-  // Integer downsample factor, no linear interpolation.
-
-  unsigned int p = m_pos;
-  unsigned int pstep = m_downsample;
-
   // Empty input must short-circuit before the resize, otherwise unsigned
   // (n - p + pstep - 1) underflows when n == 0 and p > 0.
   if (n == 0) {
@@ -51,47 +46,134 @@ void LowPassFilterFirIQ::process(const IQSampleVector &samples_in,
     return;
   }
 
+  filter(m_coeff, m_state, samples_in, samples_out);
+
+  // Crossfade from the output of the old coefficients.
+  if (crossfading()) {
+    filter(m_fade_coeff, m_fade_state, samples_in, m_fade_out);
+    unsigned int count = std::min<unsigned int>(samples_out.size(),
+                                                m_fade_length - m_fade_pos);
+    for (unsigned int i = 0; i < count; i++) {
+      IQSample::value_type w =
+          IQSample::value_type(m_fade_pos + i + 1) / m_fade_length;
+      samples_out[i] = m_fade_out[i] + (samples_out[i] - m_fade_out[i]) * w;
+    }
+    m_fade_pos += count;
+  }
+
+  advance(n);
+}
+
+// Output the delayed input samples without filtering.
+void LowPassFilterFirIQ::bypass(std::span<const IQSample> samples_in,
+                                IQSampleVector &samples_out) {
+  assert(m_downsample == 1);
+  unsigned int n = samples_in.size();
+  unsigned int delay = m_order / 2;
+  unsigned int head = std::min(delay, n);
+
+  samples_out.resize(n);
+  std::copy(m_state.end() - delay, m_state.end() - delay + head,
+            samples_out.begin());
+  if (n > delay) {
+    std::copy(samples_in.begin(), samples_in.end() - delay,
+              samples_out.begin() + delay);
+  }
+
+  update_state(m_state, samples_in);
+  advance(n);
+  m_fade_length = 0;
+  m_fade_pos = 0;
+}
+
+// Change the filter coefficients.
+void LowPassFilterFirIQ::set_coefficients(const IQSampleCoeff &coeff,
+                                          const unsigned int crossfade_length) {
+  assert(!coeff.empty());
+
+  // Keep the old coefficients and history for crossfading.
+  // A crossfade in progress is replaced.
+  if (crossfade_length > 0) {
+    m_fade_coeff = m_coeff;
+    m_fade_state = m_state;
+  }
+  m_fade_length = crossfade_length;
+  m_fade_pos = 0;
+
+  // Keep the latest input samples as the history of the new order.
+  unsigned int order = coeff.size() - 1;
+  if (order > m_order) {
+    m_state.insert(m_state.begin(), order - m_order, IQSample(0));
+  } else {
+    m_state.erase(m_state.begin(), m_state.begin() + (m_order - order));
+  }
+  m_coeff = coeff;
+  m_order = order;
+}
+
+// Compute the output samples and update the history.
+void LowPassFilterFirIQ::filter(const IQSampleCoeff &coeff,
+                                IQSampleVector &state,
+                                std::span<const IQSample> samples_in,
+                                IQSampleVector &samples_out) const {
+  unsigned int order = state.size();
+  unsigned int n = samples_in.size();
+
+  // Integer downsample factor, no linear interpolation.
+
+  unsigned int p = m_pos;
+  unsigned int pstep = m_downsample;
+
   samples_out.resize((n - p + pstep - 1) / pstep);
 
-  // The first few samples need data from m_state.
+  // The first few samples need data from state.
   // NOTE: this assumes the filter has symmetric coefficient pairs
   unsigned int i = 0;
   for (; p < n && p < order; p += pstep, i++) {
     IQSample y = 0;
     for (unsigned int j = p + 1; j <= order; j++) {
-      y += m_state[order + p - j] * m_coeff[j];
+      y += state[order + p - j] * coeff[j];
     }
     for (unsigned int j = 1; j <= p; j++) {
-      y += samples_in[p - j] * m_coeff[j];
+      y += samples_in[p - j] * coeff[j];
     }
     samples_out[i] = y;
   }
 
   // Remaining samples only need data from samples_in.
   // NOTE: this assumes the filter has symmetric coefficient pairs
-  unsigned int half_order = (order - 1) / 2;
-  for (; p < n; p += pstep, i++) {
-    IQSample y = 0;
-    for (unsigned int k = 0; k <= half_order; k++) {
-      y += (samples_in[p - k] + samples_in[p - (order - k)]) * m_coeff[k];
-    }
-    if ((order % 2) == 0) {
-      y += samples_in[p - (order / 2)] * m_coeff[(order / 2)];
-    }
-    samples_out[i] = y;
+  if (p < n) {
+    unsigned int count = (n - p + pstep - 1) / pstep;
+    DspKernels::fir_symmetric_iq(&samples_in[p - order], coeff.data(), order,
+                                 &samples_out[i], count, pstep);
+    p += count * pstep;
+    i += count;
   }
 
   assert(i == samples_out.size());
 
-  // Update index of start position in text sample block.
+  update_state(state, samples_in);
+}
+
+// Update index of start position in next sample block.
+void LowPassFilterFirIQ::advance(const unsigned int n) {
+  unsigned int p = m_pos;
+  if (p < n) {
+    p += ((n - p + m_downsample - 1) / m_downsample) * m_downsample;
+  }
   m_pos = p - n;
+}
 
-  // Update m_state.
+// Update the history with the input samples.
+void LowPassFilterFirIQ::update_state(IQSampleVector &state,
+                                      std::span<const IQSample> samples_in) {
+  unsigned int order = state.size();
+  unsigned int n = samples_in.size();
   if (n < order) {
-    std::copy(m_state.begin() + n, m_state.end(), m_state.begin());
-    std::copy(samples_in.begin(), samples_in.end(), m_state.end() - n);
+    std::copy(state.begin() + n, state.end(), state.begin());
+    std::copy(samples_in.begin(), samples_in.end(), state.end() - n);
   } else {
-    std::copy(samples_in.end() - order, samples_in.end(), m_state.begin());
+    std::copy(samples_in.end() - order, samples_in.end(), state.begin());
   }
 }
 
@@ -105,7 +187,7 @@ LowPassFilterFirAudio::LowPassFilterFirAudio(const SampleCoeff &coeff)
 }
 
 // Process samples.
-void LowPassFilterFirAudio::process(const SampleVector &samples_in,
+void LowPassFilterFirAudio::process(std::span<const Sample> samples_in,
                                     SampleVector &samples_out) {
   unsigned int order = m_state.size();
   unsigned int n = samples_in.size();
@@ -136,16 +218,12 @@ void LowPassFilterFirAudio::process(const SampleVector &samples_in,
 
   // Remaining samples only need data from samples_in.
   // NOTE: this assumes the filter has symmetric coefficient pairs
-  unsigned int half_order = (order - 1) / 2;
-  for (; p < n; p++, i++) {
-    Sample y = 0;
-    for (unsigned int k = 0; k <= half_order; k++) {
-      y += (samples_in[p - k] + samples_in[p - (order - k)]) * m_coeff[k];
-    }
-    if ((order % 2) == 0) {
-      y += samples_in[p - (order / 2)] * m_coeff[(order / 2)];
-    }
-    samples_out[i] = y;
+  if (p < n) {
+    unsigned int count = n - p;
+    DspKernels::fir_symmetric_real(&samples_in[p - order], m_coeff.data(),
+                                   order, &samples_out[i], count);
+    p += count;
+    i += count;
   }
 
   assert(i == samples_out.size());
@@ -177,6 +255,14 @@ double FirstOrderIirFilter::process(double input) {
   return y;
 }
 
+// Change the filter coefficients.
+void FirstOrderIirFilter::set_coefficients(const double b0, const double b1,
+                                           const double a1) {
+  m_b0 = b0;
+  m_b1 = b1;
+  m_a1 = a1;
+}
+
 // Class LowPassFilterRC
 // Construct 1st order low-pass IIR filter.
 // Continuous domain:
@@ -187,8 +273,17 @@ LowPassFilterRC::LowPassFilterRC(const double timeconst)
     : m_timeconst(timeconst), m_a1(-std::exp(-1 / m_timeconst)), m_b0(1 + m_a1),
       m_filter0(m_b0, 0, m_a1), m_filter1(m_b0, 0, m_a1) {}
 
+// Change the time constant.
+void LowPassFilterRC::set_timeconst(const double timeconst) {
+  m_timeconst = timeconst;
+  m_a1 = -std::exp(-1 / m_timeconst);
+  m_b0 = 1 + m_a1;
+  m_filter0.set_coefficients(m_b0, 0, m_a1);
+  m_filter1.set_coefficients(m_b0, 0, m_a1);
+}
+
 // Process samples.
-void LowPassFilterRC::process(const SampleVector &samples_in,
+void LowPassFilterRC::process(std::span<const Sample> samples_in,
                               SampleVector &samples_out) {
   unsigned int n = samples_in.size();
   samples_out.resize(n);
@@ -199,7 +294,7 @@ void LowPassFilterRC::process(const SampleVector &samples_in,
 }
 
 // Process interleaved samples.
-void LowPassFilterRC::process_interleaved(const SampleVector &samples_in,
+void LowPassFilterRC::process_interleaved(std::span<const Sample> samples_in,
                                           SampleVector &samples_out) {
   unsigned int n = samples_in.size();
   samples_out.resize(n);
@@ -211,7 +306,7 @@ void LowPassFilterRC::process_interleaved(const SampleVector &samples_in,
 }
 
 // Process samples in-place.
-void LowPassFilterRC::process_inplace(SampleVector &samples) {
+void LowPassFilterRC::process_inplace(std::span<Sample> samples) {
   unsigned int n = samples.size();
 
   for (unsigned int i = 0; i < n; i++) {
@@ -221,7 +316,7 @@ void LowPassFilterRC::process_inplace(SampleVector &samples) {
 }
 
 // Process interleaved samples in-place.
-void LowPassFilterRC::process_interleaved_inplace(SampleVector &samples) {
+void LowPassFilterRC::process_interleaved_inplace(std::span<Sample> samples) {
   unsigned int n = samples.size();
 
   for (unsigned int i = 0; (i + 1) < n; i += 2) {
@@ -290,7 +385,7 @@ HighPassFilterIir::HighPassFilterIir(const double cutoff) {
 }
 
 // Process samples.
-void HighPassFilterIir::process(const SampleVector &samples_in,
+void HighPassFilterIir::process(std::span<const Sample> samples_in,
                                 SampleVector &samples_out) {
   unsigned int n = samples_in.size();
   samples_out.resize(n);
@@ -301,7 +396,7 @@ void HighPassFilterIir::process(const SampleVector &samples_in,
 }
 
 // Process samples in-place.
-void HighPassFilterIir::process_inplace(SampleVector &samples) {
+void HighPassFilterIir::process_inplace(std::span<Sample> samples) {
   unsigned int n = samples.size();
 
   for (unsigned int i = 0; i < n; i++) {
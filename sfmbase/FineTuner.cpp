@@ -17,56 +17,53 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <cmath>
+
 #include "FineTuner.h"
 
 // class FineTuner
 
 // Constructors.
-FineTuner::FineTuner(unsigned const int table_size, const int freq_shift)
-    : m_index(0), m_table_size(table_size), m_table(table_size),
-      m_phase_table(table_size) {
+FineTuner::FineTuner(const double sample_rate, const double freq_shift)
+    : m_sample_rate(sample_rate), m_freq_shift(0), m_phase_inc(1, 0),
+      m_phase(1, 0) {
   set_freq_shift(freq_shift);
 }
 
-// Set shift frequency table while maintaining the phase continuity.
-void FineTuner::set_freq_shift(const int freq_shift) {
-  // Get the current phase shigt value and set it to the offset,
-  // and if the offset > 2*M_PI, put in in the range of 0 <= offset <= 2*M_PI.
-  // When right after the FineTuner object is constructed,
-  // m_index == 0, and m_phase_table[0] == 0,
-  // so phase offset is set to zero and has no problem.
-  double phase_offset = std::fmod(m_phase_table[m_index], 2.0 * M_PI);
-  m_index = 0;
-  // Initialize the sin/cos and phase values.
-  double phase_step = 2.0 * M_PI / double(m_table_size);
-  for (unsigned int i = 0; i < m_table_size; i++) {
-    double phi = ((((int64_t)freq_shift * i) % m_table_size) * phase_step) +
-                 phase_offset;
-    double pcos = cos(phi);
-    double psin = sin(phi);
-    m_table[i] = IQSample(pcos, psin);
-    m_phase_table[i] = phi;
-  }
+// Set the phase increment per sample.
+// The current phase is kept as is, so the phase is continuous.
+void FineTuner::set_freq_shift(const double freq_shift) {
+  m_freq_shift = freq_shift;
+  double phase_step = 2.0 * M_PI * freq_shift / m_sample_rate;
+  m_phase_inc = lv_32fc_t(std::cos(phase_step), std::sin(phase_step));
 }
 
 // Process samples.
-void FineTuner::process(const IQSampleVector &samples_in,
+void FineTuner::process(std::span<const IQSample> samples_in,
                         IQSampleVector &samples_out) {
-  unsigned int tblidx = m_index;
-  unsigned int tblsiz = m_table.size();
   unsigned int n = samples_in.size();
-
   samples_out.resize(n);
+  process_samples(samples_in.data(), samples_out.data(), n);
+}
 
-  for (unsigned int i = 0; i < n; i++) {
-    samples_out[i] = samples_in[i] * m_table[tblidx];
-    tblidx++;
-    if (tblidx == tblsiz) {
-      tblidx = 0;
-    }
-  }
+// Process samples in-place.
+void FineTuner::process_inplace(std::span<IQSample> samples) {
+  process_samples(samples.data(), samples.data(), samples.size());
+}
 
-  m_index = tblidx;
+inline void FineTuner::process_samples(const IQSample *input,
+                                       IQSample *output, unsigned int n) {
+  // Note: the rotator kernels load each sample before storing it,
+  // so the input and output can be the same buffer.
+  // Note 2: from VOLK 3.1.0 the phase increment is passed by pointer,
+  // handled in the following if-else-endif clause.
+#if VOLK_VERSION < 030100
+  // Before 3.1.0
+  volk_32fc_s32fc_x2_rotator_32fc(output, input, m_phase_inc, &m_phase, n);
+#else
+  // 3.1.0 and later (version inclusive)
+  volk_32fc_s32fc_x2_rotator2_32fc(output, input, &m_phase_inc, &m_phase, n);
+#endif // VOLK_VERSION
 }
 
 // end
@@ -22,21 +22,26 @@
 
 // class FmDecoder
 
-FmDecoder::FmDecoder(bool fmfilter_enable, IQSampleCoeff &fmfilter_coeff,
-                     bool stereo, double deemphasis, bool pilot_shift,
+FmDecoder::FmDecoder(bool fmfilter_enable,
+                     const IQSampleCoeff &fmfilter_coeff, bool stereo,
+                     double deemphasis, bool pilot_shift,
                      unsigned int multipath_stages)
     // Initialize member fields
-    : m_fmfilter_enable(fmfilter_enable), m_fmfilter_coeff(fmfilter_coeff),
-      m_pilot_shift(pilot_shift),
+    : m_fmfilter_enable(fmfilter_enable), m_pilot_shift(pilot_shift),
       m_enable_multipath_filter((multipath_stages > 0)),
-      // Wait first 100 blocks to enable the multipath filter
-      m_wait_multipath_blocks(100), m_multipath_stages(multipath_stages),
-      m_stereo_enabled(stereo), m_stereo_detected(false), m_baseband_mean(0),
-      m_baseband_level(0), m_if_rms(0.0)
-
-      // Construct FM narrow filter
+      // Wait first blocks to enable the multipath filter
+      m_wait_multipath_blocks(multipath_wait_blocks),
+      m_multipath_stages(multipath_stages),
+      m_stereo_enabled(stereo), m_stereo_detected(false),
+      m_rds_enabled(false), m_baseband_mean(0),
+      m_baseband_level(0), m_if_rms(0.0), m_profiler(nullptr)
+
+      // Construct FM narrow filter,
+      // or the delay of the bypassed filter
       ,
-      m_fmfilter(m_fmfilter_coeff, 1)
+      m_fmfilter(fmfilter_enable ? fmfilter_coeff
+                                 : FilterParameters::delay_3taps_only_iq,
+                 1)
 
       // Construct AudioResampler for mono and stereo channels
       ,
@@ -76,13 +81,15 @@ FmDecoder::FmDecoder(bool fmfilter_enable, IQSampleCoeff &fmfilter_coeff,
       // Construct multipath filter
       // for 384kHz IF: 288 -> 750 microseconds (288/384000 * 1000000)
       ,
-      m_multipathfilter(m_enable_multipath_filter ? m_multipath_stages : 1)
+      m_multipathfilter(std::in_place,
+                        m_enable_multipath_filter ? m_multipath_stages : 1)
 
 {
   // Do nothing
 }
 
-void FmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
+void FmDecoder::process(std::span<const IQSample> samples_in,
+                        SampleVector &audio) {
 
   // If no sampled baseband signal comes out,
   // terminate and wait for next block,
@@ -92,43 +99,62 @@ void FmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
   }
 
   // Measure IF RMS level.
-  m_if_rms = Utility::rms_level_sample(samples_in);
+  m_if_rms = Utility::rms_level_sample(samples_in, m_buf_magnitude_sq);
+
+  // The skipped stages are bypassed by pointing to the input of the stage
+  // instead of moving the buffers, so that all buffers are kept allocated.
 
   // Apply IF filter if IF resampler is enabled
-  if (m_fmfilter_enable) {
+  // (or while crossfading to the bypassed filter).
+  std::span<const IQSample> samples_iffiltered = samples_in;
+  if (m_fmfilter_enable || m_fmfilter.crossfading()) {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::IfFilter,
+                               samples_in.size());
     m_fmfilter.process(samples_in, m_samples_in_iffiltered);
+    samples_iffiltered = m_samples_in_iffiltered;
   } else {
-    m_samples_in_iffiltered = std::move(samples_in);
+    // Delay as delay_3taps_only_iq, so that the output is aligned
+    // when crossfading, and keep the filter history to enable
+    // the filter later.
+    m_fmfilter.bypass(samples_in, m_samples_in_iffiltered);
+    samples_iffiltered = m_samples_in_iffiltered;
   }
 
   // Perform IF AGC.
-  m_ifagc.process(m_samples_in_iffiltered, m_samples_in_after_agc);
+  {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::IfAgc,
+                               samples_iffiltered.size());
+    m_ifagc.process(samples_iffiltered, m_samples_in_after_agc);
+  }
 
+  // No multipath filter applied unless enabled and done successfully.
+  std::span<const IQSample> samples_multipathfiltered = m_samples_in_after_agc;
   if (m_wait_multipath_blocks > 0) {
     m_wait_multipath_blocks--;
-    // No multipath filter applied.
-    m_samples_in_multipathfiltered = std::move(m_samples_in_after_agc);
-  } else {
-    if (m_enable_multipath_filter) {
-      // Apply multipath filter.
-      bool done_ok = m_multipathfilter.process(m_samples_in_after_agc,
-                                               m_samples_in_multipathfiltered);
-      // Check if the error evaluation becomes invalid/infinite.
-      if (!done_ok) {
-        // Reset the filter coefficients.
-        m_multipathfilter.initialize_coefficients();
-        // Discard the invalid filter output, and
-        // use the no-filter input after resetting the filter.
-        m_samples_in_multipathfiltered = std::move(m_samples_in_after_agc);
-      }
+  } else if (m_enable_multipath_filter) {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::Multipath,
+                               m_samples_in_after_agc.size());
+    // Apply multipath filter.
+    bool done_ok = m_multipathfilter->process(m_samples_in_after_agc,
+                                              m_samples_in_multipathfiltered);
+    // Check if the error evaluation becomes invalid/infinite.
+    if (done_ok) {
+      samples_multipathfiltered = m_samples_in_multipathfiltered;
     } else {
-      // No multipath filter applied.
-      m_samples_in_multipathfiltered = std::move(m_samples_in_after_agc);
+      // Reset the filter coefficients.
+      // Discard the invalid filter output, and
+      // use the no-filter input after resetting the filter.
+      m_multipathfilter->initialize_coefficients();
     }
   }
 
   // Demodulate FM to MPX signal.
-  m_phasedisc.process(m_samples_in_multipathfiltered, m_buf_decoded);
+  {
+    StageProfiler::Scope scope(m_profiler,
+                               StageProfiler::Stage::Discriminator,
+                               samples_multipathfiltered.size());
+    m_phasedisc.process(samples_multipathfiltered, m_buf_decoded);
+  }
 
   // If no downsampled baseband signal comes out,
   // terminate and wait for next block,
@@ -154,7 +180,11 @@ void FmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
   if (m_stereo_enabled) {
     // Lock on stereo pilot,
     // and remove locked 19kHz tone from the composite signal.
-    m_pilotpll.process(m_buf_baseband, m_buf_rawstereo, m_pilot_shift);
+    {
+      StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::PilotPll,
+                                 m_buf_baseband.size());
+      m_pilotpll.process(m_buf_baseband, m_buf_rawstereo, m_pilot_shift);
+    }
 
     // Force-set this flag to true to measure stereo PLL phase noise
     // m_stereo_detected = true;
@@ -173,29 +203,53 @@ void FmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
     // NOTE: This MUST be done even if no stereo signal is detected yet,
     // because the downsamplers for mono and stereo signal must be
     // kept in sync.
+    StageProfiler::Scope scope(m_profiler,
+                               StageProfiler::Stage::AudioResampler,
+                               m_buf_rawstereo.size());
     m_audioresampler_stereo.process(m_buf_rawstereo, m_buf_stereo_firstout);
+  } else if (m_rds_enabled) {
+    // Lock on stereo pilot for the RDS subcarrier only.
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::PilotPll,
+                               m_buf_baseband.size());
+    m_pilotpll.process(m_buf_baseband, m_buf_rawstereo, m_pilot_shift);
   }
 
   // Deemphasize the mono audio signal.
   m_deemph_mono.process_inplace(m_buf_baseband);
 
   // Extract mono audio signal.
-  m_audioresampler_mono.process(m_buf_baseband, m_buf_mono_firstout);
+  {
+    StageProfiler::Scope scope(m_profiler,
+                               StageProfiler::Stage::AudioResampler,
+                               m_buf_baseband.size());
+    m_audioresampler_mono.process(m_buf_baseband, m_buf_mono_firstout);
+  }
   // If no mono audio signal comes out, terminate and wait for next block,
   if (m_buf_mono_firstout.size() == 0) {
     audio.resize(0);
     return;
   }
-  // Filter out mono 19kHz pilot signal.
-  m_pilotcut_mono.process(m_buf_mono_firstout, m_buf_mono);
-  // DC blocking
-  m_dcblock_mono.process_inplace(m_buf_mono);
-
-  if (m_stereo_enabled) {
+  // In mono mode, the mono signal is filtered directly into the audio.
+  SampleVector &buf_mono = m_stereo_enabled ? m_buf_mono : audio;
+  {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::AudioFilter,
+                               m_buf_mono_firstout.size());
     // Filter out mono 19kHz pilot signal.
-    m_pilotcut_stereo.process(m_buf_stereo_firstout, m_buf_stereo);
+    m_pilotcut_mono.process(m_buf_mono_firstout, buf_mono);
     // DC blocking
-    m_dcblock_stereo.process_inplace(m_buf_stereo);
+    m_dcblock_mono.process_inplace(buf_mono);
+  }
+
+  if (m_stereo_enabled) {
+    {
+      StageProfiler::Scope scope(m_profiler,
+                                 StageProfiler::Stage::AudioFilter,
+                                 m_buf_stereo_firstout.size());
+      // Filter out mono 19kHz pilot signal.
+      m_pilotcut_stereo.process(m_buf_stereo_firstout, m_buf_stereo);
+      // DC blocking
+      m_dcblock_stereo.process_inplace(m_buf_stereo);
+    }
 
     if (m_stereo_detected) {
       if (m_pilot_shift) {
@@ -214,10 +268,63 @@ void FmDecoder::process(IQSampleVector samples_in, SampleVector &audio) {
         mono_to_left_right(m_buf_mono, audio);
       }
     }
-  } else {
-    // Just return mono channel.
-    audio = std::move(m_buf_mono);
   }
+  // Otherwise the mono channel is already in the audio.
+}
+
+void FmDecoder::skip(std::size_t if_length, SampleVector &audio) {
+  // Skip the IF samples of whole audio samples, and feed the rest
+  // to the audio resamplers, so that the resamplers keep the same phase
+  // as decoding all the IF samples.
+  std::size_t rest = if_length % audio_decimation;
+  std::size_t audio_length = (if_length - rest) / audio_decimation;
+  if (rest > 0) {
+    m_buf_baseband.assign(rest, 0.0);
+    m_audioresampler_mono.process(m_buf_baseband, m_buf_mono_firstout);
+    if (m_stereo_enabled) {
+      m_audioresampler_stereo.process(m_buf_baseband, m_buf_stereo_firstout);
+    }
+    audio_length += m_buf_mono_firstout.size();
+  }
+  // Stereo output is always interleaved, even for mono signal.
+  audio.assign(audio_length * (m_stereo_enabled ? 2 : 1), 0.0);
+  // The pilot phase is lost, and no PPS event is generated.
+  m_pilotpll.skip(if_length);
+  m_stereo_detected = false;
+}
+
+void FmDecoder::reset() {
+  // Retrain the multipath filter after the same wait as the start.
+  m_multipathfilter->initialize_coefficients();
+  m_wait_multipath_blocks = multipath_wait_blocks;
+  m_ifagc.reset_gain();
+  m_baseband_mean = 0;
+}
+
+void FmDecoder::set_deemphasis(double deemphasis) {
+  // Same as the constructor.
+  double timeconst =
+      (deemphasis == 0) ? 1.0 : (deemphasis * sample_rate_if * 1.0e-6);
+  m_deemph_mono.set_timeconst(timeconst);
+  m_deemph_stereo.set_timeconst(timeconst);
+}
+
+void FmDecoder::set_multipath_stages(unsigned int multipath_stages) {
+  m_enable_multipath_filter = (multipath_stages > 0);
+  m_multipath_stages = multipath_stages;
+  m_multipathfilter.emplace(m_enable_multipath_filter ? m_multipath_stages
+                                                      : 1);
+}
+
+void FmDecoder::set_filter(bool fmfilter_enable,
+                           const IQSampleCoeff &fmfilter_coeff,
+                           unsigned int crossfade_length) {
+  // The bypassed filter is the delay of delay_3taps_only_iq.
+  m_fmfilter.set_coefficients(fmfilter_enable
+                                  ? fmfilter_coeff
+                                  : FilterParameters::delay_3taps_only_iq,
+                              crossfade_length);
+  m_fmfilter_enable = fmfilter_enable;
 }
 
 // Demodulate stereo L-R signal.
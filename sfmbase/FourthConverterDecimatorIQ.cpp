@@ -0,0 +1,206 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+
+#include "FourthConverterDecimatorIQ.h"
+
+// The phase of the Fs/4 rotation at the center tap is fixed
+// when the number of the tap pairs is odd.
+static_assert(FourthConverterDecimatorIQ::half_length % 2 == 1);
+
+namespace {
+
+// Number of the odd input samples for each output sample.
+constexpr unsigned int odd_taps = 2 * FourthConverterDecimatorIQ::half_length;
+// Number of output samples computed at a time, an even number
+// so that the signs of the output samples are fixed in a tile.
+constexpr unsigned int tile_length = 16;
+
+// Zeroth-order modified Bessel function of the first kind.
+double bessel_i0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (unsigned int k = 1; k < 50; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-17) {
+      break;
+    }
+  }
+  return sum;
+}
+
+} // namespace
+
+FourthConverterDecimatorIQ::FourthConverterDecimatorIQ()
+    : m_parity(0), m_sign(1.0f) {
+  // Kaiser-windowed sinc half-band filter.
+  // Only the taps at the even positions from the start are non-zero,
+  // except for the center tap of 0.5.
+  std::vector<double> h(half_length);
+  double sum = 0;
+  for (unsigned int i = 0; i < half_length; i++) {
+    double t = i - (taps - 1) / 4.0;
+    double sinc = std::sin(M_PI * t) / (M_PI * t);
+    double r = 4.0 * i / (taps - 1) - 1.0;
+    double window = bessel_i0(kaiser_beta * std::sqrt(1.0 - r * r)) /
+                    bessel_i0(kaiser_beta);
+    h[i] = 0.5 * sinc * window;
+    sum += h[i];
+  }
+  // Normalize the DC gain to 1 with the center tap of 0.5,
+  // and fold the Fs/4 rotation of the input samples, (-1)^i,
+  // into the coefficients.
+  m_coeff.resize(half_length);
+  for (unsigned int i = 0; i < half_length; i++) {
+    double c = h[i] * 0.25 / sum;
+    m_coeff[i] = (i % 2 == 0) ? c : -c;
+  }
+  // The odd input samples before the first output sample are zero.
+  m_odd_re.assign(half_length, 0);
+  m_odd_im.assign(half_length, 0);
+}
+
+// Return the number of the output samples for n input samples.
+unsigned int FourthConverterDecimatorIQ::output_size(unsigned int n) const {
+  unsigned int even = m_even_re.size() + (n + 1 - m_parity) / 2;
+  unsigned int odd = m_odd_re.size() + (n + m_parity) / 2;
+  return (odd >= odd_taps) ? std::min(even, odd - odd_taps + 1) : 0;
+}
+
+// Compute the output samples and call store(i, re, im) for each.
+//
+// The output sample m is that of the half-band filter at the input
+// sample n = 2 * m + (taps - 1) / 2, which is at an odd position:
+// (-j)^n * (sum of h[k] * (-1)^(k/2) * x[n - k] for the even k
+//           + 0.5 * j * x[n - (taps - 1) / 2]),
+// where the taps k and (taps - 1 - k) have the opposite signs.
+// The input samples x[n - k] are odd[m + half_length - 1 - k / 2],
+// where odd[i] is x[2 * i + 1], and x[n - (taps - 1) / 2] is x[2 * m].
+template <typename Store>
+unsigned int FourthConverterDecimatorIQ::process_samples(
+    std::span<const IQSample> samples_in, Store store) {
+  unsigned int count = output_size(samples_in.size());
+
+  // Split the input samples into the odd and even positions.
+  unsigned int n = samples_in.size();
+  unsigned int n_even = (n + 1 - m_parity) / 2;
+  unsigned int n_odd = n - n_even;
+  const IQSample *in_even = samples_in.data() + m_parity;
+  const IQSample *in_odd = samples_in.data() + (1 - m_parity);
+  unsigned int even_size = m_even_re.size();
+  m_even_re.resize(even_size + n_even);
+  m_even_im.resize(even_size + n_even);
+  for (unsigned int i = 0; i < n_even; i++) {
+    m_even_re[even_size + i] = in_even[2 * i].real();
+    m_even_im[even_size + i] = in_even[2 * i].imag();
+  }
+  unsigned int odd_size = m_odd_re.size();
+  m_odd_re.resize(odd_size + n_odd);
+  m_odd_im.resize(odd_size + n_odd);
+  for (unsigned int i = 0; i < n_odd; i++) {
+    m_odd_re[odd_size + i] = in_odd[2 * i].real();
+    m_odd_im[odd_size + i] = in_odd[2 * i].imag();
+  }
+  m_parity = (m_parity + n) % 2;
+
+  const float *coeff = m_coeff.data();
+  const float *odd_re = m_odd_re.data();
+  const float *odd_im = m_odd_im.data();
+  const float *even_re = m_even_re.data();
+  const float *even_im = m_even_im.data();
+  float sign = m_sign;
+  unsigned int i = 0;
+
+  // Compute a tile of output samples at a time, so that the loops
+  // over the tile are vectorized. Each output sample is accumulated
+  // in the same order as the remaining ones.
+  for (; i + tile_length <= count; i += tile_length) {
+    float re[tile_length];
+    float im[tile_length];
+    // Multiply the center tap by j.
+    for (unsigned int j = 0; j < tile_length; j++) {
+      re[j] = -0.5f * even_im[i + j];
+      im[j] = 0.5f * even_re[i + j];
+    }
+    for (unsigned int k = 0; k < half_length; k++) {
+      const float c = coeff[k];
+      const float *x0_re = odd_re + i + odd_taps - 1 - k;
+      const float *x0_im = odd_im + i + odd_taps - 1 - k;
+      const float *x1_re = odd_re + i + k;
+      const float *x1_im = odd_im + i + k;
+      for (unsigned int j = 0; j < tile_length; j++) {
+        re[j] += c * (x0_re[j] - x1_re[j]);
+        im[j] += c * (x0_im[j] - x1_im[j]);
+      }
+    }
+    // Multiply by -j or +j alternately.
+    for (unsigned int j = 0; j < tile_length; j += 2) {
+      store(i + j, sign * im[j], -sign * re[j]);
+      store(i + j + 1, -sign * im[j + 1], sign * re[j + 1]);
+    }
+  }
+
+  // Remaining samples.
+  for (; i < count; i++) {
+    float re = -0.5f * even_im[i];
+    float im = 0.5f * even_re[i];
+    for (unsigned int k = 0; k < half_length; k++) {
+      const float c = coeff[k];
+      re += c * (odd_re[i + odd_taps - 1 - k] - odd_re[i + k]);
+      im += c * (odd_im[i + odd_taps - 1 - k] - odd_im[i + k]);
+    }
+    store(i, sign * im, -sign * re);
+    sign = -sign;
+  }
+  m_sign = sign;
+
+  // Keep the input samples for the next output samples.
+  m_odd_re.erase(m_odd_re.begin(), m_odd_re.begin() + count);
+  m_odd_im.erase(m_odd_im.begin(), m_odd_im.begin() + count);
+  m_even_re.erase(m_even_re.begin(), m_even_re.begin() + count);
+  m_even_im.erase(m_even_im.begin(), m_even_im.begin() + count);
+  return count;
+}
+// Process samples.
+void FourthConverterDecimatorIQ::process(std::span<const IQSample> samples_in,
+                                         IQSampleVector &samples_out) {
+  samples_out.resize(output_size(samples_in.size()));
+  IQSample *output = samples_out.data();
+  process_samples(samples_in, [output](unsigned int i, float re, float im) {
+    output[i] = IQSample(re, im);
+  });
+}
+
+// Process samples into the split-complex block for the IF resampler.
+void FourthConverterDecimatorIQ::process(std::span<const IQSample> samples_in,
+                                         IQSampleSplitVector &samples_out) {
+  samples_out.resize(output_size(samples_in.size()));
+  double *out_re = samples_out.re.data();
+  double *out_im = samples_out.im.data();
+  process_samples(samples_in,
+                  [out_re, out_im](unsigned int i, float re, float im) {
+                    out_re[i] = re;
+                    out_im[i] = im;
+                  });
+}
+
+// end
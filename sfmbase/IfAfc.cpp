@@ -0,0 +1,64 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+
+#include "IfAfc.h"
+
+// class IfAfc
+
+// Constructor.
+IfAfc::IfAfc(double sample_rate, double tuner_freq, double max_ppm,
+             unsigned int update_blocks)
+    : m_tuner_freq(tuner_freq), m_max_ppm(max_ppm),
+      m_update_blocks(update_blocks), m_blocks(0), m_correction_ppm(0),
+      m_tuner(sample_rate) {}
+
+// Clear the correction.
+void IfAfc::reset(double tuner_freq) {
+  m_tuner_freq = tuner_freq;
+  m_blocks = 0;
+  m_correction_ppm = 0;
+  m_tuner.set_freq_shift(0);
+}
+
+// Update the correction once per averaging period.
+bool IfAfc::update(double ppm) {
+  if (++m_blocks < m_update_blocks) {
+    return false;
+  }
+  m_blocks = 0;
+  if (std::fabs(ppm) < dead_band_ppm) {
+    return false;
+  }
+  double step = std::clamp(ppm, -max_step_ppm, max_step_ppm);
+  double correction =
+      std::clamp(m_correction_ppm + step, -m_max_ppm, m_max_ppm);
+  if (correction == m_correction_ppm) {
+    return false;
+  }
+  m_correction_ppm = correction;
+  // The IF is shifted by the correction relative to the tuner frequency,
+  // with the phase continuous.
+  m_tuner.set_freq_shift(m_correction_ppm * m_tuner_freq * 1.0e-6);
+  return true;
+}
+
+// end
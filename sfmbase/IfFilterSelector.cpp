@@ -0,0 +1,153 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "IfFilterSelector.h"
+
+// class IfFilterSelector
+
+// Constructor.
+IfFilterSelector::IfFilterSelector(double sample_rate)
+    : m_blocks(0), m_release(0), m_filtertype(FilterType::Default),
+      m_adjacent_level(-100.0),
+      m_channel_bin(channel_bandwidth / sample_rate * fft_length),
+      m_medium_bin(medium_edge / sample_rate * fft_length),
+      m_window(fft_length), m_twiddle(fft_length / 2), m_bitrev(fft_length),
+      m_fft(fft_length), m_power(fft_length) {
+  assert(m_channel_bin < m_medium_bin && m_medium_bin < fft_length / 2);
+
+  // Hann window.
+  for (unsigned int i = 0; i < fft_length; i++) {
+    m_window[i] = 0.5 - 0.5 * std::cos(2.0 * M_PI * i / fft_length);
+  }
+  for (unsigned int i = 0; i < fft_length / 2; i++) {
+    double phase = -2.0 * M_PI * i / fft_length;
+    m_twiddle[i] = IQSample(std::cos(phase), std::sin(phase));
+  }
+  unsigned int bits = 0;
+  while ((1U << bits) < fft_length) {
+    bits++;
+  }
+  for (unsigned int i = 0; i < fft_length; i++) {
+    unsigned int r = 0;
+    for (unsigned int b = 0; b < bits; b++) {
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    m_bitrev[i] = r;
+  }
+}
+
+// Measure the IF samples and update the selected filter type.
+bool IfFilterSelector::process(std::span<const IQSample> samples) {
+  if (++m_blocks < measure_blocks || samples.size() < fft_length) {
+    return false;
+  }
+  m_blocks = 0;
+
+  // Average the frames spread over the block.
+  unsigned int frames =
+      std::min<std::size_t>(max_frames, samples.size() / fft_length);
+  std::size_t stride = samples.size() / frames;
+  std::fill(m_power.begin(), m_power.end(), 0.0f);
+  for (unsigned int i = 0; i < frames; i++) {
+    add_power_spectrum(samples.subspan(i * stride, fft_length));
+  }
+
+  // Sum the energy of the bands on both sides of the channel,
+  // except for the Nyquist frequency bin.
+  double channel = 0, adjacent = 0;
+  for (unsigned int k = 0; k < fft_length / 2; k++) {
+    double power = m_power[k];
+    if (k > 0) {
+      power += m_power[fft_length - k];
+    }
+    if (k <= m_channel_bin) {
+      channel += power;
+    } else if (k > m_medium_bin) {
+      adjacent += power;
+    }
+  }
+  m_adjacent_level = 10 * std::log10(adjacent / (channel + 1e-20) + 1e-10);
+
+  // The levels of the active filters are lowered by the hysteresis.
+  bool narrow_active = (m_filtertype == FilterType::Narrow);
+  bool medium_active = (m_filtertype != FilterType::Default);
+  FilterType target = FilterType::Default;
+  if (m_adjacent_level >
+      narrow_level - (narrow_active ? hysteresis : 0.0)) {
+    target = FilterType::Narrow;
+  } else if (m_adjacent_level >
+             medium_level - (medium_active ? hysteresis : 0.0)) {
+    target = FilterType::Medium;
+  }
+
+  // Rank the filter types by the bandwidth.
+  auto rank = [](FilterType type) {
+    return (type == FilterType::Narrow)   ? 2
+           : (type == FilterType::Medium) ? 1
+                                          : 0;
+  };
+  if (rank(target) > rank(m_filtertype)) {
+    // Narrow the filter at once.
+    m_filtertype = target;
+    m_release = 0;
+    return true;
+  }
+  if (rank(target) < rank(m_filtertype)) {
+    // Widen the filter after the release count.
+    if (++m_release >= release_count) {
+      m_filtertype = target;
+      m_release = 0;
+      return true;
+    }
+    return false;
+  }
+  m_release = 0;
+  return false;
+}
+
+// Add the power spectrum of the windowed frame.
+void IfFilterSelector::add_power_spectrum(std::span<const IQSample> frame) {
+  for (unsigned int i = 0; i < fft_length; i++) {
+    m_fft[m_bitrev[i]] = frame[i] * m_window[i];
+  }
+  fft();
+  for (unsigned int i = 0; i < fft_length; i++) {
+    m_power[i] += std::norm(m_fft[i]);
+  }
+}
+
+// In-place radix-2 decimation-in-time FFT of the bit-reversed input.
+void IfFilterSelector::fft() {
+  for (unsigned int half = 1; half < fft_length; half *= 2) {
+    unsigned int step = fft_length / (half * 2);
+    for (unsigned int start = 0; start < fft_length; start += half * 2) {
+      for (unsigned int j = 0; j < half; j++) {
+        IQSample t = m_fft[start + j + half] * m_twiddle[j * step];
+        m_fft[start + j + half] = m_fft[start + j] - t;
+        m_fft[start + j] += t;
+      }
+    }
+  }
+}
+
+// end
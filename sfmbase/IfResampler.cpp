@@ -34,29 +34,36 @@ IfResampler::IfResampler(const double input_rate, const double output_rate)
   // do nothing
 }
 
-void IfResampler::process(const IQSampleVector &samples_in,
+void IfResampler::process(std::span<const IQSample> samples_in,
                           IQSampleVector &samples_out) {
   size_t input_size = samples_in.size();
 
   assert(input_size <= max_input_length);
 
   // Use two independent sample rate converters in sync.
-  DoubleVector samples_in_re;
-  DoubleVector samples_in_im;
-  samples_in_re.resize(input_size);
-  samples_in_im.resize(input_size);
+  m_samples_in_split.resize(input_size);
 
   // See lv_cmake() definition for VOLK complex processing.
-  volk_32fc_deinterleave_64f_x2(samples_in_re.data(), samples_in_im.data(),
+  volk_32fc_deinterleave_64f_x2(m_samples_in_split.re.data(),
+                                m_samples_in_split.im.data(),
                                 samples_in.data(), input_size);
 
+  process(m_samples_in_split, samples_out);
+}
+
+void IfResampler::process(IQSampleSplitVector &samples_in,
+                          IQSampleVector &samples_out) {
+  size_t input_size = samples_in.size();
+
+  assert(input_size <= max_input_length);
+
   size_t output_length_re, output_length_im;
   double *output0_re, *output0_im;
 
   output_length_re =
-      m_cdspr_re->process(samples_in_re.data(), input_size, output0_re);
+      m_cdspr_re->process(samples_in.re.data(), input_size, output0_re);
   output_length_im =
-      m_cdspr_im->process(samples_in_im.data(), input_size, output0_im);
+      m_cdspr_im->process(samples_in.im.data(), input_size, output0_im);
   assert(output_length_re == output_length_im);
 
   // Copy CDSPReampler24 internal buffers to given output buffer
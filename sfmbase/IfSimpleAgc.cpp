@@ -16,6 +16,9 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <cmath>
+#include <type_traits>
+
 #include "IfSimpleAgc.h"
 
 // class IfSimpleAgc
@@ -34,16 +37,43 @@ void IfSimpleAgc::reset_gain() { m_current_gain = m_initial_gain; }
 // IF AGC based on the Tisserand-Berviller algorithm
 // Target level = 1.0
 
-void IfSimpleAgc::process(const IQSampleVector &samples_in,
+void IfSimpleAgc::process(std::span<const IQSample> samples_in,
                           IQSampleVector &samples_out) {
   unsigned int n = samples_in.size();
   samples_out.resize(n);
+  process_samples(samples_in.data(), samples_out.data(), n);
+}
+
+void IfSimpleAgc::process_inplace(std::span<IQSample> samples) {
+  process_samples(samples.data(), samples.data(), samples.size());
+}
 
+void IfSimpleAgc::process_real(std::span<const IQSample> samples_in,
+                               IQSampleDecodedVector &samples_out) {
+  unsigned int n = samples_in.size();
+  samples_out.resize(n);
+  process_samples(samples_in.data(), samples_out.data(), n);
+}
+
+template <typename T>
+inline void IfSimpleAgc::process_samples(const IQSample *input, T *output,
+                                         unsigned int n) {
   for (unsigned int i = 0; i < n; i++) {
-    IQSample x = samples_in[i];
+    IQSample x = input[i];
     IQSample x2 = x * m_current_gain;
-    samples_out[i] = x2;
-    float z = 1.0 + (m_distortion_rate * (1.0 - std::norm(x2)));
+    if constexpr (std::is_same_v<T, IQSample>) {
+      output[i] = x2;
+    } else {
+      output[i] = x2.real();
+    }
+    float power = std::norm(x2);
+    float z = 1.0 + (m_distortion_rate * (1.0 - power));
+    // A strong signal after a weak one, e.g., after a dropout,
+    // makes z negative, and the gain keeps changing its sign,
+    // so set the gain to give the target level at once instead.
+    if (z < 0.5f) {
+      z = 1.0f / std::sqrt(power);
+    }
     m_current_gain *= z;
     // Check if m_current_gain is finite
     if (!std::isfinite(m_current_gain)) {
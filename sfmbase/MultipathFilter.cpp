@@ -61,6 +61,7 @@ MultipathFilter::MultipathFilter(unsigned int stages)
       // Initialize coefficient and state vectors with the size.
       ,
       m_coeff(m_filter_order), m_state(m_filter_order),
+      m_state_mag_sq(m_filter_order),
       // Initialize calculation error value.
       m_error(0) {
 
@@ -68,6 +69,7 @@ MultipathFilter::MultipathFilter(unsigned int stages)
   // Guard against constructor overflow on m_filter_order = stages*4 + 1
   // and m_index_reference_point = stages*3 + 1.
   assert(stages < (UINT_MAX / 4));
+  m_state.reserve(m_filter_order + 1);
   for (unsigned int i = 0; i < m_filter_order; i++) {
     m_state[i] = IQSample(0, 0);
   }
@@ -92,9 +94,11 @@ void MultipathFilter::initialize_coefficients() {
 inline IQSample MultipathFilter::single_process(const IQSample filter_input) {
   // Remove the element number zero (oldest one)
   // and add the input as the newest element at the end of the buffer
+  // NOTE: the capacity is reserved in the constructor,
+  // so that the insertion does not reallocate the buffer.
   m_state.emplace_back(filter_input);
   m_state.erase(m_state.begin());
-  IQSample output = IQSample(0, 0);
+  alignas(volk_result_alignment) IQSample output = IQSample(0, 0);
   // VOLK calculation, equivalent to:
   // for (unsigned int i = 0; i < m_filter_order; i++) {
   //   output += m_state[i] * m_coeff[i];
@@ -107,9 +111,7 @@ inline IQSample MultipathFilter::single_process(const IQSample filter_input) {
 // Update coefficients by complex LMS/CMA method.
 inline void MultipathFilter::update_coeff(const IQSample result) {
 
-  volk::vector<float> state_mag_sq;
-  state_mag_sq.resize(m_filter_order);
-  float state_mag_sq_sum;
+  alignas(volk_result_alignment) float state_mag_sq_sum;
 
   // Input instant envelope
   const double env = std::norm(result);
@@ -120,9 +122,9 @@ inline void MultipathFilter::update_coeff(const IQSample result) {
   // First calculate the square norm of input data (m_state) by
   // * Compute the square magnitude of each element of m_state
   // * Then add the square magnitude for all the elements
-  volk_32fc_magnitude_squared_32f(state_mag_sq.data(), m_state.data(),
+  volk_32fc_magnitude_squared_32f(m_state_mag_sq.data(), m_state.data(),
                                   m_filter_order);
-  volk_32f_accumulator_s32f(&state_mag_sq_sum, state_mag_sq.data(),
+  volk_32f_accumulator_s32f(&state_mag_sq_sum, m_state_mag_sq.data(),
                             m_filter_order);
 
   // Obtain the step size (dymanically computed)
@@ -161,7 +163,7 @@ inline void MultipathFilter::update_coeff(const IQSample result) {
 }
 
 // Process block samples.
-bool MultipathFilter::process(const IQSampleVector &samples_in,
+bool MultipathFilter::process(std::span<const IQSample> samples_in,
                               IQSampleVector &samples_out) {
   unsigned int n = samples_in.size();
   if (n == 0) {
@@ -21,14 +21,15 @@
 
 // class NbfmDecoder
 
-NbfmDecoder::NbfmDecoder(IQSampleCoeff &nbfmfilter_coeff, const double freq_dev)
+NbfmDecoder::NbfmDecoder(const IQSampleCoeff &nbfmfilter_coeff,
+                         const double freq_dev)
     // Initialize member fields
-    : m_nbfmfilter_coeff(nbfmfilter_coeff), m_freq_dev(freq_dev),
-      m_baseband_mean(0), m_baseband_level(0), m_if_rms(0.0)
+    : m_freq_dev(freq_dev), m_baseband_mean(0), m_baseband_level(0),
+      m_if_rms(0.0), m_profiler(nullptr)
 
       // Construct NBFM narrow filter
       ,
-      m_nbfmfilter(m_nbfmfilter_coeff, 1)
+      m_nbfmfilter(nbfmfilter_coeff, 1)
 
       // Construct PhaseDiscriminator
       ,
@@ -44,20 +45,33 @@ NbfmDecoder::NbfmDecoder(IQSampleCoeff &nbfmfilter_coeff, const double freq_dev)
   // Do nothing
 }
 
-void NbfmDecoder::process(const IQSampleVector &samples_in,
+void NbfmDecoder::process(std::span<const IQSample> samples_in,
                           SampleVector &audio) {
 
   // Apply IF filter.
-  m_nbfmfilter.process(samples_in, m_buf_filtered);
+  {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::IfFilter,
+                               samples_in.size());
+    m_nbfmfilter.process(samples_in, m_buf_filtered);
+  }
 
   // Measure IF RMS level.
-  m_if_rms = Utility::rms_level_sample(m_buf_filtered);
+  m_if_rms = Utility::rms_level_sample(m_buf_filtered, m_buf_magnitude_sq);
 
-  // Perform IF AGC.
-  m_ifagc.process(m_buf_filtered, m_samples_in_after_agc);
+  // Perform IF AGC in-place.
+  {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::IfAgc,
+                               m_buf_filtered.size());
+    m_ifagc.process_inplace(m_buf_filtered);
+  }
 
   // Demodulate FM to audio signal.
-  m_phasedisc.process(m_samples_in_after_agc, m_buf_decoded);
+  {
+    StageProfiler::Scope scope(m_profiler,
+                               StageProfiler::Stage::Discriminator,
+                               m_buf_filtered.size());
+    m_phasedisc.process(m_buf_filtered, m_buf_decoded);
+  }
   size_t decoded_size = m_buf_decoded.size();
   // If no downsampled decoded signal comes out,
   // terminate and wait for next block,
@@ -85,14 +99,26 @@ void NbfmDecoder::process(const IQSampleVector &samples_in,
   m_baseband_level = 0.95 * m_baseband_level + 0.05 * baseband_rms;
 
   // Filter out audio high frequency noise.
-  m_audiofilter.process(m_buf_baseband, m_buf_baseband_filtered);
+  {
+    StageProfiler::Scope scope(m_profiler, StageProfiler::Stage::AudioFilter,
+                               m_buf_baseband.size());
+    // Just return mono channel.
+    m_audiofilter.process(m_buf_baseband, audio);
+  }
 
   // Adjust gain by -3dB (0.707)
   const double audio_gain = std::pow(10.0, (-3.0 / 20.0));
-  Utility::adjust_gain(m_buf_baseband_filtered, audio_gain);
+  Utility::adjust_gain(audio, audio_gain);
+}
+
+void NbfmDecoder::skip(std::size_t if_length, SampleVector &audio) {
+  // The audio sample rate is the same as the IF sample rate.
+  audio.assign(if_length, 0.0);
+}
 
-  // Just return mono channel.
-  audio = std::move(m_buf_baseband_filtered);
+void NbfmDecoder::reset() {
+  m_ifagc.reset_gain();
+  m_baseband_mean = 0;
 }
 
 //
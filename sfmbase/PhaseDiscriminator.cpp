@@ -30,7 +30,7 @@ PhaseDiscriminator::PhaseDiscriminator(double max_freq_dev)
       m_boundary(1.0 / (max_freq_dev * 2.0)), m_save_value(0) {}
 
 // Process samples.
-void PhaseDiscriminator::process(const IQSampleVector &samples_in,
+void PhaseDiscriminator::process(std::span<const IQSample> samples_in,
                                  IQSampleDecodedVector &samples_out) {
   unsigned int n = samples_in.size();
   samples_out.resize(n);
@@ -48,16 +48,20 @@ PilotPhaseLock::PilotPhaseLock(double freq)
       m_biquad_phasor_i1(1.46974784e-06, 0, 0, -1.99682419, 0.996825659),
       m_biquad_phasor_q1(1.46974784e-06, 0, 0, -1.99682419, 0.996825659),
       // differentiator-like 1st-order inverse LPF (not really an HPF)
-      m_first_phase_err(0.000304341788, -0.000304324564, 0), m_freq_err(0) {
-  // do nothing
+      m_first_phase_err(0.000304341788, -0.000304324564, 0), m_freq_err(0),
+      m_rds_mixing(false) {
+  m_pps_events.reserve(reserved_pps_events);
 }
 
 // Process samples and generate the 38kHz locked tone.
-void PilotPhaseLock::process(const SampleVector &samples_in,
+void PilotPhaseLock::process(std::span<const Sample> samples_in,
                              SampleVector &samples_out, bool pilot_shift) {
   unsigned int n = samples_in.size();
 
   samples_out.resize(n);
+  if (m_rds_mixing) {
+    m_rds_baseband.resize(n);
+  }
 
   bool was_locked = (m_lock_cnt >= m_lock_delay);
   m_pps_events.clear();
@@ -92,6 +96,16 @@ void PilotPhaseLock::process(const SampleVector &samples_in,
     Sample phasor_i = psin * x;
     Sample phasor_q = pcos * x;
 
+    // Mix down the input with the 57kHz RDS subcarrier
+    // phase-locked to the third harmonic of the pilot.
+    if (m_rds_mixing) {
+      // sin(3*x) = sin(x) * (3 - 4 * sin(x) * sin(x))
+      // cos(3*x) = cos(x) * (4 * cos(x) * cos(x) - 3)
+      Sample psin3 = psin * (3 - 4 * psin * psin);
+      Sample pcos3 = pcos * (4 * pcos * pcos - 3);
+      m_rds_baseband[i] = IQSample(2 * x * pcos3, -2 * x * psin3);
+    }
+
     // Run IQ phase error through biquad LPFs once.
     Sample new_phasor_i = m_biquad_phasor_i1.process(phasor_i);
     Sample new_phasor_q = m_biquad_phasor_q1.process(phasor_q);
@@ -170,4 +184,13 @@ void PilotPhaseLock::process(const SampleVector &samples_in,
   m_sample_cnt += n;
 }
 
+// Account for skipped samples.
+void PilotPhaseLock::skip(std::size_t samples) {
+  m_lock_cnt = 0;
+  m_pilot_periods = 0;
+  m_pps_cnt = 0;
+  m_pps_events.clear();
+  m_sample_cnt += samples;
+}
+
 // end
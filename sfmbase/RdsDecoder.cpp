@@ -0,0 +1,582 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <fmt/format.h>
+
+#include "RdsDecoder.h"
+#include "Utility.h"
+
+// RDS block offset words (IEC 62106), indexed by BlockIndex.
+// C' (used in version B groups) is the fifth entry.
+static constexpr std::uint32_t offset_words[5] = {0x0fc, 0x198, 0x168, 0x1b4,
+                                                  0x350};
+// Generator polynomial of the (26,16) shortened cyclic code:
+// x^10 + x^8 + x^7 + x^5 + x^4 + x^3 + 1
+static constexpr std::uint32_t generator_polynomial = 0x5b9;
+// Marker of ambiguous burst error syndromes.
+static constexpr std::uint32_t burst_ambiguous = 0xffffffff;
+
+// Costas loop gains for approx. 20Hz loop bandwidth at 24kHz.
+static constexpr double costas_alpha = 2.2e-3;
+static constexpr double costas_beta = 2.5e-6;
+// Maximum residual carrier frequency offset (100Hz at 24kHz).
+static constexpr double costas_max_freq =
+    2.0 * M_PI * 100.0 / RdsDecoder::sample_rate_internal;
+// Gardner timing loop gain.
+static constexpr double timing_gain = 0.005;
+
+// Construct RDS decoder.
+RdsDecoder::RdsDecoder(FILE *output, bool threaded)
+    : m_output(output), m_carrier_phase(0), m_carrier_freq(0),
+      m_carrier_power(0), m_mf_pos(0), m_mf_sum(0), m_symbol_phase(0),
+      m_prev_y(0), m_prev_strobe(0), m_mid_strobe(0), m_symbol_level(0),
+      m_prev_chip(0), m_chip_count(0), m_pairing_score{0, 0}, m_prev_bit(0),
+      m_shift_reg(0), m_bit_count(0), m_synced_flag(false),
+      m_candidate_bit(0), m_candidate_index(-1), m_block_bits(0),
+      m_block_index(0), m_block_errors(0), m_block_total(0),
+      m_group_data{0, 0, 0, 0}, m_group_valid{false, false, false, false},
+      m_pi(-1), m_pi_candidate(-1), m_ps_segments(0), m_rt_segments(0),
+      m_rt_ab(-1), m_group_count(0), m_synced(false), m_threaded(threaded),
+      m_closed(false) {
+
+  // First stage: 3rd-order CIC-equivalent FIR (boxcar of 8 taps, cubed),
+  // which has nulls at every multiple of the decimated rate 48kHz.
+  IQSampleCoeff boxcar(decimation_first, 1.0f);
+  IQSampleCoeff coeff(1, 1.0f);
+  for (int k = 0; k < 3; k++) {
+    IQSampleCoeff conv(coeff.size() + boxcar.size() - 1, 0.0f);
+    for (unsigned int i = 0; i < coeff.size(); i++) {
+      for (unsigned int j = 0; j < boxcar.size(); j++) {
+        conv[i + j] += coeff[i] * boxcar[j];
+      }
+    }
+    coeff = std::move(conv);
+  }
+  float gain = decimation_first * decimation_first * decimation_first;
+  for (auto &c : coeff) {
+    c /= gain;
+  }
+  m_coeff_first = std::move(coeff);
+
+  // Second stage: Hamming-windowed sinc LPF at 48kHz,
+  // to reject the L-R subcarrier sideband 4kHz away from 57kHz.
+  double fc = lpf_cutoff / (sample_rate_if / decimation_first);
+  double center = (lpf_taps - 1) / 2.0;
+  double sum = 0;
+  m_coeff_second.resize(lpf_taps);
+  for (unsigned int i = 0; i < lpf_taps; i++) {
+    double t = i - center;
+    double sinc = (t == 0) ? 2.0 * fc
+                           : std::sin(2.0 * M_PI * fc * t) / (M_PI * t);
+    double window = 0.54 - 0.46 * std::cos(2.0 * M_PI * i / (lpf_taps - 1));
+    m_coeff_second[i] = sinc * window;
+    sum += sinc * window;
+  }
+  for (auto &c : m_coeff_second) {
+    c /= sum;
+  }
+
+  // Chip matched filter length.
+  m_mf_state.assign(
+      static_cast<unsigned int>(std::lrint(sample_rate_internal / chip_rate)),
+      0.0f);
+
+  m_ps.fill(' ');
+  m_rt.fill(' ');
+
+  // Build the syndrome table of correctable burst errors
+  // (1-bit and 2-bit bursts).
+  m_burst_table.assign(1024, 0);
+  for (unsigned int len = 1; len <= 2; len++) {
+    std::uint32_t pattern = (1u << len) - 1;
+    for (unsigned int i = 0; i + len <= 26; i++) {
+      std::uint32_t e = pattern << i;
+      std::uint32_t s = syndrome(e);
+      if (m_burst_table[s] == 0) {
+        m_burst_table[s] = e;
+      } else {
+        m_burst_table[s] = burst_ambiguous;
+      }
+    }
+  }
+
+  if (m_threaded) {
+    m_thread = std::make_unique<std::thread>(&RdsDecoder::run, this);
+  }
+}
+
+// Destructor.
+RdsDecoder::~RdsDecoder() {
+  if (!m_closed) {
+    close();
+  }
+}
+
+// Feed a block of 57kHz-mixed samples.
+void RdsDecoder::feed(IQSampleVector &&samples) {
+  if (m_closed) {
+    return;
+  }
+  if (m_threaded) {
+    // Drop the block rather than stalling the caller.
+    if (m_queue.queue_size() < max_queue_blocks) {
+      m_queue.push(std::move(samples));
+    }
+  } else {
+    process(samples);
+    samples.clear();
+    std::scoped_lock<std::mutex> lock(m_spare_mutex);
+    if (m_spare.empty()) {
+      m_spare.push_back(std::move(samples));
+    }
+  }
+}
+
+// Return a recycled empty buffer if available.
+IQSampleVector RdsDecoder::get_spare() {
+  IQSampleVector ret;
+  std::scoped_lock<std::mutex> lock(m_spare_mutex);
+  if (!m_spare.empty()) {
+    std::swap(ret, m_spare.back());
+    m_spare.pop_back();
+  }
+  return ret;
+}
+
+// Stop the decoder thread.
+void RdsDecoder::close() {
+  m_closed = true;
+  if (m_thread) {
+    m_queue.push_end();
+    m_thread->join();
+    m_thread.reset();
+  }
+}
+
+// Decoder thread body.
+void RdsDecoder::run() {
+  for (;;) {
+    if (m_queue.pull_end_reached()) {
+      break;
+    }
+    IQSampleVector samples = m_queue.pull();
+    if (samples.empty()) {
+      continue;
+    }
+    process(samples);
+    samples.clear();
+    std::scoped_lock<std::mutex> lock(m_spare_mutex);
+    if (m_spare.size() < 4) {
+      m_spare.push_back(std::move(samples));
+    }
+  }
+}
+
+// Decode a block of samples.
+void RdsDecoder::process(std::span<const IQSample> samples) {
+  // First stage decimation: 384kHz -> 48kHz.
+  m_hist_first.insert(m_hist_first.end(), samples.begin(), samples.end());
+  std::size_t len = m_coeff_first.size();
+  std::size_t pos = 0;
+  m_buf_first.clear();
+  for (; pos + len <= m_hist_first.size(); pos += decimation_first) {
+    IQSample acc = 0;
+    for (std::size_t i = 0; i < len; i++) {
+      acc += m_hist_first[pos + i] * m_coeff_first[i];
+    }
+    m_buf_first.push_back(acc);
+  }
+  m_hist_first.erase(m_hist_first.begin(), m_hist_first.begin() + pos);
+
+  // Second stage decimation: 48kHz -> 24kHz.
+  m_hist_second.insert(m_hist_second.end(), m_buf_first.begin(),
+                       m_buf_first.end());
+  len = m_coeff_second.size();
+  pos = 0;
+  for (; pos + len <= m_hist_second.size(); pos += decimation_second) {
+    IQSample acc = 0;
+    for (std::size_t i = 0; i < len; i++) {
+      acc += m_hist_second[pos + i] * m_coeff_second[i];
+    }
+    process_internal(acc);
+  }
+  m_hist_second.erase(m_hist_second.begin(), m_hist_second.begin() + pos);
+}
+
+// Process a baseband sample at the internal rate.
+void RdsDecoder::process_internal(IQSample z) {
+  // Costas loop for BPSK: remove the residual carrier phase.
+  IQSample rot = z * IQSample(std::cos(m_carrier_phase),
+                              -std::sin(m_carrier_phase));
+  float power = std::norm(rot);
+  m_carrier_power = 0.999f * m_carrier_power + 0.001f * power;
+  double err = rot.real() * rot.imag() / (m_carrier_power + 1e-20f);
+  err = std::clamp(err, -1.0, 1.0);
+  m_carrier_freq += costas_beta * err;
+  m_carrier_freq =
+      std::clamp(m_carrier_freq, -costas_max_freq, costas_max_freq);
+  m_carrier_phase += m_carrier_freq + costas_alpha * err;
+  m_carrier_phase = std::remainder(m_carrier_phase, 2.0 * M_PI);
+
+  // Chip matched filter: moving sum over a chip period.
+  float r = rot.real();
+  m_mf_sum += r - m_mf_state[m_mf_pos];
+  m_mf_state[m_mf_pos] = r;
+  m_mf_pos = (m_mf_pos + 1) % m_mf_state.size();
+
+  process_symbol(m_mf_sum);
+}
+
+// Gardner symbol timing recovery at the chip rate.
+void RdsDecoder::process_symbol(float y) {
+  static constexpr double step = chip_rate / sample_rate_internal;
+  double prev_phase = m_symbol_phase;
+  m_symbol_phase += step;
+
+  if (prev_phase < 0.5 && m_symbol_phase >= 0.5) {
+    // Interpolate the sample at the middle of two strobes.
+    double frac = (0.5 - prev_phase) / step;
+    m_mid_strobe = m_prev_y + (y - m_prev_y) * frac;
+  } else if (m_symbol_phase >= 1.0) {
+    // Interpolate the strobe sample.
+    double frac = (1.0 - prev_phase) / step;
+    float strobe = m_prev_y + (y - m_prev_y) * frac;
+    m_symbol_level = 0.99f * m_symbol_level + 0.01f * std::fabs(strobe);
+    // Gardner timing error, normalized by the symbol level.
+    double err = m_mid_strobe * (m_prev_strobe - strobe) /
+                 (m_symbol_level * m_symbol_level + 1e-20f);
+    err = std::clamp(err, -1.0, 1.0);
+    m_symbol_phase -= 1.0 + timing_gain * err;
+    m_prev_strobe = strobe;
+    process_chip(strobe);
+  }
+  m_prev_y = y;
+}
+
+// Biphase decoding: pair two chips of opposite signs into a bit.
+void RdsDecoder::process_chip(float chip) {
+  m_chip_count++;
+  unsigned int parity = m_chip_count & 1;
+  // The correct pairing has opposite chip signs almost always.
+  float opposite = (chip * m_prev_chip < 0) ? 1.0f : 0.0f;
+  m_pairing_score[parity] =
+      0.98f * m_pairing_score[parity] + 0.02f * opposite;
+  unsigned int pairing = (m_pairing_score[0] > m_pairing_score[1]) ? 0 : 1;
+  if (parity == pairing) {
+    unsigned int raw_bit = (m_prev_chip > chip) ? 1 : 0;
+    // Differential decoding (also removes the BPSK phase ambiguity).
+    process_bit(raw_bit ^ m_prev_bit);
+    m_prev_bit = raw_bit;
+  }
+  m_prev_chip = chip;
+}
+
+// Block synchronization.
+void RdsDecoder::process_bit(unsigned int bit) {
+  m_shift_reg = ((m_shift_reg << 1) | bit) & 0x3ffffff;
+  m_bit_count++;
+
+  if (m_synced_flag) {
+    if (++m_block_bits == 26) {
+      m_block_bits = 0;
+      process_block(m_shift_reg);
+    }
+    return;
+  }
+
+  if (m_bit_count < 26) {
+    return;
+  }
+  // Search for a block with a valid offset word.
+  std::uint32_t s = syndrome(m_shift_reg);
+  int index = -1;
+  for (int i = 0; i < 5; i++) {
+    if (s == offset_words[i]) {
+      index = (i == 4) ? BlockC : i;
+      break;
+    }
+  }
+  if (index < 0) {
+    return;
+  }
+  // Two valid blocks in the consistent distance and order establish
+  // the synchronization.
+  if (m_candidate_index >= 0) {
+    std::uint64_t distance = m_bit_count - m_candidate_bit;
+    if ((distance % 26) == 0 && (distance / 26) <= 6 &&
+        static_cast<int>((m_candidate_index + distance / 26) % 4) == index) {
+      m_synced_flag = true;
+      m_synced.store(true);
+      m_block_bits = 0;
+      m_block_errors = 0;
+      m_block_total = 0;
+      m_group_valid.fill(false);
+      m_group_data[index] = m_shift_reg >> 10;
+      m_group_valid[index] = true;
+      m_block_index = (index + 1) % 4;
+      if (index == BlockD) {
+        m_group_valid.fill(false);
+      }
+      return;
+    }
+  }
+  m_candidate_bit = m_bit_count;
+  m_candidate_index = index;
+}
+
+// Process a 26-bit block at the expected block index.
+void RdsDecoder::process_block(std::uint32_t word) {
+  std::uint32_t s = syndrome(word);
+  bool valid = false;
+  for (int i = 0; i < 5 && !valid; i++) {
+    int index = (i == 4) ? BlockC : i;
+    if (index != static_cast<int>(m_block_index)) {
+      continue;
+    }
+    if (s == offset_words[i]) {
+      valid = true;
+    } else {
+      std::uint32_t e = m_burst_table[s ^ offset_words[i]];
+      if (e != 0 && e != burst_ambiguous) {
+        word ^= e;
+        valid = true;
+      }
+    }
+  }
+
+  m_group_data[m_block_index] = word >> 10;
+  m_group_valid[m_block_index] = valid;
+
+  // Lose synchronization when too many blocks are uncorrectable.
+  m_block_total++;
+  if (!valid) {
+    m_block_errors++;
+  }
+  if (m_block_total >= 50) {
+    if (m_block_errors > 35) {
+      m_synced_flag = false;
+      m_synced.store(false);
+      m_candidate_index = -1;
+    }
+    m_block_total = 0;
+    m_block_errors = 0;
+  }
+
+  if (m_block_index == BlockD) {
+    process_group();
+    m_group_valid.fill(false);
+  }
+  m_block_index = (m_block_index + 1) % 4;
+}
+
+// Decode a complete group.
+void RdsDecoder::process_group() {
+  if (!m_group_valid[BlockB]) {
+    return;
+  }
+  std::uint16_t b = m_group_data[BlockB];
+  unsigned int type = b >> 12;
+  bool version_b = (b >> 11) & 1;
+
+  // Get PI code from block A, or from block C' for version B groups.
+  int pi;
+  if (m_group_valid[BlockA]) {
+    pi = m_group_data[BlockA];
+  } else if (version_b && m_group_valid[BlockC]) {
+    pi = m_group_data[BlockC];
+  } else {
+    return;
+  }
+  // Confirm a new PI code by two consecutive groups.
+  if (pi != m_pi) {
+    if (pi != m_pi_candidate) {
+      m_pi_candidate = pi;
+      return;
+    }
+    m_pi = pi;
+    m_ps.fill(' ');
+    m_ps_segments = 0;
+    m_ps_emitted.clear();
+    m_rt.fill(' ');
+    m_rt_segments = 0;
+    m_rt_emitted.clear();
+    fmt::println(m_output, "{{\"time\":{:.3f},\"pi\":\"0x{:04X}\"}}",
+                 Utility::get_time(), m_pi);
+    fflush(m_output);
+  }
+  m_group_count++;
+
+  std::string group = fmt::format("{}{}", type, version_b ? 'B' : 'A');
+  bool tp = (b >> 10) & 1;
+  unsigned int pty = (b >> 5) & 0x1f;
+  std::uint16_t c = m_group_data[BlockC];
+  std::uint16_t d = m_group_data[BlockD];
+
+  switch (type) {
+  case 0: {
+    // Basic tuning and switching information: Program Service name.
+    if (!m_group_valid[BlockD]) {
+      break;
+    }
+    unsigned int segment = b & 0x3;
+    m_ps[2 * segment] = d >> 8;
+    m_ps[2 * segment + 1] = d & 0xff;
+    m_ps_segments |= 1u << segment;
+    if (m_ps_segments == 0xf) {
+      m_ps_segments = 0;
+      std::string ps(m_ps.data(), m_ps.size());
+      if (ps != m_ps_emitted) {
+        m_ps_emitted = ps;
+        emit(group, fmt::format("\"ps\":{},\"tp\":{},\"pty\":{}",
+                                json_string(m_ps.data(), m_ps.size()), tp,
+                                pty));
+      }
+    }
+    break;
+  }
+  case 2: {
+    // RadioText.
+    int ab = (b >> 4) & 1;
+    if (ab != m_rt_ab) {
+      // Text A/B flag toggled: clear the text.
+      m_rt_ab = ab;
+      m_rt.fill(' ');
+      m_rt_segments = 0;
+    }
+    unsigned int segment = b & 0xf;
+    unsigned int chars_per_segment = version_b ? 2 : 4;
+    if (version_b) {
+      if (!m_group_valid[BlockD]) {
+        break;
+      }
+      m_rt[2 * segment] = d >> 8;
+      m_rt[2 * segment + 1] = d & 0xff;
+    } else {
+      if (!m_group_valid[BlockC] || !m_group_valid[BlockD]) {
+        break;
+      }
+      m_rt[4 * segment] = c >> 8;
+      m_rt[4 * segment + 1] = c & 0xff;
+      m_rt[4 * segment + 2] = d >> 8;
+      m_rt[4 * segment + 3] = d & 0xff;
+    }
+    m_rt_segments |= 1u << segment;
+    // Text ends at carriage return or at the maximum length.
+    std::size_t max_length = version_b ? 32 : 64;
+    std::size_t length = max_length;
+    for (std::size_t i = 0; i < max_length; i++) {
+      if (m_rt[i] == '\r') {
+        length = i;
+        break;
+      }
+    }
+    unsigned int needed =
+        (length + chars_per_segment - 1) / chars_per_segment;
+    std::uint32_t needed_mask =
+        (needed >= 32) ? 0xffffffff : (1u << needed) - 1;
+    if (needed > 0 && (m_rt_segments & needed_mask) == needed_mask) {
+      m_rt_segments = 0;
+      while (length > 0 && m_rt[length - 1] == ' ') {
+        length--;
+      }
+      std::string rt(m_rt.data(), length);
+      if (rt != m_rt_emitted) {
+        m_rt_emitted = rt;
+        emit(group, fmt::format("\"rt\":{}", json_string(m_rt.data(), length)));
+      }
+    }
+    break;
+  }
+  case 4: {
+    // Clock time and date.
+    if (version_b || !m_group_valid[BlockC] || !m_group_valid[BlockD]) {
+      break;
+    }
+    long mjd = ((b & 0x3) << 15) | (c >> 1);
+    int hour = ((c & 0x1) << 4) | (d >> 12);
+    int minute = (d >> 6) & 0x3f;
+    int offset = (d & 0x1f) * 30 * (((d >> 5) & 1) ? -1 : 1);
+    if (hour > 23 || minute > 59) {
+      break;
+    }
+    // Convert UTC to local time.
+    long local = mjd * 1440 + hour * 60 + minute + offset;
+    long local_mjd = local / 1440;
+    int local_min = local % 1440;
+    // MJD to date conversion (IEC 62106 Annex G).
+    int yp = static_cast<int>((local_mjd - 15078.2) / 365.25);
+    int mp = static_cast<int>(
+        (local_mjd - 14956.1 - static_cast<int>(yp * 365.25)) / 30.6001);
+    int day = local_mjd - 14956 - static_cast<int>(yp * 365.25) -
+              static_cast<int>(mp * 30.6001);
+    int k = (mp == 14 || mp == 15) ? 1 : 0;
+    int year = yp + k + 1900;
+    int month = mp - 1 - k * 12;
+    emit(group,
+         fmt::format("\"ct\":\"{:04}-{:02}-{:02}T{:02}:{:02}{}{:02}:{:02}\"",
+                     year, month, day, local_min / 60, local_min % 60,
+                     offset < 0 ? '-' : '+', std::abs(offset) / 60,
+                     std::abs(offset) % 60));
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// Write a JSON line with the given members.
+void RdsDecoder::emit(const std::string &group, const std::string &members) {
+  fmt::println(m_output,
+               "{{\"time\":{:.3f},\"pi\":\"0x{:04X}\",\"group\":\"{}\",{}}}",
+               Utility::get_time(), m_pi, group, members);
+  fflush(m_output);
+}
+
+// Compute 10-bit syndrome of a 26-bit block.
+// For a valid block, the syndrome equals the offset word.
+std::uint32_t RdsDecoder::syndrome(std::uint32_t word) {
+  std::uint32_t reg = word;
+  for (int i = 25; i >= 10; i--) {
+    if (reg & (1u << i)) {
+      reg ^= generator_polynomial << (i - 10);
+    }
+  }
+  return reg & 0x3ff;
+}
+
+// Return JSON string literal from RDS characters.
+// Characters out of the ASCII printable range are escaped as is.
+std::string RdsDecoder::json_string(const char *chars, std::size_t n) {
+  std::string ret("\"");
+  for (std::size_t i = 0; i < n; i++) {
+    unsigned char ch = static_cast<unsigned char>(chars[i]);
+    if (ch == '"' || ch == '\\') {
+      ret.push_back('\\');
+      ret.push_back(ch);
+    } else if (ch >= 0x20 && ch < 0x7f) {
+      ret.push_back(ch);
+    } else {
+      ret.append(fmt::format("\\u{:04x}", ch));
+    }
+  }
+  ret.push_back('"');
+  return ret;
+}
+
+// end
@@ -257,6 +257,29 @@ uint32_t RtlSdrSource::get_sample_rate() {
 // Return device current center frequency in Hz.
 uint32_t RtlSdrSource::get_frequency() { return rtlsdr_get_center_freq(m_dev); }
 
+// Retune the device without restarting the stream.
+bool RtlSdrSource::set_frequency(uint32_t frequency) {
+  if ((frequency < 10000000) || (frequency > 2200000000)) {
+    m_error = "Invalid frequency";
+    return false;
+  }
+  if (!m_dev) {
+    return false;
+  }
+
+  // Tune Fs/4 below the station to avoid DC offset, as configure().
+  const uint32_t tuner_freq = frequency - get_sample_rate() / 4u;
+  if (rtlsdr_set_center_freq(m_dev, tuner_freq) < 0) {
+    m_error = "rtlsdr_set_center_freq failed";
+    return false;
+  }
+
+  m_confFreq = frequency;
+  // Discard the samples of the previous frequency.
+  request_segment();
+  return true;
+}
+
 // Do not assume low-IF for RTL-SDR (Zero-IF by definition)
 bool RtlSdrSource::is_low_if() { return false; }
 
@@ -297,7 +320,10 @@ bool RtlSdrSource::start(DataBuffer<IQSample> *buf,
   m_stop_flag = stop_flag;
 
   if (m_thread == 0) {
-    m_thread = std::make_unique<std::thread>(run);
+    m_thread = std::make_unique<std::thread>([this] {
+      m_thread_setting.apply("source");
+      run();
+    });
     return true;
   } else {
     m_error = "Source thread already started";
@@ -322,7 +348,10 @@ void RtlSdrSource::run() {
     return;
   }
   while (!self->m_stop_flag->load() && get_samples(&iqsamples)) {
-    self->m_buf->push(std::move(iqsamples));
+    if (self->check_segment(retune_pipeline_blocks)) {
+      self->m_buf->push(std::move(iqsamples));
+      iqsamples = self->m_buf->get_spare();
+    }
   }
 }
 
@@ -339,7 +368,8 @@ bool RtlSdrSource::get_samples(IQSampleVector *samples) {
     return false;
   }
 
-  std::vector<uint8_t> buf(2 * self->m_block_length);
+  std::vector<uint8_t> &buf = self->m_read_buf;
+  buf.resize(2 * self->m_block_length);
 
   r = rtlsdr_read_sync(self->m_dev, buf.data(), 2 * self->m_block_length,
                        &n_read);
@@ -0,0 +1,167 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <unistd.h>
+
+#include "SampleFileWriter.h"
+
+// Construct the writer and start the writer thread.
+SampleFileWriter::SampleFileWriter(const std::string &filename,
+                                   unsigned int samplerate,
+                                   unsigned int channels, int format)
+    : m_channels(channels), m_zombie(false), m_closed(false),
+      m_dropped_blocks(0), m_written_frames(0) {
+
+  if (filename == "-") {
+    m_fd = STDOUT_FILENO;
+  } else {
+    m_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (m_fd < 0) {
+      set_error(
+          fmt::format("can not open '{}' ({})", filename, strerror(errno)));
+      return;
+    }
+  }
+
+  m_sfinfo.format = format;
+  m_sfinfo.samplerate = samplerate;
+  m_sfinfo.channels = channels;
+
+  if (!sf_format_check(&m_sfinfo)) {
+    set_error(fmt::format("SF_INFO for file '{}' is invalid", filename));
+  } else {
+    m_sndfile = sf_open_fd(m_fd, SFM_WRITE, &m_sfinfo, SF_TRUE);
+    if (m_sndfile == nullptr) {
+      set_error(fmt::format("can not open '{}' ({})", filename,
+                            sf_strerror(nullptr)));
+    }
+  }
+  if (m_sndfile == nullptr) {
+    if (m_fd != STDOUT_FILENO && m_fd >= 0) {
+      ::close(m_fd);
+    }
+    m_fd = -1;
+    return;
+  }
+
+  // For RF64 file, downgrade to WAV if filesize is smaller than 4GB
+  int filetype = m_sfinfo.format & SF_FORMAT_TYPEMASK;
+  if (filetype == SF_FORMAT_RF64) {
+    sf_command(m_sndfile, SFC_RF64_AUTO_DOWNGRADE, NULL, SF_TRUE);
+  }
+  // Clip float samples out of range when converting to integers
+  if ((m_sfinfo.format & SF_FORMAT_SUBMASK) != SF_FORMAT_FLOAT) {
+    sf_command(m_sndfile, SFC_SET_CLIPPING, NULL, SF_TRUE);
+  }
+
+  m_thread = std::make_unique<std::thread>(&SampleFileWriter::run, this);
+}
+
+// Destructor.
+SampleFileWriter::~SampleFileWriter() {
+  if (!m_closed.load()) {
+    close();
+  }
+}
+
+// Queue interleaved float samples to be written.
+void SampleFileWriter::push(IQSampleDecodedVector &&samples) {
+  if (m_zombie.load() || m_closed.load()) {
+    return;
+  }
+  if (m_queue.queue_size() >= max_queue_blocks) {
+    m_dropped_blocks++;
+    return;
+  }
+  m_queue.push(std::move(samples));
+}
+
+// Queue IQ samples as two-channel frames.
+void SampleFileWriter::push(const IQSampleVector &samples) {
+  assert(m_channels == 2);
+  IQSampleDecodedVector buf = get_spare();
+  const float *p = reinterpret_cast<const float *>(samples.data());
+  buf.assign(p, p + 2 * samples.size());
+  push(std::move(buf));
+}
+
+// Return a recycled empty buffer if available.
+IQSampleDecodedVector SampleFileWriter::get_spare() {
+  IQSampleDecodedVector ret;
+  std::scoped_lock<std::mutex> lock(m_spare_mutex);
+  if (!m_spare.empty()) {
+    std::swap(ret, m_spare.back());
+    m_spare.pop_back();
+  }
+  return ret;
+}
+
+// Flush the queue, stop the writer thread, and close the file.
+void SampleFileWriter::close() {
+  if (m_closed.exchange(true)) {
+    return;
+  }
+  m_queue.push_end();
+  if (m_thread) {
+    m_thread->join();
+    m_thread.reset();
+  }
+  if (m_sndfile) {
+    sf_close(m_sndfile);
+    m_sndfile = nullptr;
+  }
+}
+
+// Writer thread body.
+void SampleFileWriter::run() {
+  for (;;) {
+    if (m_queue.pull_end_reached()) {
+      break;
+    }
+    IQSampleDecodedVector buf = m_queue.pull();
+    if (buf.empty() || m_zombie.load()) {
+      continue;
+    }
+    sf_count_t frames = buf.size() / m_channels;
+    sf_count_t k = sf_writef_float(m_sndfile, buf.data(), frames);
+    if (k != frames) {
+      set_error(fmt::format("write failed ({})", sf_strerror(m_sndfile)));
+    }
+    m_written_frames += k;
+    // Recycle the buffer.
+    buf.clear();
+    std::scoped_lock<std::mutex> lock(m_spare_mutex);
+    if (m_spare.size() < max_spare_blocks) {
+      m_spare.push_back(std::move(buf));
+    }
+  }
+}
+
+// Set error message and mark as zombie.
+void SampleFileWriter::set_error(const std::string &msg) {
+  std::scoped_lock<std::mutex> lock(m_error_mutex);
+  m_error = msg;
+  m_zombie.store(true);
+}
+
+// end
@@ -0,0 +1,149 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cmath>
+#include <fmt/format.h>
+
+#include "ConfigParser.h"
+#include "Scanner.h"
+#include "Utility.h"
+
+// class Scanner
+
+// Constructor.
+Scanner::Scanner()
+    : m_index(0), m_dwell_time(default_dwell_time),
+      m_hold_time(default_hold_time), m_sample_rate(0),
+      m_state(State::Retuning), m_segment(0), m_samples(0),
+      m_audio_pending(false), m_retune_time(0),
+      m_latency_count(0), m_latency_sum(0), m_latency_max(0) {}
+
+bool Scanner::configure(const std::string &configuration) {
+  ConfigParser cp;
+  ConfigParser::map_type m;
+  cp.parse_config_string(configuration, m);
+
+  for (const auto &pair : m) {
+    const std::string &key = pair.first;
+    const std::string &value = pair.second;
+    if (key == "freqs") {
+      if (!parse_frequencies(value, m_frequencies)) {
+        m_error = fmt::format("invalid frequency list freqs={}", value);
+        return false;
+      }
+    } else if (key == "dwell" || key == "hold") {
+      double &time = (key == "dwell") ? m_dwell_time : m_hold_time;
+      if (!Utility::parse_dbl(value.c_str(), time) || time < 0.001 ||
+          time > 3600) {
+        m_error = fmt::format("{} must be from 0.001 to 3600", key);
+        return false;
+      }
+    } else {
+      m_error = fmt::format("unknown key {}", key);
+      return false;
+    }
+  }
+
+  if (m_frequencies.size() < 2) {
+    m_error = "freqs must have two or more frequencies";
+    return false;
+  }
+  return true;
+}
+
+std::uint32_t Scanner::next() {
+  m_index = (m_index + 1) % m_frequencies.size();
+  return m_frequencies[m_index];
+}
+
+void Scanner::retuned(double time) {
+  m_state = State::Retuning;
+  m_samples = 0;
+  m_audio_pending = true;
+  m_retune_time = time;
+}
+
+Scanner::Action Scanner::feed(std::uint64_t segment, std::size_t if_length,
+                              bool active) {
+  switch (m_state) {
+  case State::Retuning:
+    // Skip the stale blocks until the new segment begins.
+    if (segment == m_segment) {
+      return Action::Skip;
+    }
+    m_segment = segment;
+    m_state = State::Settling;
+    [[fallthrough]];
+  case State::Settling:
+    m_samples += if_length;
+    if (m_samples >= settle_time * m_sample_rate) {
+      m_state = State::Listening;
+      m_samples = 0;
+    }
+    return Action::Skip;
+  case State::Listening:
+    if (active) {
+      m_state = State::Active;
+      m_samples = 0;
+      return Action::Decode;
+    }
+    m_samples += if_length;
+    return (m_samples >= m_dwell_time * m_sample_rate) ? Action::Retune
+                                                       : Action::Skip;
+  case State::Active:
+    m_samples = active ? 0 : m_samples + if_length;
+    return (m_samples >= m_hold_time * m_sample_rate) ? Action::Retune
+                                                      : Action::Decode;
+  }
+  return Action::Skip;
+}
+
+double Scanner::audio_started(double time) {
+  double latency = time - m_retune_time;
+  m_audio_pending = false;
+  m_latency_count++;
+  m_latency_sum += latency;
+  if (latency > m_latency_max) {
+    m_latency_max = latency;
+  }
+  return latency;
+}
+
+// Parse the colon-separated frequency list.
+bool Scanner::parse_frequencies(const std::string &s,
+                                std::vector<std::uint32_t> &frequencies) {
+  frequencies.clear();
+  std::size_t begin = 0;
+  while (begin <= s.size()) {
+    std::size_t end = s.find(':', begin);
+    if (end == std::string::npos) {
+      end = s.size();
+    }
+    double freq;
+    if (!Utility::parse_dbl(s.substr(begin, end - begin).c_str(), freq) ||
+        freq < 0 || freq > 4.0e9) {
+      return false;
+    }
+    frequencies.push_back(static_cast<std::uint32_t>(std::lround(freq)));
+    begin = end + 1;
+  }
+  return true;
+}
+
+// end
@@ -0,0 +1,287 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "SignalGenerator.h"
+
+// class SignalGenerator::Oscillator
+
+SignalGenerator::Oscillator::Oscillator(double freq, double sample_rate)
+    : m_phasor(1.0, 0.0),
+      m_step(std::polar(1.0, 2.0 * M_PI * freq / sample_rate)) {}
+
+// class SignalGenerator
+
+// Construct signal generator.
+SignalGenerator::SignalGenerator(double sample_rate, unsigned int seed)
+    : m_sample_rate(sample_rate), m_noise_level(0.0), m_noise_gen(seed),
+      m_noise_dist(0.0, 1.0), m_echo_delay(0), m_echo_gain(0.0, 0.0),
+      m_echo_index(0) {
+  set_rds_station(default_rds_pi, "SYNTHFM");
+}
+
+// Add FM broadcast stereo multiplex with the 19kHz pilot.
+void SignalGenerator::add_fm_stereo(double offset, double left_freq,
+                                    double right_freq, double audio_level,
+                                    double amplitude, double rds_level) {
+  m_carriers.push_back(Carrier{
+      .modulation = Modulation::FmStereo,
+      .amplitude = amplitude,
+      .carrier = Oscillator(0, m_sample_rate),
+      .tone1 = Oscillator(left_freq, m_sample_rate),
+      .tone2 = Oscillator(right_freq, m_sample_rate),
+      .pilot = Oscillator(fm_pilot_freq, m_sample_rate),
+      .index = audio_level,
+      .phase = 0,
+      .phase_step = offset / m_sample_rate,
+      .rds_level = rds_level,
+      .rds_index = 0,
+      .rds_phase = 0,
+      .rds_symbol = 1.0});
+}
+
+// Set the RDS program identification and program service name.
+// Four 0A groups carry the PS by two characters each.
+void SignalGenerator::set_rds_station(std::uint16_t pi,
+                                      const std::string &ps) {
+  // Offset words of the blocks A, B, C, and D.
+  static constexpr std::uint16_t offset_words[4] = {0x0fc, 0x198, 0x168,
+                                                    0x1b4};
+  std::string name(ps);
+  name.resize(8, ' ');
+
+  m_rds_bits.clear();
+  for (unsigned int segment = 0; segment < 4; segment++) {
+    // Group type 0A, no TP, PTY 0, no TA, music,
+    // DI stereo flag in the last segment, and the segment address.
+    std::uint16_t block_b = static_cast<std::uint16_t>(
+        (1 << 3) | ((segment == 3 ? 1 : 0) << 2) | segment);
+    // No alternative frequency.
+    std::uint16_t block_c = 0xe0cd;
+    std::uint16_t block_d = static_cast<std::uint16_t>(
+        (static_cast<unsigned char>(name[2 * segment]) << 8) |
+        static_cast<unsigned char>(name[2 * segment + 1]));
+    const std::uint16_t blocks[4] = {pi, block_b, block_c, block_d};
+    for (unsigned int i = 0; i < 4; i++) {
+      std::uint32_t word = rds_block(blocks[i], offset_words[i]);
+      for (int bit = 25; bit >= 0; bit--) {
+        m_rds_bits.push_back((word >> bit) & 1);
+      }
+    }
+  }
+  for (auto &c : m_carriers) {
+    c.rds_index %= m_rds_bits.size();
+  }
+}
+
+// Return the 26-bit RDS block of the information word and the offset word.
+std::uint32_t SignalGenerator::rds_block(std::uint16_t info,
+                                         std::uint16_t offset) {
+  // Generator polynomial x^10 + x^8 + x^7 + x^5 + x^4 + x^3 + 1.
+  static constexpr std::uint32_t poly = 0x5b9;
+  std::uint32_t reg = std::uint32_t(info) << 10;
+  for (int i = 25; i >= 10; i--) {
+    if (reg & (1u << i)) {
+      reg ^= poly << (i - 10);
+    }
+  }
+  return (std::uint32_t(info) << 10) | ((reg & 0x3ff) ^ offset);
+}
+
+// Return the next RDS biphase waveform sample of the carrier.
+// A bit is a cycle of sine wave at the bit rate, whose polarity is
+// the differentially encoded bit; a one inverts the polarity.
+double SignalGenerator::next_rds(Carrier &c) {
+  double value = c.rds_symbol * unit_phasor(c.rds_phase).imag();
+  c.rds_phase += rds_bit_rate / m_sample_rate;
+  if (c.rds_phase >= 1.0) {
+    c.rds_phase -= 1.0;
+    c.rds_index = (c.rds_index + 1) % m_rds_bits.size();
+    if (m_rds_bits[c.rds_index]) {
+      c.rds_symbol = -c.rds_symbol;
+    }
+  }
+  return value;
+}
+
+// Add narrow band FM carrier modulated by a tone.
+void SignalGenerator::add_nbfm(double offset, double tone_freq,
+                               double deviation, double amplitude) {
+  m_carriers.push_back(Carrier{
+      .modulation = Modulation::Nbfm,
+      .amplitude = amplitude,
+      .carrier = Oscillator(0, m_sample_rate),
+      .tone1 = Oscillator(tone_freq, m_sample_rate),
+      .tone2 = Oscillator(0, m_sample_rate),
+      .pilot = Oscillator(0, m_sample_rate),
+      .index = deviation,
+      .phase = 0,
+      .phase_step = offset / m_sample_rate});
+}
+
+// Add AM carrier modulated by a tone with the modulation depth.
+void SignalGenerator::add_am(double offset, double tone_freq, double depth,
+                             double amplitude) {
+  m_carriers.push_back(Carrier{.modulation = Modulation::Am,
+                               .amplitude = amplitude,
+                               .carrier = Oscillator(offset, m_sample_rate),
+                               .tone1 = Oscillator(tone_freq, m_sample_rate),
+                               .tone2 = Oscillator(0, m_sample_rate),
+                               .pilot = Oscillator(0, m_sample_rate),
+                               .index = depth,
+                               .phase = 0,
+                               .phase_step = 0});
+}
+
+// Add single-tone SSB signal.
+// A single-tone SSB signal is a carrier shifted by the tone frequency.
+void SignalGenerator::add_ssb(double offset, double tone_freq, bool upper,
+                              double amplitude) {
+  add_cw(upper ? offset + tone_freq : offset - tone_freq, amplitude);
+}
+
+// Add unmodulated carrier.
+void SignalGenerator::add_cw(double offset, double amplitude) {
+  m_carriers.push_back(Carrier{.modulation = Modulation::Carrier,
+                               .amplitude = amplitude,
+                               .carrier = Oscillator(offset, m_sample_rate),
+                               .tone1 = Oscillator(0, m_sample_rate),
+                               .tone2 = Oscillator(0, m_sample_rate),
+                               .pilot = Oscillator(0, m_sample_rate),
+                               .index = 0,
+                               .phase = 0,
+                               .phase_step = 0});
+}
+
+// Add an echo of the whole signal.
+void SignalGenerator::set_multipath(double delay, double gain, double phase) {
+  m_echo_delay =
+      static_cast<std::size_t>(std::lround(delay * m_sample_rate));
+  m_echo_gain = std::polar(gain, phase);
+  m_echo_history.assign(m_echo_delay, 0.0);
+  m_echo_index = 0;
+}
+
+// Return the unit phasor of the phase in cycles, from [0, 1).
+// A linearly interpolated table is much faster than std::polar(),
+// and the error is below -120dB.
+std::complex<double> SignalGenerator::unit_phasor(double cycles) {
+  static constexpr unsigned int table_size = 4096;
+  static const std::array<std::complex<double>, table_size + 1> table = [] {
+    std::array<std::complex<double>, table_size + 1> t;
+    for (unsigned int i = 0; i <= table_size; i++) {
+      t[i] = std::polar(1.0, 2.0 * M_PI * i / table_size);
+    }
+    return t;
+  }();
+  double position = cycles * table_size;
+  unsigned int index = static_cast<unsigned int>(position);
+  double frac = position - index;
+  return table[index] + frac * (table[index + 1] - table[index]);
+}
+
+// Generate n samples.
+// Each carrier is generated over a chunk of samples in turn,
+// which keeps the inner loops short and the sum in the cache.
+void SignalGenerator::generate(IQSampleVector &samples_out, std::size_t n) {
+  const double fm_dev_cycles = fm_freq_dev / m_sample_rate;
+  m_sum.assign(n, 0.0);
+
+  for (std::size_t begin = 0; begin < n; begin += chunk_length) {
+    const std::size_t end = std::min(n, begin + chunk_length);
+    for (auto &c : m_carriers) {
+      switch (c.modulation) {
+      case Modulation::FmStereo:
+        for (std::size_t i = begin; i < end; i++) {
+          double left = c.tone1.next().imag();
+          double right = c.tone2.next().imag();
+          std::complex<double> pilot = c.pilot.next();
+          // Stereo subcarrier at 38kHz is coherent with the pilot:
+          // sin(2 * theta) = 2 * sin(theta) * cos(theta).
+          double subcarrier = 2.0 * pilot.imag() * pilot.real();
+          double mpx = c.index * (0.5 * (left + right) +
+                                  0.5 * (left - right) * subcarrier) +
+                       fm_pilot_level * pilot.imag();
+          if (c.rds_level > 0) {
+            // RDS subcarrier at 57kHz is the third harmonic of the pilot.
+            mpx +=
+                c.rds_level * next_rds(c) * (pilot * pilot * pilot).imag();
+          }
+          c.phase += c.phase_step + fm_dev_cycles * mpx;
+          c.phase -= std::floor(c.phase);
+          m_sum[i] += c.amplitude * unit_phasor(c.phase);
+        }
+        break;
+      case Modulation::Nbfm:
+        for (std::size_t i = begin; i < end; i++) {
+          double tone = c.tone1.next().imag();
+          c.phase += c.phase_step + c.index * tone / m_sample_rate;
+          c.phase -= std::floor(c.phase);
+          m_sum[i] += c.amplitude * unit_phasor(c.phase);
+        }
+        break;
+      case Modulation::Am:
+        for (std::size_t i = begin; i < end; i++) {
+          double tone = c.tone1.next().imag();
+          m_sum[i] +=
+              c.amplitude * (1.0 + c.index * tone) * c.carrier.next();
+        }
+        break;
+      case Modulation::Carrier:
+        for (std::size_t i = begin; i < end; i++) {
+          m_sum[i] += c.amplitude * c.carrier.next();
+        }
+        break;
+      }
+    }
+  }
+  for (auto &c : m_carriers) {
+    c.carrier.normalize();
+    c.tone1.normalize();
+    c.tone2.normalize();
+    c.pilot.normalize();
+  }
+
+  if (m_echo_delay > 0) {
+    for (std::size_t i = 0; i < n; i++) {
+      std::complex<double> delayed = m_echo_history[m_echo_index];
+      m_echo_history[m_echo_index] = m_sum[i];
+      m_echo_index = (m_echo_index + 1) % m_echo_delay;
+      m_sum[i] += m_echo_gain * delayed;
+    }
+  }
+
+  if (m_noise_level > 0) {
+    const double noise_sigma = m_noise_level * M_SQRT1_2;
+    for (std::size_t i = 0; i < n; i++) {
+      double re = m_noise_dist(m_noise_gen);
+      double im = m_noise_dist(m_noise_gen);
+      m_sum[i] += noise_sigma * std::complex<double>(re, im);
+    }
+  }
+
+  samples_out.resize(n);
+  for (std::size_t i = 0; i < n; i++) {
+    samples_out[i] = IQSample(m_sum[i].real(), m_sum[i].imag());
+  }
+}
+
+// end
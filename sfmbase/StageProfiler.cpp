@@ -0,0 +1,254 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fmt/format.h>
+
+#include "StageProfiler.h"
+
+// Construct profiler with all counters cleared.
+StageProfiler::StageProfiler() {
+  for (auto &stats : m_stats) {
+    stats.count.store(0);
+    stats.total_ns.store(0);
+    stats.max_ns.store(0);
+    stats.samples.store(0);
+    for (auto &bucket : stats.buckets) {
+      bucket.store(0);
+    }
+  }
+}
+
+// Record a duration of a stage.
+// Only the DSP thread writes, so relaxed ordering is sufficient.
+void StageProfiler::record(Stage stage, std::uint64_t ns,
+                           std::size_t samples) {
+  StageStats &stats = m_stats[static_cast<unsigned int>(stage)];
+  unsigned int bucket = ns == 0 ? 0 : std::bit_width(ns) - 1;
+  bucket = std::min(bucket, num_buckets - 1);
+  stats.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  stats.count.fetch_add(1, std::memory_order_relaxed);
+  stats.total_ns.fetch_add(ns, std::memory_order_relaxed);
+  stats.samples.fetch_add(samples, std::memory_order_relaxed);
+  if (ns > stats.max_ns.load(std::memory_order_relaxed)) {
+    stats.max_ns.store(ns, std::memory_order_relaxed);
+  }
+}
+
+// Copy the counters into snapshot.
+void StageProfiler::copy_to(StageProfiler &snapshot) const {
+  for (unsigned int i = 0; i < num_stages; i++) {
+    const StageStats &stats = m_stats[i];
+    StageStats &copy = snapshot.m_stats[i];
+    copy.count.store(stats.count.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+    copy.total_ns.store(stats.total_ns.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+    copy.max_ns.store(stats.max_ns.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+    copy.samples.store(stats.samples.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+    for (unsigned int k = 0; k < num_buckets; k++) {
+      copy.buckets[k].store(stats.buckets[k].load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+    }
+  }
+}
+
+// Return the name of a stage.
+const char *StageProfiler::stage_name(Stage stage) {
+  switch (stage) {
+  case Stage::FourthConverter:
+    return "fourth_converter";
+  case Stage::IfResampler:
+    return "if_resampler";
+  case Stage::IfAfc:
+    return "if_afc";
+  case Stage::FineTuner:
+    return "fine_tuner";
+  case Stage::IfFilter:
+    return "if_filter";
+  case Stage::IfAgc:
+    return "if_agc";
+  case Stage::Multipath:
+    return "multipath";
+  case Stage::Discriminator:
+    return "discriminator";
+  case Stage::PilotPll:
+    return "pilot_pll";
+  case Stage::AudioResampler:
+    return "audio_resampler";
+  case Stage::AudioFilter:
+    return "audio_filter";
+  case Stage::AfAgc:
+    return "af_agc";
+  case Stage::OutputWrite:
+    return "output_write";
+  default:
+    return "unknown";
+  }
+}
+
+// Estimate the given quantile from the histogram.
+// The upper bound of the bucket is returned, limited by the maximum.
+std::uint64_t StageProfiler::quantile_ns(const StageStats &stats, double q) {
+  std::uint64_t count = stats.count.load(std::memory_order_relaxed);
+  if (count == 0) {
+    return 0;
+  }
+  std::uint64_t max_ns = stats.max_ns.load(std::memory_order_relaxed);
+  std::uint64_t target = static_cast<std::uint64_t>(q * count);
+  std::uint64_t sum = 0;
+  for (unsigned int k = 0; k < num_buckets; k++) {
+    sum += stats.buckets[k].load(std::memory_order_relaxed);
+    if (sum > target) {
+      return std::min(std::uint64_t(2) << k, max_ns);
+    }
+  }
+  return max_ns;
+}
+
+// Return the current snapshot as a JSON object string.
+std::string StageProfiler::to_json() const {
+  std::string out("{\"stages\":[");
+  bool first = true;
+  for (unsigned int i = 0; i < num_stages; i++) {
+    const StageStats &stats = m_stats[i];
+    std::uint64_t count = stats.count.load(std::memory_order_relaxed);
+    if (count == 0) {
+      continue;
+    }
+    std::uint64_t total_ns = stats.total_ns.load(std::memory_order_relaxed);
+    std::uint64_t samples = stats.samples.load(std::memory_order_relaxed);
+    // Trim trailing empty buckets.
+    unsigned int last = 0;
+    for (unsigned int k = 0; k < num_buckets; k++) {
+      if (stats.buckets[k].load(std::memory_order_relaxed) > 0) {
+        last = k;
+      }
+    }
+    std::string buckets;
+    for (unsigned int k = 0; k <= last; k++) {
+      buckets += fmt::format(
+          "{}{}", k == 0 ? "" : ",",
+          stats.buckets[k].load(std::memory_order_relaxed));
+    }
+    out += fmt::format(
+        "{}{{\"name\":\"{}\",\"blocks\":{},\"samples\":{},\"total_ns\":{},"
+        "\"mean_ns\":{:.0f},\"p50_ns\":{},\"p99_ns\":{},\"max_ns\":{},"
+        "\"ns_per_sample\":{:.3f},\"log2_ns_buckets\":[{}]}}",
+        first ? "" : ",", stage_name(static_cast<Stage>(i)), count, samples,
+        total_ns, double(total_ns) / count, quantile_ns(stats, 0.5),
+        quantile_ns(stats, 0.99),
+        stats.max_ns.load(std::memory_order_relaxed),
+        samples > 0 ? double(total_ns) / samples : 0.0, buckets);
+    first = false;
+  }
+  out += "]}";
+  return out;
+}
+
+// Print a human-readable summary table.
+void StageProfiler::print_summary(FILE *fp) const {
+  fmt::println(fp, "{:<16} {:>9} {:>10} {:>10} {:>10} {:>10} {:>8}", "stage",
+               "blocks", "mean_us", "p50_us", "p99_us", "max_us", "ns/smp");
+  for (unsigned int i = 0; i < num_stages; i++) {
+    const StageStats &stats = m_stats[i];
+    std::uint64_t count = stats.count.load(std::memory_order_relaxed);
+    if (count == 0) {
+      continue;
+    }
+    std::uint64_t total_ns = stats.total_ns.load(std::memory_order_relaxed);
+    std::uint64_t samples = stats.samples.load(std::memory_order_relaxed);
+    fmt::println(fp,
+                 "{:<16} {:>9} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} "
+                 "{:>8.2f}",
+                 stage_name(static_cast<Stage>(i)), count,
+                 1.0e-3 * total_ns / count, 1.0e-3 * quantile_ns(stats, 0.5),
+                 1.0e-3 * quantile_ns(stats, 0.99),
+                 1.0e-3 * stats.max_ns.load(std::memory_order_relaxed),
+                 samples > 0 ? double(total_ns) / samples : 0.0);
+  }
+}
+
+// class StageProfileWriter
+
+// Start the writer thread.
+StageProfileWriter::StageProfileWriter(const std::string &filename)
+    : m_filename(filename), m_pending(false), m_stop(false),
+      m_thread(&StageProfileWriter::run, this) {}
+
+// Stop the writer thread.
+StageProfileWriter::~StageProfileWriter() {
+  {
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cond.notify_all();
+  m_thread.join();
+}
+
+// Copy the counters to be written.
+void StageProfileWriter::request(const StageProfiler &profiler) {
+  {
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    if (m_pending) {
+      return;
+    }
+    profiler.copy_to(m_snapshot);
+    m_pending = true;
+  }
+  m_cond.notify_all();
+}
+
+// Write the profile to the file, and print the summary.
+void StageProfileWriter::write(const StageProfiler &profiler,
+                               const std::string &filename) {
+  FILE *fp = fopen(filename.c_str(), "w");
+  if (fp == nullptr) {
+    fmt::println(stderr, "\nERROR: can not open profile file '{}' ({})",
+                 filename, strerror(errno));
+  } else {
+    fmt::println(fp, "{}", profiler.to_json());
+    fclose(fp);
+  }
+  fmt::println(stderr, "\nDSP stage profile:");
+  profiler.print_summary(stderr);
+}
+
+// Writer thread body.
+// The snapshot is not changed by request() while m_pending is set,
+// so that it is written without holding the lock.
+void StageProfileWriter::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_cond.wait(lock, [&] { return m_pending || m_stop; });
+    if (!m_pending) {
+      return;
+    }
+    lock.unlock();
+    write(m_snapshot, m_filename);
+    lock.lock();
+    m_pending = false;
+  }
+}
+
+// end
@@ -0,0 +1,372 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <fmt/format.h>
+
+#include "ConfigParser.h"
+#include "FineTuner.h"
+#include "SyntheticSource.h"
+#include "Utility.h"
+
+// Constructor
+SyntheticSource::SyntheticSource(int dev_index)
+    : m_sample_rate(default_sample_rate), m_frequency(default_frequency),
+      m_scene_frequency(default_frequency), m_scene(Scene::FM),
+      m_scene_name("fm"), m_offset(0), m_rds(false),
+      m_snr_db(INFINITY), m_echo_delay_us(0), m_echo_gain(0),
+      m_zero_offset(false), m_realtime(true), m_seconds(0), m_seed(1),
+      m_block_length(min_block_length), m_samples_generated(0),
+      m_thread(nullptr) {
+  (void)dev_index;
+  m_devname = "Synthetic";
+}
+
+// Destructor
+SyntheticSource::~SyntheticSource() {}
+
+bool SyntheticSource::configure(std::string configurationStr) {
+  ConfigParser cp;
+  ConfigParser::map_type m;
+  cp.parse_config_string(configurationStr, m);
+
+  bool blklen_specified = false;
+
+  for (const auto &pair : m) {
+    const std::string &key = pair.first;
+    const std::string &value = pair.second;
+    if (key == "srate") {
+      double srate;
+      if (!Utility::parse_dbl(value.c_str(), srate) || srate < 48000 ||
+          srate > max_sample_rate) {
+        m_error = fmt::format(
+            "SyntheticSource: srate must be from 48000 to {}",
+            max_sample_rate);
+        return false;
+      }
+      m_sample_rate = static_cast<std::uint32_t>(std::lround(srate));
+    } else if (key == "freq") {
+      double freq;
+      if (!Utility::parse_dbl(value.c_str(), freq) || freq < 0 ||
+          freq > 4.0e9) {
+        m_error = "SyntheticSource: invalid freq";
+        return false;
+      }
+      m_frequency = static_cast<std::uint32_t>(std::lround(freq));
+    } else if (key == "scene") {
+      const struct {
+        const char *name;
+        Scene scene;
+      } scenes[] = {
+          {"fm", Scene::FM},         {"am", Scene::AM},
+          {"usb", Scene::USB},       {"lsb", Scene::LSB},
+          {"cw", Scene::CW},         {"fmband", Scene::FmBand},
+          {"amband", Scene::AmBand},
+      };
+      bool found = false;
+      for (const auto &s : scenes) {
+        if (value == s.name) {
+          m_scene = s.scene;
+          m_scene_name = s.name;
+          found = true;
+        }
+      }
+      if (!found) {
+        m_error = fmt::format("SyntheticSource: unknown scene '{}'", value);
+        return false;
+      }
+    } else if (key == "offset") {
+      if (!Utility::parse_dbl(value.c_str(), m_offset)) {
+        m_error = "SyntheticSource: invalid offset";
+        return false;
+      }
+    } else if (key == "rds") {
+      m_rds = true;
+    } else if (key == "snr") {
+      if (!Utility::parse_dbl(value.c_str(), m_snr_db)) {
+        m_error = "SyntheticSource: invalid snr";
+        return false;
+      }
+    } else if (key == "echo_delay") {
+      if (!Utility::parse_dbl(value.c_str(), m_echo_delay_us) ||
+          m_echo_delay_us < 0 || m_echo_delay_us > 1000) {
+        m_error = "SyntheticSource: echo_delay must be from 0 to 1000";
+        return false;
+      }
+    } else if (key == "echo_gain") {
+      if (!Utility::parse_dbl(value.c_str(), m_echo_gain) ||
+          m_echo_gain < 0 || m_echo_gain > 1) {
+        m_error = "SyntheticSource: echo_gain must be from 0 to 1";
+        return false;
+      }
+    } else if (key == "zero_offset") {
+      m_zero_offset = true;
+    } else if (key == "realtime") {
+      int realtime_value;
+      if (!Utility::parse_int(value.c_str(), realtime_value) ||
+          (realtime_value != 0 && realtime_value != 1)) {
+        m_error = "SyntheticSource: invalid realtime";
+        return false;
+      }
+      m_realtime = (realtime_value == 1);
+    } else if (key == "seconds") {
+      if (!Utility::parse_dbl(value.c_str(), m_seconds) || m_seconds < 0) {
+        m_error = "SyntheticSource: invalid seconds";
+        return false;
+      }
+    } else if (key == "seed") {
+      int seed;
+      if (!Utility::parse_int(value.c_str(), seed) || seed < 0) {
+        m_error = "SyntheticSource: invalid seed";
+        return false;
+      }
+      m_seed = static_cast<unsigned int>(seed);
+    } else if (key == "blklen") {
+      if (!Utility::parse_int(value.c_str(), m_block_length) ||
+          m_block_length <= 0 || m_block_length > (1 << 24)) {
+        m_error = "SyntheticSource: invalid blklen";
+        return false;
+      }
+      blklen_specified = true;
+    } else {
+      m_error = fmt::format("SyntheticSource: unknown key '{}'", key);
+      return false;
+    }
+  }
+
+  // Blocks of about 5 milliseconds, as the hardware drivers.
+  if (!blklen_specified) {
+    m_block_length = std::max<int>(
+        min_block_length,
+        static_cast<int>(std::bit_ceil(m_sample_rate / 200u)));
+  }
+
+  setup_scene();
+  m_scene_frequency = m_frequency;
+  m_confFreq = m_frequency;
+  return true;
+}
+
+// Retune the source; the stations of the scene are kept in place.
+bool SyntheticSource::set_frequency(std::uint32_t frequency) {
+  if (frequency > 4000000000u) {
+    m_error = "SyntheticSource: invalid freq";
+    return false;
+  }
+  // The new segment is started by the generator thread.
+  m_frequency.store(frequency);
+  m_confFreq = frequency;
+  return true;
+}
+
+// Set up the carriers of the scene.
+void SyntheticSource::setup_scene() {
+  const double rate = m_sample_rate;
+  m_generator = std::make_unique<SignalGenerator>(rate, m_seed);
+  SignalGenerator &gen = *m_generator;
+  // The signal is at +Fs/4 for the zero-IF devices.
+  const double center = m_zero_offset ? rate / 4 : 0;
+  const double offset = center + m_offset;
+  const double rds_level = m_rds ? 0.04 : 0.0;
+
+  switch (m_scene) {
+  case Scene::FM:
+    gen.add_fm_stereo(offset, 1000, 400, 0.85, carrier_amplitude, rds_level);
+    break;
+  case Scene::AM:
+    gen.add_am(offset, 1000, 0.5, carrier_amplitude);
+    break;
+  case Scene::USB:
+    gen.add_ssb(offset, 1000, true, carrier_amplitude);
+    break;
+  case Scene::LSB:
+    gen.add_ssb(offset, 1000, false, carrier_amplitude);
+    break;
+  case Scene::CW:
+    // Heard at 600Hz by the 500Hz pitch shift.
+    gen.add_cw(offset + 100, carrier_amplitude);
+    break;
+  case Scene::FmBand:
+  case Scene::AmBand: {
+    // Weaker stations on both sides of the main station,
+    // as long as they fit in 80% of the bandwidth.
+    const bool fm = (m_scene == Scene::FmBand);
+    const double spacing = fm ? 200000 : 9000;
+    if (fm) {
+      gen.add_fm_stereo(offset, 1000, 400, 0.85, carrier_amplitude,
+                        rds_level);
+    } else {
+      gen.add_am(offset, 1000, 0.5, carrier_amplitude);
+    }
+    for (int k = 1; k <= max_band_neighbors; k++) {
+      bool added = false;
+      for (int sign : {-1, 1}) {
+        double station = offset + sign * k * spacing;
+        if (std::fabs(station - center) > 0.4 * rate) {
+          continue;
+        }
+        double tone = 300 + 100 * k;
+        double amplitude = carrier_amplitude * (k % 2 == 1 ? 0.3 : 0.1);
+        if (fm) {
+          gen.add_fm_stereo(station, tone, tone * 2, 0.85, amplitude);
+        } else {
+          gen.add_am(station, tone, 0.5, amplitude);
+        }
+        added = true;
+      }
+      if (!added) {
+        break;
+      }
+    }
+    break;
+  }
+  }
+
+  if (std::isfinite(m_snr_db)) {
+    gen.set_noise(carrier_amplitude * std::pow(10.0, -m_snr_db / 20.0));
+  }
+  if (m_echo_delay_us > 0 && m_echo_gain > 0) {
+    gen.set_multipath(m_echo_delay_us * 1.0e-6, m_echo_gain);
+  }
+}
+
+void SyntheticSource::print_specific_parms() {
+  fmt::println(stderr, "SyntheticSource: scene {}, offset {:.0f} [Hz]{}{}",
+               m_scene_name, m_offset, m_rds ? ", RDS" : "",
+               m_zero_offset ? ", zero IF" : "");
+  if (std::isfinite(m_snr_db)) {
+    fmt::println(stderr, "SyntheticSource: SNR {:.1f} [dB]", m_snr_db);
+  }
+  if (m_echo_delay_us > 0 && m_echo_gain > 0) {
+    fmt::println(stderr, "SyntheticSource: echo {:.2f} [us], gain {:.3f}",
+                 m_echo_delay_us, m_echo_gain);
+  }
+  fmt::println(stderr, "SyntheticSource: block length {}{}", m_block_length,
+               m_realtime ? "" : ", generating faster than real time");
+}
+
+// Return a list of supported devices.
+void SyntheticSource::get_device_names(std::vector<std::string> &devices) {
+  devices.push_back("Synthetic");
+}
+
+bool SyntheticSource::start(DataBuffer<IQSample> *buf,
+                            std::atomic_bool *stop_flag) {
+  m_buf = buf;
+  m_stop_flag = stop_flag;
+
+  if (m_thread) {
+    m_error = "Source thread already started";
+    return false;
+  }
+  if (!m_generator) {
+    setup_scene();
+  }
+  m_thread = std::make_unique<std::thread>([this] {
+    m_thread_setting.apply("source");
+    run();
+  });
+  return true;
+}
+
+bool SyntheticSource::stop() {
+  if (m_thread) {
+    m_thread->join();
+    m_thread.reset();
+
+    // Report the achieved speed.
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - m_start_time)
+                         .count();
+    double duration = double(m_samples_generated.load()) / m_sample_rate;
+    fmt::println(stderr,
+                 "SyntheticSource: {:.3f} seconds of samples generated in "
+                 "{:.3f} seconds ({:.2f} times real time)",
+                 duration, elapsed, elapsed > 0 ? duration / elapsed : 0.0);
+  }
+  return true;
+}
+
+// Generator thread body.
+void SyntheticSource::run() {
+  const std::uint64_t total_samples =
+      m_seconds > 0 ? static_cast<std::uint64_t>(m_seconds * m_sample_rate)
+                    : 0;
+  IQSampleVector iqsamples;
+  // Shift the scene to the tuned frequency.
+  std::uint32_t frequency = m_scene_frequency;
+  FineTuner tuner(m_sample_rate);
+
+  m_start_time = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point begin = m_start_time;
+  std::uint64_t generated = 0;
+  while (!m_stop_flag->load()) {
+    std::size_t n = m_block_length;
+    if (total_samples > 0) {
+      if (generated >= total_samples) {
+        break;
+      }
+      n = static_cast<std::size_t>(
+          std::min<std::uint64_t>(n, total_samples - generated));
+    }
+    std::uint32_t tuned = m_frequency.load();
+    if (tuned != frequency) {
+      frequency = tuned;
+      tuner.set_freq_shift(double(m_scene_frequency) - double(frequency));
+      // Discard the samples of the previous frequency.
+      m_buf->start_segment();
+    }
+    m_generator->generate(iqsamples, n);
+    if (frequency != m_scene_frequency) {
+      tuner.process_inplace(iqsamples);
+    }
+    generated += n;
+    m_samples_generated.store(generated);
+    m_buf->push(std::move(iqsamples));
+    iqsamples = m_buf->get_spare();
+
+    if (m_realtime) {
+      // Pace to the sample rate; no catching up when behind.
+      std::chrono::steady_clock::time_point due =
+          begin +
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(double(generated) /
+                                            m_sample_rate));
+      std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now();
+      if (due > now) {
+        std::this_thread::sleep_until(due);
+      } else {
+        begin += now - due;
+      }
+    } else {
+      // No pacing, but wait for the decoder to catch up
+      // so that the queue memory is bounded.
+      while (!m_stop_flag->load() &&
+             !m_buf->wait_queue_size_below(max_queued_blocks,
+                                           std::chrono::milliseconds(100))) {
+      }
+    }
+  }
+
+  m_buf->push_end();
+}
+
+// end
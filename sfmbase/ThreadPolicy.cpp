@@ -0,0 +1,228 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2015 Edouard Griffiths, F4EXB
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "ConfigParser.h"
+#include "ThreadPolicy.h"
+#include "Utility.h"
+
+namespace {
+
+#ifdef CPU_SETSIZE
+constexpr int max_cpus = CPU_SETSIZE;
+#else
+constexpr int max_cpus = 1024;
+#endif
+
+// Touch the stack pages below the caller.
+[[gnu::noinline]] void prefault_stack() {
+  volatile unsigned char stack[ThreadPolicy::stack_prefault_size];
+  const std::size_t page_size = sysconf(_SC_PAGESIZE);
+  for (std::size_t i = 0; i < sizeof(stack); i += page_size) {
+    stack[i] = 0;
+  }
+}
+
+std::string cpus_string(const std::vector<int> &cpus) {
+  std::string s;
+  for (int cpu : cpus) {
+    s += s.empty() ? "" : ":";
+    s += std::to_string(cpu);
+  }
+  return s;
+}
+
+} // namespace
+
+bool ThreadSetting::apply(const std::string &thread_name) const {
+  bool ok = true;
+
+  if (!cpus.empty()) {
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int cpu : cpus) {
+      CPU_SET(cpu, &cpuset);
+    }
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (ret == 0) {
+      fmt::println(stderr, "Thread policy: {} thread on CPU {}", thread_name,
+                   cpus_string(cpus));
+    } else {
+      fmt::println(stderr,
+                   "WARNING: Thread policy: {} thread: "
+                   "can not set CPU {} ({})",
+                   thread_name, cpus_string(cpus), std::strerror(ret));
+      ok = false;
+    }
+#else
+    fmt::println(stderr,
+                 "WARNING: Thread policy: {} thread: "
+                 "CPU affinity is not supported on this platform",
+                 thread_name);
+    ok = false;
+#endif
+  }
+
+  if (priority > 0) {
+    struct sched_param param = {};
+    param.sched_priority = priority;
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (ret == 0) {
+      fmt::println(stderr, "Thread policy: {} thread SCHED_FIFO priority {}",
+                   thread_name, priority);
+    } else {
+      fmt::println(stderr,
+                   "WARNING: Thread policy: {} thread: "
+                   "can not set SCHED_FIFO priority {} ({})",
+                   thread_name, priority, std::strerror(ret));
+      if (ret == EPERM) {
+        fmt::println(stderr, "WARNING: Thread policy: "
+                             "CAP_SYS_NICE or RLIMIT_RTPRIO is required");
+      }
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+bool ThreadPolicy::configure(const std::string &configuration) {
+  ConfigParser cp;
+  ConfigParser::map_type m;
+  cp.parse_config_string(configuration, m);
+
+  for (const auto &pair : m) {
+    const std::string &key = pair.first;
+    const std::string &value = pair.second;
+    if (key == "source_cpus" || key == "dsp_cpus") {
+      ThreadSetting &setting = (key == "source_cpus") ? m_source : m_dsp;
+      if (!parse_cpus(value, setting.cpus)) {
+        m_error = fmt::format("invalid CPU list {}={}", key, value);
+        return false;
+      }
+    } else if (key == "source_priority" || key == "dsp_priority") {
+      ThreadSetting &setting = (key == "source_priority") ? m_source : m_dsp;
+      int priority;
+      if (!Utility::parse_int(value.c_str(), priority) ||
+          priority < sched_get_priority_min(SCHED_FIFO) ||
+          priority > sched_get_priority_max(SCHED_FIFO)) {
+        m_error = fmt::format("{} must be from {} to {}", key,
+                              sched_get_priority_min(SCHED_FIFO),
+                              sched_get_priority_max(SCHED_FIFO));
+        return false;
+      }
+      setting.priority = priority;
+    } else if (key == "mlock") {
+      m_mlock = true;
+    } else {
+      m_error = fmt::format("unknown key {}", key);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ThreadPolicy::lock_memory() {
+  if (!m_mlock) {
+    return true;
+  }
+
+  // Locking the future pages fails the allocations beyond the limit,
+  // so require the limit to be removed unless running as root.
+  struct rlimit limit;
+  if (geteuid() != 0 && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 &&
+      limit.rlim_cur != RLIM_INFINITY) {
+    m_error = fmt::format("RLIMIT_MEMLOCK is {} bytes, "
+                          "set it to unlimited (ulimit -l unlimited)",
+                          limit.rlim_cur);
+    fmt::println(stderr, "WARNING: Thread policy: can not lock memory: {}",
+                 m_error);
+    return false;
+  }
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    m_error = std::strerror(errno);
+    fmt::println(stderr, "WARNING: Thread policy: can not lock memory: {}",
+                 m_error);
+    return false;
+  }
+
+#ifdef __GLIBC__
+  // Keep the freed memory in the heap instead of returning it
+  // to the kernel, and allocate the large blocks from the heap,
+  // so that the pre-faulted pages are reused.
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+  void *heap = std::malloc(heap_prefault_size);
+  if (heap != nullptr) {
+    std::memset(heap, 0, heap_prefault_size);
+    std::free(heap);
+  }
+#endif
+  prefault_stack();
+
+  fmt::println(stderr, "Thread policy: memory locked");
+  return true;
+}
+
+bool ThreadPolicy::parse_cpus(const std::string &s, std::vector<int> &cpus) {
+  cpus.clear();
+  std::size_t begin = 0;
+  while (begin <= s.size()) {
+    std::size_t end = s.find(':', begin);
+    if (end == std::string::npos) {
+      end = s.size();
+    }
+    std::string item = s.substr(begin, end - begin);
+    std::size_t dash = item.find('-');
+    int first, last;
+    if (dash == std::string::npos) {
+      if (!Utility::parse_int(item.c_str(), first)) {
+        return false;
+      }
+      last = first;
+    } else if (!Utility::parse_int(item.substr(0, dash).c_str(), first) ||
+               !Utility::parse_int(item.substr(dash + 1).c_str(), last)) {
+      return false;
+    }
+    if (first < 0 || last < first || last >= max_cpus) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+    begin = end + 1;
+  }
+  return !cpus.empty();
+}
+
+// end
@@ -0,0 +1,434 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2019-2024 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fmt/format.h>
+#include <random>
+#include <volk/volk_prefs.h>
+
+#include "VolkSelfTest.h"
+
+// Read all lines of the file, without the trailing newlines.
+// Return an empty vector if the file can not be read.
+static std::vector<std::string> read_lines(const char *filename) {
+  std::vector<std::string> lines;
+  FILE *fp = fopen(filename, "r");
+  if (fp == nullptr) {
+    return lines;
+  }
+  char buf[1024];
+  std::string line;
+  while (fgets(buf, sizeof(buf), fp) != nullptr) {
+    line += buf;
+    if (!line.empty() && line.back() == '\n') {
+      line.pop_back();
+      lines.push_back(line);
+      line.clear();
+    }
+  }
+  if (!line.empty()) {
+    lines.push_back(line);
+  }
+  fclose(fp);
+  return lines;
+}
+
+// Construct self-test with the test signal buffers.
+// The buffers have an extra element to time the unaligned access.
+VolkSelfTest::VolkSelfTest()
+    : m_cin1(block_length + 1), m_cin2(block_length + 1),
+      m_cout(block_length + 1), m_fin1(block_length + 1),
+      m_fin2(block_length + 1), m_fout(block_length + 1),
+      m_din1(block_length + 1), m_din2(block_length + 1),
+      m_dout1(block_length + 1), m_dout2(block_length + 1),
+      m_fm_detect_save(0), m_rotator_phase(1, 0) {
+  // Random test signals in [-1, 1].
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  for (unsigned int i = 0; i <= block_length; i++) {
+    m_cin1[i] = lv_32fc_t(dist(gen), dist(gen));
+    m_cin2[i] = lv_32fc_t(dist(gen), dist(gen));
+    m_fin1[i] = dist(gen);
+    m_fin2[i] = dist(gen);
+    m_din1[i] = dist(gen);
+    m_din2[i] = dist(gen);
+  }
+
+  // The kernels used by the decoders, called as the decoders do.
+  const unsigned int n = block_length;
+  const unsigned int m = multipath_length;
+  m_kernels = {
+      {"volk_32fc_s32f_atan2_32f", n, volk_32fc_s32f_atan2_32f_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32fc_s32f_atan2_32f_manual(m_fout.data() + o, m_cin1.data() + o,
+                                         1.0f, n, impl);
+       }},
+      {"volk_32f_s32f_32f_fm_detect_32f", n,
+       volk_32f_s32f_32f_fm_detect_32f_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32f_s32f_32f_fm_detect_32f_manual(m_fout.data() + o,
+                                                m_fin1.data() + o, 1.0f,
+                                                &m_fm_detect_save, n, impl);
+       }},
+      {"volk_32fc_magnitude_32f", n, volk_32fc_magnitude_32f_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32fc_magnitude_32f_manual(m_fout.data() + o, m_cin1.data() + o,
+                                        n, impl);
+       }},
+      {"volk_32fc_magnitude_squared_32f", n,
+       volk_32fc_magnitude_squared_32f_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32fc_magnitude_squared_32f_manual(m_fout.data() + o,
+                                                m_cin1.data() + o, n, impl);
+       }},
+      {"volk_32f_accumulator_s32f", n, volk_32f_accumulator_s32f_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32f_accumulator_s32f_manual(m_fout.data(), m_fin1.data() + o, n,
+                                          impl);
+       }},
+      {"volk_32f_x2_dot_prod_32f", n, volk_32f_x2_dot_prod_32f_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32f_x2_dot_prod_32f_manual(m_fout.data(), m_fin1.data() + o,
+                                         m_fin2.data() + o, n, impl);
+       }},
+      {"volk_32fc_deinterleave_64f_x2", n,
+       volk_32fc_deinterleave_64f_x2_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32fc_deinterleave_64f_x2_manual(m_dout1.data() + o,
+                                              m_dout2.data() + o,
+                                              m_cin1.data() + o, n, impl);
+       }},
+      {"volk_32f_convert_64f", n, volk_32f_convert_64f_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32f_convert_64f_manual(m_dout1.data() + o, m_fin1.data() + o, n,
+                                     impl);
+       }},
+      {"volk_64f_convert_32f", n, volk_64f_convert_32f_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_64f_convert_32f_manual(m_fout.data() + o, m_din1.data() + o, n,
+                                     impl);
+       }},
+      {"volk_64f_x2_multiply_64f", n, volk_64f_x2_multiply_64f_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_64f_x2_multiply_64f_manual(m_dout1.data() + o, m_din1.data() + o,
+                                         m_din2.data() + o, n, impl);
+       }},
+#if VOLK_VERSION < 030100
+      {"volk_32fc_s32fc_x2_rotator_32fc", n,
+       volk_32fc_s32fc_x2_rotator_32fc_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32fc_s32fc_x2_rotator_32fc_manual(
+             m_cout.data() + o, m_cin1.data() + o, lv_32fc_t(0.6f, 0.8f),
+             &m_rotator_phase, n, impl);
+       }},
+#else
+      {"volk_32fc_s32fc_x2_rotator2_32fc", n,
+       volk_32fc_s32fc_x2_rotator2_32fc_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         const lv_32fc_t phase_inc(0.6f, 0.8f);
+         volk_32fc_s32fc_x2_rotator2_32fc_manual(
+             m_cout.data() + o, m_cin1.data() + o, &phase_inc,
+             &m_rotator_phase, n, impl);
+       }},
+#endif // VOLK_VERSION
+      {"volk_32fc_x2_dot_prod_32fc", m,
+       volk_32fc_x2_dot_prod_32fc_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32fc_x2_dot_prod_32fc_manual(m_cout.data(), m_cin1.data() + o,
+                                           m_cin2.data() + o, m, impl);
+       }},
+#if VOLK_VERSION < 030100
+      {"volk_32fc_x2_s32fc_multiply_conjugate_add_32fc", m,
+       volk_32fc_x2_s32fc_multiply_conjugate_add_32fc_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         volk_32fc_x2_s32fc_multiply_conjugate_add_32fc_manual(
+             m_cout.data() + o, m_cin1.data() + o, m_cin2.data() + o,
+             lv_32fc_t(1.0e-6f, 0), m, impl);
+       }},
+#else
+      {"volk_32fc_x2_s32fc_multiply_conjugate_add2_32fc", m,
+       volk_32fc_x2_s32fc_multiply_conjugate_add2_32fc_get_func_desc,
+       [=, this](const char *impl, unsigned int o) {
+         const lv_32fc_t scalar(1.0e-6f, 0);
+         volk_32fc_x2_s32fc_multiply_conjugate_add2_32fc_manual(
+             m_cout.data() + o, m_cin1.data() + o, m_cin2.data() + o, &scalar,
+             m, impl);
+       }},
+#endif // VOLK_VERSION
+  };
+}
+
+// Return seconds per call of the implementation.
+double VolkSelfTest::time_impl(const Kernel &kernel, const char *impl,
+                               unsigned int offset) {
+  using clock = std::chrono::steady_clock;
+  // Warm up the caches.
+  kernel.call(impl, offset);
+  double best = 0;
+  for (unsigned int round = 0; round < rounds; round++) {
+    clock::time_point start = clock::now();
+    unsigned int calls = 0;
+    double elapsed;
+    do {
+      kernel.call(impl, offset);
+      calls++;
+      elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < min_round_time);
+    double per_call = elapsed / calls;
+    if (round == 0 || per_call < best) {
+      best = per_call;
+    }
+  }
+  return best;
+}
+
+// Time all implementations of the kernels and print the results.
+void VolkSelfTest::run() {
+  fmt::println(stderr, "VOLK self-test: machine {}", volk_get_machine());
+  m_results.clear();
+  for (const auto &kernel : m_kernels) {
+    volk_func_desc_t desc = kernel.describe();
+    Result result{kernel.name, "", ""};
+    double best_a = 0;
+    double best_u = 0;
+    fmt::println(stderr, "{} ({} samples):", kernel.name, kernel.length);
+    for (std::size_t i = 0; i < desc.n_impls; i++) {
+      const char *impl = desc.impl_names[i];
+      // Aligned buffers: all implementations.
+      double time_a = time_impl(kernel, impl, 0);
+      if (result.impl_a.empty() || time_a < best_a) {
+        result.impl_a = impl;
+        best_a = time_a;
+      }
+      // Unaligned buffers: unaligned implementations only.
+      if (desc.impl_alignment[i]) {
+        fmt::println(stderr, "  {:<16} {:9.3f} [ns/sample]", impl,
+                     1.0e9 * time_a / kernel.length);
+        continue;
+      }
+      double time_u = time_impl(kernel, impl, 1);
+      if (result.impl_u.empty() || time_u < best_u) {
+        result.impl_u = impl;
+        best_u = time_u;
+      }
+      fmt::println(stderr,
+                   "  {:<16} {:9.3f} [ns/sample], unaligned {:9.3f} "
+                   "[ns/sample]",
+                   impl, 1.0e9 * time_a / kernel.length,
+                   1.0e9 * time_u / kernel.length);
+    }
+    if (result.impl_u.empty()) {
+      result.impl_u = "generic";
+    }
+    fmt::println(stderr, "  selected: {} (aligned), {} (unaligned)",
+                 result.impl_a, result.impl_u);
+    m_results.push_back(result);
+  }
+}
+
+// Return the configuration file name which VOLK resolves
+// with VOLK_CONFIGPATH set to the directory.
+// If read is true, return empty string unless the file exists.
+static std::string resolve_config_path(const std::string &dir, bool read) {
+  const char *saved = std::getenv("VOLK_CONFIGPATH");
+  std::string saved_value = saved ? saved : "";
+  setenv("VOLK_CONFIGPATH", dir.c_str(), 1);
+  char path[1024];
+  volk_get_config_path(path, read);
+  if (saved != nullptr) {
+    setenv("VOLK_CONFIGPATH", saved_value.c_str(), 1);
+  } else {
+    unsetenv("VOLK_CONFIGPATH");
+  }
+  return path;
+}
+
+// Write the selected implementations to the cache file.
+bool VolkSelfTest::write_cache() {
+  std::string filename = cache_file();
+  if (filename.empty()) {
+    m_error = "can not determine the cache directory (set HOME)";
+    return false;
+  }
+  std::string dir = std::filesystem::path(filename).parent_path();
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    m_error =
+        fmt::format("can not create directory '{}' ({})", dir, ec.message());
+    return false;
+  }
+
+  // Keep the current configuration of the other kernels.
+  char path[1024];
+  volk_get_config_path(path, true);
+  std::vector<std::string> kept_lines;
+  if (path[0] != '\0') {
+    for (const auto &line : read_lines(path)) {
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      std::string name = line.substr(0, line.find(' '));
+      bool tested = false;
+      for (const auto &result : m_results) {
+        tested = tested || (name == result.name);
+      }
+      if (!tested) {
+        kept_lines.push_back(line);
+      }
+    }
+  }
+
+  // Write to a temporary file and rename,
+  // since the current configuration may be the cache file itself.
+  std::string tmp_filename = filename + ".tmp";
+  FILE *fp = fopen(tmp_filename.c_str(), "w");
+  if (fp == nullptr) {
+    m_error = fmt::format("can not open '{}' ({})", tmp_filename,
+                          strerror(errno));
+    return false;
+  }
+  fmt::println(fp, "{}", cache_header());
+  if (path[0] != '\0') {
+    fmt::println(fp, "#other kernels from {}", path);
+  }
+  for (const auto &line : kept_lines) {
+    fmt::println(fp, "{}", line);
+  }
+  for (const auto &result : m_results) {
+    fmt::println(fp, "{} {} {}", result.name, result.impl_a, result.impl_u);
+  }
+  if (fclose(fp) != 0) {
+    m_error = fmt::format("can not write '{}' ({})", tmp_filename,
+                          strerror(errno));
+    return false;
+  }
+  std::filesystem::rename(tmp_filename, filename, ec);
+  if (ec) {
+    m_error =
+        fmt::format("can not rename to '{}' ({})", filename, ec.message());
+    return false;
+  }
+  fmt::println(stderr, "VOLK self-test result written to '{}'", filename);
+
+  // Check that VOLK loads the written file by use_cache().
+  std::string resolved = resolve_config_path(cache_config_dir(), true);
+  if (resolved != filename) {
+    m_error = fmt::format("VOLK reads '{}' instead of '{}'", resolved,
+                          filename);
+    return false;
+  }
+  return true;
+}
+
+// Use the cache if exists for the current VOLK version and machine.
+bool VolkSelfTest::use_cache() {
+  if (std::getenv("VOLK_CONFIGPATH") != nullptr) {
+    return false;
+  }
+  std::string filename = cache_file();
+  if (filename.empty()) {
+    return false;
+  }
+  std::vector<std::string> lines = read_lines(filename.c_str());
+  if (lines.empty() || lines[0] != cache_header()) {
+    return false;
+  }
+  if (setenv("VOLK_CONFIGPATH", cache_config_dir().c_str(), 0) != 0) {
+    return false;
+  }
+  // Do not leave VOLK_CONFIGPATH set unless VOLK loads the cache file.
+  char path[1024];
+  volk_get_config_path(path, true);
+  if (filename != path) {
+    unsetenv("VOLK_CONFIGPATH");
+    return false;
+  }
+  return true;
+}
+
+// Print the VOLK configuration file and the selected implementations.
+void VolkSelfTest::print_selection() {
+  char path[1024];
+  volk_get_config_path(path, true);
+  if (path[0] == '\0') {
+    fmt::println(stderr, "VOLK config: none, using VOLK default kernels "
+                         "(run --volk-selftest to select)");
+    return;
+  }
+  fmt::println(stderr, "VOLK config: {}", path);
+
+  volk_arch_pref_t *prefs = nullptr;
+  std::size_t n_prefs = volk_load_preferences(&prefs);
+  VolkSelfTest test;
+  for (const auto &kernel : test.m_kernels) {
+    const volk_arch_pref_t *found = nullptr;
+    for (std::size_t i = 0; i < n_prefs; i++) {
+      if (std::strcmp(prefs[i].name, kernel.name) == 0) {
+        found = &prefs[i];
+      }
+    }
+    if (found) {
+      fmt::println(stderr, "  {}: {} / {}", kernel.name, found->impl_a,
+                   found->impl_u);
+    } else {
+      fmt::println(stderr, "  {}: VOLK default", kernel.name);
+    }
+  }
+  std::free(prefs);
+}
+
+// Return the cache directory name.
+std::string VolkSelfTest::cache_dir() {
+  const char *xdg_cache_home = std::getenv("XDG_CACHE_HOME");
+  if (xdg_cache_home != nullptr && xdg_cache_home[0] != '\0') {
+    return std::string(xdg_cache_home) + "/airspy-fmradion";
+  }
+  const char *home = std::getenv("HOME");
+  if (home != nullptr && home[0] != '\0') {
+    return std::string(home) + "/.cache/airspy-fmradion";
+  }
+  return "";
+}
+
+// Return the directory set to VOLK_CONFIGPATH for the cache.
+std::string VolkSelfTest::cache_config_dir() {
+  std::string dir = cache_dir();
+  return dir.empty() ? dir : dir + "/volk";
+}
+
+// Return the cache file name as resolved by VOLK.
+std::string VolkSelfTest::cache_file() {
+  std::string dir = cache_config_dir();
+  return dir.empty() ? dir : resolve_config_path(dir, false);
+}
+
+// Return the first line of the cache file.
+std::string VolkSelfTest::cache_header() {
+  return fmt::format("#airspy-fmradion --volk-selftest: VOLK {}.{}.{}, "
+                     "machine {}",
+                     VOLK_VERSION_MAJOR, VOLK_VERSION_MINOR,
+                     VOLK_VERSION_MAINT, volk_get_machine());
+}
+
+// end